@@ -0,0 +1,161 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "AlignedBufferPool.h"
+
+#include <stdlib.h>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "common/ceph_context.h"
+#include "include/buffer_raw.h"
+#include "include/page.h"
+
+struct AlignedBufferPool::Impl {
+  static constexpr unsigned shard_bits = 3;
+  static constexpr unsigned num_shards = 1 << shard_bits;
+
+  struct Shard {
+    std::mutex lock;
+    std::map<unsigned, std::vector<char*>> idle;  ///< length -> buffers
+  };
+
+  const uint64_t max_bytes;         ///< idle bytes allowed in the pool
+  const unsigned max_buffer_size;   ///< larger buffers are not recycled
+  std::atomic<uint64_t> idle_bytes = {0};
+  Shard shards[num_shards];
+
+  Impl(uint64_t max_bytes, unsigned max_buffer)
+    : max_bytes(max_bytes),
+      max_buffer_size(max_buffer) {}
+
+  ~Impl() {
+    for (auto& s : shards) {
+      for (auto& p : s.idle) {
+	for (auto d : p.second) {
+	  _account(-1, -(int64_t)p.first);
+	  ::free(d);
+	}
+      }
+    }
+  }
+
+  static void _account(int64_t items, int64_t bytes) {
+    mempool::get_pool(mempool::mempool_buffer_pool).adjust_count(items, bytes);
+  }
+
+  bool is_poolable(unsigned len) const {
+    return len && len <= max_buffer_size && max_bytes >= len;
+  }
+
+  Shard& get_shard(unsigned len) {
+    // buffers are mostly freed on another thread than the one that asked
+    // for them (a reader's data is released by the messenger worker that
+    // sent it), so shard on the length: get and put of a given length
+    // always meet, and different lengths spread over the locks.  lengths
+    // are mostly page multiples, hence the multiplicative hash.
+    uint32_t pages = len >> CEPH_PAGE_SHIFT;
+    return shards[(pages * 2654435761u) >> (32 - shard_bits)];
+  }
+
+  char *get(unsigned len) {
+    Shard& s = get_shard(len);
+    std::lock_guard<std::mutex> l(s.lock);
+    auto p = s.idle.find(len);
+    if (p == s.idle.end()) {
+      return nullptr;
+    }
+    char *d = p->second.back();
+    p->second.pop_back();
+    if (p->second.empty()) {
+      s.idle.erase(p);
+    }
+    idle_bytes -= len;
+    _account(-1, -(int64_t)len);
+    return d;
+  }
+
+  void put(char *d, unsigned len) {
+    if (idle_bytes.fetch_add(len) + len > max_bytes) {
+      idle_bytes -= len;
+      ::free(d);
+      return;
+    }
+    Shard& s = get_shard(len);
+    std::lock_guard<std::mutex> l(s.lock);
+    s.idle[len].push_back(d);
+    _account(1, len);
+  }
+};
+
+namespace {
+  class raw_pooled : public ceph::buffer::raw {
+    std::shared_ptr<AlignedBufferPool::Impl> pool;
+  public:
+    MEMPOOL_CLASS_HELPERS();
+
+    raw_pooled(char *d, unsigned l,
+	       std::shared_ptr<AlignedBufferPool::Impl> p)
+      : raw(d, l, mempool::mempool_buffer_pool),
+	pool(std::move(p)) {}
+    ~raw_pooled() override {
+      pool->put(data, len);
+    }
+    raw* clone_empty() override {
+      return ceph::buffer::create_page_aligned(len);
+    }
+  };
+}
+
+MEMPOOL_DEFINE_OBJECT_FACTORY(raw_pooled, buffer_raw_pooled, buffer_meta);
+
+AlignedBufferPool::AlignedBufferPool(CephContext *cct)
+  : impl(std::make_shared<Impl>(
+	   cct->_conf.get_val<uint64_t>("aligned_buffer_pool_max_bytes"),
+	   cct->_conf.get_val<uint64_t>("aligned_buffer_pool_max_buffer_size")))
+{
+}
+
+AlignedBufferPool::~AlignedBufferPool()
+{
+}
+
+AlignedBufferPool& AlignedBufferPool::get(CephContext *cct)
+{
+  return cct->lookup_or_create_singleton_object<AlignedBufferPool>(
+    "AlignedBufferPool", false, cct);
+}
+
+ceph::bufferptr AlignedBufferPool::create(unsigned len)
+{
+  if (!impl->is_poolable(len)) {
+    return ceph::bufferptr(ceph::buffer::create_page_aligned(len));
+  }
+  char *d = impl->get(len);
+  if (!d) {
+    void *p;
+    int r = ::posix_memalign(&p, CEPH_PAGE_SIZE, len);
+    if (r) {
+      throw ceph::buffer::bad_alloc();
+    }
+    d = static_cast<char*>(p);
+  }
+  return ceph::bufferptr(new raw_pooled(d, len, impl));
+}
+
+uint64_t AlignedBufferPool::get_idle_bytes() const
+{
+  return impl->idle_bytes;
+}
@@ -0,0 +1,57 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_COMMON_ALIGNEDBUFFERPOOL_H
+#define CEPH_COMMON_ALIGNEDBUFFERPOOL_H
+
+#include <memory>
+
+#include "include/buffer.h"
+
+class CephContext;
+
+/**
+ * AlignedBufferPool
+ *
+ * Recycles page aligned buffers.  O_DIRECT device reads and messenger
+ * receives take their buffers from here; the data then travels up the
+ * stack by reference (checksum, cache, reply, socket) and the memory goes
+ * back to the pool once the last bufferptr is dropped, typically right
+ * after the message carrying it has been sent.
+ *
+ * Idle buffers are kept per exact length, so a recycled buffer never
+ * carries slop that would make a consumer rebuild (copy) it.  All memory
+ * owned by the pool, handed out or idle, is accounted to the buffer_pool
+ * mempool.
+ */
+class AlignedBufferPool {
+public:
+  struct Impl;
+
+  explicit AlignedBufferPool(CephContext *cct);
+  ~AlignedBufferPool();
+
+  /// the pool shared by everything running under cct
+  static AlignedBufferPool& get(CephContext *cct);
+
+  /// a page aligned buffer of exactly len bytes
+  ceph::bufferptr create(unsigned len);
+
+  /// bytes currently held idle by the pool
+  uint64_t get_idle_bytes() const;
+
+private:
+  // shared with every buffer handed out, which may outlive the pool
+  std::shared_ptr<Impl> impl;
+};
+
+#endif
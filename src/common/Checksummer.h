@@ -4,10 +4,15 @@
 #ifndef CEPH_OS_BLUESTORE_CHECKSUMMER
 #define CEPH_OS_BLUESTORE_CHECKSUMMER
 
+#include <algorithm>
+
 #include "xxHash/xxhash.h"
 
 class Checksummer {
 public:
+  /// chunks handed to an Alg::calc_multi() call at once
+  static constexpr size_t batch_width = 8;
+
   enum CSumType {
     CSUM_NONE = 1,	//intentionally set to 1 to be aligned with OSDMnitor's pool_opts_t handling - it treats 0 as unset while we need to distinguish none and unset cases
     CSUM_XXHASH32 = 2,
@@ -86,6 +91,22 @@ public:
       ) {
       return p.crc32c(len, init_value);
     }
+    static void calc_multi(
+      init_value_t init_value,
+      size_t len,
+      const char * const *data,
+      value_t *values,
+      size_t n
+      ) {
+      uint32_t crcs[batch_width];
+      std::fill_n(crcs, n, init_value);
+      ceph_crc32c_multi(n, crcs,
+			reinterpret_cast<unsigned char const * const *>(data),
+			len);
+      for (size_t i = 0; i < n; ++i) {
+	values[i] = crcs[i];
+      }
+    }
   };
 
   struct crc32c_16 {
@@ -107,6 +128,22 @@ public:
       ) {
       return p.crc32c(len, init_value) & 0xffff;
     }
+    static void calc_multi(
+      init_value_t init_value,
+      size_t len,
+      const char * const *data,
+      value_t *values,
+      size_t n
+      ) {
+      uint32_t crcs[batch_width];
+      std::fill_n(crcs, n, init_value);
+      ceph_crc32c_multi(n, crcs,
+			reinterpret_cast<unsigned char const * const *>(data),
+			len);
+      for (size_t i = 0; i < n; ++i) {
+	values[i] = crcs[i] & 0xffff;
+      }
+    }
   };
 
   struct crc32c_8 {
@@ -128,6 +165,22 @@ public:
       ) {
       return p.crc32c(len, init_value) & 0xff;
     }
+    static void calc_multi(
+      init_value_t init_value,
+      size_t len,
+      const char * const *data,
+      value_t *values,
+      size_t n
+      ) {
+      uint32_t crcs[batch_width];
+      std::fill_n(crcs, n, init_value);
+      ceph_crc32c_multi(n, crcs,
+			reinterpret_cast<unsigned char const * const *>(data),
+			len);
+      for (size_t i = 0; i < n; ++i) {
+	values[i] = crcs[i] & 0xff;
+      }
+    }
   };
 
   struct xxhash32 {
@@ -157,6 +210,18 @@ public:
       }
       return XXH32_digest(state);
     }
+    static void calc_multi(
+      init_value_t init_value,
+      size_t len,
+      const char * const *data,
+      value_t *values,
+      size_t n
+      ) {
+      // one-shot hashing of contiguous chunks needs no state allocation
+      for (size_t i = 0; i < n; ++i) {
+	values[i] = XXH32(data[i], len, init_value);
+      }
+    }
   };
 
   struct xxhash64 {
@@ -186,6 +251,18 @@ public:
       }
       return XXH64_digest(state);
     }
+    static void calc_multi(
+      init_value_t init_value,
+      size_t len,
+      const char * const *data,
+      value_t *values,
+      size_t n
+      ) {
+      // one-shot hashing of contiguous chunks needs no state allocation
+      for (size_t i = 0; i < n; ++i) {
+	values[i] = XXH64(data[i], len, init_value);
+      }
+    }
   };
 
   template<class Alg>
@@ -265,6 +342,105 @@ public:
     Alg::fini(&state);
     return -1;  // no errors
   }
+
+  /// a verify() call that is part of a verify_batch()
+  struct verify_item_t {
+    size_t csum_block_size = 0;
+    size_t offset = 0;                    ///< of bl in the checksummed data
+    const bufferlist *bl = nullptr;       ///< a whole number of csum blocks
+    const bufferptr *csum_data = nullptr;
+    int bad = -1;             ///< [out] offset of the first bad block, or -1
+    uint64_t bad_csum = 0;    ///< [out] checksum computed for that block
+  };
+
+  /**
+   * verify many buffers in one pass
+   *
+   * Blocks from all items are queued and checksummed batch_width at a
+   * time with Alg::calc_multi(), which lets the implementation keep several
+   * independent computations in flight.  Blocks that straddle two buffers
+   * of a bufferlist are checksummed on their own.
+   *
+   * @returns the number of items with a bad block
+   */
+  template<class Alg>
+  static int verify_batch(verify_item_t *items, size_t n) {
+    struct lane_t {
+      verify_item_t *item;
+      size_t pos;
+      const typename Alg::value_t *expected;
+    };
+    const char *data[batch_width];
+    lane_t lanes[batch_width];
+    typename Alg::value_t values[batch_width];
+    size_t num_lanes = 0;
+    size_t lane_len = 0;
+
+    auto check = [](verify_item_t *item, size_t pos,
+		    typename Alg::value_t expected,
+		    typename Alg::value_t v) {
+      if (expected != v && (item->bad < 0 || (size_t)item->bad > pos)) {
+	item->bad = pos;
+	item->bad_csum = v;
+      }
+    };
+    auto flush = [&]() {
+      if (num_lanes) {
+	Alg::calc_multi(-1, lane_len, data, values, num_lanes);
+	for (size_t i = 0; i < num_lanes; ++i) {
+	  check(lanes[i].item, lanes[i].pos, *lanes[i].expected, values[i]);
+	}
+	num_lanes = 0;
+      }
+    };
+
+    typename Alg::state_t state;
+    Alg::init(&state);
+    for (size_t i = 0; i < n; ++i) {
+      verify_item_t& item = items[i];
+      const size_t block_size = item.csum_block_size;
+      size_t length = item.bl->length();
+      assert(length % block_size == 0);
+      item.bad = -1;
+
+      if (block_size != lane_len) {
+	flush();
+	lane_len = block_size;
+      }
+      const typename Alg::value_t *pv =
+	reinterpret_cast<const typename Alg::value_t*>(item.csum_data->c_str());
+      pv += item.offset / block_size;
+      size_t pos = item.offset;
+      bufferlist::const_iterator p = item.bl->begin();
+      while (length > 0) {
+	auto start = p;
+	const char *d;
+	if (p.get_ptr_and_advance(block_size, &d) == block_size) {
+	  data[num_lanes] = d;
+	  lanes[num_lanes] = lane_t{&item, pos, pv};
+	  if (++num_lanes == batch_width) {
+	    flush();
+	  }
+	} else {
+	  p = start;
+	  check(&item, pos, *pv, Alg::calc(state, -1, block_size, p));
+	}
+	++pv;
+	pos += block_size;
+	length -= block_size;
+      }
+    }
+    flush();
+    Alg::fini(&state);
+
+    int bad = 0;
+    for (size_t i = 0; i < n; ++i) {
+      if (items[i].bad >= 0) {
+	++bad;
+      }
+    }
+    return bad;
+  }
 };
 
 #endif
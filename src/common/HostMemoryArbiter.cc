@@ -0,0 +1,380 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "HostMemoryArbiter.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "common/admin_socket.h"
+#include "common/ceph_context.h"
+#include "common/ceph_time.h"
+#include "common/debug.h"
+#include "common/errno.h"
+#include "common/Formatter.h"
+
+#define dout_context cct
+#define dout_subsys ceph_subsys_osd
+#undef dout_prefix
+#define dout_prefix *_dout << "host_memory_arbiter "
+
+static constexpr uint32_t SEGMENT_MAGIC = 0x63656d61;  // "cema"
+static constexpr uint32_t SEGMENT_VERSION = 1;
+static constexpr unsigned MAX_MEMBERS = 64;
+/// members that did not update for this long are considered gone
+static constexpr uint64_t STALE_NS = 30ull * 1000000000ull;
+
+struct HostMemoryArbiter::slot_t {
+  char name[64];          ///< empty if the slot is free
+  uint64_t stamp;         ///< monotonic ns of the last update
+  uint64_t target;
+  uint64_t min;
+  uint64_t demand;
+  uint64_t granted;
+};
+
+struct HostMemoryArbiter::segment_t {
+  uint32_t magic;
+  uint32_t version;
+  slot_t slots[MAX_MEMBERS];
+};
+
+// CLOCK_MONOTONIC is shared by every process on the host and, unlike
+// the wall clock, is not stepped by NTP or by hand
+static uint64_t now_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    ceph::mono_clock::now().time_since_epoch()).count();
+}
+
+class HostMemoryArbiter::SocketHook : public AdminSocketHook {
+  HostMemoryArbiter *arbiter;
+  AdminSocket *admin_socket;
+  std::string command;
+
+public:
+  SocketHook(CephContext *cct, HostMemoryArbiter *a)
+    : arbiter(a),
+      admin_socket(cct->get_admin_socket())
+  {
+    if (!admin_socket) {
+      return;
+    }
+    std::string c = "dump_host_memory_arbiter";
+    int r = admin_socket->register_command(
+      c, c, this, "show the memory budget granted to each daemon of the host");
+    if (r == 0) {
+      command = c;
+    } else {
+      ldout(cct, 1) << __func__ << " cannot register '" << c
+		    << "': " << cpp_strerror(r) << dendl;
+    }
+  }
+
+  ~SocketHook() override {
+    if (!command.empty()) {
+      (void)admin_socket->unregister_command(command);
+    }
+  }
+
+  bool call(std::string_view c, const cmdmap_t& cmdmap,
+	    std::string_view format, bufferlist& out) override {
+    if (c != command) {
+      return false;
+    }
+    Formatter *f = Formatter::create(format, "json-pretty", "json-pretty");
+    arbiter->dump(f);
+    f->flush(out);
+    delete f;
+    return true;
+  }
+};
+
+HostMemoryArbiter::HostMemoryArbiter(CephContext *cct,
+				     const std::string& path,
+				     const std::string& name)
+  : cct(cct),
+    path(path),
+    name(name.substr(0, sizeof(slot_t::name) - 1))
+{
+}
+
+HostMemoryArbiter::~HostMemoryArbiter()
+{
+  close();
+}
+
+int HostMemoryArbiter::_lock_segment() const
+{
+  int r;
+  do {
+    r = ::flock(fd, LOCK_EX);
+  } while (r < 0 && errno == EINTR);
+  return r < 0 ? -errno : 0;
+}
+
+void HostMemoryArbiter::_unlock_segment() const
+{
+  ::flock(fd, LOCK_UN);
+}
+
+bool HostMemoryArbiter::_slot_is_live(const slot_t& s, uint64_t now) const
+{
+  return s.name[0] && s.stamp + STALE_NS > now;
+}
+
+int HostMemoryArbiter::_claim_slot(uint64_t now)
+{
+  // our own slot if we restarted quickly, else the first unused one
+  int free_slot = -1;
+  for (unsigned i = 0; i < MAX_MEMBERS; ++i) {
+    slot_t& s = seg->slots[i];
+    if (s.name[0] && strncmp(s.name, name.c_str(), sizeof(s.name)) == 0) {
+      return i;
+    }
+    if (free_slot < 0 && !_slot_is_live(s, now)) {
+      free_slot = i;
+    }
+  }
+  if (free_slot >= 0) {
+    slot_t& s = seg->slots[free_slot];
+    memset(&s, 0, sizeof(s));
+    strncpy(s.name, name.c_str(), sizeof(s.name) - 1);
+    s.stamp = now;
+  }
+  return free_slot;
+}
+
+int HostMemoryArbiter::open()
+{
+  std::lock_guard<std::mutex> l(lock);
+  assert(fd < 0);
+  fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    int r = -errno;
+    lderr(cct) << __func__ << " cannot open " << path << ": "
+	       << cpp_strerror(r) << dendl;
+    return r;
+  }
+  int r = _lock_segment();
+  if (r < 0) {
+    goto out_close;
+  }
+  struct stat st;
+  if (::fstat(fd, &st) < 0) {
+    r = -errno;
+    goto out_unlock;
+  }
+  if ((size_t)st.st_size < sizeof(segment_t) &&
+      ::ftruncate(fd, sizeof(segment_t)) < 0) {
+    r = -errno;
+    goto out_unlock;
+  }
+  {
+    void *p = ::mmap(nullptr, sizeof(segment_t), PROT_READ | PROT_WRITE,
+		     MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+      r = -errno;
+      goto out_unlock;
+    }
+    seg = static_cast<segment_t*>(p);
+  }
+  if (seg->magic != SEGMENT_MAGIC || seg->version != SEGMENT_VERSION) {
+    memset(seg, 0, sizeof(*seg));
+    seg->magic = SEGMENT_MAGIC;
+    seg->version = SEGMENT_VERSION;
+  }
+  slot = _claim_slot(now_ns());
+  if (slot < 0) {
+    r = -ENOSPC;
+    goto out_unmap;
+  }
+  _unlock_segment();
+  ldout(cct, 1) << __func__ << " joined " << path << " in slot " << slot
+		<< dendl;
+  asok_hook = new SocketHook(cct, this);
+  return 0;
+
+ out_unmap:
+  ::munmap(seg, sizeof(segment_t));
+  seg = nullptr;
+ out_unlock:
+  _unlock_segment();
+ out_close:
+  lderr(cct) << __func__ << " cannot join " << path << ": "
+	     << cpp_strerror(r) << dendl;
+  VOID_TEMP_FAILURE_RETRY(::close(fd));
+  fd = -1;
+  return r;
+}
+
+void HostMemoryArbiter::close()
+{
+  // unregister outside our lock; a running dump takes it
+  delete asok_hook;
+  asok_hook = nullptr;
+
+  std::lock_guard<std::mutex> l(lock);
+  if (fd < 0) {
+    return;
+  }
+  if (_lock_segment() == 0) {
+    slot_t& s = seg->slots[slot];
+    if (strncmp(s.name, name.c_str(), sizeof(s.name)) == 0) {
+      memset(&s, 0, sizeof(s));
+    }
+    _unlock_segment();
+  }
+  ::munmap(seg, sizeof(segment_t));
+  seg = nullptr;
+  VOID_TEMP_FAILURE_RETRY(::close(fd));
+  fd = -1;
+  slot = -1;
+  granted = 0;
+}
+
+void HostMemoryArbiter::compute_grants(uint64_t host_target, double min_ratio,
+				       std::vector<member_t> *members)
+{
+  uint64_t total_target = 0, total_demand = 0;
+  for (auto& m : *members) {
+    total_target += m.target;
+    total_demand += m.demand;
+  }
+  if (total_target == 0) {
+    return;
+  }
+  if (host_target == 0) {
+    host_target = total_target;
+  }
+  min_ratio = std::min(std::max(min_ratio, 0.0), 1.0);
+
+  // everyone keeps a floor; demand decides over the rest
+  double scale = (double)host_target / (double)total_target;
+  std::vector<double> fair, floor;
+  double total_floor = 0;
+  for (auto& m : *members) {
+    fair.push_back(m.target * scale);
+    floor.push_back(std::max(min_ratio * fair.back(), (double)m.min));
+    total_floor += floor.back();
+  }
+  double pool = std::max((double)host_target - total_floor, 0.0);
+  for (size_t i = 0; i < members->size(); ++i) {
+    member_t& m = (*members)[i];
+    double share = total_demand ?
+      (double)m.demand / (double)total_demand :
+      fair[i] / (double)host_target;
+    uint64_t want = floor[i] + pool * share;
+    m.granted = m.granted ? (m.granted + want) / 2 : want;
+  }
+}
+
+uint64_t HostMemoryArbiter::update(uint64_t target, uint64_t min,
+				   uint64_t demand)
+{
+  std::lock_guard<std::mutex> l(lock);
+  if (fd < 0) {
+    return target;
+  }
+  uint64_t host_target = cct->_conf.get_val<uint64_t>("osd_memory_host_target");
+  double min_ratio = cct->_conf.get_val<double>("osd_memory_host_min_ratio");
+
+  if (_lock_segment() < 0) {
+    return granted ? granted : target;
+  }
+  uint64_t now = now_ns();
+  if (strncmp(seg->slots[slot].name, name.c_str(), sizeof(slot_t::name))) {
+    // someone took our slot while we were not updating; find another
+    int s = _claim_slot(now);
+    if (s < 0) {
+      _unlock_segment();
+      ldout(cct, 1) << __func__ << " no free slot, using our own target"
+		    << dendl;
+      return target;
+    }
+    slot = s;
+  }
+  slot_t& mine = seg->slots[slot];
+  mine.stamp = now;
+  mine.target = target;
+  mine.min = min;
+  mine.demand = demand;
+
+  std::vector<member_t> members;
+  std::vector<unsigned> index;
+  for (unsigned i = 0; i < MAX_MEMBERS; ++i) {
+    const slot_t& s = seg->slots[i];
+    if (!_slot_is_live(s, now)) {
+      continue;
+    }
+    member_t m;
+    m.target = s.target;
+    m.min = s.min;
+    m.demand = s.demand;
+    m.granted = s.granted;
+    members.push_back(m);
+    index.push_back(i);
+  }
+  compute_grants(host_target, min_ratio, &members);
+  for (size_t i = 0; i < members.size(); ++i) {
+    seg->slots[index[i]].granted = members[i].granted;
+  }
+  granted = mine.granted;
+  _unlock_segment();
+
+  ldout(cct, 20) << __func__ << " target " << target << " min " << min
+		 << " demand " << demand << " members " << members.size()
+		 << " granted " << granted << dendl;
+  return granted;
+}
+
+uint64_t HostMemoryArbiter::get_granted() const
+{
+  std::lock_guard<std::mutex> l(lock);
+  return granted;
+}
+
+void HostMemoryArbiter::dump(Formatter *f) const
+{
+  std::lock_guard<std::mutex> l(lock);
+  f->open_object_section("host_memory_arbiter");
+  f->dump_string("path", path);
+  f->dump_string("name", name);
+  f->dump_unsigned("granted", granted);
+  f->open_array_section("members");
+  if (fd >= 0 && _lock_segment() == 0) {
+    uint64_t now = now_ns();
+    for (unsigned i = 0; i < MAX_MEMBERS; ++i) {
+      const slot_t& s = seg->slots[i];
+      if (!_slot_is_live(s, now)) {
+	continue;
+      }
+      f->open_object_section("member");
+      f->dump_string("name", std::string(s.name, strnlen(s.name, sizeof(s.name))));
+      f->dump_unsigned("target", s.target);
+      f->dump_unsigned("min", s.min);
+      f->dump_unsigned("demand", s.demand);
+      f->dump_unsigned("granted", s.granted);
+      f->dump_float("age", (double)(now - s.stamp) / 1000000000.0);
+      f->close_section();
+    }
+    _unlock_segment();
+  }
+  f->close_section();
+  f->close_section();
+}
@@ -0,0 +1,104 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_COMMON_HOSTMEMORYARBITER_H
+#define CEPH_COMMON_HOSTMEMORYARBITER_H
+
+#include <stdint.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+class CephContext;
+namespace ceph {
+  class Formatter;
+}
+
+/**
+ * HostMemoryArbiter
+ *
+ * Splits one memory budget between the daemons of a host.  Every member
+ * maps the same small file (normally in /dev/shm) holding one slot per
+ * daemon, and on each of its cache resize passes publishes its own memory
+ * target and demand (cache miss bytes since the previous pass), then
+ * recomputes the grants of all live members under an flock.
+ *
+ * Each member keeps min_ratio of its fair share, its own target scaled to
+ * the host target; the rest of the host budget follows demand.  Grants are
+ * blended with the previous ones so the split moves gradually; their sum
+ * converges on the host target over successive rebalances rather than
+ * matching it after any single pass (members joining or leaving, or floors
+ * above the budget, can leave it off for a while).  Slots of daemons that
+ * went away are reused.
+ */
+class HostMemoryArbiter {
+public:
+  struct member_t {
+    std::string name;
+    uint64_t target = 0;    ///< what the member would use on its own
+    uint64_t min = 0;       ///< never grant less than this
+    uint64_t demand = 0;    ///< cache miss bytes in the last interval
+    uint64_t granted = 0;   ///< budget assigned by the last pass
+  };
+
+  HostMemoryArbiter(CephContext *cct, const std::string& path,
+		    const std::string& name);
+  ~HostMemoryArbiter();
+
+  /// map the shared segment and claim a slot
+  int open();
+  /// give the slot back; the others pick up its budget on their next pass
+  void close();
+
+  /**
+   * publish our target and demand and rebalance the host
+   *
+   * @param target our own memory target
+   * @param min the least we can run with
+   * @param demand cache miss bytes since the previous call
+   * @returns the memory target we were granted, target if not open
+   */
+  uint64_t update(uint64_t target, uint64_t min, uint64_t demand);
+
+  /// budget granted by the last update(), 0 before the first one
+  uint64_t get_granted() const;
+
+  void dump(ceph::Formatter *f) const;
+
+  /// split host_target between the members (0 for the sum of their targets)
+  static void compute_grants(uint64_t host_target, double min_ratio,
+			     std::vector<member_t> *members);
+
+private:
+  struct slot_t;
+  struct segment_t;
+  class SocketHook;
+
+  CephContext *cct;
+  const std::string path;
+  const std::string name;
+
+  mutable std::mutex lock;
+  int fd = -1;
+  segment_t *seg = nullptr;
+  int slot = -1;
+  uint64_t granted = 0;
+  SocketHook *asok_hook = nullptr;
+
+  int _lock_segment() const;
+  void _unlock_segment() const;
+  bool _slot_is_live(const slot_t& s, uint64_t now) const;
+  int _claim_slot(uint64_t now);
+};
+
+#endif
@@ -0,0 +1,101 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_COMMON_MPSCQUEUE_H
+#define CEPH_COMMON_MPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+/**
+ * MPSCQueue
+ *
+ * Lock-free queue for many producers and a consumer that takes everything
+ * at once.  push() links a node onto an atomic list head with a single
+ * compare-and-swap; consume() detaches the whole list with one exchange
+ * and hands the items over oldest first.  Nodes are never unlinked one
+ * by one, so there is no ABA problem and consume() may even run in
+ * several threads, each getting a disjoint batch.
+ *
+ * The head is updated with sequentially consistent operations, so a
+ * consumer that announces it is going to sleep and then finds empty()
+ * cannot miss a producer that pushes and then looks for sleepers.
+ */
+template <typename T>
+class MPSCQueue {
+  struct node {
+    node *next;
+    T value;
+    template <typename... Args>
+    explicit node(Args&&... args)
+      : next(nullptr), value(std::forward<Args>(args)...) {}
+  };
+
+  std::atomic<node*> head = { nullptr };
+
+  static node *reverse(node *n) {
+    node *r = nullptr;
+    while (n) {
+      node *next = n->next;
+      n->next = r;
+      r = n;
+      n = next;
+    }
+    return r;
+  }
+
+public:
+  MPSCQueue() = default;
+  MPSCQueue(const MPSCQueue&) = delete;
+  MPSCQueue& operator=(const MPSCQueue&) = delete;
+  ~MPSCQueue() {
+    consume([](T&&) {});
+  }
+
+  /// queue an item; returns true if the queue was empty
+  template <typename... Args>
+  bool push(Args&&... args) {
+    node *n = new node(std::forward<Args>(args)...);
+    node *h = head.load(std::memory_order_relaxed);
+    do {
+      n->next = h;
+    } while (!head.compare_exchange_weak(h, n));
+    return h == nullptr;
+  }
+
+  bool empty() const {
+    return head.load() == nullptr;
+  }
+
+  /**
+   * take every queued item, oldest first
+   *
+   * @param f called with each item
+   * @returns the number of items taken
+   */
+  template <typename F>
+  size_t consume(F&& f) {
+    node *n = reverse(head.exchange(nullptr));
+    size_t count = 0;
+    while (n) {
+      node *next = n->next;
+      f(std::move(n->value));
+      delete n;
+      n = next;
+      ++count;
+    }
+    return count;
+  }
+};
+
+#endif
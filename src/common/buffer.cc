@@ -1252,6 +1252,59 @@ using namespace ceph;
     }
   }
 
+  /*
+   * crc32c of a whole ptr, from or into the crc cache of its raw
+   */
+  static uint32_t _cached_ptr_crc32c(const buffer::ptr& bp, uint32_t crc,
+				     int *hits, int *adjusts, int *misses)
+  {
+    buffer::raw *r = bp.get_raw();
+    pair<size_t, size_t> ofs(bp.offset(), bp.offset() + bp.length());
+    pair<uint32_t, uint32_t> ccrc;
+    if (r->get_crc(ofs, &ccrc)) {
+      if (ccrc.first == crc) {
+	// got it already
+	(*hits)++;
+	return ccrc.second;
+      }
+      /* If we have cached crc32c(buf, v) for initial value v,
+       * we can convert this to a different initial value v' by:
+       * crc32c(buf, v') = crc32c(buf, v) ^ adjustment
+       * where adjustment = crc32c(0*len(buf), v ^ v')
+       *
+       * http://crcutil.googlecode.com/files/crc-doc.1.0.pdf
+       * note, u for our crc32c implementation is 0
+       */
+      (*adjusts)++;
+      return ccrc.second ^ ceph_crc32c(ccrc.first ^ crc, NULL, bp.length());
+    }
+    (*misses)++;
+    uint32_t base = crc;
+    crc = ceph_crc32c(crc, (unsigned char*)bp.c_str(), bp.length());
+    r->set_crc(ofs, make_pair(base, crc));
+    return crc;
+  }
+
+  static void _track_crc(int hits, int adjusts, int misses)
+  {
+    if (buffer_track_crc) {
+      if (adjusts)
+	buffer_cached_crc_adjusted += adjusts;
+      if (hits)
+	buffer_cached_crc += hits;
+      if (misses)
+	buffer_missed_crc += misses;
+    }
+  }
+
+  static uint32_t cached_ptr_crc32c(const buffer::ptr& bp, uint32_t crc)
+  {
+    int hits = 0, adjusts = 0, misses = 0;
+    crc = _cached_ptr_crc32c(bp, crc, &hits, &adjusts, &misses);
+    _track_crc(hits, adjusts, misses);
+    return crc;
+  }
+
   template<bool is_const>
   size_t buffer::list::iterator_impl<is_const>::get_ptr_and_advance(
     size_t want, const char **data)
@@ -1279,6 +1332,17 @@ using namespace ceph;
   {
     length = std::min<size_t>(length, get_remaining());
     while (length > 0) {
+      if (p != ls->end() && p_off == 0 && p->length() &&
+	  p->length() <= length) {
+	// a whole ptr: its crc may be cached already, e.g. by the messenger
+	// that received it
+	size_t l = p->length();
+	crc = cached_ptr_crc32c(*p, crc);
+	++p;
+	off += l;
+	length -= l;
+	continue;
+      }
       const char *p;
       size_t l = get_ptr_and_advance(length, &p);
       crc = ceph_crc32c(crc, (unsigned char*)p, l);
@@ -2412,44 +2476,12 @@ __u32 buffer::list::crc32c(__u32 crc) const
        it != _buffers.end();
        ++it) {
     if (it->length()) {
-      raw *r = it->get_raw();
-      pair<size_t, size_t> ofs(it->offset(), it->offset() + it->length());
-      pair<uint32_t, uint32_t> ccrc;
-      if (r->get_crc(ofs, &ccrc)) {
-	if (ccrc.first == crc) {
-	  // got it already
-	  crc = ccrc.second;
-	  cache_hits++;
-	} else {
-	  /* If we have cached crc32c(buf, v) for initial value v,
-	   * we can convert this to a different initial value v' by:
-	   * crc32c(buf, v') = crc32c(buf, v) ^ adjustment
-	   * where adjustment = crc32c(0*len(buf), v ^ v')
-	   *
-	   * http://crcutil.googlecode.com/files/crc-doc.1.0.pdf
-	   * note, u for our crc32c implementation is 0
-	   */
-	  crc = ccrc.second ^ ceph_crc32c(ccrc.first ^ crc, NULL, it->length());
-	  cache_adjusts++;
-	}
-      } else {
-	cache_misses++;
-	uint32_t base = crc;
-	crc = ceph_crc32c(crc, (unsigned char*)it->c_str(), it->length());
-	r->set_crc(ofs, make_pair(base, crc));
-      }
+      crc = _cached_ptr_crc32c(*it, crc, &cache_hits, &cache_adjusts,
+			       &cache_misses);
     }
   }
 
-  if (buffer_track_crc) {
-    if (cache_adjusts)
-      buffer_cached_crc_adjusted += cache_adjusts;
-    if (cache_hits)
-      buffer_cached_crc += cache_hits;
-    if (cache_misses)
-      buffer_missed_crc += cache_misses;
-  }
-
+  _track_crc(cache_hits, cache_adjusts, cache_misses);
   return crc;
 }
 
@@ -0,0 +1,75 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <string.h>
+
+#include "acconfig.h"
+#include "common/crc32c_intel_multi.h"
+#include "common/crc32c_intel_baseline.h"
+#include "common/crc32c_intel_fast.h"
+
+#ifdef __x86_64__
+
+#include <nmmintrin.h>
+
+/*
+ * The crc32 instruction has a latency of 3 cycles but can issue every
+ * cycle, so a single dependency chain leaves it idle two thirds of the
+ * time.  Running four independent buffers through it side by side keeps
+ * it busy without the pclmul recombination a split single buffer needs.
+ */
+__attribute__((target("sse4.2")))
+static void crc32c_x4(uint32_t *crcs, unsigned char const * const *data,
+		      unsigned len)
+{
+	uint64_t c0 = crcs[0], c1 = crcs[1], c2 = crcs[2], c3 = crcs[3];
+	unsigned char const *p0 = data[0], *p1 = data[1];
+	unsigned char const *p2 = data[2], *p3 = data[3];
+	unsigned i = 0;
+
+	for (; i + 8 <= len; i += 8) {
+		uint64_t w0, w1, w2, w3;
+		memcpy(&w0, p0 + i, 8);
+		memcpy(&w1, p1 + i, 8);
+		memcpy(&w2, p2 + i, 8);
+		memcpy(&w3, p3 + i, 8);
+		c0 = _mm_crc32_u64(c0, w0);
+		c1 = _mm_crc32_u64(c1, w1);
+		c2 = _mm_crc32_u64(c2, w2);
+		c3 = _mm_crc32_u64(c3, w3);
+	}
+	for (; i < len; ++i) {
+		c0 = _mm_crc32_u8(c0, p0[i]);
+		c1 = _mm_crc32_u8(c1, p1[i]);
+		c2 = _mm_crc32_u8(c2, p2[i]);
+		c3 = _mm_crc32_u8(c3, p3[i]);
+	}
+	crcs[0] = c0;
+	crcs[1] = c1;
+	crcs[2] = c2;
+	crcs[3] = c3;
+}
+
+void ceph_crc32c_intel_multi(unsigned n, uint32_t *crcs,
+			     unsigned char const * const *data, unsigned len)
+{
+	for (; n >= 4; n -= 4, crcs += 4, data += 4)
+		crc32c_x4(crcs, data, len);
+	for (; n; --n, ++crcs, ++data) {
+		if (ceph_crc32c_intel_fast_exists())
+			*crcs = ceph_crc32c_intel_fast(*crcs, *data, len);
+		else
+			*crcs = ceph_crc32c_intel_baseline(*crcs, *data, len);
+	}
+}
+
+#endif
@@ -0,0 +1,42 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_COMMON_CRC32C_INTEL_MULTI_H
+#define CEPH_COMMON_CRC32C_INTEL_MULTI_H
+
+#include "include/int_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef __x86_64__
+
+extern void ceph_crc32c_intel_multi(unsigned n, uint32_t *crcs,
+				    unsigned char const * const *data,
+				    unsigned len);
+
+#else
+
+static inline void ceph_crc32c_intel_multi(unsigned n, uint32_t *crcs,
+					   unsigned char const * const *data,
+					   unsigned len)
+{
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,489 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <list>
+#include <map>
+
+#include "common/ceph_time.h"
+#include "common/Formatter.h"
+#include "common/OpQueue.h"
+
+#include "include/assert.h"
+
+
+namespace ceph {
+
+  struct mClockCostInfo {
+    double reservation; // cost units/sec; 0 for none
+    double weight;	// must be > 0
+    double limit;	// cost units/sec; 0 for none
+
+    mClockCostInfo(double _reservation, double _weight, double _limit) :
+      reservation(_reservation),
+      weight(_weight),
+      limit(_limit)
+    {}
+  };
+
+  /*
+   * mClock (Gulati et al., OSDI '10) for a single server, with costs.
+   *
+   * Every client has a reservation (cost units per second it is
+   * guaranteed), a weight (its share of whatever is left over) and a
+   * limit (cost units per second it should not exceed).  Each tag
+   * advances by cost / rate, so a request ten times as expensive as
+   * another consumes ten times as much of its client's reservation,
+   * share and limit.  The unit of cost is up to the caller; it only
+   * has to agree with the unit of the rates handed back by the
+   * ClientInfoFunc.
+   *
+   * Tags are assigned when a request reaches the head of its client's
+   * queue, so the ClientInfo may change while requests are queued.
+   * As with mClockQueue the limit is not a hard cap: when every
+   * client is over its limit the one with the lowest proportional tag
+   * is still served, since the op queue workers expect an item
+   * whenever the queue is not empty.
+   */
+  template <typename T, typename K>
+  class mClockCostQueue : public OpQueue <T, K> {
+
+  public:
+
+    using ClientInfo = mClockCostInfo;
+    using ClientInfoFunc = std::function<const ClientInfo*(const K&)>;
+    // monotonic time, in seconds
+    using ClockFunc = std::function<double()>;
+
+    enum class phase_t { reservation, priority };
+
+  private:
+
+    static constexpr double max_tag = std::numeric_limits<double>::max();
+
+    struct Request {
+      T item;
+      double cost;
+      double arrival;
+      // arrived behind other requests of the same client
+      bool backlogged;
+
+      Request(T&& _item, double _cost, double _arrival, bool _backlogged) :
+	item(std::move(_item)),
+	cost(_cost),
+	arrival(_arrival),
+	backlogged(_backlogged)
+      {}
+    };
+
+    using TagKey = std::pair<double,uint64_t>;
+
+    struct ClientRec {
+      const K key;
+      const uint64_t id;
+      std::deque<Request> requests;
+
+      // tags of the head request; valid while `tagged`
+      bool tagged = false;
+      double r_tag = 0.0;
+      double p_tag = 0.0;
+      double l_tag = 0.0;
+
+      // the tags the next request is computed from
+      double prev_r = 0.0;
+      double prev_p = 0.0; // finish tag of the last proportional request
+      double prev_l = 0.0;
+
+      ClientRec(const K& _key, uint64_t _id) : key(_key), id(_id) {}
+
+      TagKey r_key() const { return TagKey(r_tag, id); }
+      TagKey p_key() const { return TagKey(p_tag, id); }
+    };
+
+    using ClientMap = std::map<K,ClientRec>;
+    using StrictQueue = std::map<unsigned, std::list<std::pair<K,T>>>;
+
+    ClientInfoFunc info_f;
+    ClockFunc clock_f;
+
+    ClientMap clients;
+    // clients with requests, ordered by the tags of their head request;
+    // clients without a reservation are only in by_p
+    std::map<TagKey,ClientRec*> by_r;
+    std::map<TagKey,ClientRec*> by_p;
+
+    uint64_t next_client_id = 0;
+    unsigned count = 0;
+    // start tag of the last request served by weight; new or returning
+    // clients start from here so they can't bank credit while idle
+    double virtual_time = 0.0;
+    unsigned dequeues_since_trim = 0;
+
+    uint64_t reservation_count = 0;
+    uint64_t priority_count = 0;
+    uint64_t limit_break_count = 0;
+
+    StrictQueue high_queue;
+    // see mClockQueue: requeued items go here rather than being
+    // re-tagged
+    std::list<std::pair<K,T>> queue_front;
+
+    static double mono_now() {
+      return std::chrono::duration<double>(
+	ceph::mono_clock::now().time_since_epoch()).count();
+    }
+
+    void tag_head(ClientRec& c) {
+      assert(!c.requests.empty());
+      const Request& r = c.requests.front();
+      const ClientInfo* info = info_f(c.key);
+      assert(info && info->weight > 0.0);
+
+      if (info->reservation > 0.0) {
+	// a client that has been waiting all along keeps the reservation
+	// it built up; tags are assigned at the head of the queue, so
+	// clamping to this request's arrival would throw that away
+	c.r_tag = c.prev_r + r.cost / info->reservation;
+	if (!r.backlogged) {
+	  c.r_tag = std::max(c.r_tag, r.arrival);
+	}
+	c.prev_r = c.r_tag;
+      } else {
+	c.r_tag = max_tag;
+      }
+
+      c.p_tag = std::max(c.prev_p, virtual_time);
+      c.prev_p = c.p_tag + r.cost / info->weight;
+
+      if (info->limit > 0.0) {
+	c.l_tag = std::max(c.prev_l + r.cost / info->limit, r.arrival);
+	c.prev_l = c.l_tag;
+      } else {
+	c.l_tag = 0.0;
+      }
+      c.tagged = true;
+    }
+
+    void index(ClientRec& c) {
+      if (c.r_tag < max_tag) {
+	by_r.emplace(c.r_key(), &c);
+      }
+      by_p.emplace(c.p_key(), &c);
+    }
+
+    void unindex(ClientRec& c) {
+      if (c.r_tag < max_tag) {
+	by_r.erase(c.r_key());
+      }
+      by_p.erase(c.p_key());
+    }
+
+    // (re)tag and index c's head request, if it has one
+    void schedule(ClientRec& c) {
+      if (c.requests.empty()) {
+	c.tagged = false;
+	return;
+      }
+      if (!c.tagged) {
+	tag_head(c);
+      }
+      index(c);
+    }
+
+    // idle clients are remembered until the tags they ran up have
+    // expired, so that going briefly idle doesn't wipe out a debt
+    void trim_idle(double now) {
+      for (auto i = clients.begin(); i != clients.end(); /* no-inc */) {
+	const ClientRec& c = i->second;
+	if (c.requests.empty() &&
+	    c.prev_r <= now &&
+	    c.prev_l <= now &&
+	    c.prev_p <= virtual_time) {
+	  i = clients.erase(i);
+	} else {
+	  ++i;
+	}
+      }
+    }
+
+    ClientRec* pick(double now, phase_t *phase) {
+      if (!by_r.empty() && by_r.begin()->first.first <= now) {
+	*phase = phase_t::reservation;
+	return by_r.begin()->second;
+      }
+      *phase = phase_t::priority;
+      for (auto& i : by_p) {
+	if (i.second->l_tag <= now) {
+	  return i.second;
+	}
+      }
+      ++limit_break_count;
+      return by_p.begin()->second;
+    }
+
+    unsigned remove_requests(ClientRec& c, std::function<bool (T&&)> f) {
+      unsigned removed = 0;
+      bool head_removed = false;
+      for (auto i = c.requests.size(); i > 0; --i) {
+	auto it = c.requests.begin() + (i - 1);
+	if (f(std::move(it->item))) {
+	  head_removed = head_removed || (i == 1);
+	  c.requests.erase(it);
+	  ++removed;
+	}
+      }
+      if (head_removed) {
+	c.tagged = false;
+      }
+      return removed;
+    }
+
+  public:
+
+    mClockCostQueue(const ClientInfoFunc& _info_f,
+		    const ClockFunc& _clock_f = ClockFunc()) :
+      info_f(_info_f),
+      clock_f(_clock_f ? _clock_f : ClockFunc(&mClockCostQueue::mono_now))
+    {
+      // empty
+    }
+
+    unsigned length() const override final {
+      unsigned total = count + queue_front.size();
+      for (auto& i : high_queue) {
+	total += i.second.size();
+      }
+      return total;
+    }
+
+    // number of requests waiting for the tag scheduler
+    unsigned request_count() const {
+      return count;
+    }
+
+    unsigned client_count() const {
+      return clients.size();
+    }
+
+    // be sure to do things in reverse priority order and push_front
+    // to the list so items end up on list in front-to-back priority
+    // order
+    void remove_by_filter(std::function<bool (T&&)> filter_accum) {
+      for (auto& i : clients) {
+	ClientRec& c = i.second;
+	if (c.requests.empty()) {
+	  continue;
+	}
+	unindex(c);
+	count -= remove_requests(c, filter_accum);
+	schedule(c);
+      }
+
+      for (auto i = queue_front.rbegin(); i != queue_front.rend(); /* no-inc */) {
+	if (filter_accum(std::move(i->second))) {
+	  i = decltype(i){ queue_front.erase(std::next(i).base()) };
+	} else {
+	  ++i;
+	}
+      }
+
+      for (auto i = high_queue.begin(); i != high_queue.end(); /* no-inc */) {
+	auto& l = i->second;
+	for (auto j = l.rbegin(); j != l.rend(); /* no-inc */) {
+	  if (filter_accum(std::move(j->second))) {
+	    j = decltype(j){ l.erase(std::next(j).base()) };
+	  } else {
+	    ++j;
+	  }
+	}
+	if (l.empty()) {
+	  i = high_queue.erase(i);
+	} else {
+	  ++i;
+	}
+      }
+    }
+
+    void remove_by_class(K k, std::list<T> *out = nullptr) override final {
+      auto ci = clients.find(k);
+      if (ci != clients.end() && !ci->second.requests.empty()) {
+	ClientRec& c = ci->second;
+	unindex(c);
+	count -= c.requests.size();
+	if (out) {
+	  for (auto j = c.requests.rbegin(); j != c.requests.rend(); ++j) {
+	    out->push_front(std::move(j->item));
+	  }
+	}
+	c.requests.clear();
+	c.tagged = false;
+      }
+
+      for (auto i = queue_front.rbegin(); i != queue_front.rend(); /* no-inc */) {
+	if (k == i->first) {
+	  if (nullptr != out) out->push_front(std::move(i->second));
+	  i = decltype(i){ queue_front.erase(std::next(i).base()) };
+	} else {
+	  ++i;
+	}
+      }
+
+      for (auto i = high_queue.begin(); i != high_queue.end(); /* no-inc */) {
+	auto& l = i->second;
+	for (auto j = l.rbegin(); j != l.rend(); /* no-inc */) {
+	  if (k == j->first) {
+	    if (nullptr != out) out->push_front(std::move(j->second));
+	    j = decltype(j){ l.erase(std::next(j).base()) };
+	  } else {
+	    ++j;
+	  }
+	}
+	if (l.empty()) {
+	  i = high_queue.erase(i);
+	} else {
+	  ++i;
+	}
+      }
+    }
+
+    void enqueue_strict(K cl, unsigned priority, T&& item) override final {
+      high_queue[priority].emplace_back(cl, std::move(item));
+    }
+
+    void enqueue_strict_front(K cl, unsigned priority, T&& item) override final {
+      high_queue[priority].emplace_front(cl, std::move(item));
+    }
+
+    // `cost` is in the same unit as the client rates; it is clamped to
+    // at least 1 so that zero-cost requests still consume something
+    void enqueue_cost(const K& cl, double cost, T&& item) {
+      auto ci = clients.find(cl);
+      if (ci == clients.end()) {
+	ci = clients.emplace(cl, ClientRec(cl, next_client_id++)).first;
+      }
+      ClientRec& c = ci->second;
+      c.requests.emplace_back(std::move(item), std::max(cost, 1.0), clock_f(),
+			      !c.requests.empty());
+      ++count;
+      if (c.requests.size() == 1) {
+	schedule(c);
+      }
+    }
+
+    void enqueue(K cl, unsigned priority, unsigned cost, T&& item) override final {
+      // priority is ignored
+      enqueue_cost(cl, cost, std::move(item));
+    }
+
+    void enqueue_front(K cl,
+		       unsigned priority,
+		       unsigned cost,
+		       T&& item) override final {
+      queue_front.emplace_front(std::pair<K,T>(cl, std::move(item)));
+    }
+
+    bool empty() const override final {
+      return count == 0 && high_queue.empty() && queue_front.empty();
+    }
+
+    T dequeue() override final {
+      return dequeue(nullptr);
+    }
+
+    // as dequeue(), also reporting which mClock phase picked the
+    // request (strict and front items count as reservation)
+    T dequeue(phase_t *phase_out) {
+      assert(!empty());
+
+      if (!high_queue.empty()) {
+	auto& l = high_queue.rbegin()->second;
+	T ret = std::move(l.front().second);
+	l.pop_front();
+	if (l.empty()) {
+	  high_queue.erase(high_queue.rbegin()->first);
+	}
+	if (phase_out) *phase_out = phase_t::reservation;
+	return ret;
+      }
+
+      if (!queue_front.empty()) {
+	T ret = std::move(queue_front.front().second);
+	queue_front.pop_front();
+	if (phase_out) *phase_out = phase_t::reservation;
+	return ret;
+      }
+
+      const double now = clock_f();
+      phase_t phase;
+      ClientRec& c = *pick(now, &phase);
+      unindex(c);
+
+      Request& r = c.requests.front();
+      if (phase == phase_t::reservation) {
+	++reservation_count;
+      } else {
+	++priority_count;
+	virtual_time = std::max(virtual_time, c.p_tag);
+	// service above the reservation doesn't count against it
+	const ClientInfo* info = info_f(c.key);
+	if (info->reservation > 0.0) {
+	  c.prev_r -= r.cost / info->reservation;
+	}
+      }
+
+      T ret = std::move(r.item);
+      c.requests.pop_front();
+      --count;
+      c.tagged = false;
+      schedule(c);
+
+      if (++dequeues_since_trim >= 1024) {
+	dequeues_since_trim = 0;
+	trim_idle(now);
+      }
+
+      if (phase_out) *phase_out = phase;
+      return ret;
+    }
+
+    void dump(ceph::Formatter *f) const override final {
+      f->open_array_section("high_queues");
+      for (auto& p : high_queue) {
+	f->open_object_section("subqueue");
+	f->dump_int("priority", p.first);
+	f->dump_int("size", p.second.size());
+	f->close_section();
+      }
+      f->close_section();
+
+      f->open_object_section("queue_front");
+      f->dump_int("size", queue_front.size());
+      f->close_section();
+
+      f->open_object_section("queue");
+      f->dump_int("size", count);
+      f->dump_int("clients", clients.size());
+      f->dump_float("virtual_time", virtual_time);
+      f->dump_unsigned("reservation_dequeues", reservation_count);
+      f->dump_unsigned("priority_dequeues", priority_count);
+      f->dump_unsigned("limit_breaks", limit_break_count);
+      f->close_section();
+    } // dump
+  };
+
+} // namespace ceph
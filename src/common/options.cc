@@ -817,6 +817,17 @@ std::vector<Option> get_global_options() {
     .set_flag(Option::FLAG_NO_MON_UPDATE)
     .set_description(""),
 
+    Option("aligned_buffer_pool_max_bytes", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(64_M)
+    .set_description("Maximum bytes of idle page aligned buffers kept for reuse")
+    .set_long_description("Block device reads and messenger receives take their page aligned buffers from a shared pool and give them back when the last reference is dropped (e.g., once the data has been sent). This caps how much idle memory the pool may hold; 0 disables the pool.")
+    .add_see_also("aligned_buffer_pool_max_buffer_size"),
+
+    Option("aligned_buffer_pool_max_buffer_size", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(4_M)
+    .set_description("Largest buffer the aligned buffer pool will recycle")
+    .add_see_also("aligned_buffer_pool_max_bytes"),
+
     Option("key", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("")
     .set_description("Authentication key")
@@ -884,6 +895,12 @@ std::vector<Option> get_global_options() {
     .set_default(0)
     .set_description(""),
 
+    Option("ms_tcp_busy_poll_us", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_description("Set SO_BUSY_POLL on messenger sockets so reads poll the device queue for up to this many microseconds (0 to not set it)")
+    .set_long_description("Values above the net.core.busy_read sysctl need CAP_NET_ADMIN.")
+    .add_see_also("ms_async_busy_poll_us"),
+
     Option("ms_tcp_prefetch_max_size", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
     .set_default(4_K)
     .set_description(""),
@@ -1040,13 +1057,48 @@ std::vector<Option> get_global_options() {
     .set_default(5)
     .set_description(""),
 
+    Option("ms_async_send_batch_bytes", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(256_K)
+    .set_description("Gather queued outgoing messages of a connection into one send of up to this many bytes")
+    .add_see_also("ms_async_send_flush_window_us"),
+
+    Option("ms_async_send_flush_window_us", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_description("Hold a batch of outgoing messages smaller than ms_async_send_batch_bytes for up to this many microseconds, waiting for more (0 to send right away)")
+    .add_see_also("ms_async_send_batch_bytes"),
+
+    Option("ms_async_send_zerocopy_min_bytes", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_description("Send batches of at least this many bytes with MSG_ZEROCOPY, pinning their buffers until the kernel is done with them (0 to disable)")
+    .set_long_description("Only the posix stack on Linux 4.14 and later supports this; elsewhere it is ignored. Zero copy sends pay for page pinning and completion notifications, so they only help with large payloads such as replicated writes."),
+
     Option("ms_async_set_affinity", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(true)
-    .set_description(""),
+    .set_description("Pin messenger workers to ms_async_affinity_cores")
+    .add_see_also("ms_async_affinity_cores"),
 
     Option("ms_async_affinity_cores", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("")
-    .set_description(""),
+    .set_description("Comma separated CPUs; worker i runs on the (i modulo count)th one (empty to not pin)")
+    .add_see_also("ms_async_set_affinity"),
+
+    Option("ms_async_reuseport", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Give every messenger worker its own SO_REUSEPORT listener, so incoming connections stay on the worker that accepted them")
+    .set_long_description("The kernel spreads new connections over the listeners by their hash instead of the messenger balancing them by load. Only the posix stack supports this."),
+
+    Option("ms_async_busy_poll_us", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_description("Let an idle messenger worker spin on non-blocking event waits for up to this many microseconds before it sleeps (0 to always sleep)")
+    .set_long_description("Spinning saves the wakeup latency of every small op at the cost of CPU time; the msgr_poll_* perf counters show how often spins pay off.")
+    .add_see_also("ms_async_busy_poll_adaptive")
+    .add_see_also("ms_tcp_busy_poll_us"),
+
+    Option("ms_async_busy_poll_adaptive", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(true)
+    .set_description("Shorten the busy poll of workers whose events arrive further apart than ms_async_busy_poll_us, and lengthen it again as they come closer")
+    .add_see_also("ms_async_busy_poll_us"),
 
     Option("ms_async_rdma_device_name", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("")
@@ -2375,6 +2427,26 @@ std::vector<Option> get_global_options() {
     .set_flag(Option::FLAG_STARTUP)
     .set_description(""),
 
+    Option("osd_op_shard_affinity", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Pin the threads of op shard i to the CPU of messenger worker i")
+    .set_long_description("Uses the CPUs listed in ms_async_affinity_cores, so a worker and the shard of the same index share a core. A PG always maps to the same shard, so ops are not rerouted; the op_dispatch_local and op_dispatch_cross_core counters show how often the dispatching worker already runs on the core of the shard.")
+    .add_see_also("ms_async_affinity_cores"),
+
+    Option("osd_op_steal_threshold", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Let idle op threads take work from other op shards with at least this many queued items, until they are down to half of it (0 to never steal)")
+    .set_long_description("A PG stays with its shard and its ops stay in order; a stolen item is handled under the locks of its own shard. The queue_depth, steals and stolen counters of each OSDShard show the balance."),
+
+    Option("osd_op_inline_reads", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Run client reads on the messenger thread that received them when their op shard and PG are idle")
+    .set_long_description("Saves the hand-off to an op thread, which dominates the latency of small reads on fast devices, at the cost of blocking the messenger thread while the read runs. Reads of busy shards or PGs are queued as usual, and inline reads skip the op queue scheduler. The op_inline and op_inline_fallback counters and the op_r_inline_latency and op_r_queued_latency histograms compare the two paths.")
+    .add_see_also("osd_op_shard_affinity"),
+
     Option("osd_op_num_shards_hdd", Option::TYPE_INT, Option::LEVEL_ADVANCED)
     .set_default(5)
     .set_flag(Option::FLAG_STARTUP)
@@ -2391,11 +2463,12 @@ std::vector<Option> get_global_options() {
 
     Option("osd_op_queue", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("wpq")
-    .set_enum_allowed( { "wpq", "prioritized", "mclock_opclass", "mclock_client", "debug_random" } )
+    .set_enum_allowed( { "wpq", "prioritized", "mclock_opclass", "mclock_client", "mclock_cost", "debug_random" } )
     .set_description("which operation queue algorithm to use")
-    .set_long_description("which operation queue algorithm to use; mclock_opclass and mclock_client are currently experimental")
+    .set_long_description("which operation queue algorithm to use; mclock_opclass, mclock_client and mclock_cost are currently experimental")
     .set_flag(Option::FLAG_STARTUP)
-    .add_see_also("osd_op_queue_cut_off"),
+    .add_see_also("osd_op_queue_cut_off")
+    .add_see_also("osd_mclock_cost_profile"),
 
     Option("osd_op_queue_cut_off", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("low")
@@ -2860,6 +2933,40 @@ std::vector<Option> get_global_options() {
     .add_see_also("osd_op_queue_mclock_scrub_res")
     .add_see_also("osd_op_queue_mclock_scrub_wgt"),
 
+    Option("osd_mclock_cost_profile", Option::TYPE_STR, Option::LEVEL_ADVANCED)
+    .set_default("high_client_ops")
+    .set_enum_allowed( { "high_client_ops", "balanced", "high_recovery_ops" } )
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("how the mclock_cost op queue divides the device between client ops, recovery and background work")
+    .set_long_description("Reservations and limits are fractions of the device capacity (see osd_mclock_cost_iops), split evenly across op shards and then across the clients of a class that have ops queued. high_client_ops reserves 60% for client ops, 20% for recovery and caps scrub, snap trimming and pg deletion at 30%; balanced reserves 40% each and caps background work at 50%; high_recovery_ops reserves 30% for client ops and 60% for recovery.")
+    .add_see_also("osd_op_queue")
+    .add_see_also("osd_mclock_cost_iops")
+    .add_see_also("osd_mclock_cost_bandwidth"),
+
+    Option("osd_mclock_cost_iops", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(0.0)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("small random IOPS the data device sustains, for the mclock_cost op queue; 0 to measure it at startup")
+    .set_long_description("An op moving N bytes is charged 1 + N * iops / bandwidth small random I/Os. If this is 0, the OSD uses the value it measured at an earlier start, or measures it with 4 KiB random writes if osd_mclock_cost_bench is set; otherwise it assumes 300 for rotational and 20000 for other devices.")
+    .add_see_also("osd_mclock_cost_bandwidth")
+    .add_see_also("osd_mclock_cost_bench"),
+
+    Option("osd_mclock_cost_bandwidth", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("sequential bytes/sec the data device sustains, for the mclock_cost op queue; 0 to measure it at startup")
+    .set_long_description("If this is 0, the OSD uses the value it measured at an earlier start, or measures it with 4 MiB writes if osd_mclock_cost_bench is set; otherwise it assumes 150 MiB/s for rotational and 500 MiB/s for other devices.")
+    .add_see_also("osd_mclock_cost_iops")
+    .add_see_also("osd_mclock_cost_bench"),
+
+    Option("osd_mclock_cost_bench", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(true)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("measure whichever of osd_mclock_cost_iops and osd_mclock_cost_bandwidth is unset and not yet measured when the OSD starts")
+    .set_long_description("For IOPS the OSD writes 16 1 MiB objects and then 3000 4 KiB blocks at random offsets within them; for bandwidth it writes 64 MiB in 4 MiB objects. The objects are removed afterwards. This happens before the OSD boots and can take several seconds on a slow disk. The bench is skipped if the store has less than 1 GiB available. Results are saved in the store's metadata (mclock_cost_iops, mclock_cost_bandwidth) and reused at later starts.")
+    .add_see_also("osd_mclock_cost_iops")
+    .add_see_also("osd_mclock_cost_bandwidth"),
+
     Option("osd_ignore_stale_divergent_priors", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(false)
     .set_description(""),
@@ -3128,6 +3235,19 @@ std::vector<Option> get_global_options() {
     .set_default(512_K)
     .set_description("Number of bytes to read from an object at a time during deep scrub"),
 
+    Option("osd_deep_scrub_max_bytes_per_sec", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_description("Limit on the data all deep scrubs on an OSD read per second (0 = unlimited)")
+    .set_long_description("Deep scrub charges what it reads against this budget and, once ahead of it, waits before starting the next chunk, the way osd_scrub_sleep does, without holding up the op queue. It never waits while a chunk is blocked for writes.")
+    .add_see_also("osd_deep_scrub_stride")
+    .add_see_also("osd_scrub_sleep"),
+
+    Option("osd_deep_scrub_verify_csum", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Have the object store verify its own checksums during deep scrub instead of returning the data to be hashed")
+    .set_long_description("On a store that keeps per-block checksums (BlueStore), deep scrub of replicated pools asks the store to check object data against them in place. Data corruption is still found, but no whole-object data digest is computed, so replicas are not compared on data contents and the data digest in the object info is not checked. Objects the store cannot vouch for are read and hashed as usual. Erasure coded pools always read and hash, as their shards are checked against the stored chunk hashes.")
+    .add_see_also("bluestore_csum_type"),
+
     Option("osd_deep_scrub_keys", Option::TYPE_INT, Option::LEVEL_ADVANCED)
     .set_default(1024)
     .set_description("Number of keys to read from an object at a time during deep scrub"),
@@ -3188,6 +3308,11 @@ std::vector<Option> get_global_options() {
     .set_default(40)
     .set_description(""),
 
+    Option("osd_pg_advance_skip_quiet_maps", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(true)
+    .set_description("let PGs catching up on OSD maps step over epochs that do not affect them")
+    .set_long_description("When a PG is behind the OSD's map it normally runs every intermediate epoch through its peering state machine. With this enabled, an epoch that marks no OSD up or down, changes no flags, and leaves the PG's up and acting sets and its pool untouched only moves the PG's map reference forward. The newest map is always delivered in full."),
+
     Option("osd_min_pg_log_entries", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
     .set_default(3000)
     .set_description("minimum number of entries to maintain in the PG log")
@@ -3213,6 +3338,15 @@ std::vector<Option> get_global_options() {
     .set_default(1.3)
     .set_description(""),
 
+    Option("osd_pg_log_compact_entries", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("write PG log entries and dups in the compact on-disk encoding")
+    .set_long_description("The compact encoding stores each entry with varints and relative to its own version and reqid, which roughly halves the bytes written to the PG log per client op. Enabling it sets an incompat feature in the OSD superblock, so the OSD can no longer be started by a release that does not understand the encoding; entries already written in the old encoding remain readable.")
+    .add_service("osd")
+    .add_see_also("osd_max_pg_log_entries")
+    .add_see_also("osd_pg_log_dups_tracked"),
+
     Option("osd_pg_log_trim_min", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
     .set_default(100)
     .set_description(""),
@@ -3511,6 +3645,22 @@ std::vector<Option> get_global_options() {
     .set_default(false)
     .set_description(""),
 
+    Option("rocksdb_tombstone_compact_deletes", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(1000000)
+    .set_description("Compact a key range once this many keys were deleted in its prefix (0 to disable)")
+    .set_long_description("Deletes only leave tombstones behind until a compaction drops them, and iterators have to step over every one of them.  Deletions are tallied per prefix along with the range of keys they touched; once the tally reaches this value that range is queued for compaction."),
+
+    Option("rocksdb_tombstone_compact_skips", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(100000)
+    .set_description("Compact a key range once iterators skipped this many tombstones in it (0 to disable)")
+    .set_long_description("Enables rocksdb's per thread perf counting so that iterators can report the tombstones they stepped over, and where."),
+
+    Option("rocksdb_tombstone_compact_interval", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(60)
+    .set_description("Minimum number of seconds between two tombstone triggered compactions")
+    .add_see_also("rocksdb_tombstone_compact_deletes")
+    .add_see_also("rocksdb_tombstone_compact_skips"),
+
     Option("rocksdb_bloom_bits_per_key", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
     .set_default(20)
     .set_description("Number of bits per key to use for RocksDB's bloom filters.")
@@ -3706,6 +3856,23 @@ std::vector<Option> get_global_options() {
     .add_see_also("bluestore_cache_autotune")
     .set_description("When tcmalloc and cache autotuning is enabled, wait this many seconds between resizing caches."),
 
+    Option("osd_memory_host_arbiter_path", Option::TYPE_STR, Option::LEVEL_ADVANCED)
+    .set_default("")
+    .add_see_also("osd_memory_host_target")
+    .set_description("Shared file through which the OSDs of a host split memory between them (empty to disable)")
+    .set_long_description("When set, e.g. to /dev/shm/ceph-osd-memory, every OSD on the host that autotunes its cache joins the same arbiter.  Instead of osd_memory_target, each then tunes its cache towards a budget granted by the arbiter: every OSD keeps osd_memory_host_min_ratio of its fair share and the rest of the host budget goes to the OSDs whose caches miss the most."),
+
+    Option("osd_memory_host_target", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .add_see_also("osd_memory_host_arbiter_path")
+    .set_description("Memory the OSDs sharing a host memory arbiter should use together (0 for the sum of their osd_memory_target)"),
+
+    Option("osd_memory_host_min_ratio", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(.5)
+    .set_min_max(0.0, 1.0)
+    .add_see_also("osd_memory_host_arbiter_path")
+    .set_description("Fraction of its fair share of the host memory an OSD keeps however little its cache is used"),
+
     Option("memstore_device_bytes", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
     .set_default(1_G)
     .set_description(""),
@@ -3753,6 +3920,23 @@ std::vector<Option> get_global_options() {
     .set_default(16)
     .set_description(""),
 
+    Option("bdev_ioring", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .add_see_also("bdev_ioring_hipri")
+    .add_see_also("bdev_ioring_sqthread_poll")
+    .set_description("Use the Linux io_uring API instead of libaio for kernel block devices")
+    .set_long_description("Falls back to libaio if ceph was built without liburing or the running kernel does not support io_uring."),
+
+    Option("bdev_ioring_hipri", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .add_see_also("bdev_ioring")
+    .set_description("Poll for io_uring completions instead of waiting for interrupts (IORING_SETUP_IOPOLL)"),
+
+    Option("bdev_ioring_sqthread_poll", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .add_see_also("bdev_ioring")
+    .set_description("Have a kernel thread drain the io_uring submission queue (IORING_SETUP_SQPOLL)"),
+
     Option("bdev_block_size", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
     .set_default(4_K)
     .set_description(""),
@@ -3823,12 +4007,18 @@ std::vector<Option> get_global_options() {
 
     Option("bluefs_allocator", Option::TYPE_STR, Option::LEVEL_DEV)
     .set_default("bitmap")
+    .set_enum_allowed({"bitmap", "stupid", "avl"})
     .set_description(""),
 
     Option("bluefs_preextend_wal_files", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(false)
     .set_description(""),
 
+    Option("bluefs_wal_log", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Journal metadata for rocksdb WAL files in a separate log")
+    .set_long_description("WAL files get their own metadata journal, lock and fsync path, so a WAL fsync does not wait for a main log flush or compaction.  The superblock written with this enabled cannot be read by older versions.  Disabling it moves the metadata back to the main log at the next mount."),
+
     Option("bluestore_bluefs", Option::TYPE_BOOL, Option::LEVEL_DEV)
     .set_default(true)
     .set_flag(Option::FLAG_CREATE)
@@ -4044,6 +4234,12 @@ std::vector<Option> get_global_options() {
     .set_flag(Option::FLAG_RUNTIME)
     .set_description(""),
 
+    Option("bluestore_inline_data_max_size", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Store object data up to this size inside the onode")
+    .set_long_description("Objects whose data ends below this offset keep it in the onode key/value record instead of allocating blobs on the block device, so reading or writing them is a single key/value operation. Objects are moved out of the onode as soon as a write extends past the limit. The limit is capped at bluestore_min_alloc_size. 0 disables inline data. Writing the first inline object marks the store as requiring inline data support, so releases without it refuse to mount it from then on."),
+
     Option("bluestore_max_blob_size", Option::TYPE_SIZE, Option::LEVEL_DEV)
     .set_default(0)
     .set_flag(Option::FLAG_RUNTIME)
@@ -4093,6 +4289,25 @@ std::vector<Option> get_global_options() {
     .set_default(64)
     .set_description("Max pinned cache entries we consider before giving up"),
 
+    Option("bluestore_cache_trim_batch_onodes", Option::TYPE_UINT, Option::LEVEL_DEV)
+    .set_default(1024)
+    .set_description("Max onodes evicted from a cache shard before its lock is dropped and retaken (0 for no limit)"),
+
+    Option("bluestore_cache_trim_batch_bytes", Option::TYPE_SIZE, Option::LEVEL_DEV)
+    .set_default(16_M)
+    .set_description("Max buffer bytes evicted from a cache shard before its lock is dropped and retaken (0 for no limit)"),
+
+    Option("bluestore_cache_autotune_shards", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(true)
+    .add_see_also("bluestore_cache_shard_min_ratio")
+    .set_description("Size each cache shard by its share of recent onode and buffer lookups instead of splitting the cache evenly"),
+
+    Option("bluestore_cache_shard_min_ratio", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(.25)
+    .set_min_max(0.0, 1.0)
+    .add_see_also("bluestore_cache_autotune_shards")
+    .set_description("Fraction of an even split that every cache shard keeps regardless of demand"),
+
     Option("bluestore_cache_type", Option::TYPE_STR, Option::LEVEL_DEV)
     .set_default("2q")
     .set_enum_allowed({"2q", "lru"})
@@ -4152,8 +4367,15 @@ std::vector<Option> get_global_options() {
 
     Option("bluestore_allocator", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("bitmap")
-    .set_enum_allowed({"bitmap", "stupid"})
-    .set_description("Allocator policy"),
+    .set_enum_allowed({"bitmap", "stupid", "avl"})
+    .set_description("Allocator policy")
+    .set_long_description("avl keeps free extents in offset and size ordered AVL trees and allocates best-fit; it stays fast on large, heavily fragmented devices at the cost of memory proportional to the number of free extents."),
+
+    Option("bluestore_alloc_snapshot", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Save allocator state on clean umount and reuse it on the next mount")
+    .set_long_description("On a clean umount the free extents of the allocator are written to a bluefs file, and the next mount loads them instead of walking the whole freelist, which can take minutes on large devices. The snapshot is removed as soon as the store is opened, so after a crash, fsck or any other access the allocator is rebuilt from the freelist as usual. Requires bluefs.")
+    .add_see_also("bluestore_allocator"),
 
     Option("bluestore_freelist_blocks_per_key", Option::TYPE_SIZE, Option::LEVEL_DEV)
     .set_default(128)
@@ -4176,12 +4398,23 @@ std::vector<Option> get_global_options() {
     .set_description("Rocksdb options"),
 
     Option("bluestore_rocksdb_cf", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
-    .set_default(false)
-    .set_description("Enable use of rocksdb column families for bluestore metadata"),
+    .set_default(true)
+    .set_description("Enable use of rocksdb column families for bluestore metadata")
+    .set_long_description("Only applies when a store is created; existing "
+			  "stores can be converted offline with "
+			  "'ceph-bluestore-tool migrate-cf'."),
 
     Option("bluestore_rocksdb_cfs", Option::TYPE_STR, Option::LEVEL_DEV)
-    .set_default("M= P= L=")
-    .set_description("List of whitespace-separate key/value pairs where key is CF name and value is CF options"),
+    .set_default("M= "
+		 "P=write_buffer_size=16777216;max_write_buffer_number=8;"
+		 "min_write_buffer_number_to_merge=4 "
+		 "L=write_buffer_size=16777216;max_write_buffer_number=8;"
+		 "min_write_buffer_number_to_merge=4")
+    .set_description("List of whitespace-separate key/value pairs where key is CF name and value is CF options")
+    .set_long_description("Deferred writes (L) and PG logs (P) are deleted "
+			  "soon after they are written; merging several "
+			  "memtables per flush drops most of their values "
+			  "before they ever reach an SST file."),
 
     Option("bluestore_fsck_on_mount", Option::TYPE_BOOL, Option::LEVEL_DEV)
     .set_default(false)
@@ -4252,6 +4485,13 @@ std::vector<Option> get_global_options() {
     .set_flag(Option::FLAG_RUNTIME)
     .set_description("Default bluestore_deferred_batch_ops for non-rotational (solid state) media"),
 
+    Option("bluestore_deferred_batch_window_max", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(.5)
+    .set_flag(Option::FLAG_RUNTIME)
+    .add_see_also("bluestore_deferred_batch_ops")
+    .set_description("Max seconds deferred writes are held back for batching")
+    .set_long_description("Pending deferred writes are submitted once the oldest has waited about one measured device round trip, capped at this value, even if bluestore_deferred_batch_ops has not been reached.  0 disables the time-based trigger."),
+
     Option("bluestore_nid_prealloc", Option::TYPE_INT, Option::LEVEL_DEV)
     .set_default(1024)
     .set_description("Number of unique object ids to preallocate at a time"),
@@ -4303,6 +4543,10 @@ std::vector<Option> get_global_options() {
     .set_default(false)
     .set_description(""),
 
+    Option("bluestore_debug_inject_csum_err_probability", Option::TYPE_FLOAT, Option::LEVEL_DEV)
+    .set_default(0.0)
+    .set_description("inject crc verification errors into bluestore device reads"),
+
     Option("bluestore_debug_randomize_serial_transaction", Option::TYPE_INT, Option::LEVEL_DEV)
     .set_default(0)
     .set_description(""),
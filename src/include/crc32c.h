@@ -17,6 +17,17 @@ extern ceph_crc32c_func_t ceph_crc32c_func;
 
 extern ceph_crc32c_func_t ceph_choose_crc32(void);
 
+typedef void (*ceph_crc32c_multi_func_t)(unsigned n, uint32_t *crcs,
+					 unsigned char const * const *data,
+					 unsigned length);
+
+/*
+ * the chosen implementation for checksumming several buffers at once.
+ */
+extern ceph_crc32c_multi_func_t ceph_crc32c_multi_func;
+
+extern ceph_crc32c_multi_func_t ceph_choose_crc32_multi(void);
+
 /**
  * calculate crc32c for data that is entirely 0 (ZERO)
  *
@@ -50,6 +61,24 @@ static inline uint32_t ceph_crc32c(uint32_t crc, unsigned char const *data, unsi
   return ceph_crc32c_func(crc, data, length);
 }
 
+/**
+ * calculate crc32c of several equally sized buffers
+ *
+ * Same as calling ceph_crc32c() on each buffer, but independent buffers
+ * may be interleaved to keep more than one crc computation in flight.
+ *
+ * @param n number of buffers
+ * @param crcs initial values on entry, crcs on return
+ * @param data n pointers to buffers, none of them NULL
+ * @param length length of each buffer
+ */
+static inline void ceph_crc32c_multi(unsigned n, uint32_t *crcs,
+				     unsigned char const * const *data,
+				     unsigned length)
+{
+  ceph_crc32c_multi_func(n, crcs, data, length);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -158,6 +158,7 @@ namespace mempool {
   f(bluefs)			      \
   f(buffer_anon)		      \
   f(buffer_meta)		      \
+  f(buffer_pool)		      \
   f(osd)			      \
   f(osd_mapbl)			      \
   f(osd_pglog)			      \
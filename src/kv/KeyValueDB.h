@@ -433,6 +433,12 @@ public:
   virtual void compact_range_async(const std::string& prefix,
 				   const std::string& start, const std::string& end) {}
 
+  /// move all keys of each prefix into a column family named after it
+  virtual int migrate_prefixes_to_cfs(const std::vector<ColumnFamily>& cfs,
+				      std::ostream &out) {
+    return -EOPNOTSUPP;
+  }
+
   // See RocksDB merge operator definition, we support the basic
   // associative merge only right now.
   class MergeOperator {
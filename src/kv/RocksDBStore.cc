@@ -5,6 +5,7 @@
 #include <map>
 #include <string>
 #include <memory>
+#include <mutex>
 #include <errno.h>
 #include <unistd.h>
 #include <sys/types.h>
@@ -16,6 +17,7 @@
 #include "rocksdb/slice.h"
 #include "rocksdb/cache.h"
 #include "rocksdb/filter_policy.h"
+#include "rocksdb/listener.h"
 #include "rocksdb/utilities/convenience.h"
 #include "rocksdb/merge_operator.h"
 #include "kv/rocksdb_cache/BinnedLRUCache.h"
@@ -55,6 +57,87 @@ static rocksdb::SliceParts prepare_sliceparts(const bufferlist &bl,
 }
 
 
+//
+// Per column family flush and compaction accounting, fed from RocksDB's
+// background threads.  Write amplification is what flushes and compactions
+// wrote to the column family over what its flushes took in.
+class RocksDBStore::CFStatsListener : public rocksdb::EventListener {
+  CephContext *cct;
+  std::mutex lock;
+  std::map<string, PerfCounters*> loggers;  ///< cf name -> counters
+
+  PerfCounters *get_logger(const string& cf_name) {
+    std::lock_guard<std::mutex> l(lock);
+    auto p = loggers.find(cf_name);
+    if (p != loggers.end()) {
+      return p->second;
+    }
+    PerfCountersBuilder plb(cct, "rocksdb_cf_" + cf_name,
+			    l_rocksdb_cf_first, l_rocksdb_cf_last);
+    plb.add_u64_counter(l_rocksdb_cf_flushes, "flushes", "Memtable flushes");
+    plb.add_u64_counter(l_rocksdb_cf_flush_bytes, "flush_bytes",
+			"Bytes written by memtable flushes",
+			NULL, 0, unit_t(UNIT_BYTES));
+    plb.add_u64_counter(l_rocksdb_cf_compactions, "compactions",
+			"Compactions");
+    plb.add_u64_counter(l_rocksdb_cf_compaction_read_bytes,
+			"compaction_read_bytes", "Bytes read by compactions",
+			NULL, 0, unit_t(UNIT_BYTES));
+    plb.add_u64_counter(l_rocksdb_cf_compaction_write_bytes,
+			"compaction_write_bytes", "Bytes written by compactions",
+			NULL, 0, unit_t(UNIT_BYTES));
+    plb.add_u64(l_rocksdb_cf_write_amp_pct, "write_amp_pct",
+		"Flush and compaction bytes written over flush bytes, "
+		"in percent");
+    PerfCounters *logger = plb.create_perf_counters();
+    cct->get_perfcounters_collection()->add(logger);
+    loggers[cf_name] = logger;
+    return logger;
+  }
+
+  static void update_write_amp(PerfCounters *logger) {
+    uint64_t flushed = logger->get(l_rocksdb_cf_flush_bytes);
+    if (flushed) {
+      uint64_t written =
+	flushed + logger->get(l_rocksdb_cf_compaction_write_bytes);
+      logger->set(l_rocksdb_cf_write_amp_pct, written * 100 / flushed);
+    }
+  }
+
+public:
+  explicit CFStatsListener(CephContext *c) : cct(c) {}
+  ~CFStatsListener() override {
+    for (auto& p : loggers) {
+      cct->get_perfcounters_collection()->remove(p.second);
+      delete p.second;
+    }
+  }
+
+  void OnFlushCompleted(rocksdb::DB *db,
+			const rocksdb::FlushJobInfo& info) override {
+    PerfCounters *logger = get_logger(info.cf_name);
+    const auto& props = info.table_properties;
+    logger->inc(l_rocksdb_cf_flushes);
+    logger->inc(l_rocksdb_cf_flush_bytes,
+		props.data_size + props.index_size + props.filter_size);
+    update_write_amp(logger);
+  }
+
+  void OnCompactionCompleted(rocksdb::DB *db,
+			     const rocksdb::CompactionJobInfo& info) override {
+    if (!info.status.ok()) {
+      return;
+    }
+    PerfCounters *logger = get_logger(info.cf_name);
+    logger->inc(l_rocksdb_cf_compactions);
+    logger->inc(l_rocksdb_cf_compaction_read_bytes,
+		info.stats.total_input_bytes);
+    logger->inc(l_rocksdb_cf_compaction_write_bytes,
+		info.stats.total_output_bytes);
+    update_write_amp(logger);
+  }
+};
+
 //
 // One of these for the default rocksdb column family, routing each prefix
 // to the appropriate MergeOperator.
@@ -340,6 +423,11 @@ int RocksDBStore::load_rocksdb_options(bool create_if_missing, rocksdb::Options&
     opt.statistics = dbstats;
   }
 
+  if (!cf_stats) {
+    cf_stats = std::make_shared<CFStatsListener>(cct);
+  }
+  opt.listeners.push_back(cf_stats);
+
   opt.create_if_missing = create_if_missing;
   if (kv_options.count("separate_wal_dir")) {
     opt.wal_dir = path + ".wal";
@@ -588,6 +676,13 @@ int RocksDBStore::do_open(ostream &out, bool create_if_missing,
   plb.add_time_avg(l_rocksdb_write_delay_time, "rocksdb_write_delay_time", "Rocksdb write delay time");
   plb.add_time_avg(l_rocksdb_write_pre_and_post_process_time, 
       "rocksdb_write_pre_and_post_time", "total time spent on writing a record, excluding write process");
+  plb.add_u64_counter(l_rocksdb_iter_tombstone_skips, "iter_tombstone_skips",
+		      "Tombstones skipped by iterators");
+  plb.add_u64_counter(l_rocksdb_tombstone_compact, "tombstone_compact",
+		      "Range compactions triggered by tombstones");
+  plb.add_u64_counter(l_rocksdb_tombstone_compact_throttled,
+		      "tombstone_compact_throttled",
+		      "Tombstone triggered compactions held back by the rate limit");
   logger = plb.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
 
@@ -651,6 +746,84 @@ void RocksDBStore::close()
     cct->get_perfcounters_collection()->remove(logger);
 }
 
+int RocksDBStore::migrate_prefixes_to_cfs(const vector<ColumnFamily>& cfs,
+					  ostream &out)
+{
+  // every batch moves its keys atomically, so an interrupted migration
+  // can simply be run again
+  const uint64_t batch_keys = 1024;
+  rocksdb::WriteOptions woptions;
+  woptions.sync = true;
+  for (auto& p : cfs) {
+    rocksdb::Status status;
+    auto cf = get_cf_handle(p.name);
+    if (!cf) {
+      rocksdb::ColumnFamilyOptions cf_opt(db->GetOptions(default_cf));
+      status = rocksdb::GetColumnFamilyOptionsFromString(
+	cf_opt, p.option, &cf_opt);
+      if (!status.ok()) {
+	derr << __func__ << " invalid db column family options for CF '"
+	     << p.name << "': " << p.option << dendl;
+	out << "invalid options for column family " << p.name << std::endl;
+	return -EINVAL;
+      }
+      install_cf_mergeop(p.name, &cf_opt);
+      status = db->CreateColumnFamily(cf_opt, p.name, &cf);
+      if (!status.ok()) {
+	derr << __func__ << " failed to create column family " << p.name
+	     << ": " << status.ToString() << dendl;
+	return -EIO;
+      }
+      add_column_family(p.name, static_cast<void*>(cf));
+      out << "created column family " << p.name << std::endl;
+    }
+
+    const string start = combine_strings(p.name, string());
+    const string end = past_prefix(p.name);
+    rocksdb::Slice cstart(start);
+    rocksdb::Slice cend(end);
+    rocksdb::ReadOptions ropts;
+    ropts.iterate_upper_bound = &cend;
+    std::unique_ptr<rocksdb::Iterator> it(db->NewIterator(ropts, default_cf));
+    rocksdb::WriteBatch bat;
+    uint64_t moved = 0;
+    for (it->Seek(cstart); it->Valid(); it->Next()) {
+      rocksdb::Slice key = it->key();
+      key.remove_prefix(start.size());
+      bat.Put(cf, key, it->value());
+      bat.Delete(default_cf, it->key());
+      if (++moved % batch_keys == 0) {
+	status = db->Write(woptions, &bat);
+	if (!status.ok()) {
+	  break;
+	}
+	bat.Clear();
+      }
+    }
+    if (status.ok()) {
+      status = it->status();
+    }
+    if (status.ok() && bat.Count()) {
+      status = db->Write(woptions, &bat);
+    }
+    if (!status.ok()) {
+      derr << __func__ << " moving prefix " << p.name << " failed: "
+	   << status.ToString() << dendl;
+      return -EIO;
+    }
+    if (moved) {
+      // drop the tombstones left behind
+      db->CompactRange(rocksdb::CompactRangeOptions(), default_cf,
+		       &cstart, &cend);
+    }
+    dout(1) << __func__ << " moved " << moved << " keys of prefix " << p.name
+	    << dendl;
+    out << "moved " << moved << " keys into column family " << p.name
+	<< std::endl;
+  }
+  return 0;
+}
+
 int RocksDBStore::repair(std::ostream &out)
 {
   rocksdb::Options opt;
@@ -759,6 +932,11 @@ int RocksDBStore::submit_common(rocksdb::WriteOptions& woptions, KeyValueDB::Tra
     _t->bat.Iterate(&rocks_txc);
     derr << __func__ << " error: " << s.ToString() << " code = " << s.code()
          << " Rocksdb transaction: " << rocks_txc.seen << dendl;
+  } else if (!_t->deletes.empty()) {
+    for (auto& p : _t->deletes) {
+      note_tombstones(p.first, &p.second, nullptr);
+    }
+    _t->deletes.clear();
   }
 
   if (g_conf()->rocksdb_perf) {
@@ -878,6 +1056,9 @@ void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
   } else {
     bat.Delete(db->default_cf, combine_strings(prefix, k));
   }
+  if (db->tombstone_compact_deletes) {
+    note_delete(prefix, k, k, 1);
+  }
 }
 
 void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
@@ -892,6 +1073,10 @@ void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
     combine_strings(prefix, k, keylen, &key);
     bat.Delete(db->default_cf, rocksdb::Slice(key));
   }
+  if (db->tombstone_compact_deletes) {
+    string key(k, keylen);
+    note_delete(prefix, key, key, 1);
+  }
 }
 
 void RocksDBStore::RocksDBTransactionImpl::rm_single_key(const string &prefix,
@@ -903,21 +1088,27 @@ void RocksDBStore::RocksDBTransactionImpl::rm_single_key(const string &prefix,
   } else {
     bat.SingleDelete(db->default_cf, combine_strings(prefix, k));
   }
+  if (db->tombstone_compact_deletes) {
+    note_delete(prefix, k, k, 1);
+  }
 }
 
 void RocksDBStore::RocksDBTransactionImpl::rmkeys_by_prefix(const string &prefix)
 {
+  uint64_t n = 0;
   auto cf = db->get_cf_handle(prefix);
   if (cf) {
     if (db->enable_rmrange) {
       string endprefix("\xff\xff\xff\xff");  // FIXME: this is cheating...
       bat.DeleteRange(cf, string(), endprefix);
+      n = 1;
     } else {
       auto it = db->get_iterator(prefix);
       for (it->seek_to_first();
 	   it->valid();
 	   it->next()) {
 	bat.Delete(cf, rocksdb::Slice(it->key()));
+	++n;
       }
     }
   } else {
@@ -927,25 +1118,32 @@ void RocksDBStore::RocksDBTransactionImpl::rmkeys_by_prefix(const string &prefix
       bat.DeleteRange(db->default_cf,
 		      combine_strings(prefix, string()),
 		      combine_strings(endprefix, string()));
+      n = 1;
     } else {
       auto it = db->get_iterator(prefix);
       for (it->seek_to_first();
 	   it->valid();
 	   it->next()) {
 	bat.Delete(db->default_cf, combine_strings(prefix, it->key()));
+	++n;
       }
     }
   }
+  if (n && db->tombstone_compact_deletes) {
+    note_delete(prefix, string(), string(), n);
+  }
 }
 
 void RocksDBStore::RocksDBTransactionImpl::rm_range_keys(const string &prefix,
                                                          const string &start,
                                                          const string &end)
 {
+  uint64_t n = 0;
   auto cf = db->get_cf_handle(prefix);
   if (cf) {
     if (db->enable_rmrange) {
       bat.DeleteRange(cf, rocksdb::Slice(start), rocksdb::Slice(end));
+      n = 1;
     } else {
       auto it = db->get_iterator(prefix);
       it->lower_bound(start);
@@ -955,6 +1153,7 @@ void RocksDBStore::RocksDBTransactionImpl::rm_range_keys(const string &prefix,
 	}
 	bat.Delete(cf, rocksdb::Slice(it->key()));
 	it->next();
+	++n;
       }
     }
   } else {
@@ -963,6 +1162,7 @@ void RocksDBStore::RocksDBTransactionImpl::rm_range_keys(const string &prefix,
 	db->default_cf,
 	rocksdb::Slice(combine_strings(prefix, start)),
 	rocksdb::Slice(combine_strings(prefix, end)));
+      n = 1;
     } else {
       auto it = db->get_iterator(prefix);
       it->lower_bound(start);
@@ -973,9 +1173,13 @@ void RocksDBStore::RocksDBTransactionImpl::rm_range_keys(const string &prefix,
 	bat.Delete(db->default_cf,
 		   combine_strings(prefix, it->key()));
 	it->next();
+	++n;
       }
     }
   }
+  if (n && db->tombstone_compact_deletes) {
+    note_delete(prefix, start, end, n);
+  }
 }
 
 void RocksDBStore::RocksDBTransactionImpl::merge(
@@ -1167,6 +1371,34 @@ void RocksDBStore::compact()
 }
 
 
+void RocksDBStore::compact_prefix(const string& prefix)
+{
+  auto cf = get_cf_handle(prefix);
+  if (cf) {
+    logger->inc(l_rocksdb_compact_range);
+    rocksdb::CompactRangeOptions options;
+    db->CompactRange(options, cf, nullptr, nullptr);
+  } else {
+    compact_range(prefix, past_prefix(prefix));
+  }
+}
+
+void RocksDBStore::compact_range(const string& prefix,
+				 const string& start, const string& end)
+{
+  auto cf = get_cf_handle(prefix);
+  if (cf) {
+    logger->inc(l_rocksdb_compact_range);
+    rocksdb::CompactRangeOptions options;
+    rocksdb::Slice cstart(start);
+    rocksdb::Slice cend(end);
+    db->CompactRange(options, cf, &cstart, &cend);
+  } else {
+    compact_range(combine_strings(prefix, start),
+		  combine_strings(prefix, end));
+  }
+}
+
 void RocksDBStore::compact_thread_entry()
 {
   compact_queue_lock.Lock();
@@ -1242,11 +1474,109 @@ bool RocksDBStore::check_omap_dir(string &omap_dir)
 void RocksDBStore::compact_range(const string& start, const string& end)
 {
   rocksdb::CompactRangeOptions options;
+  if (!cf_handles.empty()) {
+    // queued ranges are combined keys; a prefix with a column family of
+    // its own is compacted there, up to end or the end of the family
+    string prefix, kstart;
+    if (split_key(start, &prefix, &kstart) < 0) {
+      prefix = start;
+      kstart.clear();
+    }
+    auto cf = get_cf_handle(prefix);
+    if (cf) {
+      string eprefix, kend;
+      bool bounded = split_key(end, &eprefix, &kend) == 0 && eprefix == prefix;
+      rocksdb::Slice cstart(kstart);
+      rocksdb::Slice cend(kend);
+      db->CompactRange(options, cf, &cstart, bounded ? &cend : nullptr);
+      return;
+    }
+  }
   rocksdb::Slice cstart(start);
   rocksdb::Slice cend(end);
   db->CompactRange(options, &cstart, &cend);
 }
 
+void RocksDBStore::note_tombstones(const string& prefix,
+				   const tombstone_range_t *deletes,
+				   const tombstone_range_t *skips)
+{
+  string start, end;
+  uint64_t count;
+  {
+    std::lock_guard<std::mutex> l(tombstone_lock);
+    auto& t = tombstones[prefix];
+    if (deletes) {
+      t.first.merge(*deletes);
+    }
+    if (skips) {
+      t.second.merge(*skips);
+    }
+    tombstone_range_t *hot = nullptr;
+    if (tombstone_compact_deletes &&
+	t.first.count >= tombstone_compact_deletes) {
+      hot = &t.first;
+    } else if (tombstone_compact_skips &&
+	       t.second.count >= tombstone_compact_skips) {
+      hot = &t.second;
+    }
+    if (!hot) {
+      return;
+    }
+    auto now = ceph::coarse_mono_clock::now();
+    if (last_tombstone_compact != ceph::coarse_mono_time() &&
+	now - last_tombstone_compact <
+	  ceph::make_timespan(tombstone_compact_interval)) {
+      // keep accumulating; the range is compacted once the interval passed
+      logger->inc(l_rocksdb_tombstone_compact_throttled);
+      return;
+    }
+    last_tombstone_compact = now;
+    start = combine_strings(prefix, hot->first);
+    end = hot->last.empty() ?
+      past_prefix(prefix) : combine_strings(prefix, hot->last);
+    count = hot->count;
+    *hot = tombstone_range_t();
+  }
+  dout(10) << __func__ << " " << count << " tombstones in prefix " << prefix
+	   << ", compacting " << RocksWBHandler::pretty_binary_string(start)
+	   << " to " << RocksWBHandler::pretty_binary_string(end) << dendl;
+  logger->inc(l_rocksdb_tombstone_compact);
+  compact_range_async(start, end);
+}
+
+void RocksDBStore::note_iterator_skips(const string& prefix,
+				       const string& from,
+				       rocksdb::Iterator *it,
+				       bool combined_keys,
+				       uint64_t skips_base)
+{
+  uint64_t now = rocksdb::get_perf_context()->internal_delete_skipped_count;
+  // the thread's perf context may have been reset since the seek
+  uint64_t skipped = now >= skips_base ? now - skips_base : now;
+  if (!skipped) {
+    return;
+  }
+  logger->inc(l_rocksdb_iter_tombstone_skips, skipped);
+
+  // the tombstones lie between the seek and where the iterator stopped
+  string to;
+  if (it->Valid()) {
+    if (combined_keys) {
+      string p, k;
+      if (split_key(it->key(), &p, &k) == 0 && p == prefix) {
+	to = k;
+      }
+    } else {
+      to = it->key().ToString();
+    }
+  }
+  tombstone_range_t r;
+  r.count = skipped;
+  r.extend(from, to);
+  note_tombstones(prefix, nullptr, &r);
+}
+
 int64_t RocksDBStore::request_cache_bytes(PriorityCache::Priority pri, uint64_t chunk_bytes) const
 {
   auto cache = bbt_opts.block_cache;
@@ -1318,16 +1648,39 @@ int64_t RocksDBStore::get_cache_capacity() {
 
 RocksDBStore::RocksDBWholeSpaceIteratorImpl::~RocksDBWholeSpaceIteratorImpl()
 {
+  if (seeked) {
+    store->note_iterator_skips(seek_prefix, seek_key, dbiter, true,
+			       skips_base);
+  }
   delete dbiter;
 }
+void RocksDBStore::RocksDBWholeSpaceIteratorImpl::note_seek(
+  const string& prefix, const string& key)
+{
+  if (!store) {
+    return;
+  }
+  // account what was skipped since the previous seek before moving on;
+  // seeks that are not within a prefix are not tracked
+  if (seeked) {
+    store->note_iterator_skips(seek_prefix, seek_key, dbiter, true,
+			       skips_base);
+  }
+  seeked = !prefix.empty();
+  seek_prefix = prefix;
+  seek_key = key;
+  skips_base = rocksdb::get_perf_context()->internal_delete_skipped_count;
+}
 int RocksDBStore::RocksDBWholeSpaceIteratorImpl::seek_to_first()
 {
+  note_seek(string(), string());
   dbiter->SeekToFirst();
   assert(!dbiter->status().IsIOError());
   return dbiter->status().ok() ? 0 : -1;
 }
 int RocksDBStore::RocksDBWholeSpaceIteratorImpl::seek_to_first(const string &prefix)
 {
+  note_seek(prefix, string());
   rocksdb::Slice slice_prefix(prefix);
   dbiter->Seek(slice_prefix);
   assert(!dbiter->status().IsIOError());
@@ -1335,12 +1688,14 @@ int RocksDBStore::RocksDBWholeSpaceIteratorImpl::seek_to_first(const string &pre
 }
 int RocksDBStore::RocksDBWholeSpaceIteratorImpl::seek_to_last()
 {
+  note_seek(string(), string());
   dbiter->SeekToLast();
   assert(!dbiter->status().IsIOError());
   return dbiter->status().ok() ? 0 : -1;
 }
 int RocksDBStore::RocksDBWholeSpaceIteratorImpl::seek_to_last(const string &prefix)
 {
+  note_seek(string(), string());
   string limit = past_prefix(prefix);
   rocksdb::Slice slice_limit(limit);
   dbiter->Seek(slice_limit);
@@ -1364,6 +1719,7 @@ int RocksDBStore::RocksDBWholeSpaceIteratorImpl::upper_bound(const string &prefi
 }
 int RocksDBStore::RocksDBWholeSpaceIteratorImpl::lower_bound(const string &prefix, const string &to)
 {
+  note_seek(prefix, to);
   string bound = combine_strings(prefix, to);
   rocksdb::Slice slice_bound(bound);
   dbiter->Seek(slice_bound);
@@ -1445,29 +1801,64 @@ string RocksDBStore::past_prefix(const string &prefix)
   return limit;
 }
 
+RocksDBStore *RocksDBStore::track_iterator_skips()
+{
+  if (!tombstone_compact_skips) {
+    return nullptr;
+  }
+  // rocksdb only counts skipped tombstones at kEnableCount and up
+  if (rocksdb::GetPerfLevel() < rocksdb::PerfLevel::kEnableCount) {
+    rocksdb::SetPerfLevel(rocksdb::PerfLevel::kEnableCount);
+  }
+  return this;
+}
+
 RocksDBStore::WholeSpaceIterator RocksDBStore::get_wholespace_iterator()
 {
   return std::make_shared<RocksDBWholeSpaceIteratorImpl>(
-    db->NewIterator(rocksdb::ReadOptions(), default_cf));
+    db->NewIterator(rocksdb::ReadOptions(), default_cf),
+    track_iterator_skips());
 }
 
 class CFIteratorImpl : public KeyValueDB::IteratorImpl {
 protected:
   string prefix;
   rocksdb::Iterator *dbiter;
+  RocksDBStore *store;   ///< non-null if skipped tombstones are tracked
+  bool seeked = false;
+  string seek_key;
+  uint64_t skips_base = 0;
+
+  void note_seek(bool tracked, const string& key) {
+    if (!store) {
+      return;
+    }
+    if (seeked) {
+      store->note_iterator_skips(prefix, seek_key, dbiter, false, skips_base);
+    }
+    seeked = tracked;
+    seek_key = key;
+    skips_base = rocksdb::get_perf_context()->internal_delete_skipped_count;
+  }
 public:
   explicit CFIteratorImpl(const std::string& p,
-				 rocksdb::Iterator *iter)
-    : prefix(p), dbiter(iter) { }
+			  rocksdb::Iterator *iter,
+			  RocksDBStore *s = nullptr)
+    : prefix(p), dbiter(iter), store(s) { }
   ~CFIteratorImpl() {
+    if (seeked) {
+      store->note_iterator_skips(prefix, seek_key, dbiter, false, skips_base);
+    }
     delete dbiter;
   }
 
   int seek_to_first() override {
+    note_seek(true, string());
     dbiter->SeekToFirst();
     return dbiter->status().ok() ? 0 : -1;
   }
   int seek_to_last() override {
+    note_seek(false, string());
     dbiter->SeekToLast();
     return dbiter->status().ok() ? 0 : -1;
   }
@@ -1479,6 +1870,7 @@ public:
     return dbiter->status().ok() ? 0 : -1;
   }
   int lower_bound(const string &to) override {
+    note_seek(true, to);
     rocksdb::Slice slice_bound(to);
     dbiter->Seek(slice_bound);
     return dbiter->status().ok() ? 0 : -1;
@@ -1523,7 +1915,8 @@ KeyValueDB::Iterator RocksDBStore::get_iterator(const std::string& prefix)
   if (cf_handle) {
     return std::make_shared<CFIteratorImpl>(
       prefix,
-      db->NewIterator(rocksdb::ReadOptions(), cf_handle));
+      db->NewIterator(rocksdb::ReadOptions(), cf_handle),
+      track_iterator_skips());
   } else {
     return KeyValueDB::get_iterator(prefix);
   }
@@ -10,6 +10,7 @@
 #include <map>
 #include <string>
 #include <memory>
+#include <mutex>
 #include <boost/scoped_ptr.hpp>
 #include "rocksdb/write_batch.h"
 #include "rocksdb/perf_context.h"
@@ -23,6 +24,7 @@
 #include "common/Formatter.h"
 #include "common/Cond.h"
 #include "common/ceph_context.h"
+#include "common/ceph_time.h"
 #include "common/PriorityCache.h"
 
 class PerfCounters;
@@ -43,9 +45,24 @@ enum {
   l_rocksdb_write_memtable_time,
   l_rocksdb_write_delay_time,
   l_rocksdb_write_pre_and_post_process_time,
+  l_rocksdb_iter_tombstone_skips,
+  l_rocksdb_tombstone_compact,
+  l_rocksdb_tombstone_compact_throttled,
   l_rocksdb_last,
 };
 
+// one set per column family, named rocksdb_cf_<name>
+enum {
+  l_rocksdb_cf_first = 34500,  // after l_kinetic_*
+  l_rocksdb_cf_flushes,
+  l_rocksdb_cf_flush_bytes,
+  l_rocksdb_cf_compactions,
+  l_rocksdb_cf_compaction_read_bytes,
+  l_rocksdb_cf_compaction_write_bytes,
+  l_rocksdb_cf_write_amp_pct,
+  l_rocksdb_cf_last,
+};
+
 namespace rocksdb{
   class DB;
   class Env;
@@ -86,6 +103,9 @@ class RocksDBStore : public KeyValueDB {
   bool must_close_default_cf = false;
   rocksdb::ColumnFamilyHandle *default_cf = nullptr;
 
+  class CFStatsListener;
+  std::shared_ptr<CFStatsListener> cf_stats;  ///< per-CF perf counters
+
   int submit_common(rocksdb::WriteOptions& woptions, KeyValueDB::Transaction t);
   int install_cf_mergeop(const string &cf_name, rocksdb::ColumnFamilyOptions *cf_opt);
   int create_db_dir();
@@ -115,6 +135,40 @@ class RocksDBStore : public KeyValueDB {
   void compact_range_async(const string& start, const string& end);
 
 public:
+  /// deletions and skipped tombstones seen in a prefix, and where
+  struct tombstone_range_t {
+    uint64_t count = 0;
+    bool any = false;
+    string first;     ///< lowest key involved
+    string last;      ///< highest key involved; empty for the prefix end
+
+    void extend(const string& lo, const string& hi) {
+      if (!any) {
+	first = lo;
+	last = hi;
+	any = true;
+      } else {
+	if (lo < first) {
+	  first = lo;
+	}
+	if (last.empty() || hi.empty()) {
+	  last.clear();
+	} else if (hi > last) {
+	  last = hi;
+	}
+      }
+      if (!last.empty() && last < first) {
+	std::swap(first, last);
+      }
+    }
+    void merge(const tombstone_range_t& o) {
+      if (o.any) {
+	count += o.count;
+	extend(o.first, o.last);
+      }
+    }
+  };
+
   /// compact the underlying rocksdb store
   bool compact_on_mount;
   bool disableWAL;
@@ -122,6 +176,28 @@ public:
   void compact() override;
   int64_t high_pri_watermark;
 
+private:
+  // automatic compaction of ranges full of tombstones
+  const uint64_t tombstone_compact_deletes;
+  const uint64_t tombstone_compact_skips;
+  const double tombstone_compact_interval;
+  std::mutex tombstone_lock;
+  /// prefix -> (deletions, iterator skips) since the last compaction
+  std::map<string, std::pair<tombstone_range_t,tombstone_range_t>> tombstones;
+  ceph::coarse_mono_time last_tombstone_compact;
+
+  void note_tombstones(const string& prefix,
+		       const tombstone_range_t *deletes,
+		       const tombstone_range_t *skips);
+
+public:
+  /// this store if iterators should report skipped tombstones, else null
+  RocksDBStore *track_iterator_skips();
+  /// account the tombstones an iterator stepped over since its last seek
+  void note_iterator_skips(const string& prefix, const string& from,
+			   rocksdb::Iterator *it, bool combined_keys,
+			   uint64_t skips_base);
+
   void compact_async() override {
     compact_range_async(string(), string());
   }
@@ -131,16 +207,12 @@ public:
   static int _test_init(const string& dir);
   int init(string options_str) override;
   /// compact rocksdb for all keys with a given prefix
-  void compact_prefix(const string& prefix) override {
-    compact_range(prefix, past_prefix(prefix));
-  }
+  void compact_prefix(const string& prefix) override;
   void compact_prefix_async(const string& prefix) override {
     compact_range_async(prefix, past_prefix(prefix));
   }
 
-  void compact_range(const string& prefix, const string& start, const string& end) override {
-    compact_range(combine_strings(prefix, start), combine_strings(prefix, end));
-  }
+  void compact_range(const string& prefix, const string& start, const string& end) override;
   void compact_range_async(const string& prefix, const string& start, const string& end) override {
     compact_range_async(combine_strings(prefix, start), combine_strings(prefix, end));
   }
@@ -160,7 +232,13 @@ public:
     compact_on_mount(false),
     disableWAL(false),
     enable_rmrange(cct->_conf->rocksdb_enable_rmrange),
-    high_pri_watermark(0)
+    high_pri_watermark(0),
+    tombstone_compact_deletes(
+      cct->_conf.get_val<uint64_t>("rocksdb_tombstone_compact_deletes")),
+    tombstone_compact_skips(
+      cct->_conf.get_val<uint64_t>("rocksdb_tombstone_compact_skips")),
+    tombstone_compact_interval(
+      cct->_conf.get_val<double>("rocksdb_tombstone_compact_interval"))
   {}
 
   ~RocksDBStore() override;
@@ -176,6 +254,9 @@ public:
 
   void close() override;
 
+  int migrate_prefixes_to_cfs(const vector<ColumnFamily>& cfs,
+			      ostream &out) override;
+
   rocksdb::ColumnFamilyHandle *get_cf_handle(const std::string& cf_name) {
     auto iter = cf_handles.find(cf_name);
     if (iter == cf_handles.end())
@@ -287,6 +368,8 @@ public:
   public:
     rocksdb::WriteBatch bat;
     RocksDBStore *db;
+    /// keys deleted per prefix, if tombstones are tracked
+    std::map<string, tombstone_range_t> deletes;
 
     explicit RocksDBTransactionImpl(RocksDBStore *_db);
   private:
@@ -326,6 +409,17 @@ public:
       const string& prefix,
       const string& k,
       const bufferlist &bl) override;
+
+  private:
+    /// callers check db->tombstone_compact_deletes first, so the
+    /// bookkeeping (and the key copies it may need) costs nothing when
+    /// tombstone compaction is off
+    void note_delete(const string& prefix, const string& lo,
+		     const string& hi, uint64_t n) {
+      auto& r = deletes[prefix];
+      r.count += n;
+      r.extend(lo, hi);
+    }
   };
 
   KeyValueDB::Transaction get_transaction() override {
@@ -355,9 +449,17 @@ public:
     public KeyValueDB::WholeSpaceIteratorImpl {
   protected:
     rocksdb::Iterator *dbiter;
+    RocksDBStore *store;       ///< non-null if skipped tombstones are tracked
+    bool seeked = false;
+    string seek_prefix;        ///< prefix and key of the last seek
+    string seek_key;
+    uint64_t skips_base = 0;   ///< thread's skip count at the last seek
+
+    void note_seek(const string& prefix, const string& key);
   public:
-    explicit RocksDBWholeSpaceIteratorImpl(rocksdb::Iterator *iter) :
-      dbiter(iter) { }
+    explicit RocksDBWholeSpaceIteratorImpl(rocksdb::Iterator *iter,
+					   RocksDBStore *s = nullptr) :
+      dbiter(iter), store(s) { }
     //virtual ~RocksDBWholeSpaceIteratorImpl() { }
     ~RocksDBWholeSpaceIteratorImpl() override;
 
@@ -29,7 +29,7 @@
 #define dout_prefix *_dout << "-- " << msgr->get_myaddrs() << " "
 
 double DispatchQueue::get_max_age(utime_t now) const {
-  Mutex::Locker l(lock);
+  Mutex::Locker l(arrival_lock);
   if (marrival.empty())
     return 0;
   else
@@ -79,22 +79,80 @@ void DispatchQueue::fast_preprocess(Message *m)
 
 void DispatchQueue::enqueue(Message *m, int priority, uint64_t id)
 {
-
-  Mutex::Locker l(lock);
   if (stop) {
     m->put();
     return;
   }
   ldout(cct,20) << "queue " << m << " prio " << priority << dendl;
-  add_arrival(m);
-  if (priority >= CEPH_MSG_PRIO_LOW) {
-    mqueue.enqueue_strict(
-        id, priority, QueueItem(m));
-  } else {
-    mqueue.enqueue(
-        id, priority, m->get_cost(), QueueItem(m));
+  _push(QueueItem(m, id), priority, m->get_cost(), false);
+}
+
+void DispatchQueue::_push(QueueItem&& item, int priority, unsigned cost,
+			  bool discard)
+{
+  if (!discard)
+    ++queue_len;
+  inbox.push(std::move(item), priority, cost, discard);
+  // pairs with the check in entry() before it goes to sleep
+  if (sleeping) {
+    Mutex::Locker l(lock);
+    cond.Signal();
   }
-  cond.Signal();
+}
+
+/*
+ * Move everything producers queued into mqueue, in the order they queued
+ * it, and apply discards on the way.  Dispatch thread only.
+ */
+void DispatchQueue::_drain_inbox(set<uint64_t> *discarded)
+{
+  inbox.consume([this, discarded](InboxItem&& i) {
+      if (i.discard) {
+	_discard(i.item.get_id());
+	if (discarded)
+	  discarded->insert(i.item.get_id());
+	return;
+      }
+      if (!i.item.is_code())
+	add_arrival(i.item.get_message());
+      uint64_t id = i.item.get_id();
+      if (i.priority >= CEPH_MSG_PRIO_LOW) {
+	mqueue.enqueue_strict(id, i.priority, std::move(i.item));
+      } else {
+	mqueue.enqueue(id, i.priority, i.cost, std::move(i.item));
+      }
+    });
+}
+
+void DispatchQueue::_discard(uint64_t id)
+{
+  list<QueueItem> removed;
+  mqueue.remove_by_class(id, &removed);
+  for (list<QueueItem>::iterator i = removed.begin();
+       i != removed.end();
+       ++i) {
+    assert(!(i->is_code())); // We don't discard id 0, ever!
+    Message *m = i->get_message();
+    remove_arrival(m);
+    dispatch_throttle_release(m->get_dispatch_throttle_size());
+    m->put();
+    --queue_len;
+  }
+}
+
+/// drop what was queued after the dispatch thread stopped
+void DispatchQueue::_discard_inbox()
+{
+  inbox.consume([this](InboxItem&& i) {
+      if (i.discard)
+	return;
+      if (!i.item.is_code()) {
+	Message *m = i.item.get_message();
+	dispatch_throttle_release(m->get_dispatch_throttle_size());
+	m->put();
+      }
+      --queue_len;
+    });
 }
 
 void DispatchQueue::local_delivery(Message *m, int priority)
@@ -154,13 +212,27 @@ void DispatchQueue::dispatch_throttle_release(uint64_t msize)
  */
 void DispatchQueue::entry()
 {
-  lock.Lock();
   while (true) {
+    _drain_inbox(nullptr);
     while (!mqueue.empty()) {
       QueueItem qitem = mqueue.dequeue();
+      if (!inbox.empty()) {
+	// take in what arrived meanwhile; a discard of this item's
+	// connection must win, as it would have before the dequeue
+	set<uint64_t> discarded;
+	_drain_inbox(&discarded);
+	if (!qitem.is_code() && discarded.count(qitem.get_id())) {
+	  Message *m = qitem.get_message();
+	  remove_arrival(m);
+	  dispatch_throttle_release(m->get_dispatch_throttle_size());
+	  m->put();
+	  --queue_len;
+	  continue;
+	}
+      }
       if (!qitem.is_code())
 	remove_arrival(qitem.get_message());
-      lock.Unlock();
+      --queue_len;
 
       if (qitem.is_code()) {
 	if (cct->_conf->ms_inject_internal_delays &&
@@ -203,30 +275,25 @@ void DispatchQueue::entry()
 	}
       }
 
-      lock.Lock();
+      if (!inbox.empty())
+	_drain_inbox(nullptr);
     }
     if (stop)
       break;
 
-    // wait for something to be put on queue
-    cond.Wait(lock);
+    // wait for something to be put on queue; a producer that pushes
+    // after we looked at the inbox sees sleeping set and wakes us
+    lock.Lock();
+    sleeping = true;
+    if (inbox.empty() && !stop)
+      cond.Wait(lock);
+    sleeping = false;
+    lock.Unlock();
   }
-  lock.Unlock();
 }
 
 void DispatchQueue::discard_queue(uint64_t id) {
-  Mutex::Locker l(lock);
-  list<QueueItem> removed;
-  mqueue.remove_by_class(id, &removed);
-  for (list<QueueItem>::iterator i = removed.begin();
-       i != removed.end();
-       ++i) {
-    assert(!(i->is_code())); // We don't discard id 0, ever!
-    Message *m = i->get_message();
-    remove_arrival(m);
-    dispatch_throttle_release(m->get_dispatch_throttle_size());
-    m->put();
-  }
+  _push(QueueItem(nullptr, id), 0, 0, true);
 }
 
 void DispatchQueue::start()
@@ -241,6 +308,7 @@ void DispatchQueue::wait()
 {
   local_delivery_thread.join();
   dispatch_thread.join();
+  _discard_inbox();
 }
 
 void DispatchQueue::discard_local()
@@ -263,8 +331,8 @@ void DispatchQueue::shutdown()
   local_delivery_lock.Unlock();
 
   // stop my dispatch thread
-  lock.Lock();
   stop = true;
+  lock.Lock();
   cond.Signal();
   lock.Unlock();
 }
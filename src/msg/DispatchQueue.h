@@ -24,6 +24,7 @@
 #include "common/Mutex.h"
 #include "common/Cond.h"
 #include "common/Thread.h"
+#include "common/MPSCQueue.h"
 #include "common/PrioritizedQueue.h"
 
 class CephContext;
@@ -36,15 +37,21 @@ struct Connection;
  * they want to be dispatched, carefully organized by Message priority
  * and permitted to deliver in a round-robin fashion.
  * See Messenger::dispatch_entry for details.
+ *
+ * Producers never take a lock: they push onto a lock-free inbox, and the
+ * dispatch thread moves whole batches of it into its own priority queue
+ * before every dequeue.  Discards travel through the inbox as well, so
+ * they apply to exactly what the connection queued before them.
  */
 class DispatchQueue {
   class QueueItem {
     int type;
+    uint64_t id;
     ConnectionRef con;
     MessageRef m;
   public:
-    explicit QueueItem(Message *m) : type(-1), con(0), m(m) {}
-    QueueItem(int type, Connection *con) : type(type), con(con), m(0) {}
+    QueueItem(Message *m, uint64_t id) : type(-1), id(id), con(0), m(m) {}
+    QueueItem(int type, Connection *con) : type(type), id(0), con(con), m(0) {}
     bool is_code() const {
       return type != -1;
     }
@@ -52,6 +59,9 @@ class DispatchQueue {
       assert(is_code());
       return type;
     }
+    uint64_t get_id() const {
+      return id;
+    }
     Message *get_message() {
       assert(!is_code());
       return m.get();
@@ -61,17 +71,36 @@ class DispatchQueue {
       return con.get();
     }
   };
-    
+
+  /// what producers hand over to the dispatch thread
+  struct InboxItem {
+    QueueItem item;
+    int priority;
+    unsigned cost;
+    bool discard;   ///< drop what item's id queued so far instead
+
+    InboxItem(QueueItem&& item, int priority, unsigned cost, bool discard)
+      : item(std::move(item)), priority(priority), cost(cost),
+	discard(discard) {}
+  };
+
   CephContext *cct;
   Messenger *msgr;
-  mutable Mutex lock;
+  Mutex lock;      ///< only for putting the dispatch thread to sleep
   Cond cond;
+  std::atomic<bool> sleeping = { false };
+
+  MPSCQueue<InboxItem> inbox;
+  std::atomic<int> queue_len = { 0 };  ///< queued items, inbox included
 
+  /// only touched by the dispatch thread
   PrioritizedQueue<QueueItem, uint64_t> mqueue;
 
+  mutable Mutex arrival_lock;  ///< protects marrival and marrival_map
   set<pair<double, Message*> > marrival;
   map<Message *, set<pair<double, Message*> >::iterator> marrival_map;
   void add_arrival(Message *m) {
+    Mutex::Locker l(arrival_lock);
     marrival_map.insert(
       make_pair(
 	m,
@@ -80,6 +109,7 @@ class DispatchQueue {
       );
   }
   void remove_arrival(Message *m) {
+    Mutex::Locker l(arrival_lock);
     map<Message *, set<pair<double, Message*> >::iterator>::iterator i =
       marrival_map.find(m);
     assert(i != marrival_map.end());
@@ -121,20 +151,29 @@ class DispatchQueue {
   uint64_t pre_dispatch(Message *m);
   void post_dispatch(Message *m, uint64_t msize);
 
+  void _push(QueueItem&& item, int priority, unsigned cost, bool discard);
+  void _drain_inbox(set<uint64_t> *discarded);
+  void _discard(uint64_t id);
+  void _discard_inbox();
+  void _queue_code(int code, Connection *con) {
+    if (stop)
+      return;
+    _push(QueueItem(code, con), CEPH_MSG_PRIO_HIGHEST, 0, false);
+  }
+
  public:
 
   /// Throttle preventing us from building up a big backlog waiting for dispatch
   Throttle dispatch_throttler;
 
-  bool stop;
+  std::atomic<bool> stop;
   void local_delivery(Message *m, int priority);
   void run_local_delivery();
 
   double get_max_age(utime_t now) const;
 
   int get_queue_len() const {
-    Mutex::Locker l(lock);
-    return mqueue.length();
+    return queue_len;
   }
 
   /**
@@ -145,54 +184,19 @@ class DispatchQueue {
   void dispatch_throttle_release(uint64_t msize);
 
   void queue_connect(Connection *con) {
-    Mutex::Locker l(lock);
-    if (stop)
-      return;
-    mqueue.enqueue_strict(
-      0,
-      CEPH_MSG_PRIO_HIGHEST,
-      QueueItem(D_CONNECT, con));
-    cond.Signal();
+    _queue_code(D_CONNECT, con);
   }
   void queue_accept(Connection *con) {
-    Mutex::Locker l(lock);
-    if (stop)
-      return;
-    mqueue.enqueue_strict(
-      0,
-      CEPH_MSG_PRIO_HIGHEST,
-      QueueItem(D_ACCEPT, con));
-    cond.Signal();
+    _queue_code(D_ACCEPT, con);
   }
   void queue_remote_reset(Connection *con) {
-    Mutex::Locker l(lock);
-    if (stop)
-      return;
-    mqueue.enqueue_strict(
-      0,
-      CEPH_MSG_PRIO_HIGHEST,
-      QueueItem(D_BAD_REMOTE_RESET, con));
-    cond.Signal();
+    _queue_code(D_BAD_REMOTE_RESET, con);
   }
   void queue_reset(Connection *con) {
-    Mutex::Locker l(lock);
-    if (stop)
-      return;
-    mqueue.enqueue_strict(
-      0,
-      CEPH_MSG_PRIO_HIGHEST,
-      QueueItem(D_BAD_RESET, con));
-    cond.Signal();
+    _queue_code(D_BAD_RESET, con);
   }
   void queue_refused(Connection *con) {
-    Mutex::Locker l(lock);
-    if (stop)
-      return;
-    mqueue.enqueue_strict(
-      0,
-      CEPH_MSG_PRIO_HIGHEST,
-      QueueItem(D_CONN_REFUSED, con));
-    cond.Signal();
+    _queue_code(D_CONN_REFUSED, con);
   }
 
   bool can_fast_dispatch(const Message *m) const;
@@ -215,6 +219,7 @@ class DispatchQueue {
       lock("Messenger::DispatchQueue::lock" + name),
       mqueue(cct->_conf->ms_pq_max_tokens_per_priority,
 	     cct->_conf->ms_pq_min_cost),
+      arrival_lock("Messenger::DispatchQueue::arrival_lock" + name),
       next_id(1),
       dispatch_thread(this),
       local_delivery_lock("Messenger::DispatchQueue::local_delivery_lock" + name),
@@ -225,6 +230,7 @@ class DispatchQueue {
       stop(false)
     {}
   ~DispatchQueue() {
+    _discard_inbox();
     assert(mqueue.empty());
     assert(marrival.empty());
     assert(local_messages.empty());
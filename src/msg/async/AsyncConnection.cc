@@ -17,8 +17,10 @@
 #include <unistd.h>
 
 #include "include/Context.h"
+#include "include/buffer_raw.h"
 #include "include/random.h"
 #include "common/errno.h"
+#include "common/AlignedBufferPool.h"
 #include "AsyncMessenger.h"
 #include "AsyncConnection.h"
 
@@ -100,7 +102,18 @@ class C_tick_wakeup : public EventCallback {
   }
 };
 
-static void alloc_aligned_buffer(bufferlist& data, unsigned len, unsigned off)
+class C_flush_batch : public EventCallback {
+  AsyncConnectionRef conn;
+
+ public:
+  explicit C_flush_batch(AsyncConnectionRef c): conn(c) {}
+  void do_request(uint64_t id) override {
+    conn->flush_batch(id);
+  }
+};
+
+static void alloc_aligned_buffer(AlignedBufferPool& pool, bufferlist& data,
+				 unsigned len, unsigned off)
 {
   // create a buffer to read into that matches the data alignment
   unsigned alloc_len = 0;
@@ -113,7 +126,7 @@ static void alloc_aligned_buffer(bufferlist& data, unsigned len, unsigned off)
     left -= head;
   }
   alloc_len += left;
-  bufferptr ptr(buffer::create_page_aligned(alloc_len));
+  bufferptr ptr(pool.create(alloc_len));
   if (head)
     ptr.set_offset(CEPH_PAGE_SIZE - head);
   data.push_back(std::move(ptr));
@@ -123,15 +136,19 @@ AsyncConnection::AsyncConnection(
   CephContext *cct, AsyncMessenger *m, DispatchQueue *q,
   Worker *w, bool m2)
   : Connection(cct, m), delay_state(NULL), async_msgr(m), conn_id(q->get_id()),
-    logger(w->get_perf_counter()), global_seq(0), connect_seq(0), peer_global_seq(0),
+    logger(w->get_perf_counter()), buffer_pool(AlignedBufferPool::get(cct)),
+    global_seq(0), connect_seq(0), peer_global_seq(0),
     state(STATE_NONE), state_after_send(STATE_NONE), port(-1),
     dispatch_queue(q), can_write(WriteStatus::NOWRITE),
     keepalive(false), recv_buf(NULL),
     recv_max_prefetch(std::max<int64_t>(msgr->cct->_conf->ms_tcp_prefetch_max_size, TCP_PREFETCH_MIN_SIZE)),
     recv_start(0), recv_end(0),
+    send_batch_bytes(cct->_conf.get_val<uint64_t>("ms_async_send_batch_bytes")),
+    send_flush_window_us(
+      cct->_conf.get_val<uint64_t>("ms_async_send_flush_window_us")),
     last_active(ceph::coarse_mono_clock::now()),
     inactive_timeout_us(cct->_conf->ms_tcp_read_timeout*1000*1000),
-    msg_left(0), cur_msg_size(0), got_bad_auth(false),
+    msg_left(0), data_direct(false), data_crc(0), cur_msg_size(0), got_bad_auth(false),
     authorizer(NULL),
     msgr2(m2), replacing(false),
     is_reset_from_peer(false), once_ready(false), state_buffer(NULL), state_offset(0),
@@ -141,6 +158,7 @@ AsyncConnection::AsyncConnection(
   write_handler = new C_handle_write(this);
   wakeup_handler = new C_time_wakeup(this);
   tick_handler = new C_tick_wakeup(this);
+  flush_handler = new C_flush_batch(this);
   // double recv_max_prefetch see "read_until"
   recv_buf = new char[2*recv_max_prefetch];
   state_buffer = new char[4096];
@@ -212,11 +230,22 @@ ssize_t AsyncConnection::_try_send(bool more)
   }
 
   assert(center->in_thread());
+  if (flush_event_id) {
+    // whatever was held back goes out now
+    center->delete_time_event(flush_event_id);
+    flush_event_id = 0;
+  }
+  flush_due = false;
   ssize_t r = cs.send(outcoming_bl, more);
   if (r < 0) {
     ldout(async_msgr->cct, 1) << __func__ << " send error: " << cpp_strerror(r) << dendl;
     return r;
   }
+  logger->inc(l_msgr_send_bytes, r);
+  if (batch_messages) {
+    logger->inc(l_msgr_send_messages_per_syscall, batch_messages);
+    batch_messages = 0;
+  }
 
   ldout(async_msgr->cct, 10) << __func__ << " sent bytes " << r
                              << " remaining bytes " << outcoming_bl.length() << dendl;
@@ -243,9 +272,13 @@ ssize_t AsyncConnection::_try_send(bool more)
 // And it will uses readahead method to reduce small read overhead,
 // "recv_buf" is used to store read buffer
 //
+// Pieces of a large data segment are read straight into the (page aligned)
+// data buffer even when they are small, so that only what was already
+// prefetched along with the header gets copied; those copies are counted.
+//
 // return the remaining bytes, 0 means this buffer is finished
 // else return < 0 means error
-ssize_t AsyncConnection::read_until(unsigned len, char *p)
+ssize_t AsyncConnection::read_until(unsigned len, char *p, bool data_segment)
 {
   ldout(async_msgr->cct, 25) << __func__ << " len is " << len << " state_offset is "
                              << state_offset << dendl;
@@ -263,6 +296,8 @@ ssize_t AsyncConnection::read_until(unsigned len, char *p)
     uint64_t to_read = std::min<uint64_t>(recv_end - recv_start, left);
     memcpy(p, recv_buf+recv_start, to_read);
     recv_start += to_read;
+    if (data_segment)
+      logger->inc(l_msgr_recv_copied_bytes, to_read);
     left -= to_read;
     ldout(async_msgr->cct, 25) << __func__ << " got " << to_read << " in buffer "
                                << " left is " << left << " buffer still has "
@@ -275,7 +310,7 @@ ssize_t AsyncConnection::read_until(unsigned len, char *p)
 
   recv_end = recv_start = 0;
   /* nothing left in the prefetch buffer */
-  if (len > recv_max_prefetch) {
+  if (len > recv_max_prefetch || (data_segment && data_direct)) {
     /* this was a large read, we don't prefetch for these */
     do {
       r = read_bulk(p+state_offset, left);
@@ -303,12 +338,16 @@ ssize_t AsyncConnection::read_until(unsigned len, char *p)
       if (r >= static_cast<int>(left)) {
         recv_start = len - state_offset;
         memcpy(p+state_offset, recv_buf, recv_start);
+        if (data_segment)
+          logger->inc(l_msgr_recv_copied_bytes, recv_start);
         state_offset = 0;
         return 0;
       }
       left -= r;
     } while (r > 0);
     memcpy(p+state_offset, recv_buf, recv_end-recv_start);
+    if (data_segment)
+      logger->inc(l_msgr_recv_copied_bytes, recv_end - recv_start);
     state_offset += (recv_end - recv_start);
     recv_end = recv_start = 0;
   }
@@ -607,16 +646,20 @@ void AsyncConnection::process()
               data_buf = p->second.first;
               // make sure it's big enough
               if (data_buf.length() < data_len)
-                data_buf.push_back(buffer::create(data_len - data_buf.length()));
+                data_buf.push_back(buffer_pool.create(data_len - data_buf.length()));
               data_blp = data_buf.begin();
             } else {
               ldout(async_msgr->cct,20) << __func__ << " allocating new rx buffer at offset " << data_off << dendl;
-              alloc_aligned_buffer(data_buf, data_len, data_off);
+              alloc_aligned_buffer(buffer_pool, data_buf, data_len, data_off);
               data_blp = data_buf.begin();
             }
           }
 
           msg_left = data_len;
+          // decide for the whole segment: a short head piece must not pull
+          // the rest of the payload through the prefetch buffer
+          data_direct = data_len > recv_max_prefetch;
+          data_crc = 0;
           state = STATE_OPEN_MESSAGE_READ_DATA;
         }
 
@@ -625,7 +668,7 @@ void AsyncConnection::process()
           while (msg_left > 0) {
             bufferptr bp = data_blp.get_current_ptr();
             unsigned read = std::min(bp.length(), msg_left);
-            r = read_until(read, bp.c_str());
+            r = read_until(read, bp.c_str(), true);
             if (r < 0) {
               ldout(async_msgr->cct, 1) << __func__ << " read data error " << dendl;
               goto fail;
@@ -633,6 +676,16 @@ void AsyncConnection::process()
               break;
             }
 
+            if (async_msgr->crcflags & MSG_CRC_DATA) {
+              // checksum each piece while it is still in cache and leave the
+              // result in the crc cache of its raw, where decode_message()
+              // and later consumers of the data (e.g. BlueStore csum) find it
+              uint32_t base = data_crc;
+              data_crc = ceph_crc32c(base, (unsigned char*)bp.c_str(), read);
+              bp.get_raw()->set_crc(
+                make_pair(bp.offset(), bp.offset() + read),
+                make_pair(base, data_crc));
+            }
             data_blp.advance(read);
             data.append(bp, 0, read);
             msg_left -= read;
@@ -2264,6 +2317,7 @@ ssize_t AsyncConnection::write_message(Message *m, bufferlist& bl, bool more)
     for (const auto &pb : bl.buffers()) {
       outcoming_bl.append((char*)pb.c_str(), pb.length());
     }
+    logger->inc(l_msgr_send_copied_bytes, bl.length());
   } else {
     outcoming_bl.claim_append(bl);  
   }
@@ -2285,17 +2339,26 @@ ssize_t AsyncConnection::write_message(Message *m, bufferlist& bl, bool more)
     outcoming_bl.append((char*)&old_footer, sizeof(old_footer));
   }
 
+  ++batch_messages;
   m->trace.event("async writing message");
   ldout(async_msgr->cct, 20) << __func__ << " sending " << m->get_seq()
                              << " " << m << dendl;
-  ssize_t total_send_size = outcoming_bl.length();
-  ssize_t rc = _try_send(more);
-  if (rc < 0) {
-    ldout(async_msgr->cct, 1) << __func__ << " error sending " << m << ", "
-                              << cpp_strerror(rc) << dendl;
+  ssize_t rc = 0;
+  if (outcoming_bl.length() < send_batch_bytes &&
+      outcoming_bl.buffers().size() < ASYNC_IOV_MAX) {
+    // gather; handle_write sends the batch with one syscall once the
+    // queue is drained
+    ldout(async_msgr->cct, 20) << __func__ << " batched " << m << ", "
+                               << batch_messages << " messages "
+                               << outcoming_bl.length() << " bytes" << dendl;
   } else {
-    logger->inc(l_msgr_send_bytes, total_send_size - outcoming_bl.length());
-    ldout(async_msgr->cct, 10) << __func__ << " sending " << m << (rc ? " continuely." :" done.") << dendl;
+    rc = _try_send(more);
+    if (rc < 0) {
+      ldout(async_msgr->cct, 1) << __func__ << " error sending " << m << ", "
+                                << cpp_strerror(rc) << dendl;
+    } else {
+      ldout(async_msgr->cct, 10) << __func__ << " sending " << m << (rc ? " continuely." :" done.") << dendl;
+    }
   }
   if (m->get_type() == CEPH_MSG_OSD_OP)
     OID_EVENT_TRACE_WITH_MSG(m, "SEND_MSG_OSD_OP_END", false);
@@ -2444,6 +2507,32 @@ void AsyncConnection::_append_keepalive_or_ack(bool ack, utime_t *tp)
   }
 }
 
+// whether to keep a small batch of messages back for a moment, hoping
+// more will be queued and go out with the same syscall
+bool AsyncConnection::_hold_batch()
+{
+  if (!send_flush_window_us || !batch_messages || flush_due ||
+      outcoming_bl.length() >= send_batch_bytes) {
+    return false;
+  }
+  if (!flush_event_id) {
+    flush_event_id = center->create_time_event(send_flush_window_us,
+					       flush_handler);
+  }
+  return true;
+}
+
+// the flush window of a held batch is over: send it, whether or not
+// anything was queued meanwhile
+void AsyncConnection::flush_batch(uint64_t id)
+{
+  ldout(async_msgr->cct, 20) << __func__ << " id=" << id << dendl;
+  // fired, so the center has already dropped it
+  flush_event_id = 0;
+  flush_due = true;
+  handle_write();
+}
+
 void AsyncConnection::handle_write()
 {
   ldout(async_msgr->cct, 10) << __func__ << dendl;
@@ -2501,6 +2590,9 @@ void AsyncConnection::handle_write()
 	ack_left -= left;
 	left = ack_left;
 	r = _try_send(left);
+      } else if (_hold_batch()) {
+	ldout(async_msgr->cct, 20) << __func__ << " holding " << batch_messages
+				   << " messages for more" << dendl;
       } else if (is_queued()) {
 	r = _try_send();
       }
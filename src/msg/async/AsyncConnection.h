@@ -34,6 +34,7 @@
 #include "Event.h"
 #include "Stack.h"
 
+class AlignedBufferPool;
 class AsyncMessenger;
 class Worker;
 
@@ -58,7 +59,7 @@ class AsyncConnection : public Connection {
   ssize_t _try_send(bool more=false);
   ssize_t _send(Message *m);
   void prepare_send_message(uint64_t features, Message *m, bufferlist &bl);
-  ssize_t read_until(unsigned needed, char *p);
+  ssize_t read_until(unsigned needed, char *p, bool data_segment=false);
   ssize_t _process_connection();
   void _connect();
   void _stop();
@@ -73,6 +74,7 @@ class AsyncConnection : public Connection {
   void handle_ack(uint64_t seq);
   void _append_keepalive_or_ack(bool ack=false, utime_t *t=NULL);
   ssize_t write_message(Message *m, bufferlist& bl, bool more);
+  bool _hold_batch();
   void inject_delay();
   ssize_t _reply_accept(char tag, ceph_msg_connect &connect, ceph_msg_connect_reply &reply,
                     bufferlist &authorizer_reply) {
@@ -104,6 +106,10 @@ class AsyncConnection : public Connection {
       center->delete_time_event(last_tick_id);
       last_tick_id = 0;
     }
+    if (flush_event_id) {
+      center->delete_time_event(flush_event_id);
+      flush_event_id = 0;
+    }
     if (cs) {
       center->delete_file_event(cs.fd(), EVENT_READABLE|EVENT_WRITABLE);
       cs.shutdown();
@@ -294,6 +300,7 @@ class AsyncConnection : public Connection {
   AsyncMessenger *async_msgr;
   uint64_t conn_id;
   PerfCounters *logger;
+  AlignedBufferPool& buffer_pool;  ///< supplies page aligned rx data buffers
   int global_seq;
   __u32 connect_seq, peer_global_seq;
   std::atomic<uint64_t> out_seq{0};
@@ -309,6 +316,12 @@ class AsyncConnection : public Connection {
   // lockfree, only used in own thread
   bufferlist outcoming_bl;
   bool open_write = false;
+  // outgoing messages are gathered into outcoming_bl and sent together
+  const uint64_t send_batch_bytes;
+  const uint64_t send_flush_window_us;
+  unsigned batch_messages = 0;       ///< messages in outcoming_bl
+  uint64_t flush_event_id = 0;       ///< fires when a held batch must go
+  bool flush_due = false;            ///< flush window over, send the batch
 
   std::mutex write_lock;
   enum class WriteStatus {
@@ -328,6 +341,7 @@ class AsyncConnection : public Connection {
   EventCallbackRef write_handler;
   EventCallbackRef wakeup_handler;
   EventCallbackRef tick_handler;
+  EventCallbackRef flush_handler;
   char *recv_buf;
   uint32_t recv_max_prefetch;
   uint32_t recv_start;
@@ -343,6 +357,8 @@ class AsyncConnection : public Connection {
   utime_t recv_stamp;
   utime_t throttle_stamp;
   unsigned msg_left;
+  bool data_direct;  ///< read the data segment around the prefetch buffer
+  uint32_t data_crc; ///< crc32c of the data read so far
   uint64_t cur_msg_size;
   ceph_msg_header current_header;
   bufferlist data_buf;
@@ -383,6 +399,7 @@ class AsyncConnection : public Connection {
   void process();
   void wakeup_from(uint64_t id);
   void tick(uint64_t id);
+  void flush_batch(uint64_t id);
   void local_deliver();
   void stop(bool queue_reset) {
     lock.lock();
@@ -398,6 +415,7 @@ class AsyncConnection : public Connection {
     delete write_handler;
     delete wakeup_handler;
     delete tick_handler;
+    delete flush_handler;
     if (delay_state) {
       delete delay_state;
       delay_state = NULL;
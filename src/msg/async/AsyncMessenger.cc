@@ -61,7 +61,8 @@ Processor::Processor(AsyncMessenger *r, Worker *w, CephContext *c)
 
 int Processor::bind(const entity_addrvec_t &bind_addrs,
 		    const set<int>& avoid_ports,
-		    entity_addrvec_t* bound_addrs)
+		    entity_addrvec_t* bound_addrs,
+		    bool sibling)
 {
   const auto& conf = msgr->cct->_conf;
   // bind to socket(s)
@@ -70,6 +71,7 @@ int Processor::bind(const entity_addrvec_t &bind_addrs,
   SocketOptions opts;
   opts.nodelay = msgr->cct->_conf->ms_tcp_nodelay;
   opts.rcbuf_size = msgr->cct->_conf->ms_tcp_rcvbuf;
+  opts.sibling_listener = sibling;
 
   listen_sockets.resize(bind_addrs.v.size());
   *bound_addrs = bind_addrs;
@@ -381,7 +383,9 @@ int AsyncMessenger::bindv(const entity_addrvec_t &bind_addrs)
   entity_addrvec_t bound_addrs;
   unsigned i = 0;
   for (auto &&p : processors) {
-    int r = p->bind(bind_addrs, avoid_ports, &bound_addrs);
+    // later processors listen on whatever port the first one picked
+    entity_addrvec_t addrs = i ? bound_addrs : bind_addrs;
+    int r = p->bind(addrs, avoid_ports, &bound_addrs, i > 0);
     if (r) {
       // Note: this is related to local tcp listen table problem.
       // Posix(default kernel implementation) backend shares listen table
@@ -426,7 +430,8 @@ int AsyncMessenger::rebind(const set<int>& avoid_ports)
 		 << " and avoid ports " << new_avoid << dendl;
   unsigned i = 0;
   for (auto &&p : processors) {
-    int r = p->bind(bind_addrs, avoid_ports, &bound_addrs);
+    entity_addrvec_t addrs = i ? bound_addrs : bind_addrs;
+    int r = p->bind(addrs, avoid_ports, &bound_addrs, i > 0);
     if (r) {
       assert(i == 0);
       return r;
@@ -59,7 +59,8 @@ class Processor {
   void stop();
   int bind(const entity_addrvec_t &bind_addrs,
 	   const set<int>& avoid_ports,
-	   entity_addrvec_t* bound_addrs);
+	   entity_addrvec_t* bound_addrs,
+	   bool sibling = false);
   void start();
   void accept();
 };
@@ -137,6 +137,11 @@ int EventCenter::init(int n, unsigned i, const std::string &t)
   file_events.resize(n);
   nevent = n;
 
+  poll_max_us = cct->_conf.get_val<uint64_t>("ms_async_busy_poll_us");
+  poll_budget_us = poll_max_us;
+  poll_adaptive = poll_max_us &&
+    cct->_conf.get_val<bool>("ms_async_busy_poll_adaptive");
+
   if (!driver->need_wakeup())
     return 0;
 
@@ -394,9 +399,39 @@ int EventCenter::process_events(unsigned timeout_microseconds,  ceph::timespan *
     tv.tv_usec = timeout_microseconds % 1000000;
   }
 
-  ldout(cct, 30) << __func__ << " wait second " << tv.tv_sec << " usec " << tv.tv_usec << dendl;
   vector<FiredFileEvent> fired_events;
-  numevents = driver->event_wait(fired_events, &tv);
+  numevents = 0;
+  bool spun = false;
+  if (blocking && poll_budget_us) {
+    // spin a while first: a sleeping thread takes tens of microseconds
+    // to wake up, longer than many ops take to serve
+    auto spin_start = ceph::mono_clock::now();
+    numevents = busy_poll(fired_events, timeout_microseconds);
+    auto spin_dur = ceph::mono_clock::now() - spin_start;
+    poll_stats.spin_time += spin_dur;
+    if (numevents || external_num_events.load()) {
+      ++poll_stats.spin_hits;
+      spun = true;
+      blocking = false;
+    } else {
+      ++poll_stats.spin_misses;
+      unsigned spun_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        spin_dur).count();
+      timeout_microseconds -= std::min(timeout_microseconds, spun_us);
+      tv.tv_sec = timeout_microseconds / 1000000;
+      tv.tv_usec = timeout_microseconds % 1000000;
+    }
+  }
+  if (blocking) {
+    ldout(cct, 30) << __func__ << " wait second " << tv.tv_sec << " usec " << tv.tv_usec << dendl;
+    ++poll_stats.sleeps;
+    auto sleep_start = ceph::mono_clock::now();
+    numevents = driver->event_wait(fired_events, &tv);
+    if (poll_adaptive)
+      adapt_poll_budget(ceph::mono_clock::now() - sleep_start);
+  } else if (!spun) {
+    numevents = driver->event_wait(fired_events, &tv);
+  }
   auto working_start = ceph::mono_clock::now();
   for (int j = 0; j < numevents; j++) {
     int rfired = 0;
@@ -451,6 +486,47 @@ int EventCenter::process_events(unsigned timeout_microseconds,  ceph::timespan *
   return numevents;
 }
 
+/*
+ * Spin on non-blocking waits until an event fires, an external event is
+ * queued or the budget runs out.  Timers are left to the caller, so the
+ * spin ends no later than timeout_us.
+ */
+int EventCenter::busy_poll(vector<FiredFileEvent> &fired_events,
+                           unsigned timeout_us)
+{
+  auto deadline = ceph::mono_clock::now() +
+    std::chrono::microseconds(std::min(poll_budget_us, timeout_us));
+  struct timeval zero = {0, 0};
+  int numevents;
+  polling = true;
+  do {
+    numevents = driver->event_wait(fired_events, &zero);
+  } while (!numevents && !external_num_events.load() &&
+           ceph::mono_clock::now() < deadline);
+  // dispatch_event_external() skips the wakeup while we spin; the caller
+  // looks at external_num_events again before it sleeps
+  polling = false;
+  return numevents;
+}
+
+/*
+ * Grow the spin when events keep arriving within the longest spin after
+ * we went to sleep, so spinning would have caught them; shrink it when
+ * the sleeps are longer, as the spinning is then wasted.
+ */
+void EventCenter::adapt_poll_budget(ceph::timespan slept)
+{
+  unsigned min_us = std::max(1u, poll_max_us / 8);
+  if (slept < std::chrono::microseconds(poll_max_us)) {
+    poll_budget_us = std::min(poll_max_us,
+                              poll_budget_us ? poll_budget_us * 2 : min_us);
+  } else {
+    poll_budget_us /= 2;
+    if (poll_budget_us < min_us)
+      poll_budget_us = 0;
+  }
+}
+
 void EventCenter::dispatch_event_external(EventCallbackRef e)
 {
   external_lock.lock();
@@ -458,7 +534,7 @@ void EventCenter::dispatch_event_external(EventCallbackRef e)
   bool wake = !external_num_events.load();
   uint64_t num = ++external_num_events;
   external_lock.unlock();
-  if (!in_thread() && wake)
+  if (!in_thread() && wake && !polling.load())
     wakeup();
 
   ldout(cct, 30) << __func__ << " " << e << " pending " << num << dendl;
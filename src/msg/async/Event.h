@@ -175,7 +175,16 @@ class EventCenter {
   unsigned idx;
   AssociatedCenters *global_centers = nullptr;
 
+  // busy polling (ms_async_busy_poll_us)
+  unsigned poll_max_us = 0;        ///< longest spin before sleeping
+  unsigned poll_budget_us = 0;     ///< current spin, adapted to the event rate
+  bool poll_adaptive = false;
+  /// set while the owner spins, so external events needn't wake it
+  std::atomic<bool> polling = { false };
+
   int process_time_events();
+  int busy_poll(vector<FiredFileEvent> &fired_events, unsigned timeout_us);
+  void adapt_poll_budget(ceph::timespan slept);
   FileEvent *_get_file_event(int fd) {
     assert(fd < nevent);
     return &file_events[fd];
@@ -206,6 +215,15 @@ class EventCenter {
   int process_events(unsigned timeout_microseconds, ceph::timespan *working_dur = nullptr);
   void wakeup();
 
+  /// how process_events waited; the owner collects and resets these
+  struct PollStats {
+    uint64_t spin_hits = 0;        ///< spins that found work
+    uint64_t spin_misses = 0;      ///< spins that gave up and slept
+    uint64_t sleeps = 0;           ///< blocking waits
+    ceph::timespan spin_time = ceph::timespan::zero();
+  } poll_stats;
+  unsigned get_poll_budget() const { return poll_budget_us; }
+
   // Used by external thread
   void dispatch_event_external(EventCallbackRef e);
   inline bool in_thread() const {
@@ -19,8 +19,12 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <errno.h>
+#ifdef __linux__
+#include <linux/errqueue.h>
+#endif
 
 #include <algorithm>
+#include <deque>
 
 #include "PosixStack.h"
 
@@ -36,15 +40,33 @@
 #undef dout_prefix
 #define dout_prefix *_dout << "PosixStack "
 
+#if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+#define HAVE_MSG_ZEROCOPY
+#endif
+
 class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
+  CephContext *cct;
   NetHandler &handler;
   int _fd;
   entity_addr_t sa;
   bool connected;
 
+  // MSG_ZEROCOPY: the kernel reads sent buffers after sendmsg() returns, so
+  // they are pinned here until the error queue reports their completion.
+  // Every zero copy sendmsg() that sends something gets the next sequence
+  // number; zc_pending holds the last number of each send() with what it sent.
+  uint64_t zc_min_bytes = 0;   ///< 0 if disabled or unsupported
+  bool zc_enabled = false;     ///< SO_ZEROCOPY is set on _fd
+  uint32_t zc_next_seq = 0;
+  std::deque<std::pair<uint32_t, bufferlist>> zc_pending;
+
  public:
-  explicit PosixConnectedSocketImpl(NetHandler &h, const entity_addr_t &sa, int f, bool connected)
-      : handler(h), _fd(f), sa(sa), connected(connected) {}
+  PosixConnectedSocketImpl(CephContext *cct, NetHandler &h, const entity_addr_t &sa, int f, bool connected)
+      : cct(cct), handler(h), _fd(f), sa(sa), connected(connected) {
+#ifdef HAVE_MSG_ZEROCOPY
+    zc_min_bytes = cct->_conf.get_val<uint64_t>("ms_async_send_zerocopy_min_bytes");
+#endif
+  }
 
   int is_connected() override {
     if (connected)
@@ -69,18 +91,76 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
     ssize_t r = ::read(_fd, buf, len);
     if (r < 0)
       r = -errno;
+    // completions raise EPOLLERR, which wakes the reader
+    if (r == -EAGAIN && !zc_pending.empty())
+      reap_zerocopy();
     return r;
   }
 
+  // release the buffers of zero copy sends the kernel is done with
+  void reap_zerocopy() {
+#ifdef HAVE_MSG_ZEROCOPY
+    while (!zc_pending.empty()) {
+      char control[CMSG_SPACE(sizeof(struct sock_extended_err))];
+      struct msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+      if (::recvmsg(_fd, &msg, MSG_ERRQUEUE) < 0)
+        return;
+      for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm;
+           cm = CMSG_NXTHDR(&msg, cm)) {
+        auto serr = reinterpret_cast<struct sock_extended_err*>(CMSG_DATA(cm));
+        if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+          continue;
+        // [ee_info, ee_data] completed; TCP completes in order
+        uint32_t done = serr->ee_data;
+        while (!zc_pending.empty() &&
+               (int32_t)(zc_pending.front().first - done) <= 0) {
+          zc_pending.pop_front();
+        }
+        if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+          // the device could not do it; stop paying for the notifications
+          ldout(cct, 5) << __func__ << " kernel copied zero copy sends, "
+                                << "disabling MSG_ZEROCOPY on fd " << _fd << dendl;
+          zc_min_bytes = 0;
+        }
+      }
+    }
+#endif
+  }
+
+  bool use_zerocopy(unsigned len) {
+#ifdef HAVE_MSG_ZEROCOPY
+    if (!zc_min_bytes || len < zc_min_bytes)
+      return false;
+    if (!zc_enabled) {
+      int on = 1;
+      if (::setsockopt(_fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) < 0) {
+        ldout(cct, 5) << __func__ << " SO_ZEROCOPY not supported: "
+                              << cpp_strerror(errno) << dendl;
+        zc_min_bytes = 0;
+        return false;
+      }
+      zc_enabled = true;
+    }
+    return true;
+#else
+    return false;
+#endif
+  }
+
   // return the sent length
   // < 0 means error occurred
-  static ssize_t do_sendmsg(int fd, struct msghdr &msg, unsigned len, bool more)
+  // *calls counts the sendmsg() calls that sent something
+  static ssize_t do_sendmsg(int fd, struct msghdr &msg, unsigned len, bool more,
+                            int flags, uint32_t *calls)
   {
     size_t sent = 0;
     while (1) {
       MSGR_SIGPIPE_STOPPER;
       ssize_t r;
-      r = ::sendmsg(fd, &msg, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+      r = ::sendmsg(fd, &msg, MSG_NOSIGNAL | (more ? MSG_MORE : 0) | flags);
       if (r < 0) {
         if (errno == EINTR) {
           continue;
@@ -90,6 +170,7 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
         return -errno;
       }
 
+      ++*calls;
       sent += r;
       if (len == sent) break;
 
@@ -110,6 +191,14 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
   }
 
   ssize_t send(bufferlist &bl, bool more) override {
+    if (!zc_pending.empty())
+      reap_zerocopy();
+    int flags = 0;
+#ifdef HAVE_MSG_ZEROCOPY
+    if (use_zerocopy(bl.length()))
+      flags = MSG_ZEROCOPY;
+#endif
+    uint32_t calls = 0;
     size_t sent_bytes = 0;
     std::list<bufferptr>::const_iterator pb = bl.buffers().begin();
     uint64_t left_pbrs = bl.buffers().size();
@@ -128,7 +217,7 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
 	msglen += pb->length();
 	++pb;
       }
-      ssize_t r = do_sendmsg(_fd, msg, msglen, left_pbrs || more);
+      ssize_t r = do_sendmsg(_fd, msg, msglen, left_pbrs || more, flags, &calls);
       if (r < 0)
         return r;
 
@@ -145,7 +234,12 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
         bl.splice(sent_bytes, bl.length()-sent_bytes, &swapped);
         bl.swap(swapped);
       } else {
-        bl.clear();
+        bl.swap(swapped);
+      }
+      // "swapped" now holds what was sent
+      if (flags && calls) {
+        zc_next_seq += calls;
+        zc_pending.emplace_back(zc_next_seq - 1, std::move(swapped));
       }
     }
 
@@ -209,7 +303,7 @@ int PosixServerSocketImpl::accept(ConnectedSocket *sock, const SocketOptions &op
   out->set_sockaddr((sockaddr*)&ss);
   handler.set_priority(sd, opt.priority, out->get_family());
 
-  std::unique_ptr<PosixConnectedSocketImpl> csi(new PosixConnectedSocketImpl(handler, *out, sd, true));
+  std::unique_ptr<PosixConnectedSocketImpl> csi(new PosixConnectedSocketImpl(w->cct, handler, *out, sd, true));
   *sock = ConnectedSocket(std::move(csi));
   return 0;
 }
@@ -218,6 +312,18 @@ void PosixWorker::initialize()
 {
 }
 
+int PosixWorker::set_reuseport(int sd)
+{
+  int on = 1;
+  if (::setsockopt(sd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+    int r = -errno;
+    lderr(cct) << __func__ << " unable to set SO_REUSEPORT: "
+               << cpp_strerror(r) << dendl;
+    return r;
+  }
+  return 0;
+}
+
 int PosixWorker::listen(entity_addr_t &sa, const SocketOptions &opt,
                         ServerSocket *sock)
 {
@@ -226,7 +332,16 @@ int PosixWorker::listen(entity_addr_t &sa, const SocketOptions &opt,
     return -errno;
   }
 
-  int r = net.set_nonblock(listen_sd);
+  int r;
+  if (reuseport && opt.sibling_listener) {
+    r = set_reuseport(listen_sd);
+    if (r < 0) {
+      ::close(listen_sd);
+      return r;
+    }
+  }
+
+  r = net.set_nonblock(listen_sd);
   if (r < 0) {
     ::close(listen_sd);
     return -errno;
@@ -248,6 +363,16 @@ int PosixWorker::listen(entity_addr_t &sa, const SocketOptions &opt,
     return r;
   }
 
+  if (reuseport && !opt.sibling_listener) {
+    // the port was picked by a plain bind, so nobody else shares it;
+    // only now let our other workers join it
+    r = set_reuseport(listen_sd);
+    if (r < 0) {
+      ::close(listen_sd);
+      return r;
+    }
+  }
+
   r = ::listen(listen_sd, cct->_conf->ms_tcp_listen_backlog);
   if (r < 0) {
     r = -errno;
@@ -277,13 +402,17 @@ int PosixWorker::connect(const entity_addr_t &addr, const SocketOptions &opts, C
 
   net.set_priority(sd, opts.priority, addr.get_family());
   *socket = ConnectedSocket(
-      std::unique_ptr<PosixConnectedSocketImpl>(new PosixConnectedSocketImpl(net, addr, sd, !opts.nonblock)));
+      std::unique_ptr<PosixConnectedSocketImpl>(new PosixConnectedSocketImpl(cct, net, addr, sd, !opts.nonblock)));
   return 0;
 }
 
 PosixNetworkStack::PosixNetworkStack(CephContext *c, const string &t)
-    : NetworkStack(c, t)
+    : NetworkStack(c, t),
+      reuseport(c->_conf.get_val<bool>("ms_async_reuseport"))
 {
+  for (auto w : workers)
+    static_cast<PosixWorker*>(w)->reuseport = reuseport;
+
   vector<string> corestrs;
   get_str_vec(cct->_conf->ms_async_affinity_cores, corestrs);
   for (auto & corestr : corestrs) {
@@ -295,3 +424,24 @@ PosixNetworkStack::PosixNetworkStack(CephContext *c, const string &t)
       lderr(cct) << __func__ << " failed to parse " << corestr << " in " << cct->_conf->ms_async_affinity_cores << dendl;
   }
 }
+
+void PosixNetworkStack::spawn_worker(unsigned i, std::function<void ()> &&func)
+{
+  threads.resize(i+1);
+  threads[i] = std::thread(func);
+
+  int cpu = get_cpuid(i);
+  if (cpu < 0 || !cct->_conf->ms_async_set_affinity)
+    return;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  int r = pthread_setaffinity_np(threads[i].native_handle(), sizeof(set), &set);
+  if (r) {
+    lderr(cct) << __func__ << " failed to pin worker " << i << " to cpu "
+               << cpu << ": " << cpp_strerror(r) << dendl;
+  } else {
+    ldout(cct, 10) << __func__ << " worker " << i << " pinned to cpu " << cpu
+                   << dendl;
+  }
+}
@@ -27,7 +27,11 @@
 class PosixWorker : public Worker {
   NetHandler net;
   void initialize() override;
+  int set_reuseport(int sd);
  public:
+  // set by PosixNetworkStack, see support_local_listen_table()
+  bool reuseport = false;
+
   PosixWorker(CephContext *c, unsigned i)
       : Worker(c, i), net(c) {}
   int listen(entity_addr_t &sa, const SocketOptions &opt,
@@ -38,6 +42,7 @@ class PosixWorker : public Worker {
 class PosixNetworkStack : public NetworkStack {
   vector<int> coreids;
   vector<std::thread> threads;
+  bool reuseport;
 
  public:
   explicit PosixNetworkStack(CephContext *c, const string &t);
@@ -47,10 +52,8 @@ class PosixNetworkStack : public NetworkStack {
       return -1;
     return coreids[id % coreids.size()];
   }
-  void spawn_worker(unsigned i, std::function<void ()> &&func) override {
-    threads.resize(i+1);
-    threads[i] = std::thread(func);
-  }
+  bool support_local_listen_table() const override { return reuseport; }
+  void spawn_worker(unsigned i, std::function<void ()> &&func) override;
   void join_worker(unsigned i) override {
     assert(threads.size() > i && threads[i].joinable());
     threads[i].join();
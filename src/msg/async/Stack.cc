@@ -46,6 +46,8 @@ std::function<void ()> NetworkStack::add_thread(unsigned i)
       ldout(cct, 10) << __func__ << " starting" << dendl;
       w->initialize();
       w->init_done();
+      auto window_start = ceph::mono_clock::now();
+      ceph::timespan window_busy = ceph::timespan::zero();
       while (!w->done) {
         ldout(cct, 30) << __func__ << " calling event process" << dendl;
 
@@ -57,6 +59,27 @@ std::function<void ()> NetworkStack::add_thread(unsigned i)
           // TODO do something?
         }
         w->perf_logger->tinc(l_msgr_running_total_time, dur);
+
+        auto& ps = w->center.poll_stats;
+        if (ps.sleeps || ps.spin_hits || ps.spin_misses) {
+          w->perf_logger->inc(l_msgr_poll_spin_hits, ps.spin_hits);
+          w->perf_logger->inc(l_msgr_poll_spin_misses, ps.spin_misses);
+          w->perf_logger->inc(l_msgr_poll_sleeps, ps.sleeps);
+          w->perf_logger->tinc(l_msgr_poll_spin_time, ps.spin_time);
+          w->perf_logger->set(l_msgr_poll_budget, w->center.get_poll_budget());
+          ps = EventCenter::PollStats();
+        }
+
+        // an idle worker sleeps in process_events, so it may report late
+        window_busy += dur;
+        auto now = ceph::mono_clock::now();
+        auto elapsed = now - window_start;
+        if (elapsed >= std::chrono::seconds(1)) {
+          w->perf_logger->set(l_msgr_event_loop_utilization,
+                              100 * window_busy.count() / elapsed.count());
+          window_start = now;
+          window_busy = ceph::timespan::zero();
+        }
       }
       w->reset();
       w->destroy();
@@ -42,6 +42,8 @@ struct SocketOptions {
   int rcbuf_size = 0;
   int priority = -1;
   entity_addr_t connect_bind_addr;
+  // another listener of ours is already bound to the address
+  bool sibling_listener = false;
 };
 
 /// \cond internal
@@ -192,6 +194,9 @@ enum {
   l_msgr_send_messages,
   l_msgr_recv_bytes,
   l_msgr_send_bytes,
+  l_msgr_send_copied_bytes,
+  l_msgr_recv_copied_bytes,
+  l_msgr_send_messages_per_syscall,
   l_msgr_created_connections,
   l_msgr_active_connections,
 
@@ -199,6 +204,13 @@ enum {
   l_msgr_running_send_time,
   l_msgr_running_recv_time,
   l_msgr_running_fast_dispatch_time,
+  l_msgr_event_loop_utilization,
+
+  l_msgr_poll_spin_hits,
+  l_msgr_poll_spin_misses,
+  l_msgr_poll_sleeps,
+  l_msgr_poll_spin_time,
+  l_msgr_poll_budget,
 
   l_msgr_last,
 };
@@ -232,6 +244,9 @@ class Worker {
     plb.add_u64_counter(l_msgr_send_messages, "msgr_send_messages", "Network sent messages");
     plb.add_u64_counter(l_msgr_recv_bytes, "msgr_recv_bytes", "Network received bytes", NULL, 0, unit_t(UNIT_BYTES));
     plb.add_u64_counter(l_msgr_send_bytes, "msgr_send_bytes", "Network sent bytes", NULL, 0, unit_t(UNIT_BYTES));
+    plb.add_u64_counter(l_msgr_send_copied_bytes, "msgr_send_copied_bytes", "Message data bytes copied while coalescing for send", NULL, 0, unit_t(UNIT_BYTES));
+    plb.add_u64_counter(l_msgr_recv_copied_bytes, "msgr_recv_copied_bytes", "Message data bytes copied out of the receive prefetch buffer", NULL, 0, unit_t(UNIT_BYTES));
+    plb.add_u64_avg(l_msgr_send_messages_per_syscall, "msgr_send_messages_per_syscall", "Messages gathered into one socket send");
     plb.add_u64_counter(l_msgr_active_connections, "msgr_active_connections", "Active connection number");
     plb.add_u64_counter(l_msgr_created_connections, "msgr_created_connections", "Created connection number");
 
@@ -239,6 +254,13 @@ class Worker {
     plb.add_time(l_msgr_running_send_time, "msgr_running_send_time", "The total time of message sending");
     plb.add_time(l_msgr_running_recv_time, "msgr_running_recv_time", "The total time of message receiving");
     plb.add_time(l_msgr_running_fast_dispatch_time, "msgr_running_fast_dispatch_time", "The total time of fast dispatch");
+    plb.add_u64(l_msgr_event_loop_utilization, "msgr_event_loop_utilization", "Percentage of the last second the worker spent handling events");
+
+    plb.add_u64_counter(l_msgr_poll_spin_hits, "msgr_poll_spin_hits", "Busy polls that found events");
+    plb.add_u64_counter(l_msgr_poll_spin_misses, "msgr_poll_spin_misses", "Busy polls that found nothing and went to sleep");
+    plb.add_u64_counter(l_msgr_poll_sleeps, "msgr_poll_sleeps", "Blocking event waits");
+    plb.add_time(l_msgr_poll_spin_time, "msgr_poll_spin_time", "The total time of busy polling");
+    plb.add_u64(l_msgr_poll_budget, "msgr_poll_budget", "Microseconds the worker currently busy polls before sleeping");
 
     perf_logger = plb.create_perf_counters();
     cct->get_perfcounters_collection()->add(perf_logger);
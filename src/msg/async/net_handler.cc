@@ -118,6 +118,17 @@ int NetHandler::set_socket_options(int sd, bool nodelay, int size)
     }
   }
 
+#ifdef SO_BUSY_POLL
+  int busy_poll = cct->_conf.get_val<uint64_t>("ms_tcp_busy_poll_us");
+  if (busy_poll) {
+    r = ::setsockopt(sd, SOL_SOCKET, SO_BUSY_POLL, (void*)&busy_poll, sizeof(busy_poll));
+    if (r < 0) {
+      r = errno;
+      ldout(cct, 0) << "couldn't set SO_BUSY_POLL to " << busy_poll << ": " << cpp_strerror(r) << dendl;
+    }
+  }
+#endif
+
   // block ESIGPIPE
 #ifdef CEPH_USE_SO_NOSIGPIPE
   int val = 1;
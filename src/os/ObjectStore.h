@@ -1655,6 +1655,29 @@ public:
      bufferlist& bl,
      uint32_t op_flags = 0) = 0;
 
+  /**
+   * verify_csum -- check a byte range of an object against the
+   * checksums the store keeps for it, without returning the data
+   *
+   * @param cid collection for object
+   * @param oid oid of object
+   * @param offset location offset of first byte to be checked
+   * @param len number of bytes to be checked
+   * @param op_flags is CEPH_OSD_OP_FLAG_*
+   * @returns number of bytes checked on success, -EIO if the data does
+   *   not match its checksums, -EOPNOTSUPP if the store keeps no
+   *   checksums for (part of) the range or cannot check it in place
+   *   right now, or another negative error code.
+   */
+   virtual int verify_csum(
+     CollectionHandle &c,
+     const ghobject_t& oid,
+     uint64_t offset,
+     size_t len,
+     uint32_t op_flags = 0) {
+     return -EOPNOTSUPP;
+   }
+
   /**
    * fiemap -- get extent map of data of an object
    *
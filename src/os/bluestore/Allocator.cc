@@ -1,24 +1,129 @@
 // -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
 // vim: ts=8 sw=2 smarttab
 
+#include <cmath>
+
 #include "Allocator.h"
 #include "StupidAllocator.h"
 #include "BitmapAllocator.h"
+#include "AvlAllocator.h"
 #include "common/debug.h"
+#include "common/errno.h"
+#include "common/admin_socket.h"
+#include "common/Formatter.h"
 
 #define dout_subsys ceph_subsys_bluestore
 
+class Allocator::SocketHook : public AdminSocketHook {
+  Allocator *alloc;
+  AdminSocket *admin_socket;
+  std::string dump_command;
+  std::string score_command;
+
+public:
+  SocketHook(CephContext *cct, Allocator *alloc)
+    : alloc(alloc),
+      admin_socket(cct->get_admin_socket())
+  {
+    if (!admin_socket) {
+      return;
+    }
+    std::string command = "bluestore allocator dump " + alloc->get_name();
+    int r = admin_socket->register_command(command, command, this,
+					   "dump allocator free regions");
+    if (r == 0) {
+      dump_command = command;
+    } else {
+      ldout(cct, 1) << __func__ << " cannot register '" << command
+		    << "': " << cpp_strerror(r) << dendl;
+    }
+    command = "bluestore allocator score " + alloc->get_name();
+    r = admin_socket->register_command(command, command, this,
+				       "give score on allocator fragmentation"
+				       " (0-no fragmentation, 1-absolute"
+				       " fragmentation)");
+    if (r == 0) {
+      score_command = command;
+    } else {
+      ldout(cct, 1) << __func__ << " cannot register '" << command
+		    << "': " << cpp_strerror(r) << dendl;
+    }
+  }
+
+  ~SocketHook() override {
+    if (!dump_command.empty()) {
+      (void)admin_socket->unregister_command(dump_command);
+    }
+    if (!score_command.empty()) {
+      (void)admin_socket->unregister_command(score_command);
+    }
+  }
+
+  bool call(std::string_view command, const cmdmap_t& cmdmap,
+	    std::string_view format, bufferlist& out) override {
+    Formatter *f = Formatter::create(format, "json-pretty", "json-pretty");
+    if (command == dump_command) {
+      f->open_object_section("allocator_dump");
+      f->dump_unsigned("capacity", alloc->get_free());
+      f->open_array_section("extents");
+      alloc->foreach([f](uint64_t offset, uint64_t length) {
+	  f->open_object_section("free");
+	  char off_hex[30];
+	  char len_hex[30];
+	  snprintf(off_hex, sizeof(off_hex), "0x%" PRIx64, offset);
+	  snprintf(len_hex, sizeof(len_hex), "0x%" PRIx64, length);
+	  f->dump_string("offset", off_hex);
+	  f->dump_string("length", len_hex);
+	  f->close_section();
+	});
+      f->close_section();
+      f->close_section();
+    } else if (command == score_command) {
+      f->open_object_section("fragmentation_score");
+      f->dump_float("fragmentation_rating", alloc->get_fragmentation_score());
+      f->close_section();
+    } else {
+      delete f;
+      return false;
+    }
+    f->flush(out);
+    delete f;
+    return true;
+  }
+};
+
+Allocator::Allocator(const std::string& name)
+  : name(name)
+{
+}
+
+Allocator::~Allocator()
+{
+  delete asok_hook;
+}
+
 Allocator *Allocator::create(CephContext* cct, string type,
-                             int64_t size, int64_t block_size)
+                             int64_t size, int64_t block_size,
+			     const std::string& name)
 {
+  Allocator *alloc = nullptr;
   if (type == "stupid") {
-    return new StupidAllocator(cct);
+    alloc = new StupidAllocator(cct, name);
   } else if (type == "bitmap") {
-    return new BitmapAllocator(cct, size, block_size);
+    alloc = new BitmapAllocator(cct, size, block_size, name);
+  } else if (type == "avl") {
+    alloc = new AvlAllocator(cct, size, block_size, name);
+  } else {
+    lderr(cct) << "Allocator::" << __func__ << " unknown alloc type "
+	       << type << dendl;
+    return nullptr;
+  }
+  if (!name.empty()) {
+    // only hook up once fully constructed so the socket never sees a
+    // half-built allocator
+    alloc->asok_hook = new SocketHook(cct, alloc);
   }
-  lderr(cct) << "Allocator::" << __func__ << " unknown alloc type "
-	     << type << dendl;
-  return nullptr;
+  return alloc;
 }
 
 void Allocator::release(const PExtentVector& release_vec)
@@ -29,3 +134,25 @@ void Allocator::release(const PExtentVector& release_vec)
   }
   release(release_set);
 }
+
+double Allocator::get_fragmentation_score()
+{
+  // Every free chunk is valued as length^k with k slightly above 1, so
+  // that doubling a chunk makes each of its bytes ~10% more useful.  The
+  // score places the current layout between the ideal (one chunk holding
+  // all free space) and the worst case (free space in 1-byte pieces).
+  static const double k = 1.0 + std::log2(1.1);
+  double value = 0;
+  uint64_t total = 0;
+  foreach([&](uint64_t offset, uint64_t length) {
+      value += std::pow(double(length), k);
+      total += length;
+    });
+  if (total <= 1) {
+    return 0.0;
+  }
+  double ideal = std::pow(double(total), k);
+  double worst = double(total);
+  double score = (ideal - value) / (ideal - worst);
+  return std::min(1.0, std::max(0.0, score));
+}
@@ -12,13 +12,15 @@
 #ifndef CEPH_OS_BLUESTORE_ALLOCATOR_H
 #define CEPH_OS_BLUESTORE_ALLOCATOR_H
 
+#include <functional>
 #include <ostream>
 #include "include/assert.h"
 #include "os/bluestore/bluestore_types.h"
 
 class Allocator {
 public:
-  virtual ~Allocator() {}
+  explicit Allocator(const std::string& name);
+  virtual ~Allocator();
 
   /*
    * Allocate required number of blocks in n number of extents.
@@ -44,6 +46,9 @@ public:
   void release(const PExtentVector& release_set);
 
   virtual void dump() = 0;
+  /// call notify for every free extent, in no particular order
+  virtual void foreach(
+    std::function<void(uint64_t offset, uint64_t length)> notify) = 0;
 
   virtual void init_add_free(uint64_t offset, uint64_t length) = 0;
   virtual void init_rm_free(uint64_t offset, uint64_t length) = 0;
@@ -53,10 +58,30 @@ public:
   {
     return 0.0;
   }
+  /*
+   * Score free space layout independent of the allocation unit:
+   * 0.0 when all free space is one extent, approaching 1.0 as it is
+   * shredded into ever smaller pieces.  Computed from foreach().
+   */
+  double get_fragmentation_score();
 
   virtual void shutdown() = 0;
+
+  /*
+   * If name is non-empty the allocator is exposed through the admin
+   * socket as "bluestore allocator {dump,score} <name>".
+   */
   static Allocator *create(CephContext* cct, string type, int64_t size,
-			   int64_t block_size);
+			   int64_t block_size, const std::string& name = "");
+
+  const std::string& get_name() const {
+    return name;
+  }
+
+private:
+  class SocketHook;
+  SocketHook* asok_hook = nullptr;
+  std::string name;
 };
 
 #endif
@@ -0,0 +1,330 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "AvlAllocator.h"
+
+#include <limits>
+
+#include "common/debug.h"
+
+#define dout_context cct
+#define dout_subsys ceph_subsys_bluestore
+#undef dout_prefix
+#define dout_prefix *_dout << "avl 0x" << this << " "
+
+MEMPOOL_DEFINE_OBJECT_FACTORY(range_seg_t, range_seg_t, bluestore_alloc);
+
+namespace {
+  // a range tree lookup key; never linked into either tree
+  range_seg_t key(uint64_t start, uint64_t end) {
+    return range_seg_t{start, end};
+  }
+
+  struct dispose_rs {
+    void operator()(range_seg_t* p) {
+      delete p;
+    }
+  };
+}
+
+AvlAllocator::AvlAllocator(CephContext* cct,
+			   int64_t device_size,
+			   int64_t block_size,
+			   const std::string& name)
+  : Allocator(name),
+    cct(cct)
+{
+  ldout(cct, 10) << __func__ << " 0x" << std::hex << device_size << "/"
+		 << block_size << std::dec << dendl;
+}
+
+AvlAllocator::~AvlAllocator()
+{
+  _clear();
+}
+
+void AvlAllocator::_add_to_tree(uint64_t start, uint64_t size)
+{
+  assert(size != 0);
+
+  uint64_t end = start + size;
+
+  // first segment starting at or after end, and the one right before it
+  auto rs_after = range_tree.upper_bound(key(start, end));
+  auto rs_before = range_tree.end();
+  if (rs_after != range_tree.begin()) {
+    rs_before = std::prev(rs_after);
+    assert(rs_before->end <= start);
+  }
+
+  bool merge_before = (rs_before != range_tree.end() &&
+		       rs_before->end == start);
+  bool merge_after = (rs_after != range_tree.end() &&
+		      rs_after->start == end);
+
+  if (merge_before && merge_after) {
+    range_size_tree.erase(range_size_tree.iterator_to(*rs_before));
+    range_size_tree.erase(range_size_tree.iterator_to(*rs_after));
+    rs_before->end = rs_after->end;
+    range_tree.erase_and_dispose(rs_after, dispose_rs{});
+    range_size_tree.insert(*rs_before);
+  } else if (merge_before) {
+    range_size_tree.erase(range_size_tree.iterator_to(*rs_before));
+    rs_before->end = end;
+    range_size_tree.insert(*rs_before);
+  } else if (merge_after) {
+    range_size_tree.erase(range_size_tree.iterator_to(*rs_after));
+    rs_after->start = start;
+    range_size_tree.insert(*rs_after);
+  } else {
+    auto new_rs = new range_seg_t{start, end};
+    range_tree.insert_before(rs_after, *new_rs);
+    range_size_tree.insert(*new_rs);
+  }
+  num_free += size;
+}
+
+void AvlAllocator::_remove_from_tree(uint64_t start, uint64_t size)
+{
+  uint64_t end = start + size;
+
+  assert(size != 0);
+  assert(size <= num_free);
+
+  auto rs = range_tree.find(key(start, end));
+  /* Make sure we completely overlap with someone */
+  assert(rs != range_tree.end());
+  assert(rs->start <= start);
+  assert(rs->end >= end);
+
+  bool left_over = (rs->start != start);
+  bool right_over = (rs->end != end);
+
+  range_size_tree.erase(range_size_tree.iterator_to(*rs));
+
+  if (left_over && right_over) {
+    auto new_seg = new range_seg_t{end, rs->end};
+    rs->end = start;
+    range_tree.insert_before(std::next(rs), *new_seg);
+    range_size_tree.insert(*new_seg);
+    range_size_tree.insert(*rs);
+  } else if (left_over) {
+    rs->end = start;
+    range_size_tree.insert(*rs);
+  } else if (right_over) {
+    rs->start = end;
+    range_size_tree.insert(*rs);
+  } else {
+    range_tree.erase_and_dispose(rs, dispose_rs{});
+  }
+  assert(num_free >= size);
+  num_free -= size;
+}
+
+int AvlAllocator::_allocate(
+  uint64_t want,
+  uint64_t unit,
+  uint64_t hint,
+  uint64_t *offset,
+  uint64_t *length)
+{
+  want = std::max(want, unit);
+
+  // 1. keep going where the hint points, if that extent can take it all
+  auto h = range_tree.lower_bound(key(hint, hint + 1));
+  if (h != range_tree.end() && h->start <= hint) {
+    uint64_t off = p2roundup(hint, unit);
+    if (off + want <= h->end) {
+      *offset = off;
+      *length = want;
+      goto found;
+    }
+  }
+
+  // 2. best fit: the shortest extent that holds want once aligned
+  for (auto rs = range_size_tree.lower_bound(key(0, want));
+       rs != range_size_tree.end();
+       ++rs) {
+    uint64_t off = p2roundup(rs->start, unit);
+    if (off + want <= rs->end) {
+      *offset = off;
+      *length = want;
+      goto found;
+    }
+  }
+
+  // 3. nothing is large enough; take what we can from the largest extent
+  for (auto rs = range_size_tree.rbegin();
+       rs != range_size_tree.rend() && rs->length() >= unit;
+       ++rs) {
+    uint64_t off = p2roundup(rs->start, unit);
+    if (off < rs->end && rs->end - off >= unit) {
+      *offset = off;
+      *length = std::min(want, p2align(rs->end - off, unit));
+      goto found;
+    }
+  }
+  return -ENOSPC;
+
+ found:
+  if (cct->_conf->bluestore_debug_small_allocations) {
+    uint64_t max =
+      unit * (rand() % cct->_conf->bluestore_debug_small_allocations);
+    if (max && *length > max) {
+      ldout(cct, 10) << __func__ << " shortening allocation of 0x" << std::hex
+		     << *length << " -> 0x"
+		     << max << " due to debug_small_allocations" << std::dec
+		     << dendl;
+      *length = max;
+    }
+  }
+  _remove_from_tree(*offset, *length);
+  return 0;
+}
+
+int64_t AvlAllocator::allocate(
+  uint64_t want_size,
+  uint64_t alloc_unit,
+  uint64_t max_alloc_size,
+  int64_t hint,
+  PExtentVector *extents)
+{
+  ldout(cct, 10) << __func__ << " want_size 0x" << std::hex << want_size
+		 << " alloc_unit 0x" << alloc_unit
+		 << " max_alloc_size 0x" << max_alloc_size
+		 << " hint 0x" << hint
+		 << std::dec << dendl;
+  assert(isp2(alloc_unit));
+
+  if (max_alloc_size == 0) {
+    max_alloc_size = want_size;
+  }
+  // bluestore_pextent_t lengths are 32 bits wide
+  max_alloc_size = std::min<uint64_t>(
+    max_alloc_size,
+    p2align<uint64_t>(std::numeric_limits<uint32_t>::max(), alloc_unit));
+
+  std::lock_guard<std::mutex> l(lock);
+  if (!hint) {
+    hint = last_alloc;
+  }
+  uint64_t allocated_size = 0;
+  while (allocated_size < want_size) {
+    uint64_t offset, length;
+    int r = _allocate(std::min(max_alloc_size, want_size - allocated_size),
+		      alloc_unit, hint, &offset, &length);
+    if (r < 0) {
+      // Allocation failed.
+      break;
+    }
+    ldout(cct, 20) << __func__ << " got 0x" << std::hex << offset << "~"
+		   << length << std::dec << dendl;
+    if (!extents->empty() &&
+	extents->back().end() == offset &&
+	extents->back().length + length <= max_alloc_size) {
+      extents->back().length += length;
+    } else {
+      extents->emplace_back(offset, length);
+    }
+    allocated_size += length;
+    hint = offset + length;
+    last_alloc = hint;
+  }
+  if (allocated_size == 0) {
+    return -ENOSPC;
+  }
+  return allocated_size;
+}
+
+void AvlAllocator::release(const interval_set<uint64_t>& release_set)
+{
+  std::lock_guard<std::mutex> l(lock);
+  for (auto p = release_set.begin(); p != release_set.end(); ++p) {
+    const auto offset = p.get_start();
+    const auto length = p.get_len();
+    ldout(cct, 10) << __func__ << " 0x" << std::hex << offset << "~" << length
+		   << std::dec << dendl;
+    _add_to_tree(offset, length);
+  }
+}
+
+uint64_t AvlAllocator::get_free()
+{
+  std::lock_guard<std::mutex> l(lock);
+  return num_free;
+}
+
+double AvlAllocator::get_fragmentation(uint64_t alloc_unit)
+{
+  assert(alloc_unit);
+  uint64_t max_intervals = 0;
+  uint64_t intervals = 0;
+  {
+    std::lock_guard<std::mutex> l(lock);
+    max_intervals = num_free / alloc_unit;
+    intervals = range_tree.size();
+  }
+  ldout(cct, 30) << __func__ << " " << intervals << "/" << max_intervals
+		 << dendl;
+  if (!intervals || max_intervals <= 1) {
+    return 0.0;
+  }
+  // unaligned leftovers shorter than alloc_unit may outnumber the units
+  intervals = std::min(intervals, max_intervals);
+  return (double)(intervals - 1) / (max_intervals - 1);
+}
+
+void AvlAllocator::dump()
+{
+  std::lock_guard<std::mutex> l(lock);
+  ldout(cct, 0) << __func__ << " range_tree: " << range_tree.size()
+		<< " extents" << dendl;
+  for (auto& rs : range_tree) {
+    ldout(cct, 0) << __func__ << "  0x" << std::hex << rs.start << "~"
+		  << rs.length() << std::dec << dendl;
+  }
+  ldout(cct, 0) << __func__ << " range_size_tree:" << dendl;
+  for (auto& rs : range_size_tree) {
+    ldout(cct, 0) << __func__ << "  0x" << std::hex << rs.start << "~"
+		  << rs.length() << std::dec << dendl;
+  }
+}
+
+void AvlAllocator::foreach(
+  std::function<void(uint64_t offset, uint64_t length)> notify)
+{
+  std::lock_guard<std::mutex> l(lock);
+  for (auto& rs : range_tree) {
+    notify(rs.start, rs.length());
+  }
+}
+
+void AvlAllocator::init_add_free(uint64_t offset, uint64_t length)
+{
+  std::lock_guard<std::mutex> l(lock);
+  ldout(cct, 10) << __func__ << " 0x" << std::hex << offset << "~" << length
+		 << std::dec << dendl;
+  _add_to_tree(offset, length);
+}
+
+void AvlAllocator::init_rm_free(uint64_t offset, uint64_t length)
+{
+  std::lock_guard<std::mutex> l(lock);
+  ldout(cct, 10) << __func__ << " 0x" << std::hex << offset << "~" << length
+		 << std::dec << dendl;
+  _remove_from_tree(offset, length);
+}
+
+void AvlAllocator::_clear()
+{
+  range_size_tree.clear();
+  range_tree.clear_and_dispose(dispose_rs{});
+  num_free = 0;
+  last_alloc = 0;
+}
+
+void AvlAllocator::shutdown()
+{
+  std::lock_guard<std::mutex> l(lock);
+  _clear();
+}
@@ -17,7 +17,8 @@ class BitmapAllocator : public Allocator,
   CephContext* cct;
 
 public:
-  BitmapAllocator(CephContext* _cct, int64_t capacity, int64_t alloc_unit);
+  BitmapAllocator(CephContext* _cct, int64_t capacity, int64_t alloc_unit,
+		  const std::string& name = "");
   ~BitmapAllocator() override
   {
   }
@@ -38,6 +39,11 @@ public:
   void dump() override
   {
   }
+  void foreach(
+    std::function<void(uint64_t offset, uint64_t length)> notify) override
+  {
+    _foreach(notify);
+  }
   double get_fragmentation(uint64_t) override
   {
     return _get_fragmentation();
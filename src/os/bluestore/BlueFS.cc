@@ -118,6 +118,14 @@ void BlueFS::_init_logger()
   b.add_u64_counter(l_bluefs_bytes_written_slow, "bytes_written_slow",
 		    "Bytes written to WAL/SSTs at slow device", NULL,
 		    PerfCountersBuilder::PRIO_USEFUL, unit_t(UNIT_BYTES));
+  b.add_u64(l_bluefs_wal_log_bytes, "wal_log_bytes",
+	    "Size of the WAL metadata log",
+	    "wjln", PerfCountersBuilder::PRIO_USEFUL, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluefs_wal_logged_bytes, "wal_logged_bytes",
+		    "Bytes written to the WAL metadata log", NULL,
+		    PerfCountersBuilder::PRIO_USEFUL, unit_t(UNIT_BYTES));
+  b.add_time_avg(l_bluefs_wal_fsync_lat, "wal_fsync_lat",
+		 "Average fsync latency of WAL files journaled in the WAL log");
   logger = b.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
 }
@@ -395,14 +403,17 @@ void BlueFS::_init_alloc()
   dout(20) << __func__ << dendl;
   alloc.resize(MAX_BDEV);
   pending_release.resize(MAX_BDEV);
+  wal_pending_release.resize(MAX_BDEV);
   for (unsigned id = 0; id < bdev.size(); ++id) {
     if (!bdev[id]) {
       continue;
     }
     assert(bdev[id]->get_size());
+    static const char* devnames[] = {"wal", "db", "slow"};
+    std::string name = std::string("bluefs-") + devnames[id];
     alloc[id] = Allocator::create(cct, cct->_conf->bluefs_allocator,
 				  bdev[id]->get_size(),
-				  cct->_conf->bluefs_alloc_size);
+				  cct->_conf->bluefs_alloc_size, name);
     interval_set<uint64_t>& p = block_all[id];
     for (interval_set<uint64_t>::iterator q = p.begin(); q != p.end(); ++q) {
       alloc[id]->init_add_free(q.get_start(), q.get_len());
@@ -447,6 +458,15 @@ int BlueFS::mount()
     _stop_alloc();
     goto out;
   }
+  if (super.has_wal_log()) {
+    r = _replay_wal_log(false, false);
+    if (r < 0) {
+      derr << __func__ << " failed to replay wal log: " << cpp_strerror(r)
+	   << dendl;
+      _stop_alloc();
+      goto out;
+    }
+  }
 
   // init freelist
   for (auto& p : file_map) {
@@ -455,6 +475,11 @@ int BlueFS::mount()
       alloc[q.bdev]->init_rm_free(q.offset, q.length);
     }
   }
+  if (wal_log_writer) {
+    for (auto& q : wal_log_writer->file->fnode.extents) {
+      alloc[q.bdev]->init_rm_free(q.offset, q.length);
+    }
+  }
 
   // set up the log for future writes
   log_writer = _create_writer(_get_file(1));
@@ -465,6 +490,19 @@ int BlueFS::mount()
            << dendl;
 
   _init_logger();
+
+  if (cct->_conf.get_val<bool>("bluefs_wal_log")) {
+    if (!wal_log_writer) {
+      r = _open_wal_log();
+      if (r < 0) {
+	derr << __func__ << " failed to create wal log: " << cpp_strerror(r)
+	     << ", journaling WAL files in the main log" << dendl;
+      }
+    }
+  } else if (wal_log_writer) {
+    std::unique_lock<std::mutex> l(lock);
+    _retire_wal_log(l);
+  }
   return 0;
 
  out:
@@ -480,6 +518,12 @@ void BlueFS::umount()
 
   _close_writer(log_writer);
   log_writer = NULL;
+  if (wal_log_writer) {
+    _close_writer(wal_log_writer);
+    wal_log_writer = nullptr;
+  }
+  wal_log_fnodes.clear();
+  wal_log_seq = wal_log_seq_stable = 0;
 
   _stop_alloc();
   file_map.clear();
@@ -958,6 +1002,161 @@ int BlueFS::_replay(bool noop, bool to_stdout)
   return 0;
 }
 
+/*
+ * The wal log only ever carries op_file_update.  An update for ino 0
+ * extends the wal log itself; any other ino was linked through the main
+ * log, which has already been replayed, so a missing ino just means the
+ * file was removed later on.
+ */
+int BlueFS::_replay_wal_log(bool noop, bool to_stdout)
+{
+  dout(10) << __func__ << (noop ? " NO-OP" : "") << dendl;
+  uint64_t seq_last = 0;
+
+  FileRef wal_log_file = new File;
+  wal_log_file->fnode = super.wal_log_fnode;
+  dout(10) << __func__ << " wal_log_fnode " << super.wal_log_fnode << dendl;
+  if (unlikely(to_stdout)) {
+    std::cout << " wal_log_fnode " << super.wal_log_fnode << std::endl;
+  }
+
+  FileReader *log_reader = new FileReader(
+    wal_log_file, cct->_conf->bluefs_max_prefetch,
+    false,  // !random
+    true);  // ignore eof
+  while (true) {
+    assert((log_reader->buf.pos & ~super.block_mask()) == 0);
+    uint64_t pos = log_reader->buf.pos;
+    uint64_t read_pos = pos;
+    bufferlist bl;
+    {
+      int r = _read(log_reader, &log_reader->buf, read_pos, super.block_size,
+		    &bl, NULL);
+      if (r < (int)super.block_size) {
+	dout(10) << __func__ << " 0x" << std::hex << pos << std::dec
+		 << ": stop: end of wal log" << dendl;
+	break;
+      }
+      read_pos += r;
+    }
+    uint64_t more = 0;
+    uint64_t seq;
+    uuid_d uuid;
+    {
+      auto p = bl.cbegin();
+      __u8 a, b;
+      uint32_t len;
+      decode(a, p);
+      decode(b, p);
+      decode(len, p);
+      decode(uuid, p);
+      decode(seq, p);
+      if (len + 6 > bl.length()) {
+	more = round_up_to(len + 6 - bl.length(), super.block_size);
+      }
+    }
+    if (uuid != super.wal_log_uuid) {
+      dout(10) << __func__ << " 0x" << std::hex << pos << std::dec
+               << ": stop: uuid " << uuid << " != wal_log_uuid "
+	       << super.wal_log_uuid << dendl;
+      break;
+    }
+    // the first txn of each incarnation continues the previous seq
+    if (seq_last && seq != seq_last + 1) {
+      dout(10) << __func__ << " 0x" << std::hex << pos << std::dec
+               << ": stop: seq " << seq << " != expected " << seq_last + 1
+               << dendl;
+      break;
+    }
+    if (more) {
+      bufferlist t;
+      int r = _read(log_reader, &log_reader->buf, read_pos, more, &t, NULL);
+      if (r < (int)more) {
+	dout(10) << __func__ << " 0x" << std::hex << pos
+                 << ": stop: len is 0x" << bl.length() + more << std::dec
+                 << ", which is past eof" << dendl;
+	break;
+      }
+      bl.claim_append(t);
+      read_pos += r;
+    }
+    bluefs_transaction_t t;
+    try {
+      auto p = bl.cbegin();
+      decode(t, p);
+    }
+    catch (buffer::error& e) {
+      dout(10) << __func__ << " 0x" << std::hex << pos << std::dec
+               << ": stop: failed to decode: " << e.what()
+               << dendl;
+      delete log_reader;
+      return -EIO;
+    }
+    assert(seq == t.seq);
+    dout(10) << __func__ << " 0x" << std::hex << pos << std::dec
+             << ": " << t << dendl;
+    if (unlikely(to_stdout)) {
+      std::cout << " 0x" << std::hex << pos << std::dec
+                << ": " << t << std::endl;
+    }
+
+    auto p = t.op_bl.cbegin();
+    while (!p.end()) {
+      __u8 op;
+      decode(op, p);
+      if (op != bluefs_transaction_t::OP_FILE_UPDATE) {
+	derr << __func__ << " 0x" << std::hex << pos << std::dec
+             << ": stop: unexpected op " << (int)op << dendl;
+	delete log_reader;
+        return -EIO;
+      }
+      bluefs_fnode_t fnode;
+      decode(fnode, p);
+      dout(20) << __func__ << " 0x" << std::hex << pos << std::dec
+	       << ":  op_file_update " << " " << fnode << dendl;
+      if (unlikely(to_stdout)) {
+	std::cout << " 0x" << std::hex << pos << std::dec
+		  << ":  op_file_update " << " " << fnode << std::endl;
+      }
+      if (fnode.ino == 0) {
+	wal_log_file->fnode = fnode;
+	continue;
+      }
+      if (noop) {
+	continue;
+      }
+      auto q = file_map.find(fnode.ino);
+      if (q == file_map.end()) {
+	dout(20) << __func__ << "  ino " << fnode.ino << " was removed"
+		 << dendl;
+	continue;
+      }
+      q->second->fnode = fnode;
+      q->second->wal_stream = true;
+      wal_log_fnodes[fnode.ino] = fnode;
+    }
+
+    seq_last = seq;
+    wal_log_file->fnode.size = log_reader->buf.pos;
+  }
+
+  dout(10) << __func__ << " wal log size was 0x"
+           << std::hex << wal_log_file->fnode.size << std::dec << dendl;
+  if (unlikely(to_stdout)) {
+    std::cout << " wal log size was 0x"
+              << std::hex << wal_log_file->fnode.size << std::dec << std::endl;
+  }
+  delete log_reader;
+
+  if (!noop) {
+    wal_log_seq = wal_log_seq_stable = seq_last;
+    wal_log_writer = _create_writer(wal_log_file);
+    wal_log_writer->pos = wal_log_file->fnode.size;
+  }
+  dout(10) << __func__ << " done" << dendl;
+  return 0;
+}
+
 int BlueFS::log_dump()
 {
   // only dump log file's content
@@ -966,6 +1165,14 @@ int BlueFS::log_dump()
     derr << __func__ << " failed to replay log: " << cpp_strerror(r) << dendl;
     return r;
   }
+  if (super.has_wal_log()) {
+    r = _replay_wal_log(true, true);
+    if (r < 0) {
+      derr << __func__ << " failed to replay wal log: " << cpp_strerror(r)
+	   << dendl;
+      return r;
+    }
+  }
 
   return 0;
 }
@@ -999,7 +1206,16 @@ void BlueFS::_drop_link(FileRef file)
       pending_release[r.bdev].insert(r.offset, r.length);
     }
     file_map.erase(file->fnode.ino);
-    file->deleted = true;
+    if (file->wal_stream) {
+      // mark it deleted under wal_log_lock so a racing _fsync_wal won't
+      // queue it again; entries already in the wal log are ignored by
+      // replay once the removal is in the main log.
+      std::lock_guard<std::mutex> wl(wal_log_lock);
+      wal_log_fnodes.erase(file->fnode.ino);
+      file->deleted = true;
+    } else {
+      file->deleted = true;
+    }
 
     if (file->dirty_seq) {
       assert(file->dirty_seq > log_seq_stable);
@@ -1194,14 +1410,36 @@ bool BlueFS::_should_compact_log()
 	   << " ratio " << ratio
 	   << (new_log ? " (async compaction in progress)" : "")
 	   << dendl;
-  if (new_log ||
-      current < cct->_conf->bluefs_log_compact_min_size ||
-      ratio < cct->_conf->bluefs_log_compact_min_ratio) {
+  if (new_log) {
     return false;
   }
+  if (current < cct->_conf->bluefs_log_compact_min_size ||
+      ratio < cct->_conf->bluefs_log_compact_min_ratio) {
+    // the wal log is only ever rewritten along with the main log
+    return _should_compact_wal_log();
+  }
   return true;
 }
 
+bool BlueFS::_should_compact_wal_log()
+{
+  if (!wal_log_writer) {
+    return false;
+  }
+  std::lock_guard<std::mutex> wl(wal_log_lock);
+  uint64_t current = wal_log_writer->file->fnode.size;
+  uint64_t expected = round_up_to(
+    super.block_size * 2 +
+    (wal_log_fnodes.size() + 1) * (1 + sizeof(bluefs_fnode_t)),
+    super.block_size);
+  float ratio = (float)current / (float)expected;
+  dout(10) << __func__ << " current 0x" << std::hex << current
+	   << " expected " << expected << std::dec
+	   << " ratio " << ratio << dendl;
+  return current >= cct->_conf->bluefs_log_compact_min_size &&
+    ratio >= cct->_conf->bluefs_log_compact_min_ratio;
+}
+
 void BlueFS::_compact_log_dump_metadata(bluefs_transaction_t *t)
 {
   t->seq = 1;
@@ -1280,12 +1518,21 @@ void BlueFS::_compact_log_sync()
 #endif
   flush_bdev();
 
+  // everything here happens under lock, so the wal log is too
+  vector<interval_set<uint64_t>> wal_to_release;
+  if (wal_log_writer) {
+    _compact_wal_log(false, &wal_to_release);
+  }
+
   dout(10) << __func__ << " writing super" << dendl;
   super.log_fnode = log_file->fnode;
   ++super.version;
   _write_super();
   flush_bdev();
 
+  if (wal_log_writer) {
+    _compact_wal_log_finish(wal_to_release);
+  }
   dout(10) << __func__ << " release old log extents " << old_extents << dendl;
   for (auto& r : old_extents) {
     pending_release[r.bdev].insert(r.offset, r.length);
@@ -1427,6 +1674,10 @@ void BlueFS::_compact_log_async(std::unique_lock<std::mutex>& l)
     log_writer->pos - old_log_jump_to + new_log_jump_to;
 
   // 6. write the super block to reflect the changes
+  vector<interval_set<uint64_t>> wal_to_release;
+  if (wal_log_writer) {
+    _compact_wal_log(true, &wal_to_release);
+  }
   dout(10) << __func__ << " writing super" << dendl;
   super.log_fnode = log_file->fnode;
   ++super.version;
@@ -1436,6 +1687,9 @@ void BlueFS::_compact_log_async(std::unique_lock<std::mutex>& l)
   flush_bdev();
   lock.lock();
 
+  if (wal_log_writer) {
+    _compact_wal_log_finish(wal_to_release);
+  }
   // 7. release old space
   dout(10) << __func__ << " release old log extents " << old_extents << dendl;
   for (auto& r : old_extents) {
@@ -1596,6 +1850,15 @@ int BlueFS::_flush_and_sync_log(std::unique_lock<std::mutex>& l,
              << ", we lost a race against another log flush, done" << dendl;
   }
 
+  _release_extents(to_release);
+
+  _update_logger_stats();
+
+  return 0;
+}
+
+void BlueFS::_release_extents(vector<interval_set<uint64_t>>& to_release)
+{
   for (unsigned i = 0; i < to_release.size(); ++i) {
     if (!to_release[i].empty()) {
       /* OK, now we have the guarantee alloc[i] won't be null. */
@@ -1612,12 +1875,263 @@ int BlueFS::_flush_and_sync_log(std::unique_lock<std::mutex>& l,
       alloc[i]->release(to_release[i]);
     }
   }
+}
 
-  _update_logger_stats();
+void BlueFS::_log_file_update(File *f)
+{
+  if (f->wal_stream) {
+    std::lock_guard<std::mutex> wl(wal_log_lock);
+    _wal_log_reserve_runway();
+    _wal_log_queue(f, f->fnode, ++f->wal_capture_seq);
+  } else {
+    log_t.op_file_update(f->fnode);
+  }
+}
 
+int BlueFS::_open_wal_log()
+{
+  std::lock_guard<std::mutex> l(lock);
+  FileRef wal_log_file = new File;
+  wal_log_file->fnode.ino = 0;  // not part of the namespace
+  wal_log_file->fnode.prefer_bdev = BDEV_WAL;
+  int r = _allocate(wal_log_file->fnode.prefer_bdev,
+		    cct->_conf->bluefs_max_log_runway,
+		    &wal_log_file->fnode);
+  if (r < 0) {
+    return r;
+  }
+
+  // a fresh uuid per incarnation, so replay never mistakes stale blocks
+  // from an earlier wal log for ours
+  super.wal_log_fnode = wal_log_file->fnode;
+  super.wal_log_uuid.generate_random();
+  ++super.version;
+  _write_super();
+  flush_bdev();
+  dout(1) << __func__ << " " << super.wal_log_fnode << dendl;
+
+  std::lock_guard<std::mutex> wl(wal_log_lock);
+  wal_log_writer = _create_writer(wal_log_file);
+  wal_log_seq = wal_log_seq_stable = 0;
   return 0;
 }
 
+void BlueFS::_retire_wal_log(std::unique_lock<std::mutex>& l)
+{
+  dout(1) << __func__ << " moving " << wal_log_fnodes.size()
+	  << " fnodes back to the main log" << dendl;
+  {
+    std::lock_guard<std::mutex> wl(wal_log_lock);
+    for (auto& p : wal_log_fnodes) {
+      auto q = file_map.find(p.first);
+      assert(q != file_map.end());
+      q->second->wal_stream = false;
+      log_t.op_file_update(q->second->fnode);
+    }
+    wal_log_fnodes.clear();
+  }
+  _flush_and_sync_log(l);
+
+  super.wal_log_fnode = bluefs_fnode_t();
+  super.wal_log_uuid = uuid_d();
+  ++super.version;
+  _write_super();
+  flush_bdev();
+
+  std::lock_guard<std::mutex> wl(wal_log_lock);
+  for (auto& r : wal_log_writer->file->fnode.extents) {
+    pending_release[r.bdev].insert(r.offset, r.length);
+  }
+  _close_writer(wal_log_writer);
+  wal_log_writer = nullptr;
+}
+
+void BlueFS::_wal_log_reserve_runway()
+{
+  // we must be holding both lock and wal_log_lock
+  File *wal_log_file = wal_log_writer->file.get();
+  int64_t runway = wal_log_file->fnode.get_allocated() -
+    wal_log_writer->get_effective_write_pos();
+  if (runway < (int64_t)cct->_conf->bluefs_min_log_runway) {
+    dout(10) << __func__ << " allocating more wal log runway (0x"
+	     << std::hex << runway << std::dec  << " remaining)" << dendl;
+    int r = _allocate(wal_log_file->fnode.prefer_bdev,
+		      cct->_conf->bluefs_max_log_runway,
+		      &wal_log_file->fnode);
+    assert(r == 0);
+    wal_log_t.op_file_update(wal_log_file->fnode);
+  }
+}
+
+void BlueFS::_wal_log_queue(File *f, const bluefs_fnode_t& fnode,
+			    uint64_t capture)
+{
+  // we must be holding wal_log_lock
+  if (f->deleted || capture <= f->wal_logged_capture) {
+    dout(20) << __func__ << " skip " << fnode << " capture " << capture
+	     << " (logged " << f->wal_logged_capture
+	     << (f->deleted ? ", deleted)" : ")") << dendl;
+    return;
+  }
+  dout(20) << __func__ << " op_file_update " << fnode << dendl;
+  wal_log_t.op_file_update(fnode);
+  wal_log_fnodes[fnode.ino] = fnode;
+  f->wal_logged_capture = capture;
+  f->wal_logged_seq = wal_log_seq + 1;
+}
+
+int BlueFS::_flush_and_sync_wal_log(std::unique_lock<std::mutex>& wl,
+				    uint64_t want_seq)
+{
+  while (wal_log_flushing) {
+    dout(10) << __func__ << " want_seq " << want_seq
+	     << " wal log is currently flushing, waiting" << dendl;
+    wal_log_cond.wait(wl);
+  }
+  if (want_seq && want_seq <= wal_log_seq_stable) {
+    dout(10) << __func__ << " want_seq " << want_seq
+	     << " <= wal_log_seq_stable " << wal_log_seq_stable << ", done"
+	     << dendl;
+    return 0;
+  }
+  if (wal_log_t.empty()) {
+    dout(10) << __func__ << " want_seq " << want_seq << " not dirty, no-op"
+	     << dendl;
+    return 0;
+  }
+
+  vector<interval_set<uint64_t>> to_release(wal_pending_release.size());
+  to_release.swap(wal_pending_release);
+
+  uint64_t seq = wal_log_t.seq = ++wal_log_seq;
+  wal_log_t.uuid = super.wal_log_uuid;
+  dout(10) << __func__ << " " << wal_log_t << dendl;
+
+  bufferlist bl;
+  encode(wal_log_t, bl);
+  _pad_bl(bl);
+  logger->inc(l_bluefs_wal_logged_bytes, bl.length());
+  wal_log_writer->append(bl);
+
+  wal_log_t.clear();
+  wal_log_t.seq = 0;
+  wal_log_flushing = true;
+
+  int r = _flush(wal_log_writer, true);
+  assert(r == 0);
+  _flush_bdev_safely(wal_log_writer, wal_log_lock);
+
+  wal_log_flushing = false;
+  wal_log_cond.notify_all();
+  if (seq > wal_log_seq_stable) {
+    wal_log_seq_stable = seq;
+    dout(20) << __func__ << " wal_log_seq_stable " << wal_log_seq_stable
+	     << dendl;
+  }
+
+  _release_extents(to_release);
+  logger->set(l_bluefs_wal_log_bytes, wal_log_writer->file->fnode.size);
+  return 0;
+}
+
+/*
+ * Rewrite the wal log from wal_log_fnodes into fresh space under a new
+ * uuid and point the in-memory superblock at it.  Called with lock held
+ * from both log compaction paths, so the two journals are trimmed
+ * together; the caller writes the superblock and then calls
+ * _compact_wal_log_finish with to_release.  If may_unlock is set, lock
+ * is dropped while the new wal log is written out, as
+ * _compact_log_async does for the main log.  wal_log_flushing stays set
+ * throughout, so wal log flushes wait until the superblock points at
+ * the new wal log.
+ */
+void BlueFS::_compact_wal_log(
+  bool may_unlock,
+  vector<interval_set<uint64_t>> *to_release)
+{
+  std::unique_lock<std::mutex> wl(wal_log_lock);
+  while (wal_log_flushing) {
+    dout(10) << __func__ << " wal log is currently flushing, waiting" << dendl;
+    wal_log_cond.wait(wl);
+  }
+  dout(10) << __func__ << " " << wal_log_fnodes.size() << " fnodes" << dendl;
+  File *wal_log_file = wal_log_writer->file.get();
+
+  // anything still pending in wal_log_t is covered by wal_log_fnodes
+  wal_log_t.clear();
+  bluefs_transaction_t t;
+  uuid_d uuid;
+  uuid.generate_random();
+  t.uuid = uuid;
+  t.seq = ++wal_log_seq;
+  for (auto& p : wal_log_fnodes) {
+    dout(20) << __func__ << " op_file_update " << p.second << dendl;
+    t.op_file_update(p.second);
+  }
+
+  bufferlist bl;
+  encode(t, bl);
+  _pad_bl(bl);
+
+  // releases queued so far are covered by the new wal log; any queued
+  // while lock is dropped below wait for its next flush
+  to_release->resize(wal_pending_release.size());
+  to_release->swap(wal_pending_release);
+  mempool::bluefs::vector<bluefs_extent_t> old_extents;
+  uint64_t old_allocated = 0;
+  wal_log_file->fnode.swap_extents(old_extents, old_allocated);
+  dout(10) << __func__ << " old wal log extents " << old_extents << dendl;
+  for (auto& r : old_extents) {
+    (*to_release)[r.bdev].insert(r.offset, r.length);
+  }
+  int r = _allocate(wal_log_file->fnode.prefer_bdev,
+		    bl.length() + cct->_conf->bluefs_max_log_runway,
+		    &wal_log_file->fnode);
+  assert(r == 0);
+
+  _close_writer(wal_log_writer);
+  wal_log_file->fnode.size = bl.length();
+  wal_log_writer = _create_writer(wal_log_file);
+  wal_log_writer->append(bl);
+  wal_log_flushing = true;
+  r = _flush(wal_log_writer, true);
+  assert(r == 0);
+  if (may_unlock) {
+    // wal_log_lock nests inside lock, so let go of it before lock is
+    // dropped and retaken
+    wl.unlock();
+    _flush_bdev_safely(wal_log_writer);
+    wl.lock();
+  } else {
+#ifdef HAVE_LIBAIO
+    if (!cct->_conf->bluefs_sync_write) {
+      list<aio_t> completed_ios;
+      _claim_completed_aios(wal_log_writer, &completed_ios);
+      wait_for_aio(wal_log_writer);
+      completed_ios.clear();
+    }
+#endif
+    flush_bdev();
+  }
+
+  super.wal_log_fnode = wal_log_file->fnode;
+  super.wal_log_uuid = uuid;
+}
+
+void BlueFS::_compact_wal_log_finish(
+  vector<interval_set<uint64_t>>& to_release)
+{
+  std::lock_guard<std::mutex> wl(wal_log_lock);
+  wal_log_seq_stable = wal_log_seq;
+  wal_log_flushing = false;
+  wal_log_cond.notify_all();
+
+  for (unsigned i = 0; i < to_release.size(); ++i) {
+    pending_release[i].insert(to_release[i]);
+  }
+  logger->set(l_bluefs_wal_log_bytes, wal_log_writer->file->fnode.size);
+}
+
 int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
 {
   dout(10) << __func__ << " " << h << " pos 0x" << std::hex << h->pos
@@ -1629,7 +2143,7 @@ int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
   h->buffer_appender.flush();
 
   bool buffered;
-  if (h->file->fnode.ino == 1)
+  if (h->file->fnode.ino == 1 || h == wal_log_writer)
     buffered = false;
   else
     buffered = cct->_conf->bluefs_buffered_io;
@@ -1652,8 +2166,9 @@ int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
   bool must_dirty = false;
   if (allocated < offset + length) {
     // we should never run out of log space here; see the min runway check
-    // in _flush_and_sync_log.
+    // in _flush_and_sync_log and _wal_log_reserve_runway.
     assert(h->file->fnode.ino != 1);
+    assert(h != wal_log_writer);
     int r = _allocate(h->file->fnode.prefer_bdev,
 		      offset + length - allocated,
 		      &h->file->fnode);
@@ -1689,7 +2204,11 @@ int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
   if (must_dirty) {
     h->file->fnode.mtime = ceph_clock_now();
     assert(h->file->fnode.ino >= 1);
-    if (h->file->dirty_seq == 0) {
+    if (h->file->wal_stream) {
+      // picked up by the next _fsync_wal instead of the main log
+      h->file->wal_dirty = true;
+      dout(20) << __func__ << " wal_dirty" << dendl;
+    } else if (h->file->dirty_seq == 0) {
       h->file->dirty_seq = log_seq + 1;
       dirty_files[h->file->dirty_seq].push_back(*h->file);
       dout(20) << __func__ << " dirty_seq = " << log_seq + 1
@@ -1913,12 +2432,15 @@ int BlueFS::_truncate(FileWriter *h, uint64_t offset)
   }
   assert(h->file->fnode.size >= offset);
   h->file->fnode.size = offset;
-  log_t.op_file_update(h->file->fnode);
+  _log_file_update(h->file.get());
   return 0;
 }
 
 int BlueFS::_fsync(FileWriter *h, std::unique_lock<std::mutex>& l)
 {
+  if (h->file->wal_stream) {
+    return _fsync_wal(h, l);
+  }
   dout(10) << __func__ << " " << h << " " << h->file->fnode << dendl;
   int r = _flush(h, true);
   if (r < 0)
@@ -1938,7 +2460,58 @@ int BlueFS::_fsync(FileWriter *h, std::unique_lock<std::mutex>& l)
   return 0;
 }
 
+/*
+ * Metadata for a file in the wal log is captured under lock, but queued
+ * and synced under wal_log_lock alone, after the data is stable.  The
+ * capture seq keeps a slow fsync from queueing an older fnode after a
+ * newer one.  The main log is only involved for the first fsync of a
+ * new file, whose link must be stable before the wal log refers to it.
+ */
+int BlueFS::_fsync_wal(FileWriter *h, std::unique_lock<std::mutex>& l)
+{
+  dout(10) << __func__ << " " << h << " " << h->file->fnode << dendl;
+  mono_time start = mono_clock::now();
+  int r = _flush(h, true);
+  if (r < 0)
+     return r;
+  File *file = h->file.get();
+  if (file->create_seq > log_seq_stable) {
+    dout(20) << __func__ << " file link not yet stable (" << file->create_seq
+	     << "), flushing log" << dendl;
+    _flush_and_sync_log(l, file->create_seq);
+  }
+
+  bool dirty = file->wal_dirty;
+  bluefs_fnode_t fnode;
+  uint64_t capture = 0;
+  if (dirty) {
+    fnode = file->fnode;
+    capture = ++file->wal_capture_seq;
+    file->wal_dirty = false;
+    std::lock_guard<std::mutex> wl(wal_log_lock);
+    _wal_log_reserve_runway();
+  }
+
+  _flush_bdev_safely(h);
+  l.unlock();
+
+  if (dirty) {
+    std::unique_lock<std::mutex> wl(wal_log_lock);
+    _wal_log_queue(file, fnode, capture);
+    dout(20) << __func__ << " file metadata was dirty (" << capture
+	     << ") on " << fnode << ", flushing wal log" << dendl;
+    _flush_and_sync_wal_log(wl, file->wal_logged_seq);
+  }
+  logger->tinc(l_bluefs_wal_fsync_lat, mono_clock::now() - start);
+  return 0;
+}
+
 void BlueFS::_flush_bdev_safely(FileWriter *h)
+{
+  _flush_bdev_safely(h, lock);
+}
+
+void BlueFS::_flush_bdev_safely(FileWriter *h, std::mutex& l)
 {
   std::array<bool, MAX_BDEV> flush_devs = h->dirty_devs;
   h->dirty_devs.fill(false);
@@ -1946,17 +2519,17 @@ void BlueFS::_flush_bdev_safely(FileWriter *h)
   if (!cct->_conf->bluefs_sync_write) {
     list<aio_t> completed_ios;
     _claim_completed_aios(h, &completed_ios);
-    lock.unlock();
+    l.unlock();
     wait_for_aio(h);
     completed_ios.clear();
     flush_bdev(flush_devs);
-    lock.lock();
+    l.lock();
   } else
 #endif
   {
-    lock.unlock();
+    l.unlock();
     flush_bdev(flush_devs);
-    lock.lock();
+    l.lock();
   }
 }
 
@@ -2048,7 +2621,7 @@ int BlueFS::_preallocate(FileRef f, uint64_t off, uint64_t len)
     int r = _allocate(f->fnode.prefer_bdev, want, &f->fnode);
     if (r < 0)
       return r;
-    log_t.op_file_update(f->fnode);
+    _log_file_update(f.get());
   }
   return 0;
 }
@@ -2065,6 +2638,13 @@ void BlueFS::sync_metadata()
     _flush_and_sync_log(l);
     dout(10) << __func__ << " done in " << (ceph_clock_now() - start) << dendl;
   }
+  if (wal_log_writer) {
+    // as _flush_and_sync_log does for the main log; fsyncs reserve
+    // their own runway when they queue an update
+    std::unique_lock<std::mutex> wl(wal_log_lock);
+    _wal_log_reserve_runway();
+    _flush_and_sync_wal_log(wl);
+  }
 
   if (_should_compact_log()) {
     if (cct->_conf->bluefs_compact_log_sync) {
@@ -2122,8 +2702,16 @@ int BlueFS::open_for_write(
 	       << ") file " << filename
 	       << " already exists, truncate + overwrite" << dendl;
       file->fnode.size = 0;
-      for (auto& p : file->fnode.extents) {
-	pending_release[p.bdev].insert(p.offset, p.length);
+      if (file->wal_stream) {
+	// the wal log may still point at these until it is synced
+	std::lock_guard<std::mutex> wl(wal_log_lock);
+	for (auto& p : file->fnode.extents) {
+	  wal_pending_release[p.bdev].insert(p.offset, p.length);
+	}
+      } else {
+	for (auto& p : file->fnode.extents) {
+	  pending_release[p.bdev].insert(p.offset, p.length);
+	}
       }
 
       file->fnode.clear_extents();
@@ -2147,9 +2735,12 @@ int BlueFS::open_for_write(
   dout(20) << __func__ << " mapping " << dirname << "/" << filename
 	   << " to bdev " << (int)file->fnode.prefer_bdev << dendl;
 
-  log_t.op_file_update(file->fnode);
-  if (create)
+  if (create) {
+    log_t.op_file_update(file->fnode);
     log_t.op_dir_link(dirname, filename, file->fnode.ino);
+  } else {
+    _log_file_update(file.get());
+  }
 
   *h = _create_writer(file);
 
@@ -2158,6 +2749,10 @@ int BlueFS::open_for_write(
     if (logger && !overwrite) {
       logger->inc(l_bluefs_files_written_wal);
     }
+    if (create && wal_log_writer) {
+      file->wal_stream = true;
+      file->create_seq = log_seq + 1;
+    }
   } else if (boost::algorithm::ends_with(filename, ".sst")) {
     (*h)->writer_type = BlueFS::WRITER_SST;
     if (logger) {
@@ -36,6 +36,9 @@ enum {
   l_bluefs_bytes_written_wal,
   l_bluefs_bytes_written_sst,
   l_bluefs_bytes_written_slow,
+  l_bluefs_wal_log_bytes,
+  l_bluefs_wal_logged_bytes,
+  l_bluefs_wal_fsync_lat,
   l_bluefs_last,
 };
 
@@ -63,6 +66,14 @@ public:
     bool deleted;
     boost::intrusive::list_member_hook<> dirty_item;
 
+    // metadata for WAL files is journaled in the wal log, not the main log
+    bool wal_stream = false;
+    bool wal_dirty = false;        ///< fnode changed since last queued to wal log
+    uint64_t create_seq = 0;       ///< main log seq that links this file
+    uint64_t wal_capture_seq = 0;  ///< last fnode snapshot taken (lock)
+    uint64_t wal_logged_capture = 0; ///< last snapshot queued (wal_log_lock)
+    uint64_t wal_logged_seq = 0;   ///< wal log seq holding that snapshot
+
     std::atomic_int num_readers, num_writers;
     std::atomic_int num_reading;
 
@@ -244,6 +255,25 @@ private:
   FileRef new_log = nullptr;
   FileWriter *new_log_writer = nullptr;
 
+  /*
+   * The wal log is a second journal, used only for the fnodes of rocksdb
+   * WAL files.  It has its own lock and fsync path, so a WAL fsync never
+   * queues behind a main log flush or compaction.  Namespace changes
+   * (create, link, unlink) still go through the main log; once a file
+   * has an entry in the wal log, replay takes its fnode from there.  The
+   * wal log is rewritten from wal_log_fnodes whenever the main log is
+   * compacted.  wal_log_lock nests inside lock.
+   */
+  std::mutex wal_log_lock;
+  FileWriter *wal_log_writer = nullptr;  ///< writer for the wal log, if any
+  bluefs_transaction_t wal_log_t;        ///< pending wal log transaction
+  uint64_t wal_log_seq = 0;              ///< last used wal log seq
+  uint64_t wal_log_seq_stable = 0;       ///< last stable wal log seq
+  bool wal_log_flushing = false;
+  std::condition_variable wal_log_cond;
+  mempool::bluefs::map<uint64_t,bluefs_fnode_t> wal_log_fnodes; ///< ino -> last queued fnode
+  vector<interval_set<uint64_t>> wal_pending_release; ///< freed once the wal log is stable
+
   /*
    * There are up to 3 block devices:
    *
@@ -276,6 +306,7 @@ private:
   int _flush_range(FileWriter *h, uint64_t offset, uint64_t length);
   int _flush(FileWriter *h, bool force);
   int _fsync(FileWriter *h, std::unique_lock<std::mutex>& l);
+  int _fsync_wal(FileWriter *h, std::unique_lock<std::mutex>& l);
 
 #ifdef HAVE_LIBAIO
   void _claim_completed_aios(FileWriter *h, list<aio_t> *ls);
@@ -291,9 +322,25 @@ private:
   void _compact_log_sync();
   void _compact_log_async(std::unique_lock<std::mutex>& l);
 
+  void _log_file_update(File *f);
+  void _release_extents(vector<interval_set<uint64_t>>& to_release);
+
+  int _open_wal_log();
+  void _retire_wal_log(std::unique_lock<std::mutex>& l);
+  int _replay_wal_log(bool noop, bool to_stdout = false);
+  void _wal_log_reserve_runway();
+  void _wal_log_queue(File *f, const bluefs_fnode_t& fnode, uint64_t capture);
+  int _flush_and_sync_wal_log(std::unique_lock<std::mutex>& wl,
+			      uint64_t want_seq = 0);
+  bool _should_compact_wal_log();
+  void _compact_wal_log(bool may_unlock,
+			vector<interval_set<uint64_t>> *to_release);
+  void _compact_wal_log_finish(vector<interval_set<uint64_t>>& to_release);
+
   //void _aio_finish(void *priv);
 
   void _flush_bdev_safely(FileWriter *h);
+  void _flush_bdev_safely(FileWriter *h, std::mutex& l);
   void flush_bdev();  // this is safe to call without a lock
   void flush_bdev(std::array<bool, MAX_BDEV>& dirty_bdevs);  // this is safe to call without a lock
 
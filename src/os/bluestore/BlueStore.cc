@@ -785,8 +785,34 @@ BlueStore::Cache *BlueStore::Cache::create(CephContext* cct, string type,
 
 void BlueStore::Cache::trim(uint64_t onode_max, uint64_t buffer_max)
 {
-  std::lock_guard<std::recursive_mutex> l(lock);
-  _trim(onode_max, buffer_max);
+  // a big shrink (e.g. after the autotuner moves memory away from this
+  // shard) would otherwise hold the shard lock for the whole eviction and
+  // stall every op mapped here; step down a batch at a time instead.
+  uint64_t batch_onodes =
+    cct->_conf.get_val<uint64_t>("bluestore_cache_trim_batch_onodes");
+  uint64_t batch_bytes =
+    cct->_conf.get_val<Option::size_t>("bluestore_cache_trim_batch_bytes");
+  while (true) {
+    std::lock_guard<std::recursive_mutex> l(lock);
+    uint64_t num_onodes = _get_num_onodes();
+    uint64_t buffer_bytes = _get_buffer_bytes();
+    uint64_t onode_target = onode_max;
+    uint64_t buffer_target = buffer_max;
+    if (batch_onodes && num_onodes > onode_max + batch_onodes) {
+      onode_target = num_onodes - batch_onodes;
+    }
+    if (batch_bytes && buffer_bytes > buffer_max + batch_bytes) {
+      buffer_target = buffer_bytes - batch_bytes;
+    }
+    _trim(onode_target, buffer_target);
+    if (onode_target == onode_max && buffer_target == buffer_max) {
+      break;
+    }
+    if (_get_num_onodes() >= num_onodes &&
+	_get_buffer_bytes() >= buffer_bytes) {
+      break;  // everything left is pinned
+    }
+  }
 }
 
 void BlueStore::Cache::trim_all()
@@ -841,8 +867,21 @@ void BlueStore::LRUCache::_trim(uint64_t onode_max, uint64_t buffer_max)
   int max_skipped = g_conf()->bluestore_cache_trim_max_skip_pinned;
   while (num > 0) {
     Onode *o = &*p;
+    if (o->lru_referenced.exchange(false)) {
+      // looked up since it was queued; give it another trip instead
+      dout(30) << __func__ << "  " << o->oid << " referenced, requeue"
+	       << dendl;
+      if (p == onode_lru.begin()) {
+	break;
+      }
+      auto q = p--;
+      onode_lru.erase(q);
+      onode_lru.push_front(*o);
+      continue;
+    }
     int refs = o->nref.load();
-    if (refs > 1) {
+    OnodeRef ref;
+    if (refs > 1 || !o->c->onode_map.remove_unpinned(o, &ref)) {
       dout(20) << __func__ << "  " << o->oid << " has " << refs
 	       << " refs, skipping" << dendl;
       if (++skipped >= max_skipped) {
@@ -860,16 +899,13 @@ void BlueStore::LRUCache::_trim(uint64_t onode_max, uint64_t buffer_max)
       }
     }
     dout(30) << __func__ << "  rm " << o->oid << dendl;
+    --num;
     if (p != onode_lru.begin()) {
       onode_lru.erase(p--);
     } else {
       onode_lru.erase(p);
-      assert(num == 1);
+      break;
     }
-    o->get();  // paranoia
-    o->c->onode_map.remove(o->oid);
-    o->put();
-    --num;
   }
 }
 
@@ -1139,8 +1175,21 @@ void BlueStore::TwoQCache::_trim(uint64_t onode_max, uint64_t buffer_max)
   while (num > 0) {
     Onode *o = &*p;
     dout(20) << __func__ << " considering " << o << dendl;
+    if (o->lru_referenced.exchange(false)) {
+      // looked up since it was queued; give it another trip instead
+      dout(30) << __func__ << "  " << o->oid << " referenced, requeue"
+	       << dendl;
+      if (p == onode_lru.begin()) {
+	break;
+      }
+      auto q = p--;
+      onode_lru.erase(q);
+      onode_lru.push_front(*o);
+      continue;
+    }
     int refs = o->nref.load();
-    if (refs > 1) {
+    OnodeRef ref;
+    if (refs > 1 || !o->c->onode_map.remove_unpinned(o, &ref)) {
       dout(20) << __func__ << "  " << o->oid << " has " << refs
 	       << " refs; skipping" << dendl;
       if (++skipped >= max_skipped) {
@@ -1158,16 +1207,13 @@ void BlueStore::TwoQCache::_trim(uint64_t onode_max, uint64_t buffer_max)
       }
     }
     dout(30) << __func__ << " " << o->oid << " num=" << num <<" lru size="<<onode_lru.size()<< dendl;
+    --num;
     if (p != onode_lru.begin()) {
       onode_lru.erase(p--);
     } else {
       onode_lru.erase(p);
-      assert(num == 1);
+      break;
     }
-    o->get();  // paranoia
-    o->c->onode_map.remove(o->oid);
-    o->put();
-    --num;
   }
 }
 
@@ -1363,6 +1409,7 @@ void BlueStore::BufferSpace::read(
   uint64_t hit_bytes = res_intervals.size();
   assert(hit_bytes <= want_bytes);
   uint64_t miss_bytes = want_bytes - hit_bytes;
+  cache->buffer_lookup_bytes += want_bytes;
   cache->logger->inc(l_bluestore_buffer_hit_bytes, hit_bytes);
   cache->logger->inc(l_bluestore_buffer_miss_bytes, miss_bytes);
 }
@@ -1457,6 +1504,7 @@ void BlueStore::BufferSpace::split(Cache* cache, size_t pos, BlueStore::BufferSp
 BlueStore::OnodeRef BlueStore::OnodeSpace::add(const ghobject_t& oid, OnodeRef o)
 {
   std::lock_guard<std::recursive_mutex> l(cache->lock);
+  std::unique_lock<std::shared_mutex> ol(lock);
   auto p = onode_map.find(oid);
   if (p != onode_map.end()) {
     ldout(cache->cct, 30) << __func__ << " " << oid << " " << o
@@ -1477,19 +1525,23 @@ BlueStore::OnodeRef BlueStore::OnodeSpace::lookup(const ghobject_t& oid)
   bool hit = false;
 
   {
-    std::lock_guard<std::recursive_mutex> l(cache->lock);
+    std::shared_lock<std::shared_mutex> l(lock);
     ceph::unordered_map<ghobject_t,OnodeRef>::iterator p = onode_map.find(oid);
     if (p == onode_map.end()) {
       ldout(cache->cct, 30) << __func__ << " " << oid << " miss" << dendl;
     } else {
       ldout(cache->cct, 30) << __func__ << " " << oid << " hit " << p->second
 			    << dendl;
-      cache->_touch_onode(p->second);
+      // the lru position is fixed up lazily by trim
+      if (!p->second->lru_referenced.load(std::memory_order_relaxed)) {
+	p->second->lru_referenced = true;
+      }
       hit = true;
       o = p->second;
     }
   }
 
+  ++cache->onode_lookups;
   if (hit) {
     cache->logger->inc(l_bluestore_onode_hits);
   } else {
@@ -1498,9 +1550,25 @@ BlueStore::OnodeRef BlueStore::OnodeSpace::lookup(const ghobject_t& oid)
   return o;
 }
 
+bool BlueStore::OnodeSpace::remove_unpinned(Onode *o, OnodeRef *ref)
+{
+  std::unique_lock<std::shared_mutex> l(lock);
+  auto p = onode_map.find(o->oid);
+  assert(p != onode_map.end() && p->second == o);
+  // nobody can take a new ref while we hold the map exclusively, so the
+  // map's own ref being the only one means it is safe to drop
+  if (o->nref.load() > 1) {
+    return false;
+  }
+  *ref = std::move(p->second);
+  onode_map.erase(p);
+  return true;
+}
+
 void BlueStore::OnodeSpace::clear()
 {
   std::lock_guard<std::recursive_mutex> l(cache->lock);
+  std::unique_lock<std::shared_mutex> ol(lock);
   ldout(cache->cct, 10) << __func__ << dendl;
   for (auto &p : onode_map) {
     cache->_rm_onode(p.second);
@@ -1510,7 +1578,7 @@ void BlueStore::OnodeSpace::clear()
 
 bool BlueStore::OnodeSpace::empty()
 {
-  std::lock_guard<std::recursive_mutex> l(cache->lock);
+  std::shared_lock<std::shared_mutex> l(lock);
   return onode_map.empty();
 }
 
@@ -1521,6 +1589,7 @@ void BlueStore::OnodeSpace::rename(
   const mempool::bluestore_cache_other::string& new_okey)
 {
   std::lock_guard<std::recursive_mutex> l(cache->lock);
+  std::unique_lock<std::shared_mutex> ol(lock);
   ldout(cache->cct, 30) << __func__ << " " << old_oid << " -> " << new_oid
 			<< dendl;
   ceph::unordered_map<ghobject_t,OnodeRef>::iterator po, pn;
@@ -1551,7 +1620,7 @@ void BlueStore::OnodeSpace::rename(
 
 bool BlueStore::OnodeSpace::map_any(std::function<bool(OnodeRef)> f)
 {
-  std::lock_guard<std::recursive_mutex> l(cache->lock);
+  std::shared_lock<std::shared_mutex> l(lock);
   ldout(cache->cct, 20) << __func__ << dendl;
   for (auto& i : onode_map) {
     if (f(i.second)) {
@@ -2631,9 +2700,26 @@ unsigned BlueStore::ExtentMap::decode_some(bufferlist& bl)
   }
 
   assert(n == num);
+  onode->c->store->logger->inc(l_bluestore_extent_map_decode_bytes,
+			       bl.length());
+  onode->c->store->logger->inc(l_bluestore_extent_map_decode_extents, num);
   return num;
 }
 
+void BlueStore::ExtentMap::fault_inline()
+{
+  if (inline_loaded) {
+    return;
+  }
+  auto cct = onode->c->store->cct; //used by dout
+  dout(30) << __func__ << " decoding inline shard (" << inline_bl.length()
+	   << " bytes)" << dendl;
+  assert(shards.empty());
+  inline_loaded = true;
+  decode_some(inline_bl);
+  onode->c->store->logger->inc(l_bluestore_extent_map_inline_faults);
+}
+
 void BlueStore::ExtentMap::bound_encode_spanning_blobs(size_t& p)
 {
   // Version 2 differs from v1 in blob's ref_map
@@ -2709,6 +2795,7 @@ void BlueStore::ExtentMap::fault_range(
   auto cct = onode->c->store->cct; //used by dout
   dout(30) << __func__ << " 0x" << std::hex << offset << "~" << length
 	   << std::dec << dendl;
+  fault_inline();
   auto start = seek_shard(offset);
   auto last = seek_shard(offset + length);
 
@@ -2760,6 +2847,8 @@ void BlueStore::ExtentMap::dirty_range(
 	   << std::dec << dendl;
   if (shards.empty()) {
     dout(20) << __func__ << " mark inline shard dirty" << dendl;
+    // the extents must be in memory before their encoding goes away
+    fault_inline();
     inline_bl.clear();
     return;
   }
@@ -3352,10 +3441,14 @@ BlueStore::OnodeRef BlueStore::Collection::get_onode(
     // initialize extent_map
     on->extent_map.decode_spanning_blobs(p);
     if (on->onode.extent_map_shards.empty()) {
+      // decoded by the first fault_range(); ops that only touch attrs or
+      // omap never pay for it, and inline_bl is what gets written back
+      // while the map stays clean
       denc(on->extent_map.inline_bl, p);
-      on->extent_map.decode_some(on->extent_map.inline_bl);
       on->extent_map.inline_bl.reassign_to_mempool(
 	mempool::mempool_bluestore_cache_other);
+      on->extent_map.defer_inline_decode();
+      store->logger->inc(l_bluestore_extent_map_inline_deferred);
     } else {
       on->extent_map.init_shards(false, false);
     }
@@ -3373,6 +3466,10 @@ void BlueStore::Collection::split_cache(
   std::lock(cache->lock, dest->cache->lock);
   std::lock_guard<std::recursive_mutex> l(cache->lock, std::adopt_lock);
   std::lock_guard<std::recursive_mutex> l2(dest->cache->lock, std::adopt_lock);
+  std::lock(onode_map.lock, dest->onode_map.lock);
+  std::unique_lock<std::shared_mutex> ol(onode_map.lock, std::adopt_lock);
+  std::unique_lock<std::shared_mutex> ol2(dest->onode_map.lock,
+					  std::adopt_lock);
 
   int destbits = dest->cnode.bits;
   spg_t destpg;
@@ -3477,6 +3574,7 @@ void *BlueStore::MempoolThread::entry()
     }
     if (resize_interval > 0 && next_resize < ceph_clock_now()) {
       if (ceph_using_tcmalloc() && store->cache_autotune) {
+        _update_memory_target();
         _tune_cache_size(interval_stats_resize);
         interval_stats_resize = false;
       }
@@ -3507,7 +3605,6 @@ void BlueStore::MempoolThread::_adjust_cache_settings()
 void BlueStore::MempoolThread::_trim_shards(bool interval_stats)
 {
   auto cct = store->cct;
-  size_t num_shards = store->cache_shards.size();
 
   int64_t kv_used = store->db->get_cache_usage();
   int64_t meta_used = meta_cache._get_used_bytes();
@@ -3547,26 +3644,123 @@ void BlueStore::MempoolThread::_trim_shards(bool interval_stats)
                    << " data_used: " << data_used << dendl;
   }
 
-  uint64_t max_shard_onodes = static_cast<uint64_t>(
-      (meta_alloc / (double) num_shards) / meta_cache.get_bytes_per_onode());
-  uint64_t max_shard_buffer = static_cast<uint64_t>(data_alloc / num_shards);
-
-  ldout(cct, 30) << __func__ << " max_shard_onodes: " << max_shard_onodes
-                 << " max_shard_buffer: " << max_shard_buffer << dendl;
+  _update_shard_shares();
 
+  double bytes_per_onode = meta_cache.get_bytes_per_onode();
   for (auto i : store->cache_shards) {
+    uint64_t max_shard_onodes = static_cast<uint64_t>(
+        (meta_alloc * i->onode_share) / bytes_per_onode);
+    uint64_t max_shard_buffer = static_cast<uint64_t>(
+        data_alloc * i->buffer_share);
+    ldout(cct, 30) << __func__ << " shard " << i
+                   << " max_shard_onodes: " << max_shard_onodes
+                   << " max_shard_buffer: " << max_shard_buffer << dendl;
     i->trim(max_shard_onodes, max_shard_buffer);
   }
 }
 
-void BlueStore::MempoolThread::_tune_cache_size(bool interval_stats)
+void BlueStore::MempoolThread::_update_shard_shares()
+{
+  auto cct = store->cct;
+  size_t num_shards = store->cache_shards.size();
+  double even = 1.0 / num_shards;
+
+  uint64_t onode_total = 0, buffer_total = 0;
+  vector<pair<uint64_t,uint64_t>> demand;
+  demand.reserve(num_shards);
+  for (auto i : store->cache_shards) {
+    uint64_t onodes = i->onode_lookups.exchange(0);
+    uint64_t bytes = i->buffer_lookup_bytes.exchange(0);
+    demand.emplace_back(onodes, bytes);
+    onode_total += onodes;
+    buffer_total += bytes;
+  }
+
+  if (!store->cache_autotune_shards) {
+    for (auto i : store->cache_shards) {
+      i->onode_share = even;
+      i->buffer_share = even;
+    }
+    return;
+  }
+
+  // Every shard keeps min_ratio of an even split; the rest of the budget
+  // follows where lookups actually landed since the last pass.  Blend with
+  // the previous share so one quiet interval doesn't empty a shard.
+  double min_ratio = store->cache_shard_min_ratio;
+  auto blend = [&](double prev, uint64_t mine, uint64_t total) {
+    if (prev <= 0) {
+      prev = even;
+    }
+    if (total == 0) {
+      return prev;
+    }
+    double target = min_ratio * even +
+      (1.0 - min_ratio) * ((double)mine / (double)total);
+    return (prev + target) / 2;
+  };
+  for (size_t n = 0; n < num_shards; ++n) {
+    auto i = store->cache_shards[n];
+    i->onode_share = blend(i->onode_share, demand[n].first, onode_total);
+    i->buffer_share = blend(i->buffer_share, demand[n].second, buffer_total);
+    ldout(cct, 30) << __func__ << " shard " << i
+                   << " onode_lookups " << demand[n].first
+                   << " buffer_lookup_bytes " << demand[n].second
+                   << " onode_share " << i->onode_share
+                   << " buffer_share " << i->buffer_share << dendl;
+  }
+}
+
+void BlueStore::MempoolThread::_open_host_arbiter()
 {
   auto cct = store->cct;
+  string path = cct->_conf.get_val<string>("osd_memory_host_arbiter_path");
+  if (path.empty() || !store->cache_autotune) {
+    return;
+  }
+  host_arbiter.reset(
+    new HostMemoryArbiter(cct, path, cct->_conf->name.to_str()));
+  int r = host_arbiter->open();
+  if (r < 0) {
+    derr << __func__ << " cannot join host memory arbiter at " << path
+	 << ", tuning towards osd_memory_target: " << cpp_strerror(r) << dendl;
+    host_arbiter.reset();
+  }
+}
+
+void BlueStore::MempoolThread::_update_memory_target()
+{
   uint64_t target = store->osd_memory_target;
+  if (!host_arbiter) {
+    memory_target = target;
+    return;
+  }
+
+  // what our caches missed since the last pass, in bytes
+  uint64_t onode_misses = store->logger->get(l_bluestore_onode_misses);
+  uint64_t buffer_miss_bytes = store->logger->get(l_bluestore_buffer_miss_bytes);
+  uint64_t demand =
+    (onode_misses - std::min(onode_misses, last_onode_misses)) *
+      meta_cache.get_bytes_per_onode() +
+    (buffer_miss_bytes - std::min(buffer_miss_bytes, last_buffer_miss_bytes));
+  last_onode_misses = onode_misses;
+  last_buffer_miss_bytes = buffer_miss_bytes;
+
+  // never be granted less than what we need to run with minimal caches
+  uint64_t min = store->osd_memory_base +
+    store->osd_memory_cache_min / (1.0 - store->osd_memory_expected_fragmentation);
+  memory_target = host_arbiter->update(target, std::min(min, target), demand);
+}
+
+void BlueStore::MempoolThread::_tune_cache_size(bool interval_stats)
+{
+  auto cct = store->cct;
+  uint64_t target = memory_target;
   uint64_t base = store->osd_memory_base;
   double fragmentation = store->osd_memory_expected_fragmentation;
-  uint64_t cache_max = ((1.0 - fragmentation) * target) - base;
   uint64_t cache_min = store->osd_memory_cache_min;
+  uint64_t cache_max = std::max<int64_t>(
+    ((1.0 - fragmentation) * target) - base, cache_min);
 
   size_t heap_size = 0;
   size_t unmapped = 0;
@@ -3916,6 +4110,7 @@ const char **BlueStore::get_tracked_conf_keys() const
     "bluestore_deferred_batch_ops",
     "bluestore_deferred_batch_ops_hdd",
     "bluestore_deferred_batch_ops_ssd",
+    "bluestore_deferred_batch_window_max",
     "bluestore_throttle_bytes",
     "bluestore_throttle_deferred_bytes",
     "bluestore_throttle_cost_per_io_hdd",
@@ -3924,6 +4119,7 @@ const char **BlueStore::get_tracked_conf_keys() const
     "bluestore_max_blob_size",
     "bluestore_max_blob_size_ssd",
     "bluestore_max_blob_size_hdd",
+    "bluestore_inline_data_max_size",
     NULL
   };
   return KEYS;
@@ -3951,13 +4147,20 @@ void BlueStore::handle_conf_change(const ConfigProxy& conf,
       _set_blob_size();
     }
   }
+  if (changed.count("bluestore_inline_data_max_size")) {
+    if (bdev) {
+      // only after startup
+      _set_inline_data_size();
+    }
+  }
   if (changed.count("bluestore_prefer_deferred_size") ||
       changed.count("bluestore_prefer_deferred_size_hdd") ||
       changed.count("bluestore_prefer_deferred_size_ssd") ||
       changed.count("bluestore_max_alloc_size") ||
       changed.count("bluestore_deferred_batch_ops") ||
       changed.count("bluestore_deferred_batch_ops_hdd") ||
-      changed.count("bluestore_deferred_batch_ops_ssd")) {
+      changed.count("bluestore_deferred_batch_ops_ssd") ||
+      changed.count("bluestore_deferred_batch_window_max")) {
     if (bdev) {
       // only after startup
       _set_alloc_sizes();
@@ -4084,6 +4287,16 @@ void BlueStore::_set_blob_size()
            << std::dec << dendl;
 }
 
+void BlueStore::_set_inline_data_size()
+{
+  // data at or past min_alloc_size costs a full allocation unit either way
+  inline_data_max_size = std::min<uint64_t>(
+    cct->_conf.get_val<uint64_t>("bluestore_inline_data_max_size"),
+    min_alloc_size);
+  dout(10) << __func__ << " inline_data_max_size 0x" << std::hex
+	   << inline_data_max_size << std::dec << dendl;
+}
+
 void BlueStore::_set_finisher_num()
 {
   if (cct->_conf->bluestore_shard_finishers) {
@@ -4109,6 +4322,10 @@ int BlueStore::_set_cache_sizes()
       cct->_conf.get_val<Option::size_t>("bluestore_cache_autotune_chunk_size");
   cache_autotune_interval =
       cct->_conf.get_val<double>("bluestore_cache_autotune_interval");
+  cache_autotune_shards =
+      cct->_conf.get_val<bool>("bluestore_cache_autotune_shards");
+  cache_shard_min_ratio =
+      cct->_conf.get_val<double>("bluestore_cache_shard_min_ratio");
   osd_memory_target = cct->_conf.get_val<uint64_t>("osd_memory_target");
   osd_memory_base = cct->_conf.get_val<uint64_t>("osd_memory_base");
   osd_memory_expected_fragmentation =
@@ -4265,6 +4482,12 @@ void BlueStore::_init_logger()
 		    "Sum for deferred write op");
   b.add_u64_counter(l_bluestore_deferred_write_bytes, "deferred_write_bytes",
 		    "Sum for deferred write bytes", "def", 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_deferred_write_extents, "deferred_write_extents",
+		    "Deferred extents merged into deferred write ops");
+  b.add_time_avg(l_bluestore_deferred_queue_age, "deferred_queue_age",
+		 "Age of the oldest deferred batch when submitted");
+  b.add_time_avg(l_bluestore_deferred_aio_lat, "deferred_aio_lat",
+		 "Average deferred submission device latency");
   b.add_u64_counter(l_bluestore_write_penalty_read_ops, "write_penalty_read_ops",
 		    "Sum for write penalty read ops");
   b.add_u64(l_bluestore_allocated, "bluestore_allocated",
@@ -4289,6 +4512,19 @@ void BlueStore::_init_logger()
   b.add_u64_counter(l_bluestore_onode_shard_misses,
 		    "bluestore_onode_shard_misses",
 		    "Sum for onode-shard lookups missed in the cache");
+  b.add_u64_counter(l_bluestore_extent_map_decode_bytes,
+		    "bluestore_extent_map_decode_bytes",
+		    "Encoded extent map bytes decoded",
+		    NULL, 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_extent_map_decode_extents,
+		    "bluestore_extent_map_decode_extents",
+		    "Extents decoded from encoded extent maps");
+  b.add_u64_counter(l_bluestore_extent_map_inline_deferred,
+		    "bluestore_extent_map_inline_deferred",
+		    "Onode loads that deferred decoding an unsharded extent map");
+  b.add_u64_counter(l_bluestore_extent_map_inline_faults,
+		    "bluestore_extent_map_inline_faults",
+		    "Deferred unsharded extent maps decoded on first use");
   b.add_u64(l_bluestore_extents, "bluestore_extents",
 	    "Number of extents in cache");
   b.add_u64(l_bluestore_blobs, "bluestore_blobs",
@@ -4339,6 +4575,43 @@ void BlueStore::_init_logger()
                     "Read EIO errors propagated to high level callers");
   b.add_u64(l_bluestore_fragmentation, "bluestore_fragmentation_micros",
             "How fragmented bluestore free space is (free extents / max possible number of free extents) * 1000");
+  b.add_time(l_bluestore_mount_lat, "mount_lat",
+	     "Time spent in the last mount");
+  b.add_time(l_bluestore_mount_open_db_lat, "mount_open_db_lat",
+	     "Time spent opening bluefs and the kv store during mount");
+  b.add_time(l_bluestore_mount_open_alloc_lat, "mount_open_alloc_lat",
+	     "Time spent building the allocator during mount");
+  b.add_time(l_bluestore_mount_open_collections_lat,
+	     "mount_open_collections_lat",
+	     "Time spent loading collections during mount");
+  b.add_time(l_bluestore_mount_deferred_replay_lat,
+	     "mount_deferred_replay_lat",
+	     "Time spent replaying deferred writes during mount");
+  b.add_u64(l_bluestore_alloc_snapshot_loaded, "alloc_snapshot_loaded",
+	    "Whether the allocator was loaded from the umount snapshot "
+	    "rather than the freelist");
+  b.add_u64_counter(l_bluestore_inline_write_ops, "inline_write_ops",
+		    "Writes stored inline in the onode");
+  b.add_u64_counter(l_bluestore_inline_write_bytes, "inline_write_bytes",
+		    "Bytes written inline in the onode",
+		    NULL, 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_inline_read_ops, "inline_read_ops",
+		    "Reads served from onode inline data");
+  b.add_u64_counter(l_bluestore_inline_spill_ops, "inline_spill_ops",
+		    "Objects whose inline data was moved to the block device");
+  b.add_u64_counter(l_bluestore_inline_alloc_saved_bytes,
+		    "inline_alloc_saved_bytes",
+		    "Block device allocation avoided by inline data, "
+		    "in bytes rounded up to min_alloc_size",
+		    NULL, 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_read_zero_copy_bytes, "read_zero_copy_bytes",
+		    "Read result bytes passed on by reference to device, "
+		    "cache or inline buffers",
+		    NULL, 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_read_built_bytes, "read_built_bytes",
+		    "Read result bytes written out for the read: "
+		    "decompressed data and zeros for holes",
+		    NULL, 0, unit_t(UNIT_BYTES));
   logger = b.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
 }
@@ -4526,6 +4799,9 @@ void BlueStore::_set_alloc_sizes(void)
     }
   }
 
+  deferred_batch_window_max =
+    cct->_conf.get_val<double>("bluestore_deferred_batch_window_max");
+
   if (cct->_conf->bluestore_deferred_batch_ops) {
     deferred_batch_ops = cct->_conf->bluestore_deferred_batch_ops;
   } else {
@@ -4717,7 +4993,7 @@ int BlueStore::_open_alloc()
   assert(bdev->get_size());
   alloc = Allocator::create(cct, cct->_conf->bluestore_allocator,
                             bdev->get_size(),
-                            min_alloc_size);
+                            min_alloc_size, "block");
   if (!alloc) {
     lderr(cct) << __func__ << " Allocator::unknown alloc type "
                << cct->_conf->bluestore_allocator
@@ -4727,6 +5003,28 @@ int BlueStore::_open_alloc()
 
   uint64_t num = 0, bytes = 0;
 
+  if (alloc_snapshot_bl.length()) {
+    int r = _load_alloc_snapshot(&num, &bytes);
+    alloc_snapshot_bl.clear();
+    if (r == 0) {
+      logger->set(l_bluestore_alloc_snapshot_loaded, 1);
+      dout(1) << __func__ << " loaded " << byte_u_t(bytes)
+	      << " in " << num << " extents from snapshot"
+	      << dendl;
+      return 0;
+    }
+    derr << __func__ << " ignoring allocator snapshot: " << cpp_strerror(r)
+	 << dendl;
+    // start over from the freelist
+    alloc->shutdown();
+    delete alloc;
+    alloc = Allocator::create(cct, cct->_conf->bluestore_allocator,
+			      bdev->get_size(),
+			      min_alloc_size, "block");
+    num = bytes = 0;
+  }
+  logger->set(l_bluestore_alloc_snapshot_loaded, 0);
+
   dout(1) << __func__ << " opening allocation metadata" << dendl;
   // initialize from freelist
   fm->enumerate_reset();
@@ -4751,6 +5049,176 @@ int BlueStore::_open_alloc()
   return 0;
 }
 
+/*
+ * On a clean umount the allocator's free extents are written to a
+ * bluefs file so that the next mount does not have to walk the whole
+ * freelist.  The file is only trusted for the mount that immediately
+ * follows: _open_db() reads it into memory and removes it before
+ * anything can modify the store, so after a crash (or any other way of
+ * opening the store) there is no snapshot and we fall back to the
+ * freelist.
+ */
+static const char *alloc_snapshot_dir = "bluestore";
+static const char *alloc_snapshot_file = "allocator.snapshot";
+
+int BlueStore::_write_alloc_snapshot()
+{
+  utime_t start = ceph_clock_now();
+  bufferlist bl;
+  uint64_t num = 0;
+  {
+    bufferlist extents_bl;
+    alloc->foreach([&](uint64_t offset, uint64_t length) {
+	encode(offset, extents_bl);
+	encode(length, extents_bl);
+	++num;
+      });
+    ENCODE_START(1, 1, bl);
+    encode(bdev->get_size(), bl);
+    encode(min_alloc_size, bl);
+    encode(bluefs_extents, bl);
+    encode(num, bl);
+    bl.claim_append(extents_bl);
+    ENCODE_FINISH(bl);
+  }
+  uint32_t crc = bl.crc32c(-1);
+  encode(crc, bl);
+
+  if (!bluefs->dir_exists(alloc_snapshot_dir)) {
+    int r = bluefs->mkdir(alloc_snapshot_dir);
+    if (r < 0) {
+      return r;
+    }
+  }
+  // write under a temporary name so a torn write is never picked up
+  string tmp = string(alloc_snapshot_file) + ".tmp";
+  BlueFS::FileWriter *h;
+  int r = bluefs->open_for_write(alloc_snapshot_dir, tmp, &h, false);
+  if (r < 0) {
+    return r;
+  }
+  h->append(bl);
+  r = bluefs->fsync(h);
+  bluefs->close_writer(h);
+  if (r < 0) {
+    return r;
+  }
+  r = bluefs->rename(alloc_snapshot_dir, tmp,
+		     alloc_snapshot_dir, alloc_snapshot_file);
+  if (r < 0) {
+    return r;
+  }
+  bluefs->sync_metadata();
+  dout(1) << __func__ << " wrote " << num << " extents (" << bl.length()
+	  << " bytes) in " << ceph_clock_now() - start << dendl;
+  return 0;
+}
+
+void BlueStore::_read_alloc_snapshot()
+{
+  alloc_snapshot_bl.clear();
+  if (!bluefs->dir_exists(alloc_snapshot_dir)) {
+    return;
+  }
+  uint64_t size;
+  utime_t mtime;
+  bool have = false;
+  if (bluefs->stat(alloc_snapshot_dir, alloc_snapshot_file,
+		   &size, &mtime) == 0) {
+    have = true;
+    if (cct->_conf.get_val<bool>("bluestore_alloc_snapshot")) {
+      BlueFS::FileReader *h;
+      int r = bluefs->open_for_read(alloc_snapshot_dir, alloc_snapshot_file,
+				    &h, false);
+      if (r == 0) {
+	while (alloc_snapshot_bl.length() < size) {
+	  r = bluefs->read(h, &h->buf, alloc_snapshot_bl.length(),
+			   size - alloc_snapshot_bl.length(),
+			   &alloc_snapshot_bl, NULL);
+	  if (r <= 0) {
+	    break;
+	  }
+	}
+	delete h;
+      }
+      if (alloc_snapshot_bl.length() != size) {
+	derr << __func__ << " failed to read allocator snapshot: "
+	     << cpp_strerror(r) << dendl;
+	alloc_snapshot_bl.clear();
+      }
+    }
+  }
+  // whatever we do from here on invalidates the snapshot
+  bool dirty = false;
+  vector<string> ls;
+  bluefs->readdir(alloc_snapshot_dir, &ls);
+  for (auto& f : ls) {
+    if (f == "." || f == "..") {
+      continue;
+    }
+    bluefs->unlink(alloc_snapshot_dir, f);
+    dirty = true;
+  }
+  if (dirty) {
+    bluefs->sync_metadata();
+  }
+  dout(10) << __func__ << " snapshot " << (have ? "found" : "not found")
+	   << ", " << alloc_snapshot_bl.length() << " bytes read" << dendl;
+}
+
+int BlueStore::_load_alloc_snapshot(uint64_t *num, uint64_t *bytes)
+{
+  if (alloc_snapshot_bl.length() < sizeof(uint32_t)) {
+    return -EINVAL;
+  }
+  uint32_t payload_len = alloc_snapshot_bl.length() - sizeof(uint32_t);
+  bufferlist payload;
+  payload.substr_of(alloc_snapshot_bl, 0, payload_len);
+  uint32_t crc;
+  {
+    bufferlist crc_bl;
+    crc_bl.substr_of(alloc_snapshot_bl, payload_len, sizeof(uint32_t));
+    auto p = crc_bl.cbegin();
+    decode(crc, p);
+  }
+  if (crc != payload.crc32c(-1)) {
+    derr << __func__ << " bad crc" << dendl;
+    return -EIO;
+  }
+
+  try {
+    auto p = payload.cbegin();
+    DECODE_START(1, p);
+    uint64_t size, snap_min_alloc_size, n;
+    interval_set<uint64_t> snap_bluefs_extents;
+    decode(size, p);
+    decode(snap_min_alloc_size, p);
+    decode(snap_bluefs_extents, p);
+    if (size != bdev->get_size() ||
+	snap_min_alloc_size != min_alloc_size ||
+	!(snap_bluefs_extents == bluefs_extents)) {
+      derr << __func__ << " snapshot does not match the store: size 0x"
+	   << std::hex << size << " min_alloc_size 0x" << snap_min_alloc_size
+	   << " bluefs_extents 0x" << snap_bluefs_extents << std::dec << dendl;
+      return -ESTALE;
+    }
+    decode(n, p);
+    for (uint64_t i = 0; i < n; ++i) {
+      uint64_t offset, length;
+      decode(offset, p);
+      decode(length, p);
+      alloc->init_add_free(offset, length);
+      *bytes += length;
+    }
+    *num = n;
+    DECODE_FINISH(p);
+  } catch (buffer::error& e) {
+    derr << __func__ << " failed to decode: " << e.what() << dendl;
+    return -EIO;
+  }
+  return 0;
+}
+
 void BlueStore::_close_alloc()
 {
   assert(bdev);
@@ -5092,6 +5560,9 @@ int BlueStore::_open_db(bool create, bool to_repair_db)
       derr << __func__ << " failed bluefs mount: " << cpp_strerror(r) << dendl;
       goto free_bluefs;
     }
+    if (!create) {
+      _read_alloc_snapshot();
+    }
     if (cct->_conf->bluestore_bluefs_env_mirror) {
       rocksdb::Env *a = new BlueRocksEnv(bluefs);
       rocksdb::Env *b = rocksdb::Env::Default();
@@ -5182,16 +5653,7 @@ int BlueStore::_open_db(bool create, bool to_repair_db)
 
   if (kv_backend == "rocksdb") {
     options = cct->_conf->bluestore_rocksdb_options;
-
-    map<string,string> cf_map;
-    cct->_conf.with_val<string>("bluestore_rocksdb_cfs",
-                                 get_str_map,
-                                 &cf_map,
-                                 " \t");
-    for (auto& i : cf_map) {
-      dout(10) << "column family " << i.first << ": " << i.second << dendl;
-      cfs.push_back(KeyValueDB::ColumnFamily(i.first, i.second));
-    }
+    _get_rocksdb_cfs(&cfs);
   }
 
   db->init(options);
@@ -5224,11 +5686,25 @@ free_bluefs:
   return r;
 }
 
+void BlueStore::_get_rocksdb_cfs(vector<KeyValueDB::ColumnFamily> *cfs)
+{
+  map<string,string> cf_map;
+  cct->_conf.with_val<string>("bluestore_rocksdb_cfs",
+			       get_str_map,
+			       &cf_map,
+			       " \t");
+  for (auto& i : cf_map) {
+    dout(10) << "column family " << i.first << ": " << i.second << dendl;
+    cfs->push_back(KeyValueDB::ColumnFamily(i.first, i.second));
+  }
+}
+
 void BlueStore::_close_db()
 {
   assert(db);
   delete db;
   db = NULL;
+  alloc_snapshot_bl.clear();
   if (bluefs) {
     bluefs->umount();
     delete bluefs;
@@ -5710,6 +6186,7 @@ int BlueStore::mkfs()
     }
 
     ondisk_format = latest_ondisk_format;
+    compat_ondisk_format = min_compat_ondisk_format;
     _prepare_ondisk_format_super(t);
     db->submit_transaction_sync(t);
   }
@@ -5781,6 +6258,8 @@ void BlueStore::set_cache_shards(unsigned num)
 int BlueStore::_mount(bool kv_only, bool open_db)
 {
   dout(1) << __func__ << " path " << path << dendl;
+  utime_t mount_start = ceph_clock_now();
+  utime_t phase_start;
 
   _kv_only = kv_only;
 
@@ -5828,9 +6307,11 @@ int BlueStore::_mount(bool kv_only, bool open_db)
   if (r < 0)
     goto out_fsid;
 
+  phase_start = ceph_clock_now();
   r = _open_db(false, !open_db);
   if (r < 0)
     goto out_bdev;
+  logger->tset(l_bluestore_mount_open_db_lat, ceph_clock_now() - phase_start);
 
   if (kv_only)
     return 0;
@@ -5843,13 +6324,19 @@ int BlueStore::_mount(bool kv_only, bool open_db)
   if (r < 0)
     goto out_db;
 
+  phase_start = ceph_clock_now();
   r = _open_alloc();
   if (r < 0)
     goto out_fm;
+  logger->tset(l_bluestore_mount_open_alloc_lat,
+	       ceph_clock_now() - phase_start);
 
+  phase_start = ceph_clock_now();
   r = _open_collections();
   if (r < 0)
     goto out_alloc;
+  logger->tset(l_bluestore_mount_open_collections_lat,
+	       ceph_clock_now() - phase_start);
 
   r = _reload_logger();
   if (r < 0)
@@ -5863,13 +6350,17 @@ int BlueStore::_mount(bool kv_only, bool open_db)
 
   _kv_start();
 
+  phase_start = ceph_clock_now();
   r = _deferred_replay();
   if (r < 0)
     goto out_stop;
+  logger->tset(l_bluestore_mount_deferred_replay_lat,
+	       ceph_clock_now() - phase_start);
 
   mempool_thread.init();
 
   mounted = true;
+  logger->tset(l_bluestore_mount_lat, ceph_clock_now() - mount_start);
   return 0;
 
  out_stop:
@@ -5906,6 +6397,13 @@ int BlueStore::umount()
     _flush_cache();
     dout(20) << __func__ << " closing" << dendl;
 
+    if (bluefs && cct->_conf.get_val<bool>("bluestore_alloc_snapshot")) {
+      int r = _write_alloc_snapshot();
+      if (r < 0) {
+	derr << __func__ << " failed to write allocator snapshot: "
+	     << cpp_strerror(r) << dendl;
+      }
+    }
     _close_alloc();
     _close_fm();
   }
@@ -5926,6 +6424,62 @@ int BlueStore::umount()
   return 0;
 }
 
+int BlueStore::migrate_to_column_families(ostream& out)
+{
+  dout(1) << __func__ << dendl;
+  string kv_backend;
+  int r = read_meta("kv_backend", &kv_backend);
+  if (r < 0 || kv_backend != "rocksdb") {
+    out << "column families need the rocksdb kv backend" << std::endl;
+    return -EOPNOTSUPP;
+  }
+  vector<KeyValueDB::ColumnFamily> cfs;
+  _get_rocksdb_cfs(&cfs);
+
+  r = _open_path();
+  if (r < 0)
+    return r;
+  r = _open_fsid(false);
+  if (r < 0)
+    goto out_path;
+  r = _read_fsid(&fsid);
+  if (r < 0)
+    goto out_fsid;
+  r = _lock_fsid();
+  if (r < 0)
+    goto out_fsid;
+  r = _open_bdev(false);
+  if (r < 0)
+    goto out_fsid;
+  r = _open_db(false);
+  if (r < 0)
+    goto out_bdev;
+
+  {
+    // refuse to mount until every prefix has been moved
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->set(PREFIX_SUPER, "cf_migration", bufferlist());
+    db->submit_transaction_sync(t);
+  }
+  r = db->migrate_prefixes_to_cfs(cfs, out);
+  if (r == 0) {
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->rmkey(PREFIX_SUPER, "cf_migration");
+    db->submit_transaction_sync(t);
+  } else {
+    derr << __func__ << " failed: " << cpp_strerror(r) << dendl;
+  }
+
+  _close_db();
+ out_bdev:
+  _close_bdev();
+ out_fsid:
+  _close_fsid();
+ out_path:
+  _close_path();
+  return r;
+}
+
 static void apply(uint64_t off,
                   uint64_t len,
                   uint64_t granularity,
@@ -6092,6 +6646,8 @@ int BlueStore::_fsck(bool deep, bool repair)
   r = _open_db(false);
   if (r < 0)
     goto out_bdev;
+  // fsck always rebuilds the allocator from the freelist
+  alloc_snapshot_bl.clear();
 
   r = _open_super_meta();
   if (r < 0)
@@ -6290,6 +6846,18 @@ int BlueStore::_fsck(bool deep, bool repair)
       num_spanning_blobs += o->extent_map.spanning_blob_map.size();
       o->extent_map.fault_range(db, 0, OBJECT_MAX_SIZE);
       _dump_onode(o);
+      if (o->onode.has_inline_data() &&
+	  (o->onode.inline_data.length() > o->onode.size ||
+	   !o->extent_map.extent_map.empty())) {
+	derr << "fsck error: " << oid << " inline data 0x" << std::hex
+	     << o->onode.inline_data.length() << " with size 0x"
+	     << o->onode.size << std::dec << " and "
+	     << o->extent_map.extent_map.size() << " lextents" << dendl;
+	++errors;
+      }
+      if (o->onode.has_inline_data()) {
+	expected_statfs.stored += o->onode.inline_data.length();
+      }
       // shards
       if (!o->extent_map.shards.empty()) {
 	++num_sharded_objects;
@@ -7423,6 +7991,22 @@ int BlueStore::_do_read(
     length = o->onode.size - offset;
   }
 
+  if (o->onode.has_inline_data()) {
+    const bufferlist& d = o->onode.inline_data;
+    if (offset < d.length()) {
+      bufferlist t;
+      t.substr_of(d, offset, std::min<uint64_t>(length, d.length() - offset));
+      bl.claim_append(t);
+    }
+    logger->inc(l_bluestore_read_zero_copy_bytes, bl.length());
+    if (bl.length() < length) {
+      logger->inc(l_bluestore_read_built_bytes, length - bl.length());
+      bl.append_zero(length - bl.length());
+    }
+    logger->inc(l_bluestore_inline_read_ops);
+    return bl.length();
+  }
+
   auto start = mono_clock::now();
   o->extent_map.fault_range(db, offset, length);
   logger->tinc(l_bluestore_read_onode_meta_lat, mono_clock::now() - start);
@@ -7592,6 +8176,55 @@ int BlueStore::_do_read(
   }
   logger->tinc(l_bluestore_read_wait_aio_lat, mono_clock::now() - start);
 
+  // verify everything that was read uncompressed in a single batch, so
+  // that chunks of different regions and blobs are checksummed side by side
+  {
+    vector<const bluestore_blob_t*> csum_blobs;
+    vector<Checksummer::verify_item_t> csum_items;
+    vector<uint64_t> csum_logical;
+    for (auto& b2r : blobs2read) {
+      const bluestore_blob_t& blob = b2r.first->get_blob();
+      if (blob.is_compressed()) {
+	continue;
+      }
+      for (auto& reg : b2r.second) {
+	csum_blobs.push_back(&blob);
+	csum_items.emplace_back();
+	csum_items.back().offset = reg.r_off;
+	csum_items.back().bl = &reg.bl;
+	csum_logical.push_back(reg.logical_offset);
+      }
+    }
+    if (!csum_items.empty()) {
+      auto start = mono_clock::now();
+      r = bluestore_blob_t::verify_csum_batch(
+	csum_blobs.data(), csum_items.data(), csum_items.size());
+      logger->tinc(l_bluestore_csum_lat, mono_clock::now() - start);
+      if (r == 0) {
+	r = _debug_inject_csum_err(csum_items);
+      }
+      if (r < 0) {
+	derr << __func__ << " verify_csum_batch failed with exit code: "
+	     << cpp_strerror(r) << dendl;
+	return -EIO;
+      }
+      if (r > 0) {
+	for (size_t i = 0; i < csum_items.size(); ++i) {
+	  auto& item = csum_items[i];
+	  if (item.bad >= 0) {
+	    _log_bad_csum(__func__, o, csum_blobs[i], item.offset, item.bad,
+			  item.bad_csum, csum_logical[i]);
+	  }
+	}
+	return -EIO;
+      }
+    }
+  }
+
+  // everything else in the result is a reference to a device or cache
+  // buffer
+  uint64_t built = 0;
+
   // enumerate and decompress desired blobs
   auto p = compressed_blob_bls.begin();
   blobs2read_t::iterator b2r_it = blobs2read.begin();
@@ -7617,13 +8250,10 @@ int BlueStore::_do_read(
       for (auto& i : b2r_it->second) {
 	ready_regions[i.logical_offset].substr_of(
 	  raw_bl, i.blob_xoffset, i.length);
+	built += i.length;
       }
     } else {
       for (auto& reg : b2r_it->second) {
-	if (_verify_csum(o, &bptr->get_blob(), reg.r_off, reg.bl,
-			 reg.logical_offset) < 0) {
-	  return -EIO;
-	}
 	if (buffered) {
 	  bptr->shared_blob->bc.did_read(bptr->shared_blob->get_cache(),
 					 reg.r_off, reg.bl);
@@ -7659,47 +8289,235 @@ int BlueStore::_do_read(
 	       << ": zeros for 0x" << (pos + offset) << "~" << l
 	       << std::dec << dendl;
       bl.append_zero(l);
+      built += l;
       pos += l;
     }
   }
   assert(bl.length() == length);
   assert(pos == length);
   assert(pr == pr_end);
+  logger->inc(l_bluestore_read_zero_copy_bytes, length - built);
+  logger->inc(l_bluestore_read_built_bytes, built);
   r = bl.length();
   return r;
 }
 
-int BlueStore::_verify_csum(OnodeRef& o,
-			    const bluestore_blob_t* blob, uint64_t blob_xoffset,
-			    const bufferlist& bl,
-			    uint64_t logical_offset) const
+int BlueStore::verify_csum(
+  CollectionHandle &c_,
+  const ghobject_t& oid,
+  uint64_t offset,
+  size_t length,
+  uint32_t op_flags)
 {
-  int bad;
-  uint64_t bad_csum;
   auto start = mono_clock::now();
-  int r = blob->verify_csum(blob_xoffset, bl, &bad, &bad_csum);
-  if (r < 0) {
-    if (r == -1) {
-      PExtentVector pex;
-      blob->map(
-	bad,
-	blob->get_csum_chunk_size(),
-	[&](uint64_t offset, uint64_t length) {
-	  pex.emplace_back(bluestore_pextent_t(offset, length));
-          return 0;
-	});
-      derr << __func__ << " bad "
-	   << Checksummer::get_csum_type_string(blob->csum_type)
-	   << "/0x" << std::hex << blob->get_csum_chunk_size()
-	   << " checksum at blob offset 0x" << bad
-	   << ", got 0x" << bad_csum << ", expected 0x"
-	   << blob->get_csum_item(bad / blob->get_csum_chunk_size()) << std::dec
-	   << ", device location " << pex
-	   << ", logical extent 0x" << std::hex
-	   << (logical_offset + bad - blob_xoffset) << "~"
-	   << blob->get_csum_chunk_size() << std::dec
-	   << ", object " << o->oid
+  Collection *c = static_cast<Collection *>(c_.get());
+  dout(15) << __func__ << " " << c->get_cid() << " " << oid
+	   << " 0x" << std::hex << offset << "~" << length << std::dec
 	   << dendl;
+  if (!c->exists)
+    return -ENOENT;
+
+  int r;
+  {
+    RWLock::RLocker l(c->lock);
+    OnodeRef o = c->get_onode(oid, false);
+    if (!o || !o->exists) {
+      r = -ENOENT;
+    } else {
+      r = _do_verify_csum(c, o, offset, length);
+      if (r == -EIO) {
+	logger->inc(l_bluestore_read_eio);
+      }
+    }
+  }
+  if (r >= 0 && _debug_data_eio(oid)) {
+    r = -EIO;
+    derr << __func__ << " " << c->cid << " " << oid << " INJECT EIO" << dendl;
+  }
+  dout(10) << __func__ << " " << c->get_cid() << " " << oid
+	   << " 0x" << std::hex << offset << "~" << length << std::dec
+	   << " = " << r << dendl;
+  logger->tinc(l_bluestore_read_lat, mono_clock::now() - start);
+  return r;
+}
+
+int BlueStore::_do_verify_csum(
+  Collection *c,
+  OnodeRef o,
+  uint64_t offset,
+  size_t length)
+{
+  dout(20) << __func__ << " 0x" << std::hex << offset << "~" << length
+	   << " size 0x" << o->onode.size << std::dec << dendl;
+  if (offset >= o->onode.size) {
+    return 0;
+  }
+  if (offset + length > o->onode.size) {
+    length = o->onode.size - offset;
+  }
+  if (o->onode.has_inline_data()) {
+    // lives in the kv store, which checks it on its own
+    return length;
+  }
+
+  auto start = mono_clock::now();
+  o->extent_map.fault_range(db, offset, length);
+  logger->tinc(l_bluestore_read_onode_meta_lat, mono_clock::now() - start);
+
+  // unlike _do_read, go to the device even for cached data, and read
+  // whole csum chunks without trimming them back down: nothing is
+  // returned.  compressed blobs are checksummed whole.  a write still in
+  // flight (deferred ones stay that way until their txc finishes) may
+  // not have reached the device while its csum is already in the blob;
+  // leave such ranges to a regular read, which serves them from the
+  // buffer cache.
+  blobs2read_t blobs2read;
+  unsigned num_regions = 0;
+  uint64_t end = offset + length;
+  for (auto lp = o->extent_map.seek_lextent(offset);
+       lp != o->extent_map.extent_map.end() && lp->logical_offset < end;
+       ++lp) {
+    const bluestore_blob_t& blob = lp->blob->get_blob();
+    if (!blob.has_csum()) {
+      dout(20) << __func__ << "  blob " << *lp->blob << " has no csum"
+	       << dendl;
+      return -EOPNOTSUPP;
+    }
+    SharedBlob *sb = lp->blob->shared_blob.get();
+    regions2read_t& regs = blobs2read[lp->blob];
+    if (blob.is_compressed()) {
+      if (regs.empty()) {
+	if (sb->bc.has_writing(sb->get_cache(), 0,
+			       blob.get_logical_length())) {
+	  dout(20) << __func__ << "  blob " << *lp->blob
+		   << " has writes in flight" << dendl;
+	  return -EOPNOTSUPP;
+	}
+	regs.emplace_back(region_t(lp->logical_offset, 0,
+				   blob.get_ondisk_length()));
+	++num_regions;
+      }
+      continue;
+    }
+    uint64_t pos = std::max<uint64_t>(offset, lp->logical_offset);
+    uint64_t l_end = std::min<uint64_t>(end, lp->logical_end());
+    regs.emplace_back(region_t(pos, pos - lp->logical_offset + lp->blob_offset,
+			       l_end - pos));
+    region_t& reg = regs.back();
+    uint64_t chunk_size = blob.get_chunk_size(block_size);
+    reg.front = reg.blob_xoffset % chunk_size;
+    reg.r_off = reg.blob_xoffset - reg.front;
+    if (sb->bc.has_writing(sb->get_cache(), reg.r_off,
+			   p2roundup(reg.front + reg.length, chunk_size))) {
+      dout(20) << __func__ << "  blob " << *lp->blob
+	       << " has writes in flight" << dendl;
+      return -EOPNOTSUPP;
+    }
+    ++num_regions;
+  }
+
+  start = mono_clock::now();
+  IOContext ioc(cct, NULL, true); // allow EIO
+  int r = 0;
+  for (auto& p : blobs2read) {
+    const bluestore_blob_t& blob = p.first->get_blob();
+    for (auto& reg : p.second) {
+      uint64_t r_len = reg.length;
+      if (!blob.is_compressed()) {
+	uint64_t chunk_size = blob.get_chunk_size(block_size);
+	r_len += reg.front;
+	unsigned tail = r_len % chunk_size;
+	if (tail) {
+	  r_len += chunk_size - tail;
+	}
+      }
+      r = blob.map(
+	reg.r_off, r_len,
+	[&](uint64_t offset, uint64_t length) {
+	  int r;
+	  // use aio if there is more than one region to read
+	  if (num_regions > 1) {
+	    r = bdev->aio_read(offset, length, &reg.bl, &ioc);
+	  } else {
+	    r = bdev->read(offset, length, &reg.bl, &ioc, false);
+	  }
+	  if (r < 0)
+	    return r;
+	  return 0;
+	});
+      if (r < 0) {
+	derr << __func__ << " bdev-read failed: " << cpp_strerror(r) << dendl;
+	if (r == -EIO) {
+	  return r;
+	}
+	assert(r == 0);
+      }
+    }
+  }
+  if (ioc.has_pending_aios()) {
+    bdev->aio_submit(&ioc);
+    dout(20) << __func__ << " waiting for aio" << dendl;
+    ioc.aio_wait();
+    r = ioc.get_return_value();
+    if (r < 0) {
+      assert(r == -EIO); // no other errors allowed
+      return -EIO;
+    }
+  }
+  logger->tinc(l_bluestore_read_wait_aio_lat, mono_clock::now() - start);
+
+  vector<const bluestore_blob_t*> csum_blobs;
+  vector<Checksummer::verify_item_t> csum_items;
+  vector<uint64_t> csum_logical;
+  for (auto& b2r : blobs2read) {
+    for (auto& reg : b2r.second) {
+      csum_blobs.push_back(&b2r.first->get_blob());
+      csum_items.emplace_back();
+      csum_items.back().offset = reg.r_off;
+      csum_items.back().bl = &reg.bl;
+      csum_logical.push_back(reg.logical_offset - reg.front);
+    }
+  }
+  if (!csum_items.empty()) {
+    start = mono_clock::now();
+    r = bluestore_blob_t::verify_csum_batch(
+      csum_blobs.data(), csum_items.data(), csum_items.size());
+    logger->tinc(l_bluestore_csum_lat, mono_clock::now() - start);
+    if (r == 0) {
+      r = _debug_inject_csum_err(csum_items);
+    }
+    if (r < 0) {
+      derr << __func__ << " verify_csum_batch failed with exit code: "
+	   << cpp_strerror(r) << dendl;
+      return -EIO;
+    }
+    if (r > 0) {
+      for (size_t i = 0; i < csum_items.size(); ++i) {
+	auto& item = csum_items[i];
+	if (item.bad >= 0) {
+	  _log_bad_csum(__func__, o, csum_blobs[i], item.offset, item.bad,
+			item.bad_csum, csum_logical[i]);
+	}
+      }
+      return -EIO;
+    }
+  }
+  return length;
+}
+
+int BlueStore::_verify_csum(OnodeRef& o,
+			    const bluestore_blob_t* blob, uint64_t blob_xoffset,
+			    const bufferlist& bl,
+			    uint64_t logical_offset) const
+{
+  int bad;
+  uint64_t bad_csum;
+  auto start = mono_clock::now();
+  int r = blob->verify_csum(blob_xoffset, bl, &bad, &bad_csum);
+  if (r < 0) {
+    if (r == -1) {
+      _log_bad_csum(__func__, o, blob, blob_xoffset, bad, bad_csum,
+		    logical_offset);
     } else {
       derr << __func__ << " failed with exit code: " << cpp_strerror(r) << dendl;
     }
@@ -7708,6 +8526,36 @@ int BlueStore::_verify_csum(OnodeRef& o,
   return r;
 }
 
+void BlueStore::_log_bad_csum(const char *caller,
+			      OnodeRef& o,
+			      const bluestore_blob_t* blob,
+			      uint64_t blob_xoffset,
+			      int bad,
+			      uint64_t bad_csum,
+			      uint64_t logical_offset) const
+{
+  PExtentVector pex;
+  blob->map(
+    bad,
+    blob->get_csum_chunk_size(),
+    [&](uint64_t offset, uint64_t length) {
+      pex.emplace_back(bluestore_pextent_t(offset, length));
+      return 0;
+    });
+  derr << caller << " bad "
+       << Checksummer::get_csum_type_string(blob->csum_type)
+       << "/0x" << std::hex << blob->get_csum_chunk_size()
+       << " checksum at blob offset 0x" << bad
+       << ", got 0x" << bad_csum << ", expected 0x"
+       << blob->get_csum_item(bad / blob->get_csum_chunk_size()) << std::dec
+       << ", device location " << pex
+       << ", logical extent 0x" << std::hex
+       << (logical_offset + bad - blob_xoffset) << "~"
+       << blob->get_csum_chunk_size() << std::dec
+       << ", object " << o->oid
+       << dendl;
+}
+
 int BlueStore::_decompress(bufferlist& source, bufferlist* result)
 {
   int r = 0;
@@ -7769,6 +8617,14 @@ int BlueStore::_fiemap(
       length = o->onode.size - offset;
     }
 
+    if (o->onode.has_inline_data()) {
+      uint64_t inline_len = o->onode.inline_data.length();
+      if (offset < inline_len) {
+	destset.insert(offset, std::min<uint64_t>(length, inline_len - offset));
+      }
+      goto out;
+    }
+
     o->extent_map.fault_range(db, offset, length);
     eend = o->extent_map.extent_map.end();
     ep = o->extent_map.seek_lextent(offset);
@@ -8358,13 +9214,45 @@ void BlueStore::_prepare_ondisk_format_super(KeyValueDB::Transaction& t)
   }
   {
     bufferlist bl;
-    encode(min_compat_ondisk_format, bl);
+    encode((int32_t)compat_ondisk_format, bl);
     t->set(PREFIX_SUPER, "min_compat_ondisk_format", bl);
   }
 }
 
+void BlueStore::_require_compat_ondisk_format(int32_t compat)
+{
+  if (compat_ondisk_format >= compat) {
+    return;
+  }
+  std::lock_guard<std::mutex> l(compat_ondisk_format_lock);
+  if (compat_ondisk_format >= compat) {
+    return;
+  }
+  // commit this before anything that needs it can be, so older versions
+  // never get to mount a store they would misread
+  dout(1) << __func__ << " raising min_compat_ondisk_format from "
+	  << compat_ondisk_format << " to " << compat << dendl;
+  KeyValueDB::Transaction t = db->get_transaction();
+  bufferlist bl;
+  encode(compat, bl);
+  t->set(PREFIX_SUPER, "min_compat_ondisk_format", bl);
+  int r = db->submit_transaction_sync(t);
+  assert(r == 0);
+  compat_ondisk_format = compat;
+}
+
 int BlueStore::_open_super_meta()
 {
+  // a half done migration leaves keys behind in the default column family
+  {
+    bufferlist bl;
+    if (db->get(PREFIX_SUPER, "cf_migration", &bl) >= 0) {
+      derr << __func__ << " column family migration was interrupted; rerun "
+	   << "'ceph-bluestore-tool migrate-cf'" << dendl;
+      return -EIO;
+    }
+  }
+
   // nid
   {
     nid_max = 0;
@@ -8431,7 +9319,7 @@ int BlueStore::_open_super_meta()
   }
 
   // ondisk format
-  int32_t compat_ondisk_format = 0;
+  int32_t compat = 0;
   {
     bufferlist bl;
     int r = db->get(PREFIX_SUPER, "ondisk_format", &bl);
@@ -8440,7 +9328,7 @@ int BlueStore::_open_super_meta()
       dout(20) << __func__ << " missing ondisk_format; assuming kraken"
 	       << dendl;
       ondisk_format = 1;
-      compat_ondisk_format = 1;
+      compat = 1;
     } else {
       auto p = bl.cbegin();
       try {
@@ -8455,7 +9343,7 @@ int BlueStore::_open_super_meta()
 	assert(!r);
 	auto p = bl.cbegin();
 	try {
-	  decode(compat_ondisk_format, p);
+	  decode(compat, p);
 	} catch (buffer::error& e) {
 	  derr << __func__ << " unable to read compat_ondisk_format" << dendl;
 	  return -EIO;
@@ -8463,16 +9351,17 @@ int BlueStore::_open_super_meta()
       }
     }
     dout(10) << __func__ << " ondisk_format " << ondisk_format
-	     << " compat_ondisk_format " << compat_ondisk_format
+	     << " compat_ondisk_format " << compat
 	     << dendl;
   }
 
-  if (latest_ondisk_format < compat_ondisk_format) {
+  if (latest_ondisk_format < compat) {
     derr << __func__ << " compat_ondisk_format is "
-	 << compat_ondisk_format << " but we only understand version "
+	 << compat << " but we only understand version "
 	 << latest_ondisk_format << dendl;
     return -EPERM;
   }
+  compat_ondisk_format = compat;
   if (ondisk_format < latest_ondisk_format) {
     int r = _upgrade_super();
     if (r < 0) {
@@ -8504,6 +9393,7 @@ int BlueStore::_open_super_meta()
   _set_csum();
   _set_compression();
   _set_blob_size();
+  _set_inline_data_size();
 
   _set_finisher_num();
 
@@ -8518,6 +9408,7 @@ int BlueStore::_upgrade_super()
   assert(ondisk_format > 0);
   assert(ondisk_format < latest_ondisk_format);
 
+  KeyValueDB::Transaction t = db->get_transaction();
   if (ondisk_format == 1) {
     // changes:
     // - super: added ondisk_format
@@ -8525,7 +9416,6 @@ int BlueStore::_upgrade_super()
     // - super: added min_compat_ondisk_format
     // - super: added min_alloc_size
     // - super: removed min_min_alloc_size
-    KeyValueDB::Transaction t = db->get_transaction();
     {
       bufferlist bl;
       db->get(PREFIX_SUPER, "min_min_alloc_size", &bl);
@@ -8542,10 +9432,19 @@ int BlueStore::_upgrade_super()
       t->rmkey(PREFIX_SUPER, "min_min_alloc_size");
     }
     ondisk_format = 2;
-    _prepare_ondisk_format_super(t);
-    int r = db->submit_transaction_sync(t);
-    assert(r == 0);
   }
+  if (ondisk_format == 2) {
+    // changes:
+    // - onode: added inline data.  min_compat_ondisk_format is raised to
+    //   inline_data_compat_ondisk_format when the first inline onode is
+    //   written, so stores that never use it stay readable by v2.
+    ondisk_format = 3;
+  }
+  compat_ondisk_format = std::max(compat_ondisk_format.load(),
+				  min_compat_ondisk_format);
+  _prepare_ondisk_format_super(t);
+  int r = db->submit_transaction_sync(t);
+  assert(r == 0);
 
   // done
   dout(1) << __func__ << " done" << dendl;
@@ -9442,7 +10341,8 @@ void BlueStore::_kv_finalize_thread()
 
       if (!deferred_aggressive) {
 	if (deferred_queue_size >= deferred_batch_ops.load() ||
-	    throttle_deferred_bytes.past_midpoint()) {
+	    throttle_deferred_bytes.past_midpoint() ||
+	    _deferred_window_expired()) {
 	  deferred_try_submit();
 	}
       }
@@ -9481,7 +10381,7 @@ void BlueStore::_deferred_queue(TransContext *txc)
     deferred_queue.push_back(*txc->osr);
   }
   if (!txc->osr->deferred_pending) {
-    txc->osr->deferred_pending = new DeferredBatch(cct, txc->osr.get());
+    txc->osr->deferred_pending = new DeferredBatch(txc->osr.get());
   }
   ++deferred_queue_size;
   txc->osr->deferred_pending->txcs.push_back(*txc);
@@ -9508,81 +10408,173 @@ void BlueStore::deferred_try_submit()
   dout(20) << __func__ << " " << deferred_queue.size() << " osrs, "
 	   << deferred_queue_size << " txcs" << dendl;
   std::lock_guard<std::mutex> l(deferred_lock);
-  vector<OpSequencerRef> osrs;
+  vector<OpSequencer*> osrs;
   osrs.reserve(deferred_queue.size());
   for (auto& osr : deferred_queue) {
-    osrs.push_back(&osr);
-  }
-  for (auto& osr : osrs) {
-    if (osr->deferred_pending) {
-      if (!osr->deferred_running) {
-	_deferred_submit_unlock(osr.get());
-	deferred_lock.lock();
+    if (osr.deferred_pending) {
+      if (!osr.deferred_running) {
+	osrs.push_back(&osr);
       } else {
-	dout(20) << __func__ << "  osr " << osr << " already has running"
+	dout(20) << __func__ << "  osr " << &osr << " already has running"
 		 << dendl;
       }
     } else {
-      dout(20) << __func__ << "  osr " << osr << " has no pending" << dendl;
+      dout(20) << __func__ << "  osr " << &osr << " has no pending" << dendl;
     }
   }
+  if (!osrs.empty()) {
+    _deferred_submit_unlock(osrs);
+    deferred_lock.lock();
+  }
+}
+
+bool BlueStore::_deferred_window_expired()
+{
+  // Hold deferred writes for roughly one device round trip so that more
+  // of them can be merged into each sweep, but never longer than
+  // bluestore_deferred_batch_window_max.  Slow (seeking) devices thus get
+  // bigger batches and fast ones are not held back.
+  double window = deferred_batch_window_max;
+  if (window <= 0) {
+    return false;
+  }
+  double lat = deferred_lat_avg;
+  if (lat > 0 && lat < window) {
+    window = lat;
+  }
+  auto now = mono_clock::now();
+  std::lock_guard<std::mutex> l(deferred_lock);
+  for (auto& osr : deferred_queue) {
+    if (osr.deferred_pending && !osr.deferred_running &&
+	std::chrono::duration<double>(
+	  now - osr.deferred_pending->start).count() >= window) {
+      return true;
+    }
+  }
+  return false;
 }
 
 void BlueStore::_deferred_submit_unlock(OpSequencer *osr)
 {
-  dout(10) << __func__ << " osr " << osr
-	   << " " << osr->deferred_pending->iomap.size() << " ios pending "
-	   << dendl;
-  assert(osr->deferred_pending);
-  assert(!osr->deferred_running);
+  _deferred_submit_unlock(vector<OpSequencer*>{osr});
+}
 
-  auto b = osr->deferred_pending;
-  deferred_queue_size -= b->seq_bytes.size();
-  assert(deferred_queue_size >= 0);
+void BlueStore::_deferred_submit_unlock(const vector<OpSequencer*>& osrs)
+{
+  dout(10) << __func__ << " " << osrs.size() << " osrs" << dendl;
+  DeferredSubmission *s = new DeferredSubmission(cct);
 
-  osr->deferred_running = osr->deferred_pending;
-  osr->deferred_pending = nullptr;
+  // Fold every pending batch into one offset-ordered map.  Extents are not
+  // released to the allocator until their deferred io completes, so batches
+  // from different sequencers should never overlap; if one does anyway, it
+  // is left pending for a later submission rather than reordered.
+  map<uint64_t,DeferredBatch::deferred_io*> ios;
+  auto overlaps = [&](uint64_t offset, uint64_t length) {
+    auto p = ios.lower_bound(offset);
+    if (p != ios.end() && p->first < offset + length) {
+      return true;
+    }
+    if (p != ios.begin()) {
+      --p;
+      if (p->first + p->second->bl.length() > offset) {
+	return true;
+      }
+    }
+    return false;
+  };
+  auto now = mono_clock::now();
+  auto oldest = now;
+  for (auto osr : osrs) {
+    assert(osr->deferred_pending);
+    assert(!osr->deferred_running);
+    auto b = osr->deferred_pending;
+    if (!s->osrs.empty()) {
+      bool conflict = false;
+      for (auto& i : b->iomap) {
+	if (overlaps(i.first, i.second.bl.length())) {
+	  conflict = true;
+	  break;
+	}
+      }
+      if (conflict) {
+	dout(10) << __func__ << " osr " << osr
+		 << " overlaps another batch, leaving it pending" << dendl;
+	continue;
+      }
+    }
+    dout(10) << __func__ << " osr " << osr
+	     << " " << b->iomap.size() << " ios pending " << dendl;
+    for (auto& i : b->iomap) {
+      ios[i.first] = &i.second;
+    }
+    deferred_queue_size -= b->seq_bytes.size();
+    assert(deferred_queue_size >= 0);
+    osr->deferred_running = b;
+    osr->deferred_pending = nullptr;
+    oldest = std::min(oldest, b->start);
+    s->osrs.push_back(osr);
+  }
 
   deferred_lock.unlock();
 
-  for (auto& txc : b->txcs) {
-    txc.log_state_latency(logger, l_bluestore_state_deferred_queued_lat);
+  logger->tinc(l_bluestore_deferred_queue_age, now - oldest);
+  for (auto osr : s->osrs) {
+    for (auto& txc : osr->deferred_running->txcs) {
+      txc.log_state_latency(logger, l_bluestore_state_deferred_queued_lat);
+    }
   }
-  uint64_t start = 0, pos = 0;
-  bufferlist bl;
-  auto i = b->iomap.begin();
-  while (true) {
-    if (i == b->iomap.end() || i->first != pos) {
-      if (bl.length()) {
-	dout(20) << __func__ << " write 0x" << std::hex
-		 << start << "~" << bl.length()
-		 << " crc " << bl.crc32c(-1) << std::dec << dendl;
-	if (!g_conf()->bluestore_debug_omit_block_device_write) {
-	  logger->inc(l_bluestore_deferred_write_ops);
-	  logger->inc(l_bluestore_deferred_write_bytes, bl.length());
-	  int r = bdev->aio_write(start, bl, &b->ioc, false);
-	  assert(r == 0);
+
+  // Issue one sweep upward from where the previous submission ended and
+  // wrap around, coalescing contiguous extents regardless of which
+  // sequencer they came from.
+  uint64_t last_pos = deferred_last_pos;
+  auto sweep = [&](map<uint64_t,DeferredBatch::deferred_io*>::iterator i,
+		   map<uint64_t,DeferredBatch::deferred_io*>::iterator end) {
+    uint64_t start = 0, pos = 0;
+    bufferlist bl;
+    while (true) {
+      if (i == end || i->first != pos) {
+	if (bl.length()) {
+	  dout(20) << __func__ << " write 0x" << std::hex
+		   << start << "~" << bl.length()
+		   << " crc " << bl.crc32c(-1) << std::dec << dendl;
+	  if (!g_conf()->bluestore_debug_omit_block_device_write) {
+	    logger->inc(l_bluestore_deferred_write_ops);
+	    logger->inc(l_bluestore_deferred_write_bytes, bl.length());
+	    int r = bdev->aio_write(start, bl, &s->ioc, false);
+	    assert(r == 0);
+	  }
+	  last_pos = start + bl.length();
+	}
+	if (i == end) {
+	  break;
 	}
+	start = 0;
+	pos = i->first;
+	bl.clear();
       }
-      if (i == b->iomap.end()) {
-	break;
+      dout(20) << __func__ << "   seq " << i->second->seq << " 0x"
+	       << std::hex << pos << "~" << i->second->bl.length() << std::dec
+	       << dendl;
+      if (!bl.length()) {
+	start = pos;
       }
-      start = 0;
-      pos = i->first;
-      bl.clear();
-    }
-    dout(20) << __func__ << "   seq " << i->second.seq << " 0x"
-	     << std::hex << pos << "~" << i->second.bl.length() << std::dec
-	     << dendl;
-    if (!bl.length()) {
-      start = pos;
+      pos += i->second->bl.length();
+      bl.claim_append(i->second->bl);
+      logger->inc(l_bluestore_deferred_write_extents);
+      ++i;
     }
-    pos += i->second.bl.length();
-    bl.claim_append(i->second.bl);
-    ++i;
-  }
+  };
+  auto mid = ios.lower_bound(last_pos);
+  sweep(mid, ios.end());
+  sweep(ios.begin(), mid);
+  deferred_last_pos = last_pos;
 
-  bdev->aio_submit(&b->ioc);
+  if (s->ioc.has_pending_aios()) {
+    bdev->aio_submit(&s->ioc);
+  } else {
+    _deferred_submission_finish(s);
+  }
 }
 
 struct C_DeferredTrySubmit : public Context {
@@ -9593,6 +10585,20 @@ struct C_DeferredTrySubmit : public Context {
   }
 };
 
+void BlueStore::_deferred_submission_finish(DeferredSubmission *s)
+{
+  auto lat = mono_clock::now() - s->start;
+  logger->tinc(l_bluestore_deferred_aio_lat, lat);
+  double prev = deferred_lat_avg;
+  double cur = std::chrono::duration<double>(lat).count();
+  deferred_lat_avg = prev > 0 ? (prev * 7 + cur) / 8 : cur;
+
+  for (auto osr : s->osrs) {
+    _deferred_aio_finish(osr);
+  }
+  delete s;
+}
+
 void BlueStore::_deferred_aio_finish(OpSequencer *osr)
 {
   dout(10) << __func__ << " osr " << osr << dendl;
@@ -10166,6 +11172,8 @@ void BlueStore::_dump_onode(const OnodeRef& o)
 		  << " in " << o->onode.extent_map_shards.size() << " shards"
 		  << ", " << o->extent_map.spanning_blob_map.size()
 		  << " spanning blobs"
+		  << ", inline 0x" << std::hex << o->onode.inline_data.length()
+		  << std::dec
 		  << dendl;
   for (auto p = o->onode.attrs.begin();
        p != o->onode.attrs.end();
@@ -11237,6 +12245,29 @@ int BlueStore::_do_write(
     return 0;
   }
 
+  if (_can_write_inline(o, offset + length)) {
+    _do_write_inline(txc, o, offset, length, &bl);
+    return 0;
+  }
+  if (o->onode.has_inline_data()) {
+    r = _do_spill_inline(txc, c, o, fadvise_flags);
+    if (r < 0) {
+      return r;
+    }
+  }
+  return _do_write_extents(txc, c, o, offset, length, bl, fadvise_flags);
+}
+
+int BlueStore::_do_write_extents(
+  TransContext *txc,
+  CollectionRef& c,
+  OnodeRef o,
+  uint64_t offset,
+  uint64_t length,
+  bufferlist& bl,
+  uint32_t fadvise_flags)
+{
+  int r = 0;
   uint64_t end = offset + length;
 
   GarbageCollector gc(c->store->cct);
@@ -11293,6 +12324,94 @@ int BlueStore::_do_write(
   return r;
 }
 
+bool BlueStore::_can_write_inline(OnodeRef& o, uint64_t end)
+{
+  if (o->onode.has_inline_data()) {
+    return std::max<uint64_t>(end, o->onode.inline_data.length()) <=
+      inline_data_max_size;
+  }
+  // only objects without anything on disk may move their data inline
+  if (end > inline_data_max_size ||
+      !o->onode.extent_map_shards.empty()) {
+    return false;
+  }
+  o->extent_map.fault_inline();
+  return o->extent_map.extent_map.empty();
+}
+
+void BlueStore::_do_write_inline(
+  TransContext *txc,
+  OnodeRef& o,
+  uint64_t offset,
+  uint64_t length,
+  const bufferlist *bl)
+{
+  bufferlist& d = o->onode.inline_data;
+  if (!o->onode.has_inline_data()) {
+    _require_compat_ondisk_format(inline_data_compat_ondisk_format);
+    d.clear();
+    o->onode.set_flag(bluestore_onode_t::FLAG_INLINE_DATA);
+  }
+  uint64_t old_len = d.length();
+  uint64_t end = offset + length;
+
+  // never modify d in place: readers may still hold references to it
+  bufferlist n;
+  if (offset <= old_len) {
+    if (offset) {
+      n.substr_of(d, 0, offset);
+    }
+  } else {
+    n = d;
+    n.append_zero(offset - old_len);
+  }
+  if (bl) {
+    n.append(*bl);
+  } else {
+    n.append_zero(length);
+  }
+  if (end < old_len) {
+    bufferlist t;
+    t.substr_of(d, end, old_len - end);
+    n.claim_append(t);
+  }
+  n.rebuild();
+  d.swap(n);
+
+  dout(20) << __func__ << " 0x" << std::hex << offset << "~" << length
+	   << " inline 0x" << old_len << " -> 0x" << d.length() << std::dec
+	   << dendl;
+  if (end > o->onode.size) {
+    o->onode.size = end;
+  }
+  txc->statfs_delta.stored() += d.length() - old_len;
+  logger->inc(l_bluestore_inline_write_ops);
+  logger->inc(l_bluestore_inline_write_bytes, length);
+  logger->inc(l_bluestore_inline_alloc_saved_bytes,
+	      p2roundup<uint64_t>(d.length(), min_alloc_size) -
+	      p2roundup<uint64_t>(old_len, min_alloc_size));
+}
+
+int BlueStore::_do_spill_inline(
+  TransContext *txc,
+  CollectionRef& c,
+  OnodeRef o,
+  uint32_t fadvise_flags)
+{
+  bufferlist bl;
+  bl.claim(o->onode.inline_data);
+  o->onode.clear_flag(bluestore_onode_t::FLAG_INLINE_DATA);
+  // the extents written below account for it again
+  txc->statfs_delta.stored() -= bl.length();
+  dout(20) << __func__ << " " << o->oid << " 0x" << std::hex << bl.length()
+	   << std::dec << " bytes" << dendl;
+  logger->inc(l_bluestore_inline_spill_ops);
+  if (bl.length() == 0) {
+    return 0;
+  }
+  return _do_write_extents(txc, c, o, 0, bl.length(), bl, fadvise_flags);
+}
+
 int BlueStore::_write(TransContext *txc,
 		      CollectionRef& c,
 		      OnodeRef& o,
@@ -11350,6 +12469,21 @@ int BlueStore::_do_zero(TransContext *txc,
 
   _dump_onode(o);
 
+  if (o->onode.has_inline_data()) {
+    // zeros past the inline data are implicit
+    uint64_t inline_len = o->onode.inline_data.length();
+    if (offset < inline_len) {
+      _do_write_inline(txc, o, offset,
+		       std::min<uint64_t>(length, inline_len - offset),
+		       nullptr);
+    }
+    if (length > 0 && offset + length > o->onode.size) {
+      o->onode.size = offset + length;
+    }
+    txc->write_onode(o);
+    return 0;
+  }
+
   WriteContext wctx;
   o->extent_map.fault_range(db, offset, length);
   o->extent_map.punch_hole(c, offset, length, &wctx.old_extents);
@@ -11381,7 +12515,19 @@ void BlueStore::_do_truncate(
   if (offset == o->onode.size)
     return;
 
-  if (offset < o->onode.size) {
+  if (o->onode.has_inline_data()) {
+    bufferlist& d = o->onode.inline_data;
+    uint64_t old_len = d.length();
+    if (offset == 0) {
+      d.clear();
+      o->onode.clear_flag(bluestore_onode_t::FLAG_INLINE_DATA);
+    } else if (offset < d.length()) {
+      bufferlist t;
+      t.substr_of(d, 0, offset);
+      d.swap(t);
+    }
+    txc->statfs_delta.stored() -= old_len - d.length();
+  } else if (offset < o->onode.size) {
     WriteContext wctx;
     uint64_t length = o->onode.size - offset;
     o->extent_map.fault_range(db, offset, length);
@@ -11474,6 +12620,8 @@ int BlueStore::_do_remove(
 
   dout(20) << __func__ << " checking for unshareable blobs on " << h
 	   << " " << h->oid << dendl;
+  // the head's extents may not be decoded or loaded yet
+  h->extent_map.fault_range(db, 0, OBJECT_MAX_SIZE);
   map<SharedBlob*,bluestore_extent_ref_map_t> expect;
   for (auto& e : h->extent_map.extent_map) {
     const bluestore_blob_t& b = e.blob->get_blob();
@@ -11918,6 +13066,32 @@ int BlueStore::_do_clone_range(
 	   << newo->oid
 	   << " 0x" << std::hex << srcoff << "~" << length << " -> "
 	   << " 0x" << dstoff << "~" << length << std::dec << dendl;
+  if (oldo->onode.has_inline_data() || newo->onode.has_inline_data()) {
+    // there are no blobs to share; copy the data instead.  callers have
+    // zeroed the destination, so only the inline bytes need copying
+    uint64_t copy_len = length;
+    if (oldo->onode.has_inline_data()) {
+      uint64_t inline_len = oldo->onode.inline_data.length();
+      copy_len = srcoff < inline_len ?
+	std::min<uint64_t>(length, inline_len - srcoff) : 0;
+    }
+    if (copy_len) {
+      bufferlist bl;
+      int r = _do_read(c.get(), oldo, srcoff, copy_len, bl, 0);
+      if (r < 0) {
+	return r;
+      }
+      r = _do_write(txc, c, newo, dstoff, bl.length(), bl, 0);
+      if (r < 0) {
+	return r;
+      }
+    }
+    if (dstoff + length > newo->onode.size) {
+      newo->onode.size = dstoff + length;
+    }
+    return 0;
+  }
+
   oldo->extent_map.fault_range(db, srcoff, length);
   newo->extent_map.fault_range(db, dstoff, length);
   _dump_onode(oldo);
@@ -21,6 +21,7 @@
 
 #include <atomic>
 #include <mutex>
+#include <shared_mutex>
 #include <condition_variable>
 
 #include <boost/intrusive/list.hpp>
@@ -37,6 +38,7 @@
 #include "common/Throttle.h"
 #include "common/perf_counters.h"
 #include "common/PriorityCache.h"
+#include "common/HostMemoryArbiter.h"
 #include "compressor/Compressor.h"
 #include "os/ObjectStore.h"
 
@@ -89,6 +91,9 @@ enum {
   l_bluestore_write_pad_bytes,
   l_bluestore_deferred_write_ops,
   l_bluestore_deferred_write_bytes,
+  l_bluestore_deferred_write_extents,
+  l_bluestore_deferred_queue_age,
+  l_bluestore_deferred_aio_lat,
   l_bluestore_write_penalty_read_ops,
   l_bluestore_allocated,
   l_bluestore_stored,
@@ -100,6 +105,10 @@ enum {
   l_bluestore_onode_misses,
   l_bluestore_onode_shard_hits,
   l_bluestore_onode_shard_misses,
+  l_bluestore_extent_map_decode_bytes,
+  l_bluestore_extent_map_decode_extents,
+  l_bluestore_extent_map_inline_deferred,
+  l_bluestore_extent_map_inline_faults,
   l_bluestore_extents,
   l_bluestore_blobs,
   l_bluestore_buffers,
@@ -122,6 +131,19 @@ enum {
   l_bluestore_gc_merged,
   l_bluestore_read_eio,
   l_bluestore_fragmentation,
+  l_bluestore_mount_lat,
+  l_bluestore_mount_open_db_lat,
+  l_bluestore_mount_open_alloc_lat,
+  l_bluestore_mount_open_collections_lat,
+  l_bluestore_mount_deferred_replay_lat,
+  l_bluestore_alloc_snapshot_loaded,
+  l_bluestore_inline_write_ops,
+  l_bluestore_inline_write_bytes,
+  l_bluestore_inline_read_ops,
+  l_bluestore_inline_spill_ops,
+  l_bluestore_inline_alloc_saved_bytes,
+  l_bluestore_read_zero_copy_bytes,
+  l_bluestore_read_built_bytes,
   l_bluestore_last
 };
 
@@ -348,6 +370,17 @@ public:
 	      BlueStore::ready_regions_t& res,
 	      interval_set<uint32_t>& res_intervals);
 
+    /// true if a write to [offset, offset+length) may not be on disk yet
+    bool has_writing(Cache* cache, uint32_t offset, uint32_t length) {
+      std::lock_guard<std::recursive_mutex> l(cache->lock);
+      for (auto& b : writing) {
+	if (b.offset < offset + length && b.end() > offset) {
+	  return true;
+	}
+      }
+      return false;
+    }
+
     void truncate(Cache* cache, uint32_t offset) {
       discard(cache, offset, (uint32_t)-1 - offset);
     }
@@ -755,6 +788,7 @@ public:
     mempool::bluestore_cache_other::vector<Shard> shards;    ///< shards
 
     bufferlist inline_bl;    ///< cached encoded map, if unsharded; empty=>dirty
+    bool inline_loaded = true;  ///< false until inline_bl is decoded
 
     uint32_t needs_reshard_begin = 0;
     uint32_t needs_reshard_end = 0;
@@ -790,6 +824,7 @@ public:
       extent_map.clear_and_dispose(DeleteDisposer());
       shards.clear();
       inline_bl.clear();
+      inline_loaded = true;
       clear_needs_reshard();
     }
 
@@ -797,6 +832,12 @@ public:
 		     unsigned *pn);
     unsigned decode_some(bufferlist& bl);
 
+    /// keep an unsharded map encoded until something needs its extents
+    void defer_inline_decode() {
+      inline_loaded = false;
+    }
+    void fault_inline();
+
     void bound_encode_spanning_blobs(size_t& p);
     void encode_spanning_blobs(bufferlist::contiguous_appender& p);
     void decode_spanning_blobs(bufferptr::const_iterator& p);
@@ -1025,6 +1066,10 @@ public:
 
     boost::intrusive::list_member_hook<> lru_item;
 
+    /// set by OnodeSpace::lookup hits; trim gives such onodes a second
+    /// pass through the lru instead of taking the shard lock to touch them
+    std::atomic<bool> lru_referenced = {false};
+
     bluestore_onode_t onode;  ///< metadata stored as value in kv store
     bool exists;              ///< true if object logically exists
 
@@ -1067,6 +1112,14 @@ public:
     std::atomic<uint64_t> num_extents = {0};
     std::atomic<uint64_t> num_blobs = {0};
 
+    /// demand seen since the mempool thread last sized this shard
+    std::atomic<uint64_t> onode_lookups = {0};
+    std::atomic<uint64_t> buffer_lookup_bytes = {0};
+
+    /// smoothed share of the store's onode/buffer budget (mempool thread only)
+    double onode_share = 0;
+    double buffer_share = 0;
+
     static Cache *create(CephContext* cct, string type, PerfCounters *logger);
 
     Cache(CephContext* cct) : cct(cct), logger(nullptr) {}
@@ -1099,6 +1152,7 @@ public:
       --num_blobs;
     }
 
+    /// trim in bounded batches, dropping the lock between them
     void trim(uint64_t onode_max, uint64_t buffer_max);
 
     void trim_all();
@@ -1313,6 +1367,10 @@ public:
   private:
     Cache *cache;
 
+    /// protects onode_map.  lookups take it shared and never touch the
+    /// cache shard lock; writers take cache->lock first, then this.
+    std::shared_mutex lock;
+
     /// forward lookups
     mempool::bluestore_cache_other::unordered_map<ghobject_t,OnodeRef> onode_map;
 
@@ -1327,8 +1385,12 @@ public:
     OnodeRef add(const ghobject_t& oid, OnodeRef o);
     OnodeRef lookup(const ghobject_t& o);
     void remove(const ghobject_t& oid) {
+      std::unique_lock<std::shared_mutex> l(lock);
       onode_map.erase(oid);
     }
+    /// drop o from the map unless someone else holds a ref; on success the
+    /// map's ref is handed to *ref.  caller holds cache->lock.
+    bool remove_unpinned(Onode *o, OnodeRef *ref);
     void rename(OnodeRef& o, const ghobject_t& old_oid,
 		const ghobject_t& new_oid,
 		const mempool::bluestore_cache_other::string& new_okey);
@@ -1638,7 +1700,7 @@ public:
       boost::intrusive::list_member_hook<>,
       &TransContext::deferred_queue_item> > deferred_queue_t;
 
-  struct DeferredBatch final : public AioContext {
+  struct DeferredBatch {
     OpSequencer *osr;
     struct deferred_io {
       bufferlist bl;    ///< data
@@ -1646,23 +1708,34 @@ public:
     };
     map<uint64_t,deferred_io> iomap; ///< map of ios in this batch
     deferred_queue_t txcs;           ///< txcs in this batch
-    IOContext ioc;                   ///< our aios
     /// bytes of pending io for each deferred seq (may be 0)
     map<uint64_t,int> seq_bytes;
+    mono_clock::time_point start;    ///< when the first txc was queued
 
     void _discard(CephContext *cct, uint64_t offset, uint64_t length);
     void _audit(CephContext *cct);
 
-    DeferredBatch(CephContext *cct, OpSequencer *osr)
-      : osr(osr), ioc(cct, this) {}
+    explicit DeferredBatch(OpSequencer *osr)
+      : osr(osr), start(mono_clock::now()) {}
 
     /// prepare a write
     void prepare_write(CephContext *cct,
 		       uint64_t seq, uint64_t offset, uint64_t length,
 		       bufferlist::const_iterator& p);
+  };
+
+  /// the running DeferredBatches of one or more sequencers, merged and
+  /// issued to the device as a single offset-ordered stream
+  struct DeferredSubmission final : public AioContext {
+    vector<OpSequencer*> osrs;
+    IOContext ioc;                   ///< our aios
+    mono_clock::time_point start;
+
+    explicit DeferredSubmission(CephContext *cct)
+      : ioc(cct, this), start(mono_clock::now()) {}
 
     void aio_finish(BlueStore *store) override {
-      store->_deferred_aio_finish(osr);
+      store->_deferred_submission_finish(this);
     }
   };
 
@@ -1873,10 +1946,18 @@ private:
   interval_set<uint64_t> bluefs_extents;  ///< block extents owned by bluefs
   interval_set<uint64_t> bluefs_extents_reclaiming; ///< currently reclaiming
 
+  /// allocator snapshot left by the last clean umount, consumed at db open
+  bufferlist alloc_snapshot_bl;
+
   std::mutex deferred_lock;
   std::atomic<uint64_t> deferred_seq = {0};
   deferred_osr_queue_t deferred_queue; ///< osr's with deferred io pending
   int deferred_queue_size = 0;         ///< num txc's queued across all osrs
+  /// end of the last deferred extent we issued; the next submission
+  /// sweeps upward from here (c-scan)
+  std::atomic<uint64_t> deferred_last_pos = {0};
+  /// moving average of deferred submission latency, in seconds
+  std::atomic<double> deferred_lat_avg = {0};
   atomic_int deferred_aggressive = {0}; ///< aggressive wakeup of kv thread
   Finisher deferred_finisher;
 
@@ -1929,6 +2010,9 @@ private:
   ///< number threshold for forced deferred writes
   std::atomic<int> deferred_batch_ops = {0};
 
+  ///< upper bound on how long deferred writes are held for batching
+  std::atomic<double> deferred_batch_window_max = {0};
+
   ///< size threshold for forced deferred writes
   std::atomic<uint64_t> prefer_deferred_size = {0};
 
@@ -1942,6 +2026,7 @@ private:
   std::atomic<uint64_t> comp_max_blob_size = {0};
 
   std::atomic<uint64_t> max_blob_size = {0};  ///< maximum blob size
+  std::atomic<uint64_t> inline_data_max_size = {0};  ///< 0 to disable
 
   uint64_t kv_ios = 0;
   uint64_t kv_throttle_costs = 0;
@@ -1954,6 +2039,8 @@ private:
   bool cache_autotune = false;   ///< cache autotune setting
   uint64_t cache_autotune_chunk_size = 0; ///< cache autotune chunk size
   double cache_autotune_interval = 0; ///< time to wait between cache rebalancing
+  bool cache_autotune_shards = false; ///< size shards by observed demand
+  double cache_shard_min_ratio = 0;   ///< fraction of an even split each shard keeps
   uint64_t osd_memory_target = 0;   ///< OSD memory target when autotuning cache
   uint64_t osd_memory_base = 0;     ///< OSD base memory when autotuning cache
   double osd_memory_expected_fragmentation = 0; ///< expected memory fragmentation
@@ -1971,6 +2058,12 @@ private:
     bool stop = false;
     uint64_t autotune_cache_size = 0;
 
+    /// splits memory with the other OSDs of the host, if configured
+    std::unique_ptr<HostMemoryArbiter> host_arbiter;
+    uint64_t memory_target = 0;   ///< osd_memory_target or our host grant
+    uint64_t last_onode_misses = 0;
+    uint64_t last_buffer_miss_bytes = 0;
+
     struct MempoolCache : public PriorityCache::PriCache {
       BlueStore *store;
       int64_t cache_bytes[PriorityCache::Priority::LAST+1];
@@ -2076,6 +2169,7 @@ private:
     void *entry() override;
     void init() {
       assert(stop == false);
+      _open_host_arbiter();
       create("bstore_mempool");
     }
     void shutdown() {
@@ -2084,11 +2178,15 @@ private:
       cond.Signal();
       lock.Unlock();
       join();
+      host_arbiter.reset();
     }
 
   private:
     void _adjust_cache_settings();
     void _trim_shards(bool interval_stats);
+    void _update_shard_shares();
+    void _open_host_arbiter();
+    void _update_memory_target();
     void _tune_cache_size(bool interval_stats);
     void _balance_cache(const std::list<PriorityCache::PriCache *>& caches);
     void _balance_cache_pri(int64_t *mem_avail, 
@@ -2112,6 +2210,7 @@ private:
   void _close_fsid();
   void _set_alloc_sizes();
   void _set_blob_size();
+  void _set_inline_data_size();
   void _set_finisher_num();
 
   int _open_bdev(bool create);
@@ -2126,11 +2225,15 @@ private:
    * hold the rocksdb's file lock.
    */
   int _open_db(bool create, bool to_repair_db=false);
+  void _get_rocksdb_cfs(vector<KeyValueDB::ColumnFamily> *cfs);
   void _close_db();
   int _open_fm(bool create);
   void _close_fm();
   int _open_alloc();
   void _close_alloc();
+  int _write_alloc_snapshot();
+  void _read_alloc_snapshot();
+  int _load_alloc_snapshot(uint64_t *num, uint64_t *bytes);
   int _open_collections(int *errors=0);
   void _close_collections();
 
@@ -2201,7 +2304,10 @@ private:
 public:
   void deferred_try_submit();
 private:
+  bool _deferred_window_expired();
   void _deferred_submit_unlock(OpSequencer *osr);
+  void _deferred_submit_unlock(const vector<OpSequencer*>& osrs);
+  void _deferred_submission_finish(DeferredSubmission *s);
   void _deferred_aio_finish(OpSequencer *osr);
   int _deferred_replay();
 
@@ -2254,16 +2360,22 @@ private:
 
   // -- ondisk version ---
 public:
-  const int32_t latest_ondisk_format = 2;        ///< our version
+  const int32_t latest_ondisk_format = 3;        ///< our version
   const int32_t min_readable_ondisk_format = 1;  ///< what we can read
   const int32_t min_compat_ondisk_format = 2;    ///< who can read us
+  /// who can read us once an onode holds inline data
+  const int32_t inline_data_compat_ondisk_format = 3;
 
 private:
   int32_t ondisk_format = 0;  ///< value detected on mount
+  /// min_compat_ondisk_format as persisted; only ever raised
+  std::atomic<int32_t> compat_ondisk_format = {0};
+  std::mutex compat_ondisk_format_lock;  ///< serializes raising it
 
   int _upgrade_super();  ///< upgrade (called during open_super)
   uint64_t _get_ondisk_reserved() const;
   void _prepare_ondisk_format_super(KeyValueDB::Transaction& t);
+  void _require_compat_ondisk_format(int32_t compat);
 
   // --- public interface ---
 public:
@@ -2328,6 +2440,10 @@ public:
   }
   int _fsck(bool deep, bool repair);
 
+  /// offline: move each prefix in bluestore_rocksdb_cfs into its own
+  /// column family
+  int migrate_to_column_families(ostream& out);
+
   void set_cache_shards(unsigned num) override;
 
   int validate_hobject_key(const hobject_t &obj) const override {
@@ -2380,8 +2496,19 @@ public:
     size_t len,
     bufferlist& bl,
     uint32_t op_flags = 0);
+  int verify_csum(
+    CollectionHandle &c,
+    const ghobject_t& oid,
+    uint64_t offset,
+    size_t len,
+    uint32_t op_flags = 0) override;
 
 private:
+  int _do_verify_csum(
+    Collection *c,
+    OnodeRef o,
+    uint64_t offset,
+    size_t len);
   int _fiemap(CollectionHandle &c_, const ghobject_t& oid,
  	     uint64_t offset, size_t len, interval_set<uint64_t>& destset);
 public:
@@ -2523,6 +2650,18 @@ public:
   }
 
 private:
+  /// fail a checksum batch that verified fine, with probability
+  /// bluestore_debug_inject_csum_err_probability; returns the new result
+  int _debug_inject_csum_err(vector<Checksummer::verify_item_t>& items) {
+    double p = cct->_conf.get_val<double>(
+      "bluestore_debug_inject_csum_err_probability");
+    if (p <= 0 || items.empty() || (rand() % 10000) >= p * 10000) {
+      return 0;
+    }
+    items[0].bad = items[0].offset;
+    items[0].bad_csum = 0;
+    return 1;
+  }
   bool _debug_data_eio(const ghobject_t& o) {
     if (!cct->_conf->bluestore_debug_inject_read_err) {
       return false;
@@ -2555,6 +2694,14 @@ private:
     uint64_t blob_xoffset,
     const bufferlist& bl,
     uint64_t logical_offset) const;
+  void _log_bad_csum(
+    const char *caller,
+    OnodeRef& o,
+    const bluestore_blob_t* blob,
+    uint64_t blob_xoffset,
+    int bad,
+    uint64_t bad_csum,
+    uint64_t logical_offset) const;
   int _decompress(bufferlist& source, bufferlist* result);
 
 
@@ -2697,6 +2844,22 @@ private:
 		uint64_t offset, uint64_t length,
 		bufferlist& bl,
 		uint32_t fadvise_flags);
+  int _do_write_extents(TransContext *txc,
+			CollectionRef &c,
+			OnodeRef o,
+			uint64_t offset, uint64_t length,
+			bufferlist& bl,
+			uint32_t fadvise_flags);
+
+  /// true if data ending at end can be kept in (or moved into) the onode
+  bool _can_write_inline(OnodeRef& o, uint64_t end);
+  /// write into the onode's inline data; zeros if bl is null
+  void _do_write_inline(TransContext *txc, OnodeRef& o,
+			uint64_t offset, uint64_t length,
+			const bufferlist *bl);
+  /// move inline data out of the onode into regular extents
+  int _do_spill_inline(TransContext *txc, CollectionRef& c, OnodeRef o,
+		       uint32_t fadvise_flags);
   void _do_write_data(TransContext *txc,
                       CollectionRef& c,
                       OnodeRef o,
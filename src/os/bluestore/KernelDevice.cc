@@ -19,6 +19,7 @@
 #include <fcntl.h>
 
 #include "KernelDevice.h"
+#include "ioring.h"
 #include "include/types.h"
 #include "include/compat.h"
 #include "include/stringify.h"
@@ -26,6 +27,7 @@
 #include "common/debug.h"
 #include "common/blkdev.h"
 #include "common/align.h"
+#include "common/AlignedBufferPool.h"
 
 #define dout_context cct
 #define dout_subsys ceph_subsys_bdev
@@ -38,7 +40,7 @@ KernelDevice::KernelDevice(CephContext* cct, aio_callback_t cb, void *cbpriv, ai
     fd_buffered(-1),
     aio(false), dio(false),
     debug_lock("KernelDevice::debug_lock"),
-    aio_queue(cct->_conf->bdev_aio_max_queue_depth),
+    buffer_pool(AlignedBufferPool::get(cct)),
     discard_callback(d_cb),
     discard_callback_priv(d_cbpriv),
     aio_stop(false),
@@ -48,6 +50,22 @@ KernelDevice::KernelDevice(CephContext* cct, aio_callback_t cb, void *cbpriv, ai
     discard_thread(this),
     injecting_crash(0)
 {
+  unsigned iodepth = cct->_conf->bdev_aio_max_queue_depth;
+  if (cct->_conf.get_val<bool>("bdev_ioring")) {
+    if (ioring_queue_t::supported()) {
+      io_queue = std::unique_ptr<io_queue_t>(
+	new ioring_queue_t(
+	  iodepth,
+	  cct->_conf.get_val<bool>("bdev_ioring_hipri"),
+	  cct->_conf.get_val<bool>("bdev_ioring_sqthread_poll")));
+    } else {
+      derr << __func__ << " bdev_ioring is set but io_uring is not supported"
+	   << " by this build or kernel; falling back to libaio" << dendl;
+    }
+  }
+  if (!io_queue) {
+    io_queue = std::unique_ptr<io_queue_t>(new aio_queue_t(iodepth));
+  }
 }
 
 int KernelDevice::_lock()
@@ -223,6 +241,7 @@ int KernelDevice::collect_metadata(const string& prefix, map<string,string> *pm)
   (*pm)[prefix + "size"] = stringify(get_size());
   (*pm)[prefix + "block_size"] = stringify(get_block_size());
   (*pm)[prefix + "driver"] = "KernelDevice";
+  (*pm)[prefix + "io_queue"] = io_queue->get_name();
   if (rotational) {
     (*pm)[prefix + "type"] = "hdd";
   } else {
@@ -349,13 +368,14 @@ int KernelDevice::_aio_start()
 {
   if (aio) {
     dout(10) << __func__ << dendl;
-    int r = aio_queue.init();
+    std::vector<int> fds = { fd_direct, fd_buffered };
+    int r = io_queue->init(fds);
     if (r < 0) {
-      if (r == -EAGAIN) {
-	derr << __func__ << " io_setup(2) failed with EAGAIN; "
-	     << "try increasing /proc/sys/fs/aio-max-nr" << dendl;
-      } else {
-	derr << __func__ << " io_setup(2) failed: " << cpp_strerror(r) << dendl;
+      derr << __func__ << " failed to set up " << io_queue->get_name()
+	   << " queue: " << cpp_strerror(r) << dendl;
+      if (r == -EAGAIN && strcmp(io_queue->get_name(), "libaio") == 0) {
+	derr << __func__ << " try increasing /proc/sys/fs/aio-max-nr"
+	     << dendl;
       }
       return r;
     }
@@ -371,7 +391,7 @@ void KernelDevice::_aio_stop()
     aio_stop = true;
     aio_thread.join();
     aio_stop = false;
-    aio_queue.shutdown();
+    io_queue->shutdown();
   }
 }
 
@@ -426,7 +446,7 @@ void KernelDevice::_aio_thread()
     dout(40) << __func__ << " polling" << dendl;
     int max = cct->_conf->bdev_aio_reap_max;
     aio_t *aio[max];
-    int r = aio_queue.get_next_completed(cct->_conf->bdev_aio_poll_ms,
+    int r = io_queue->get_next_completed(cct->_conf->bdev_aio_poll_ms,
 					 aio, max);
     if (r < 0) {
       derr << __func__ << " got " << cpp_strerror(r) << dendl;
@@ -658,7 +678,7 @@ void KernelDevice::aio_submit(IOContext *ioc)
 
   void *priv = static_cast<void*>(ioc);
   int r, retries = 0;
-  r = aio_queue.submit_batch(ioc->running_aios.begin(), e, 
+  r = io_queue->submit_batch(ioc->running_aios.begin(), e,
 			     pending, priv, &retries);
   
   if (retries)
@@ -807,7 +827,7 @@ int KernelDevice::read(uint64_t off, uint64_t len, bufferlist *pbl,
 
   _aio_log_start(ioc, off, len);
 
-  bufferptr p = buffer::create_page_aligned(len);
+  bufferptr p = buffer_pool.create(len);
   int r = ::pread(buffered ? fd_buffered : fd_direct,
 		  p.c_str(), len, off);
   if (r < 0) {
@@ -843,7 +863,7 @@ int KernelDevice::aio_read(
     ioc->pending_aios.push_back(aio_t(ioc, fd_direct));
     ++ioc->num_pending;
     aio_t& aio = ioc->pending_aios.back();
-    aio.pread(off, len);
+    aio.pread(off, len, buffer_pool.create(len));
     dout(30) << aio << dendl;
     pbl->append(aio.bl);
     dout(5) << __func__ << " 0x" << std::hex << off << "~" << len
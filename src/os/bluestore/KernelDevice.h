@@ -16,6 +16,7 @@
 #define CEPH_OS_BLUESTORE_KERNELDEVICE_H
 
 #include <atomic>
+#include <memory>
 
 #include "include/types.h"
 #include "include/interval_set.h"
@@ -25,6 +26,8 @@
 #include "aio.h"
 #include "BlockDevice.h"
 
+class AlignedBufferPool;
+
 class KernelDevice : public BlockDevice {
   int fd_direct, fd_buffered;
   std::string path;
@@ -41,7 +44,9 @@ class KernelDevice : public BlockDevice {
   std::atomic<bool> io_since_flush = {false};
   std::mutex flush_mutex;
 
-  aio_queue_t aio_queue;
+  AlignedBufferPool& buffer_pool;  ///< recycles O_DIRECT read buffers
+
+  std::unique_ptr<io_queue_t> io_queue;
   aio_callback_t discard_callback;
   void *discard_callback_priv;
   bool aio_stop;
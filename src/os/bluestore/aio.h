@@ -7,6 +7,9 @@
 #include <boost/intrusive/list.hpp>
 #include <boost/container/small_vector.hpp>
 
+#include <list>
+#include <vector>
+
 #include "include/buffer.h"
 #include "include/types.h"
 
@@ -30,9 +33,13 @@ struct aio_t {
     io_prep_pwritev(&iocb, fd, &iov[0], iov.size(), offset);
   }
   void pread(uint64_t _offset, uint64_t len) {
+    pread(_offset, len, buffer::create_page_aligned(len));
+  }
+  /// read into a caller supplied, suitably aligned buffer of len bytes
+  void pread(uint64_t _offset, uint64_t len, bufferptr&& p) {
+    assert(p.length() == len);
     offset = _offset;
     length = len;
-    bufferptr p = buffer::create_page_aligned(length);
     io_prep_pread(&iocb, fd, p.c_str(), length, offset);
     bl.append(std::move(p));
   }
@@ -51,21 +58,35 @@ typedef boost::intrusive::list<
     boost::intrusive::list_member_hook<>,
     &aio_t::queue_item> > aio_list_t;
 
-struct aio_queue_t {
+struct io_queue_t {
+  typedef list<aio_t>::iterator aio_iter;
+
+  virtual ~io_queue_t() {};
+
+  /// set up the queue; fds are the file descriptors aios will target
+  virtual int init(std::vector<int> &fds) = 0;
+  virtual void shutdown() = 0;
+  virtual int submit_batch(aio_iter begin, aio_iter end, uint16_t aios_size,
+			   void *priv, int *retries) = 0;
+  virtual int get_next_completed(int timeout_ms, aio_t **paio, int max) = 0;
+  /// the kernel interface behind the queue, for metadata and messages
+  virtual const char *get_name() const = 0;
+};
+
+struct aio_queue_t final : public io_queue_t {
   int max_iodepth;
   io_context_t ctx;
 
-  typedef list<aio_t>::iterator aio_iter;
-
   explicit aio_queue_t(unsigned max_iodepth)
     : max_iodepth(max_iodepth),
       ctx(0) {
   }
-  ~aio_queue_t() {
+  ~aio_queue_t() final {
     assert(ctx == 0);
   }
 
-  int init() {
+  int init(std::vector<int> &fds) final {
+    (void)fds;
     assert(ctx == 0);
     int r = io_setup(max_iodepth, &ctx);
     if (r < 0) {
@@ -76,7 +97,7 @@ struct aio_queue_t {
     }
     return r;
   }
-  void shutdown() {
+  void shutdown() final {
     if (ctx) {
       int r = io_destroy(ctx);
       assert(r == 0);
@@ -84,7 +105,10 @@ struct aio_queue_t {
     }
   }
 
-  int submit_batch(aio_iter begin, aio_iter end, uint16_t aios_size, 
-		   void *priv, int *retries);
-  int get_next_completed(int timeout_ms, aio_t **paio, int max);
+  int submit_batch(aio_iter begin, aio_iter end, uint16_t aios_size,
+		   void *priv, int *retries) final;
+  int get_next_completed(int timeout_ms, aio_t **paio, int max) final;
+  const char *get_name() const final {
+    return "libaio";
+  }
 };
@@ -33,23 +33,31 @@ ostream& operator<<(ostream& out, const bluefs_extent_t& e)
 
 void bluefs_super_t::encode(bufferlist& bl) const
 {
-  ENCODE_START(1, 1, bl);
+  // an older version would silently ignore the wal log and lose
+  // whatever metadata lives only there; refuse to let it.
+  ENCODE_START(2, has_wal_log() ? 2 : 1, bl);
   encode(uuid, bl);
   encode(osd_uuid, bl);
   encode(version, bl);
   encode(block_size, bl);
   encode(log_fnode, bl);
+  encode(wal_log_fnode, bl);
+  encode(wal_log_uuid, bl);
   ENCODE_FINISH(bl);
 }
 
 void bluefs_super_t::decode(bufferlist::const_iterator& p)
 {
-  DECODE_START(1, p);
+  DECODE_START(2, p);
   decode(uuid, p);
   decode(osd_uuid, p);
   decode(version, p);
   decode(block_size, p);
   decode(log_fnode, p);
+  if (struct_v >= 2) {
+    decode(wal_log_fnode, p);
+    decode(wal_log_uuid, p);
+  }
   DECODE_FINISH(p);
 }
 
@@ -60,6 +68,8 @@ void bluefs_super_t::dump(Formatter *f) const
   f->dump_unsigned("version", version);
   f->dump_unsigned("block_size", block_size);
   f->dump_object("log_fnode", log_fnode);
+  f->dump_object("wal_log_fnode", wal_log_fnode);
+  f->dump_stream("wal_log_uuid") << wal_log_uuid;
 }
 
 void bluefs_super_t::generate_test_instances(list<bluefs_super_t*>& ls)
@@ -72,12 +82,15 @@ void bluefs_super_t::generate_test_instances(list<bluefs_super_t*>& ls)
 
 ostream& operator<<(ostream& out, const bluefs_super_t& s)
 {
-  return out << "super(uuid " << s.uuid
-	     << " osd " << s.osd_uuid
-	     << " v " << s.version
-	     << " block_size 0x" << std::hex << s.block_size
-	     << " log_fnode 0x" << s.log_fnode
-	     << std::dec << ")";
+  out << "super(uuid " << s.uuid
+      << " osd " << s.osd_uuid
+      << " v " << s.version
+      << " block_size 0x" << std::hex << s.block_size
+      << " log_fnode 0x" << s.log_fnode;
+  if (s.has_wal_log()) {
+    out << " wal_log_fnode 0x" << s.wal_log_fnode;
+  }
+  return out << std::dec << ")";
 }
 
 // bluefs_fnode_t
@@ -123,6 +123,9 @@ struct bluefs_super_t {
 
   bluefs_fnode_t log_fnode;
 
+  bluefs_fnode_t wal_log_fnode;  ///< journal for WAL file metadata, if any
+  uuid_d wal_log_uuid;           ///< tags the current wal log incarnation
+
   bluefs_super_t()
     : version(0),
       block_size(4096) { }
@@ -130,6 +133,9 @@ struct bluefs_super_t {
   uint64_t block_mask() const {
     return ~((uint64_t)block_size - 1);
   }
+  bool has_wal_log() const {
+    return !wal_log_fnode.extents.empty();
+  }
 
   void encode(bufferlist& bl) const;
   void decode(bufferlist::const_iterator& p);
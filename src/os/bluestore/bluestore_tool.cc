@@ -205,7 +205,7 @@ int main(int argc, char **argv)
     ;
   po::options_description po_positional("Positional options");
   po_positional.add_options()
-    ("command", po::value<string>(&action), "fsck, repair, bluefs-export, bluefs-bdev-sizes, bluefs-bdev-expand, show-label, set-label-key, rm-label-key, prime-osd-dir, bluefs-log-dump")
+    ("command", po::value<string>(&action), "fsck, repair, bluefs-export, bluefs-bdev-sizes, bluefs-bdev-expand, show-label, set-label-key, rm-label-key, prime-osd-dir, bluefs-log-dump, migrate-cf")
     ;
   po::options_description po_all("All options");
   po_all.add(po_options).add(po_positional);
@@ -235,7 +235,7 @@ int main(int argc, char **argv)
     exit(EXIT_FAILURE);
   }
 
-  if (action == "fsck" || action == "repair") {
+  if (action == "fsck" || action == "repair" || action == "migrate-cf") {
     if (path.empty()) {
       cerr << "must specify bluestore path" << std::endl;
       exit(EXIT_FAILURE);
@@ -336,6 +336,16 @@ int main(int argc, char **argv)
       cout << action << " success" << std::endl;
     }
   }
+  else if (action == "migrate-cf") {
+    validate_path(cct.get(), path, false);
+    BlueStore bluestore(cct.get(), path);
+    int r = bluestore.migrate_to_column_families(cout);
+    if (r < 0) {
+      cerr << "error from migrate-cf: " << cpp_strerror(r) << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    cout << action << " success" << std::endl;
+  }
   else if (action == "prime-osd-dir") {
     bluestore_bdev_label_t label;
     int r = BlueStore::_read_bdev_label(cct.get(), devs.front(), &label);
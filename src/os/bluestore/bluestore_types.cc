@@ -745,6 +745,47 @@ int bluestore_blob_t::verify_csum(uint64_t b_off, const bufferlist& bl,
     return 0;
 }
 
+int bluestore_blob_t::verify_csum_batch(const bluestore_blob_t * const *blobs,
+					Checksummer::verify_item_t *items,
+					size_t n)
+{
+  int bad = 0;
+  size_t i = 0;
+  while (i < n) {
+    // runs of the same csum type go through one batch
+    int type = blobs[i]->csum_type;
+    size_t j = i;
+    for (; j < n && blobs[j]->csum_type == type; ++j) {
+      items[j].csum_block_size = blobs[j]->get_csum_chunk_size();
+      items[j].csum_data = &blobs[j]->csum_data;
+      items[j].bad = -1;
+    }
+    switch (type) {
+    case Checksummer::CSUM_NONE:
+      break;
+    case Checksummer::CSUM_XXHASH32:
+      bad += Checksummer::verify_batch<Checksummer::xxhash32>(items + i, j - i);
+      break;
+    case Checksummer::CSUM_XXHASH64:
+      bad += Checksummer::verify_batch<Checksummer::xxhash64>(items + i, j - i);
+      break;
+    case Checksummer::CSUM_CRC32C:
+      bad += Checksummer::verify_batch<Checksummer::crc32c>(items + i, j - i);
+      break;
+    case Checksummer::CSUM_CRC32C_16:
+      bad += Checksummer::verify_batch<Checksummer::crc32c_16>(items + i, j - i);
+      break;
+    case Checksummer::CSUM_CRC32C_8:
+      bad += Checksummer::verify_batch<Checksummer::crc32c_8>(items + i, j - i);
+      break;
+    default:
+      return -EOPNOTSUPP;
+    }
+    i = j;
+  }
+  return bad;
+}
+
 void bluestore_blob_t::allocated(uint32_t b_off, uint32_t length, const PExtentVector& allocs)
 {
   if (extents.size() == 0) {
@@ -1055,11 +1096,19 @@ void bluestore_onode_t::dump(Formatter *f) const
   f->dump_unsigned("expected_object_size", expected_object_size);
   f->dump_unsigned("expected_write_size", expected_write_size);
   f->dump_unsigned("alloc_hint_flags", alloc_hint_flags);
+  if (has_inline_data()) {
+    f->dump_unsigned("inline_data_len", inline_data.length());
+  }
 }
 
 void bluestore_onode_t::generate_test_instances(list<bluestore_onode_t*>& o)
 {
   o.push_back(new bluestore_onode_t());
+  o.push_back(new bluestore_onode_t());
+  o.back()->nid = 1;
+  o.back()->size = 8192;
+  o.back()->set_flag(FLAG_INLINE_DATA);
+  o.back()->inline_data.append("small object payload");
   // FIXME
 }
 
@@ -783,6 +783,14 @@ public:
   int verify_csum(uint64_t b_off, const bufferlist& bl, int* b_bad_off,
 		  uint64_t *bad_csum) const;
 
+  /// verify_csum() many reads, possibly of different blobs, in one pass;
+  /// items[i] is a read of blobs[i] with bl and offset (b_off) set, the
+  /// rest is filled in here.  return -EOPNOTSUPP for unsupported checksum
+  /// type, otherwise the number of items with a bad chunk (see
+  /// items[i].bad and items[i].bad_csum).
+  static int verify_csum_batch(const bluestore_blob_t * const *blobs,
+			       Checksummer::verify_item_t *items, size_t n);
+
   bool can_prune_tail() const {
     return
       extents.size() > 1 &&  // if it's all invalid it's not pruning.
@@ -904,13 +912,24 @@ struct bluestore_onode_t {
   enum {
     FLAG_OMAP = 1,       ///< object may have omap data
     FLAG_PGMETA_OMAP = 2,  ///< omap data is in meta omap prefix
+    FLAG_INLINE_DATA = 4,  ///< data lives in inline_data, not in extents
   };
 
+  /// object data when FLAG_INLINE_DATA is set; anything between its end
+  /// and size reads as zeros
+  bufferlist inline_data;
+
   string get_flags_string() const {
     string s;
     if (flags & FLAG_OMAP) {
       s = "omap";
     }
+    if (flags & FLAG_INLINE_DATA) {
+      if (!s.empty()) {
+	s += "+";
+      }
+      s += "inline_data";
+    }
     return s;
   }
 
@@ -941,8 +960,13 @@ struct bluestore_onode_t {
     clear_flag(FLAG_OMAP);
   }
 
+  bool has_inline_data() const {
+    return has_flag(FLAG_INLINE_DATA);
+  }
+
   DENC(bluestore_onode_t, v, p) {
-    DENC_START(1, 1, p);
+    // only onodes that carry inline data need a reader that knows it
+    DENC_START(2, v.has_inline_data() ? 2 : 1, p);
     denc_varint(v.nid, p);
     denc_varint(v.size, p);
     denc(v.attrs, p);
@@ -951,6 +975,9 @@ struct bluestore_onode_t {
     denc_varint(v.expected_object_size, p);
     denc_varint(v.expected_write_size, p);
     denc_varint(v.alloc_hint_flags, p);
+    if (struct_v >= 2 && v.has_inline_data()) {
+      denc(v.inline_data, p);
+    }
     DENC_FINISH(p);
   }
   void dump(Formatter *f) const;
@@ -12,6 +12,7 @@
 
 #include <vector>
 #include <algorithm>
+#include <functional>
 #include <mutex>
 
 typedef uint64_t slot_t;
@@ -262,6 +263,45 @@ protected:
 
   friend class AllocatorLevel02<AllocatorLevel01Loose>;
 
+  // report each run of free l0 entries as one extent
+  void foreach_internal(
+    std::function<void(uint64_t offset, uint64_t length)> notify)
+  {
+    uint64_t run_start = 0;
+    uint64_t run_len = 0;
+    for (uint64_t i = 0; i < l0.size(); ++i) {
+      slot_t v = l0[i];
+      if (v == all_slot_set) {
+        if (!run_len) {
+          run_start = i * bits_per_slot;
+        }
+        run_len += bits_per_slot;
+        continue;
+      }
+      if (v == all_slot_clear) {
+        if (run_len) {
+          notify(run_start * l0_granularity, run_len * l0_granularity);
+          run_len = 0;
+        }
+        continue;
+      }
+      for (size_t b = 0; b < bits_per_slot; ++b) {
+        if (v & (slot_t(1) << b)) {
+          if (!run_len) {
+            run_start = i * bits_per_slot + b;
+          }
+          ++run_len;
+        } else if (run_len) {
+          notify(run_start * l0_granularity, run_len * l0_granularity);
+          run_len = 0;
+        }
+      }
+    }
+    if (run_len) {
+      notify(run_start * l0_granularity, run_len * l0_granularity);
+    }
+  }
+
   void _init(uint64_t capacity, uint64_t _alloc_unit, bool mark_as_free = true)
   {
     l0_granularity = _alloc_unit;
@@ -748,6 +788,11 @@ protected:
     std::lock_guard<std::mutex> l(lock);
     return l1.get_fragmentation();
   }
+  void _foreach(std::function<void(uint64_t offset, uint64_t length)> notify)
+  {
+    std::lock_guard<std::mutex> l(lock);
+    l1.foreach_internal(notify);
+  }
 };
 
 #endif
@@ -0,0 +1,245 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "ioring.h"
+
+#if defined(HAVE_LIBURING)
+
+#include <poll.h>
+#include <unistd.h>
+#include <liburing.h>
+
+#include <map>
+#include <mutex>
+
+#include "include/compat.h"
+#include "common/ceph_time.h"
+
+struct ioring_data {
+  struct io_uring io_uring;
+  std::mutex sq_mutex;  ///< serializes submitters; the SQ ring is single producer
+  std::mutex cq_mutex;  ///< serializes reapers
+  std::map<int, int> fixed_fds_map;  ///< fd -> slot in the registered file table
+};
+
+ioring_queue_t::ioring_queue_t(unsigned iodepth_, bool hipri_, bool sq_thread_)
+  : d(new ioring_data),
+    iodepth(iodepth_),
+    hipri(hipri_),
+    sq_thread(sq_thread_)
+{
+}
+
+ioring_queue_t::~ioring_queue_t()
+{
+}
+
+bool ioring_queue_t::supported()
+{
+  struct io_uring ring;
+  int r = io_uring_queue_init(16, &ring, 0);
+  if (r < 0) {
+    return false;
+  }
+  io_uring_queue_exit(&ring);
+  return true;
+}
+
+int ioring_queue_t::init(std::vector<int> &fds)
+{
+  unsigned flags = 0;
+  if (hipri) {
+    flags |= IORING_SETUP_IOPOLL;
+  }
+  if (sq_thread) {
+    flags |= IORING_SETUP_SQPOLL;
+  }
+
+  int r = io_uring_queue_init(iodepth, &d->io_uring, flags);
+  if (r < 0) {
+    return r;
+  }
+
+  r = io_uring_register_files(&d->io_uring, &fds[0], fds.size());
+  if (r < 0) {
+    io_uring_queue_exit(&d->io_uring);
+    return r;
+  }
+  for (unsigned i = 0; i < fds.size(); ++i) {
+    d->fixed_fds_map[fds[i]] = i;
+  }
+  return 0;
+}
+
+void ioring_queue_t::shutdown()
+{
+  d->fixed_fds_map.clear();
+  io_uring_unregister_files(&d->io_uring);
+  io_uring_queue_exit(&d->io_uring);
+}
+
+static void init_sqe(ioring_data *d, struct io_uring_sqe *sqe, aio_t *io)
+{
+  auto p = d->fixed_fds_map.find(io->fd);
+  assert(p != d->fixed_fds_map.end());
+  int fixed_fd = p->second;
+
+  if (io->iocb.aio_lio_opcode == IO_CMD_PWRITEV) {
+    io_uring_prep_writev(sqe, fixed_fd, &io->iov[0], io->iov.size(),
+			 io->offset);
+  } else if (io->iocb.aio_lio_opcode == IO_CMD_PREAD) {
+    // IORING_OP_READ needs 5.6; readv works on any kernel with io_uring
+    io->iov.clear();
+    io->iov.push_back(iovec{io->iocb.u.c.buf, io->iocb.u.c.nbytes});
+    io_uring_prep_readv(sqe, fixed_fd, &io->iov[0], io->iov.size(),
+			io->offset);
+  } else {
+    ceph_abort();
+  }
+  io_uring_sqe_set_data(sqe, io);
+  io_uring_sqe_set_flags(sqe, IOSQE_FIXED_FILE);
+}
+
+int ioring_queue_t::submit_batch(aio_iter begin, aio_iter end,
+				 uint16_t aios_size, void *priv,
+				 int *retries)
+{
+  // same backoff as the libaio queue: 2^16 * 125us = ~8 seconds
+  int attempts = 16;
+  int delay = 125;
+  int queued = 0;
+
+  std::lock_guard<std::mutex> l(d->sq_mutex);
+  aio_iter cur = begin;
+  while (cur != end) {
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&d->io_uring);
+    if (!sqe) {
+      // SQ ring is full; push what we have queued so far and retry
+      int r = io_uring_submit(&d->io_uring);
+      if (r < 0) {
+	return r;
+      }
+      if (r == 0) {
+	if (attempts-- <= 0) {
+	  return -EAGAIN;
+	}
+	usleep(delay);
+	delay *= 2;
+	(*retries)++;
+      } else {
+	attempts = 16;
+	delay = 125;
+      }
+      continue;
+    }
+    cur->priv = priv;
+    init_sqe(d.get(), sqe, &*cur);
+    ++queued;
+    ++cur;
+  }
+  assert(aios_size >= queued);
+
+  int r = io_uring_submit(&d->io_uring);
+  if (r < 0) {
+    return r;
+  }
+  return queued;
+}
+
+static int ioring_get_cqe(ioring_data *d, int max, aio_t **paio)
+{
+  struct io_uring *ring = &d->io_uring;
+  struct io_uring_cqe *cqe;
+  unsigned head;
+  int nr = 0;
+
+  io_uring_for_each_cqe(ring, head, cqe) {
+    aio_t *io = static_cast<aio_t*>(io_uring_cqe_get_data(cqe));
+    io->rval = cqe->res;
+    paio[nr++] = io;
+    if (nr == max) {
+      break;
+    }
+  }
+  io_uring_cq_advance(ring, nr);
+  return nr;
+}
+
+int ioring_queue_t::get_next_completed(int timeout_ms, aio_t **paio, int max)
+{
+  auto deadline = ceph::mono_clock::now() +
+    std::chrono::milliseconds(timeout_ms);
+  while (true) {
+    {
+      std::lock_guard<std::mutex> l(d->cq_mutex);
+      if (hipri) {
+	// with IORING_SETUP_IOPOLL nothing lands in the CQ ring unless we
+	// ask the kernel to poll for it; peeking does exactly that without
+	// blocking.
+	struct io_uring_cqe *cqe;
+	io_uring_peek_cqe(&d->io_uring, &cqe);
+      }
+      int events = ioring_get_cqe(d.get(), max, paio);
+      if (events) {
+	return events;
+      }
+    }
+
+    if (hipri) {
+      if (ceph::mono_clock::now() >= deadline) {
+	return 0;
+      }
+      continue;
+    }
+
+    // the ring fd becomes readable as soon as there is something to reap
+    struct pollfd pfd = { d->io_uring.ring_fd, POLLIN, 0 };
+    int r = TEMP_FAILURE_RETRY(::poll(&pfd, 1, timeout_ms));
+    if (r < 0) {
+      return -errno;
+    }
+    if (r == 0) {
+      return 0;
+    }
+  }
+}
+
+#else // #if defined(HAVE_LIBURING)
+
+struct ioring_data {};
+
+ioring_queue_t::ioring_queue_t(unsigned iodepth_, bool hipri_, bool sq_thread_)
+{
+}
+
+ioring_queue_t::~ioring_queue_t()
+{
+}
+
+bool ioring_queue_t::supported()
+{
+  return false;
+}
+
+int ioring_queue_t::init(std::vector<int> &fds)
+{
+  return -EOPNOTSUPP;
+}
+
+void ioring_queue_t::shutdown()
+{
+}
+
+int ioring_queue_t::submit_batch(aio_iter begin, aio_iter end,
+				 uint16_t aios_size, void *priv,
+				 int *retries)
+{
+  return -EOPNOTSUPP;
+}
+
+int ioring_queue_t::get_next_completed(int timeout_ms, aio_t **paio, int max)
+{
+  return 0;
+}
+
+#endif // #if defined(HAVE_LIBURING)
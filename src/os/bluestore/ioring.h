@@ -0,0 +1,45 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#pragma once
+
+#include "acconfig.h"
+
+#include <memory>
+
+#include "aio.h"
+
+struct ioring_data;
+
+/**
+ * io_uring backed io_queue_t
+ *
+ * The device fds are registered with the ring up front (fixed files) and
+ * completions are harvested in batches straight off the CQ ring, so the
+ * common case costs one io_uring_enter(2) per submitted batch and none per
+ * reaped completion.  Optionally the SQ ring is drained by a kernel thread
+ * (sq_thread) and completions are polled rather than interrupt driven
+ * (hipri).
+ */
+struct ioring_queue_t final : public io_queue_t {
+  std::unique_ptr<ioring_data> d;
+  unsigned iodepth = 0;
+  bool hipri = false;
+  bool sq_thread = false;
+
+  ioring_queue_t(unsigned iodepth_, bool hipri_, bool sq_thread_);
+  ~ioring_queue_t() final;
+
+  /// true if both liburing and the running kernel can set up a ring
+  static bool supported();
+
+  int init(std::vector<int> &fds) final;
+  void shutdown() final;
+
+  int submit_batch(aio_iter begin, aio_iter end, uint16_t aios_size,
+		   void *priv, int *retries) final;
+  int get_next_completed(int timeout_ms, aio_t **paio, int max) final;
+  const char *get_name() const final {
+    return "io_uring";
+  }
+};
@@ -2460,6 +2460,7 @@ int ECBackend::be_deep_scrub(
   }
   if (r > 0) {
     pos.data_hash << bl;
+    pos.read_bytes += r;
   }
   pos.data_pos += r;
   if (r == (int)stride) {
@@ -20,6 +20,7 @@
 #include <iostream>
 
 #include <unistd.h>
+#include <sched.h>
 #include <sys/stat.h>
 #include <signal.h>
 #include <boost/scoped_ptr.hpp>
@@ -145,6 +146,7 @@
 
 #include "common/cmdparse.h"
 #include "include/str_list.h"
+#include "common/strtol.h"
 #include "include/util.h"
 
 #include "include/assert.h"
@@ -204,6 +206,7 @@ CompatSet OSD::get_osd_compat_set() {
   CompatSet compat =  get_osd_initial_compat_set();
   //Any features here can be set in code, but not in initial superblock
   compat.incompat.insert(CEPH_OSD_FEATURE_INCOMPAT_SHARDS);
+  compat.incompat.insert(CEPH_OSD_FEATURE_INCOMPAT_COMPACT_PGLOG);
   return compat;
 }
 
@@ -264,6 +267,7 @@ OSDService::OSDService(OSD *osd) :
   map_cache(cct, cct->_conf->osd_map_cache_size),
   map_bl_cache(cct->_conf->osd_map_cache_size),
   map_bl_inc_cache(cct->_conf->osd_map_cache_size),
+  quiet_map_cache(cct->_conf->osd_map_cache_size),
   stat_lock("OSDService::stat_lock"),
   full_status_lock("OSDService::full_status_lock"),
   cur_state(NONE),
@@ -1207,6 +1211,38 @@ void OSDService::dec_scrubs_active()
   sched_scrub_lock.Unlock();
 }
 
+void OSDService::charge_deep_scrub(uint64_t read_bytes, uint64_t verify_bytes)
+{
+  logger->inc(l_osd_scrub_read_bytes, read_bytes);
+  logger->inc(l_osd_scrub_verify_bytes, verify_bytes);
+  uint64_t rate = cct->_conf.get_val<Option::size_t>(
+    "osd_deep_scrub_max_bytes_per_sec");
+  if (rate == 0) {
+    return;
+  }
+  utime_t now = ceph_clock_now();
+  Mutex::Locker l(sched_scrub_lock);
+  // budget left unused while nothing was scrubbing is not banked
+  if (deep_scrub_budget_until < now) {
+    deep_scrub_budget_until = now;
+  }
+  deep_scrub_budget_until += (double)(read_bytes + verify_bytes) / rate;
+}
+
+double OSDService::get_deep_scrub_delay()
+{
+  if (cct->_conf.get_val<Option::size_t>(
+	"osd_deep_scrub_max_bytes_per_sec") == 0) {
+    return 0;
+  }
+  utime_t now = ceph_clock_now();
+  Mutex::Locker l(sched_scrub_lock);
+  if (deep_scrub_budget_until <= now) {
+    return 0;
+  }
+  return (double)(deep_scrub_budget_until - now);
+}
+
 void OSDService::retrieve_epochs(epoch_t *_boot_epoch, epoch_t *_up_epoch,
                                  epoch_t *_bind_epoch) const
 {
@@ -1446,6 +1482,28 @@ OSDMapRef OSDService::_add_map(OSDMap *o)
   return l;
 }
 
+bool OSDService::is_quiet_map(OSDMapRef lastmap, OSDMapRef nextmap)
+{
+  epoch_t e = nextmap->get_epoch();
+  if (lastmap->get_epoch() + 1 != e) {
+    return false;
+  }
+  {
+    Mutex::Locker l(map_cache_lock);
+    bool quiet;
+    if (quiet_map_cache.lookup(e, &quiet)) {
+      return quiet;
+    }
+  }
+
+  bool quiet = nextmap->same_osd_states(*lastmap);
+  dout(20) << __func__ << " " << e << " " << quiet << dendl;
+
+  Mutex::Locker l(map_cache_lock);
+  quiet_map_cache.add(e, quiet);
+  return quiet;
+}
+
 OSDMapRef OSDService::try_get_map(epoch_t epoch)
 {
   Mutex::Locker l(map_cache_lock);
@@ -1916,6 +1974,7 @@ OSD::OSD(CephContext *cct_, ObjectStore *store_,
   test_ops_hook(NULL),
   op_queue(get_io_queue()),
   op_prio_cutoff(get_io_prio_cut()),
+  op_inline_reads(cct->_conf.get_val<bool>("osd_op_inline_reads")),
   op_shardedwq(
     this,
     cct->_conf->osd_op_thread_timeout,
@@ -1956,9 +2015,29 @@ OSD::OSD(CephContext *cct_, ObjectStore *store_,
       this,
       cct->_conf->osd_op_pq_max_tokens_per_priority,
       cct->_conf->osd_op_pq_min_cost,
-      op_queue);
+      op_queue,
+      cost_model,
+      num_shards);
     shards.push_back(one_shard);
   }
+  if (cct->_conf.get_val<bool>("osd_op_shard_affinity")) {
+    vector<string> cores;
+    get_str_vec(cct->_conf->ms_async_affinity_cores, cores);
+    for (uint32_t i = 0; i < num_shards && !cores.empty(); i++) {
+      string err;
+      int cpu = strict_strtol(cores[i % cores.size()].c_str(), 10, &err);
+      if (err.empty()) {
+	shards[i]->cpu = cpu;
+      }
+    }
+  }
+  if (unsigned steal = cct->_conf.get_val<uint64_t>("osd_op_steal_threshold");
+      steal && num_shards > 1) {
+    for (auto s : shards) {
+      s->steal_high = steal;
+      s->steal_low = steal / 2;
+    }
+  }
 }
 
 OSD::~OSD()
@@ -2381,6 +2460,144 @@ float OSD::get_osd_recovery_sleep()
     return cct->_conf->osd_recovery_sleep_hdd;
 }
 
+double OSD::run_osd_bench(int64_t count, int64_t bsize,
+			int64_t osize, int64_t onum)
+{
+  ObjectStore::Transaction cleanupt;
+
+  if (osize && onum) {
+    bufferlist bl;
+    bufferptr bp(osize);
+    bp.zero();
+    bl.push_back(std::move(bp));
+    bl.rebuild_page_aligned();
+    for (int i=0; i<onum; ++i) {
+      char nm[30];
+      snprintf(nm, sizeof(nm), "disk_bw_test_%d", i);
+      object_t oid(nm);
+      hobject_t soid(sobject_t(oid, 0));
+      ObjectStore::Transaction t;
+      t.write(coll_t(), ghobject_t(soid), 0, osize, bl);
+      store->queue_transaction(service.meta_ch, std::move(t), NULL);
+      cleanupt.remove(coll_t(), ghobject_t(soid));
+    }
+  }
+
+  bufferlist bl;
+  bufferptr bp(bsize);
+  bp.zero();
+  bl.push_back(std::move(bp));
+  bl.rebuild_page_aligned();
+
+  {
+    C_SaferCond waiter;
+    if (!service.meta_ch->flush_commit(&waiter)) {
+      waiter.wait();
+    }
+  }
+
+  utime_t start = ceph_clock_now();
+  for (int64_t pos = 0; pos < count; pos += bsize) {
+    char nm[30];
+    unsigned offset = 0;
+    if (onum && osize) {
+      snprintf(nm, sizeof(nm), "disk_bw_test_%d", (int)(rand() % onum));
+      offset = rand() % (osize / bsize) * bsize;
+    } else {
+      snprintf(nm, sizeof(nm), "disk_bw_test_%lld", (long long)pos);
+    }
+    object_t oid(nm);
+    hobject_t soid(sobject_t(oid, 0));
+    ObjectStore::Transaction t;
+    t.write(coll_t::meta(), ghobject_t(soid), offset, bsize, bl);
+    store->queue_transaction(service.meta_ch, std::move(t), NULL);
+    if (!onum || !osize)
+      cleanupt.remove(coll_t::meta(), ghobject_t(soid));
+  }
+
+  {
+    C_SaferCond waiter;
+    if (!service.meta_ch->flush_commit(&waiter)) {
+      waiter.wait();
+    }
+  }
+  utime_t end = ceph_clock_now();
+
+  // clean up
+  store->queue_transaction(service.meta_ch, std::move(cleanupt), NULL);
+  {
+    C_SaferCond waiter;
+    if (!service.meta_ch->flush_commit(&waiter)) {
+      waiter.wait();
+    }
+  }
+
+  return end - start;
+}
+
+void OSD::init_cost_model()
+{
+  double iops = cct->_conf.get_val<double>("osd_mclock_cost_iops");
+  double bandwidth =
+    cct->_conf.get_val<Option::size_t>("osd_mclock_cost_bandwidth");
+
+  // measured at an earlier start?
+  auto load = [this](const char *key, double *v) {
+    string val;
+    if (*v <= 0 && store->read_meta(key, &val) == 0) {
+      *v = atof(val.c_str());
+    }
+  };
+  load("mclock_cost_iops", &iops);
+  load("mclock_cost_bandwidth", &bandwidth);
+
+  if (cct->_conf.get_val<bool>("osd_mclock_cost_bench") &&
+      (iops <= 0 || bandwidth <= 0)) {
+    // the bench writes at most 64 MiB; leave it alone on a store that is
+    // anywhere near full
+    store_statfs_t st;
+    uint64_t need = 64 << 20;
+    if (store->statfs(&st) < 0 || st.available < need * 16) {
+      dout(0) << __func__ << " skipping the cost bench, only "
+	      << byte_u_t(st.available) << " available" << dendl;
+    } else {
+      if (iops <= 0) {
+	// 3000 4 KiB writes at random offsets of 16 1 MiB objects
+	int64_t bsize = 4 << 10;
+	int64_t count = 3000 * bsize;
+	double elapsed = run_osd_bench(count, bsize, 1 << 20, 16);
+	if (elapsed > 0) {
+	  iops = count / bsize / elapsed;
+	  store->write_meta("mclock_cost_iops", stringify(iops));
+	}
+      }
+      if (bandwidth <= 0) {
+	// 64 MiB of 4 MiB writes to fresh objects
+	int64_t bsize = 4 << 20;
+	int64_t count = 16 * bsize;
+	double elapsed = run_osd_bench(count, bsize, 0, 0);
+	if (elapsed > 0) {
+	  bandwidth = count / elapsed;
+	  store->write_meta("mclock_cost_bandwidth", stringify(bandwidth));
+	}
+      }
+    }
+  }
+
+  // neither configured nor measured: guess from the device type
+  if (iops <= 0) {
+    iops = store_is_rotational ? 300 : 20000;
+  }
+  if (bandwidth <= 0) {
+    bandwidth = store_is_rotational ? (150 << 20) : (500 << 20);
+  }
+
+  cost_model.set_capacity(iops, bandwidth);
+  dout(0) << __func__ << " " << si_u_t(iops) << " IOPS, "
+	  << byte_u_t(bandwidth) << "/s; 4 MiB op costs "
+	  << cost_model.cost(4 << 20) << dendl;
+}
+
 int OSD::init()
 {
   CompatSet initial, diff;
@@ -2488,6 +2705,10 @@ int OSD::init()
     goto out;
   }
 
+  if (op_queue == io_queue::mclock_cost) {
+    init_cost_model();
+  }
+
   // load up "current" osdmap
   assert_warn(!osdmap);
   if (osdmap) {
@@ -2531,6 +2752,22 @@ int OSD::init()
       goto out;
   }
 
+  if (cct->_conf.get_val<bool>("osd_pg_log_compact_entries") &&
+      !superblock.compat_features.incompat.contains(
+	CEPH_OSD_FEATURE_INCOMPAT_COMPACT_PGLOG)) {
+    dout(0) << __func__ << " enabling on-disk COMPACT PG LOG compat feature"
+	    << dendl;
+    superblock.compat_features.incompat.insert(
+      CEPH_OSD_FEATURE_INCOMPAT_COMPACT_PGLOG);
+    ObjectStore::Transaction t;
+    write_superblock(t);
+    r = store->queue_transaction(service.meta_ch, std::move(t));
+    if (r < 0)
+      goto out;
+  }
+  service.compact_pg_log = superblock.compat_features.incompat.contains(
+    CEPH_OSD_FEATURE_INCOMPAT_COMPACT_PGLOG);
+
   // make sure snap mapper object exists
   if (!store->exists(service.meta_ch, OSD::make_snapmapper_oid())) {
     dout(10) << "init creating/touching snapmapper object" << dendl;
@@ -2952,6 +3189,15 @@ void OSD::create_logger()
     32,                              ///< Enough to cover requests larger than GB
   };
 
+  // Finer latency axis to compare inline and queued reads
+  PerfHistogramCommon::axis_config_d op_hist_fine_x_axis_config{
+    "Latency (usec)",
+    PerfHistogramCommon::SCALE_LOG2, ///< Latency in logarithmic scale
+    0,                               ///< Start at 0
+    1000,                            ///< Quantization unit is 1usec
+    32,                              ///< Enough to cover much longer than slow requests
+  };
+
 
   // All the basic OSD operation stats are to be considered useful
   osd_plb.set_prio_default(PerfCountersBuilder::PRIO_USEFUL);
@@ -3051,6 +3297,26 @@ void OSD::create_logger()
     "Latency of IO before calling queue(before really queue into ShardedOpWq)"); // client io before queue op_wq latency
   osd_plb.add_time_avg(l_osd_op_before_dequeue_op_lat, "op_before_dequeue_op_lat",
     "Latency of IO before calling dequeue_op(already dequeued and get PG lock)"); // client io before dequeue_op latency
+  osd_plb.add_u64_counter(l_osd_op_dispatch_local, "op_dispatch_local",
+    "Ops queued by a thread on the CPU of their pinned shard");
+  osd_plb.add_u64_counter(l_osd_op_dispatch_cross_core, "op_dispatch_cross_core",
+    "Ops queued by a thread on another CPU than their pinned shard");
+  osd_plb.add_u64_counter(l_osd_op_inline, "op_inline",
+    "Client reads run on the messenger thread that received them");
+  osd_plb.add_u64_counter(l_osd_op_inline_fallback, "op_inline_fallback",
+    "Client reads queued because their shard or PG was busy");
+  osd_plb.add_time_avg(l_osd_op_r_inline_lat, "op_r_inline_latency",
+    "Latency of read operations run inline");
+  osd_plb.add_u64_counter_histogram(
+    l_osd_op_r_inline_lat_outb_hist, "op_r_inline_latency_out_bytes_histogram",
+    op_hist_fine_x_axis_config, op_hist_y_axis_config,
+    "Histogram of latency of read operations run inline + data read");
+  osd_plb.add_time_avg(l_osd_op_r_queued_lat, "op_r_queued_latency",
+    "Latency of read operations queued to an op shard");
+  osd_plb.add_u64_counter_histogram(
+    l_osd_op_r_queued_lat_outb_hist, "op_r_queued_latency_out_bytes_histogram",
+    op_hist_fine_x_axis_config, op_hist_y_axis_config,
+    "Histogram of latency of read operations queued to an op shard + data read");
 
   osd_plb.add_u64_counter(
     l_osd_sop, "subop", "Suboperations");
@@ -3202,6 +3468,33 @@ void OSD::create_logger()
   osd_plb.add_u64_counter(
     l_osd_pg_biginfo, "osd_pg_biginfo", "PG updated its biginfo attr");
 
+  osd_plb.add_time_avg(
+    l_osd_advance_pg_lat, "advance_pg_lat",
+    "Time to bring a PG up to the current OSD map");
+  osd_plb.add_u64_counter(
+    l_osd_advance_pg_maps, "advance_pg_maps",
+    "OSD maps handed to PGs' state machines");
+  osd_plb.add_u64_counter(
+    l_osd_advance_pg_skipped, "advance_pg_skipped",
+    "OSD maps PGs stepped over without running their state machine");
+  osd_plb.add_time_avg(
+    l_osd_peering_evt_lat, "peering_evt_lat",
+    "Time to process a peering event, including map catch-up");
+
+  osd_plb.add_u64_counter(
+    l_osd_scrub_read_bytes, "scrub_read_bytes",
+    "Object data deep scrub read", NULL, 0, unit_t(UNIT_BYTES));
+  osd_plb.add_u64_counter(
+    l_osd_scrub_verify_bytes, "scrub_verify_bytes",
+    "Object data deep scrub had the object store verify in place",
+    NULL, 0, unit_t(UNIT_BYTES));
+  osd_plb.add_time_avg(
+    l_osd_scrub_budget_wait, "scrub_budget_wait",
+    "Time deep scrub waited to stay within osd_deep_scrub_max_bytes_per_sec");
+  osd_plb.add_time_avg(
+    l_osd_op_lat_scrubbing, "op_latency_scrubbing",
+    "Latency of client operations on PGs being scrubbed");
+
   logger = osd_plb.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
 }
@@ -6047,77 +6340,7 @@ void OSD::do_command(Connection *con, ceph_tid_t tid, vector<string>& cmd, buffe
 
     dout(1) << " bench count " << count
             << " bsize " << byte_u_t(bsize) << dendl;
-
-    ObjectStore::Transaction cleanupt;
-
-    if (osize && onum) {
-      bufferlist bl;
-      bufferptr bp(osize);
-      bp.zero();
-      bl.push_back(std::move(bp));
-      bl.rebuild_page_aligned();
-      for (int i=0; i<onum; ++i) {
-	char nm[30];
-	snprintf(nm, sizeof(nm), "disk_bw_test_%d", i);
-	object_t oid(nm);
-	hobject_t soid(sobject_t(oid, 0));
-	ObjectStore::Transaction t;
-	t.write(coll_t(), ghobject_t(soid), 0, osize, bl);
-	store->queue_transaction(service.meta_ch, std::move(t), NULL);
-	cleanupt.remove(coll_t(), ghobject_t(soid));
-      }
-    }
-
-    bufferlist bl;
-    bufferptr bp(bsize);
-    bp.zero();
-    bl.push_back(std::move(bp));
-    bl.rebuild_page_aligned();
-
-    {
-      C_SaferCond waiter;
-      if (!service.meta_ch->flush_commit(&waiter)) {
-	waiter.wait();
-      }
-    }
-
-    utime_t start = ceph_clock_now();
-    for (int64_t pos = 0; pos < count; pos += bsize) {
-      char nm[30];
-      unsigned offset = 0;
-      if (onum && osize) {
-	snprintf(nm, sizeof(nm), "disk_bw_test_%d", (int)(rand() % onum));
-	offset = rand() % (osize / bsize) * bsize;
-      } else {
-	snprintf(nm, sizeof(nm), "disk_bw_test_%lld", (long long)pos);
-      }
-      object_t oid(nm);
-      hobject_t soid(sobject_t(oid, 0));
-      ObjectStore::Transaction t;
-      t.write(coll_t::meta(), ghobject_t(soid), offset, bsize, bl);
-      store->queue_transaction(service.meta_ch, std::move(t), NULL);
-      if (!onum || !osize)
-	cleanupt.remove(coll_t::meta(), ghobject_t(soid));
-    }
-
-    {
-      C_SaferCond waiter;
-      if (!service.meta_ch->flush_commit(&waiter)) {
-	waiter.wait();
-      }
-    }
-    utime_t end = ceph_clock_now();
-
-    // clean up
-    store->queue_transaction(service.meta_ch, std::move(cleanupt), NULL);
-    {
-      C_SaferCond waiter;
-      if (!service.meta_ch->flush_commit(&waiter)) {
-	waiter.wait();
-      }
-    }
-
-    double elapsed = end - start;
+    double elapsed = run_osd_bench(count, bsize, osize, onum);
     double rate = count / elapsed;
     double iops = rate / bsize;
     if (f) {
@@ -6524,6 +6747,18 @@ void OSD::ms_fast_dispatch(Message *m)
 
   if (m->get_connection()->has_features(CEPH_FEATUREMASK_RESEND_ON_SPLIT) ||
       m->get_type() != CEPH_MSG_OSD_OP) {
+    if (op_inline_reads &&
+	m->get_type() == CEPH_MSG_OSD_OP &&
+	static_cast<MOSDOp*>(m)->has_flag(CEPH_OSD_FLAG_READ) &&
+	!static_cast<MOSDOp*>(m)->has_flag(CEPH_OSD_FLAG_WRITE)) {
+      if (run_op_inline(
+	    static_cast<MOSDFastDispatchOp*>(m)->get_spg(),
+	    op,
+	    static_cast<MOSDFastDispatchOp*>(m)->get_map_epoch())) {
+	return;
+      }
+      logger->inc(l_osd_op_inline_fallback);
+    }
     // queue it directly
     enqueue_op(
       static_cast<MOSDFastDispatchOp*>(m)->get_spg(),
@@ -7818,8 +8053,11 @@ void OSD::advance_pg(
   PG::RecoveryCtx *rctx)
 {
   assert(pg->is_locked());
+  utime_t start = ceph_clock_now();
   OSDMapRef lastmap = pg->get_osdmap();
   assert(lastmap->get_epoch() < osd_epoch);
+  bool skip_quiet = cct->_conf.get_val<bool>("osd_pg_advance_skip_quiet_maps");
+  unsigned delivered = 0, skipped = 0;
   set<PGRef> new_pgs;  // any split children
   for (epoch_t next_epoch = pg->get_osdmap_epoch() + 1;
        next_epoch <= osd_epoch;
@@ -7836,9 +8074,26 @@ void OSD::advance_pg(
       pg->pg_id.pgid,
       &newup, &up_primary,
       &newacting, &acting_primary);
+
+    // during a map storm most epochs only move other pgs or up_thru;
+    // step over those rather than running each through the state
+    // machine.  the last map is always delivered.
+    if (skip_quiet &&
+	next_epoch < osd_epoch &&
+	service.is_quiet_map(lastmap, nextmap) &&
+	pg->try_skip_advance_map(
+	  nextmap, lastmap, newup, up_primary,
+	  newacting, acting_primary)) {
+      ++skipped;
+      lastmap = nextmap;
+      handle.reset_tp_timeout();
+      continue;
+    }
+
     pg->handle_advance_map(
       nextmap, lastmap, newup, up_primary,
       newacting, acting_primary, rctx);
+    ++delivered;
 
     // Check for split!
     set<spg_t> children;
@@ -7861,6 +8116,11 @@ void OSD::advance_pg(
   if (!new_pgs.empty()) {
     rctx->transaction->register_on_applied(new C_FinishSplits(this, new_pgs));
   }
+  dout(20) << __func__ << " " << pg->pg_id << " to " << osd_epoch
+	   << ": " << delivered << " maps, " << skipped << " skipped" << dendl;
+  logger->inc(l_osd_advance_pg_maps, delivered);
+  logger->inc(l_osd_advance_pg_skipped, skipped);
+  logger->tinc(l_osd_advance_pg_lat, ceph_clock_now() - start);
 }
 
 void OSD::consume_map()
@@ -8848,7 +9108,8 @@ bool OSD::op_is_discardable(const MOSDOp *op)
   return false;
 }
 
-void OSD::enqueue_op(spg_t pg, OpRequestRef& op, epoch_t epoch)
+// what every op goes through on its way to the pg, queued or run inline
+void OSD::_note_op_enqueued(spg_t pg, OpRequestRef& op, epoch_t epoch)
 {
   utime_t latency = ceph_clock_now() - op->get_req()->get_recv_stamp();
   dout(15) << "enqueue_op " << op << " prio " << op->get_req()->get_priority()
@@ -8861,16 +9122,114 @@ void OSD::enqueue_op(spg_t pg, OpRequestRef& op, epoch_t epoch)
   op->osd_trace.keyval("cost", op->get_req()->get_cost());
   op->mark_queued_for_pg();
   logger->tinc(l_osd_op_before_queue_op_lat, latency);
+  if (int cpu = shards[pg.hash_to_shard(num_shards)]->cpu; cpu >= 0) {
+    logger->inc(sched_getcpu() == cpu ? l_osd_op_dispatch_local :
+		l_osd_op_dispatch_cross_core);
+  }
+}
+
+void OSD::enqueue_op(spg_t pg, OpRequestRef& op, epoch_t epoch)
+{
+  _note_op_enqueued(pg, op, epoch);
+  unsigned cost = op->get_req()->get_cost();
+  if (op_queue == io_queue::mclock_cost &&
+      op->get_req()->get_type() == CEPH_MSG_OSD_OP) {
+    // a read's message cost is next to nothing; charge for what it
+    // will read instead.  the PG would finish decoding it anyway, and
+    // now won't, so do what do_op does once it is decoded.
+    MOSDOp *m = static_cast<MOSDOp*>(op->get_nonconst_req());
+    if (m->finish_decode()) {
+      op->reset_desc();   // for TrackedOp
+      m->clear_payload();
+    }
+    // a zero length read runs to the end of the object; guess it is
+    // the usual rbd/cephfs object size
+    const uint64_t whole_object = 4ull << 20;
+    uint64_t len = 0;
+    for (auto& o : m->ops) {
+      if (o.op.op == CEPH_OSD_OP_READ ||
+	  o.op.op == CEPH_OSD_OP_SPARSE_READ ||
+	  o.op.op == CEPH_OSD_OP_SYNC_READ) {
+	len += o.op.extent.length ? o.op.extent.length : whole_object;
+      }
+    }
+    cost = std::max<uint64_t>(cost, std::min<uint64_t>(len, UINT_MAX));
+  }
   op_shardedwq.queue(
     OpQueueItem(
       unique_ptr<OpQueueItem::OpQueueable>(new PGOpItem(pg, op)),
-      op->get_req()->get_cost(),
+      cost,
       op->get_req()->get_priority(),
       op->get_req()->get_recv_stamp(),
       op->get_req()->get_source().num(),
       epoch));
 }
 
+/*
+ * Run a read on the calling messenger thread instead of queueing it,
+ * saving the hand-off to an op thread.  Only when its shard has nothing
+ * queued and runs nothing else inline, and its PG is instantiated, has
+ * nothing queued or waiting and isn't locked, so it is ordered as if it
+ * were queued.  Ops arriving meanwhile queue as usual and wait for the
+ * pg lock.
+ */
+bool OSD::run_op_inline(spg_t pgid, OpRequestRef& op, epoch_t epoch)
+{
+  OSDShard *sdata = shards[pgid.hash_to_shard(num_shards)];
+  sdata->shard_lock.Lock();
+  auto p = sdata->pg_slots.find(pgid);
+  if (is_stopping() ||
+      sdata->inline_running ||
+      !sdata->pqueue->empty() ||
+      !sdata->shard_osdmap ||
+      epoch > sdata->shard_osdmap->get_epoch() ||
+      p == sdata->pg_slots.end()) {
+    sdata->shard_lock.Unlock();
+    return false;
+  }
+  OSDShardPGSlot *slot = p->second.get();
+  PGRef pg = slot->pg;
+  if (!pg ||
+      slot->num_running ||
+      slot->waiting_for_split ||
+      !slot->to_process.empty() ||
+      !slot->waiting.empty() ||
+      !slot->waiting_peering.empty() ||
+      !pg->try_lock()) {
+    sdata->shard_lock.Unlock();
+    return false;
+  }
+  sdata->inline_running = true;
+  // one handle per shard, shared by whichever messenger thread runs its
+  // inline op; it only ever covers one of them at a time, so point it at
+  // the current one
+  if (!sdata->inline_hb) {
+    sdata->inline_hb = cct->get_heartbeat_map()->add_worker(
+      sdata->shard_name + "::inline", pthread_self());
+  }
+  sdata->inline_hb->thread_id = pthread_self();
+  sdata->shard_lock.Unlock();
+
+  dout(15) << __func__ << " " << op << " " << *(op->get_req()) << dendl;
+  _note_op_enqueued(pgid, op, epoch);
+  op->run_inline = true;
+  logger->inc(l_osd_op_inline);
+  cct->get_heartbeat_map()->reset_timeout(
+    sdata->inline_hb, op_shardedwq.timeout_interval,
+    op_shardedwq.suicide_interval);
+  ThreadPool::TPHandle tp_handle(cct, sdata->inline_hb,
+				 op_shardedwq.timeout_interval,
+				 op_shardedwq.suicide_interval);
+  dequeue_op(pg, op, tp_handle);
+  pg->unlock();
+  cct->get_heartbeat_map()->clear_timeout(sdata->inline_hb);
+
+  sdata->shard_lock.Lock();
+  sdata->inline_running = false;
+  sdata->shard_lock.Unlock();
+  return true;
+}
+
 void OSD::enqueue_peering_evt(spg_t pgid, PGPeeringEventRef evt)
 {
   dout(15) << __func__ << " " << pgid << " " << evt->get_desc() << dendl;
@@ -8943,6 +9302,7 @@ void OSD::dequeue_peering_evt(
   PGPeeringEventRef evt,
   ThreadPool::TPHandle& handle)
 {
+  utime_t start = ceph_clock_now();
   PG::RecoveryCtx rctx = create_context();
   auto curmap = sdata->get_osdmap();
   epoch_t need_up_thru = 0, same_interval_since = 0;
@@ -8976,6 +9336,7 @@ void OSD::dequeue_peering_evt(
   dispatch_context(rctx, pg, curmap, &handle);
 
   service.send_pg_temp();
+  logger->tinc(l_osd_peering_evt_lat, ceph_clock_now() - start);
 }
 
 void OSD::dequeue_delete(
@@ -9361,6 +9722,28 @@ int OSD::init_op_flags(OpRequestRef& op)
 #undef dout_prefix
 #define dout_prefix *_dout << "osd." << osd->get_nodeid() << ":" << shard_id << "." << __func__ << " "
 
+void OSDShard::create_logger()
+{
+  PerfCountersBuilder plb(cct, shard_name, l_osd_shard_first,
+			  l_osd_shard_last);
+  plb.add_u64(l_osd_shard_queue_depth, "queue_depth",
+	      "Items in the op queue");
+  plb.add_u64_counter(l_osd_shard_stolen, "stolen",
+		      "Items run by idle threads of other shards");
+  plb.add_u64_counter(l_osd_shard_steals, "steals",
+		      "Items our idle threads ran for other shards");
+  logger = plb.create_perf_counters();
+  cct->get_perfcounters_collection()->add(logger);
+}
+
+OSDShard::~OSDShard()
+{
+  if (inline_hb)
+    cct->get_heartbeat_map()->remove_worker(inline_hb);
+  cct->get_perfcounters_collection()->remove(logger);
+  delete logger;
+}
+
 void OSDShard::_attach_pg(OSDShardPGSlot *slot, PG *pg)
 {
   dout(10) << pg->pg_id << " " << pg << dendl;
@@ -9694,10 +10077,39 @@ void OSD::ShardedOpWQ::_add_slot_waiter(
 void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb)
 {
   uint32_t shard_index = thread_index % osd->num_shards;
-  auto& sdata = osd->shards[shard_index];
+  OSDShard *sdata = osd->shards[shard_index];
   assert(sdata);
+  if (sdata->cpu >= 0) {
+    static thread_local bool pinned = false;
+    if (!pinned) {
+      pinned = true;
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(sdata->cpu, &set);
+      int r = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+      if (r) {
+	derr << __func__ << " failed to pin thread " << thread_index
+	     << " to cpu " << sdata->cpu << ": " << cpp_strerror(r) << dendl;
+      }
+    }
+  }
   // peek at spg_t
   sdata->shard_lock.Lock();
+  if (sdata->pqueue->empty() && sdata->steal_high) {
+    // nothing to do here; help out a busy shard.  its pg slots keep
+    // ordering our item against its own threads like one of theirs.
+    sdata->shard_lock.Unlock();
+    OSDShard *victim = _steal_from(shard_index);
+    if (victim) {
+      dout(20) << __func__ << " stealing from shard " << victim->shard_id
+	       << dendl;
+      sdata->logger->inc(l_osd_shard_steals);
+      victim->logger->inc(l_osd_shard_stolen);
+      sdata = victim;
+    } else {
+      sdata->shard_lock.Lock();
+    }
+  }
   if (sdata->pqueue->empty()) {
     sdata->sdata_wait_lock.Lock();
     if (!sdata->stop_waiting) {
@@ -9721,6 +10133,7 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb)
     }
   }
   OpQueueItem item = sdata->pqueue->dequeue();
+  sdata->_update_queue_depth(-1);
   if (osd->is_stopping()) {
     sdata->shard_lock.Unlock();
     return;    // OSD shutdown, discard.
@@ -9958,12 +10371,42 @@ void OSD::ShardedOpWQ::_enqueue(OpQueueItem&& item) {
   else
     sdata->pqueue->enqueue(
       item.get_owner(), priority, cost, std::move(item));
+  bool steal = sdata->_update_queue_depth(1);
   sdata->shard_lock.Unlock();
 
   sdata->sdata_wait_lock.Lock();
   sdata->sdata_cond.SignalOne();
   sdata->sdata_wait_lock.Unlock();
 
+  if (steal)
+    _wake_thieves(sdata);
+}
+
+OSDShard *OSD::ShardedOpWQ::_steal_from(uint32_t shard_index)
+{
+  for (uint32_t i = 1; i < osd->num_shards; ++i) {
+    OSDShard *s = osd->shards[(shard_index + i) % osd->num_shards];
+    if (!s->stealable)
+      continue;
+    s->shard_lock.Lock();
+    if (s->stealable && !s->pqueue->empty())
+      return s;
+    s->shard_lock.Unlock();
+  }
+  return nullptr;
+}
+
+void OSD::ShardedOpWQ::_wake_thieves(OSDShard *busy)
+{
+  uint32_t shard_index = busy->shard_id;
+  dout(20) << __func__ << " depth " << busy->queue_depth << dendl;
+  for (auto s : osd->shards) {
+    if (s == busy)
+      continue;
+    s->sdata_wait_lock.Lock();
+    s->sdata_cond.SignalOne();
+    s->sdata_wait_lock.Unlock();
+  }
 }
 
 void OSD::ShardedOpWQ::_enqueue_front(OpQueueItem&& item)
@@ -9988,11 +10431,13 @@ void OSD::ShardedOpWQ::_enqueue_front(OpQueueItem&& item)
   } else {
     dout(20) << __func__ << " " << item << dendl;
   }
-  sdata->_enqueue_front(std::move(item), osd->op_prio_cutoff);
+  bool steal = sdata->_enqueue_front(std::move(item), osd->op_prio_cutoff);
   sdata->shard_lock.Unlock();
   sdata->sdata_wait_lock.Lock();
   sdata->sdata_cond.SignalOne();
   sdata->sdata_wait_lock.Unlock();
+  if (steal)
+    _wake_thieves(sdata);
 }
 
 namespace ceph { 
@@ -10037,6 +10482,9 @@ std::ostream& operator<<(std::ostream& out, const io_queue& q) {
   case io_queue::mclock_client:
     out << "mclock_client";
     break;
+  case io_queue::mclock_cost:
+    out << "mclock_cost";
+    break;
   }
   return out;
 }
@@ -56,6 +56,7 @@
 #include "common/PrioritizedQueue.h"
 #include "osd/mClockOpClassQueue.h"
 #include "osd/mClockClientQueue.h"
+#include "osd/mClockCostClientQueue.h"
 #include "messages/MOSDOp.h"
 #include "common/EventTrace.h"
 
@@ -103,6 +104,14 @@ enum {
 
   l_osd_op_before_queue_op_lat,
   l_osd_op_before_dequeue_op_lat,
+  l_osd_op_dispatch_local,
+  l_osd_op_dispatch_cross_core,
+  l_osd_op_inline,
+  l_osd_op_inline_fallback,
+  l_osd_op_r_inline_lat,
+  l_osd_op_r_inline_lat_outb_hist,
+  l_osd_op_r_queued_lat,
+  l_osd_op_r_queued_lat_outb_hist,
 
   l_osd_sop,
   l_osd_sop_inb,
@@ -185,6 +194,16 @@ enum {
   l_osd_pg_fastinfo,
   l_osd_pg_biginfo,
 
+  l_osd_advance_pg_lat,
+  l_osd_advance_pg_maps,
+  l_osd_advance_pg_skipped,
+  l_osd_peering_evt_lat,
+
+  l_osd_scrub_read_bytes,
+  l_osd_scrub_verify_bytes,
+  l_osd_scrub_budget_wait,
+  l_osd_op_lat_scrubbing,
+
   l_osd_last,
 };
 
@@ -225,6 +244,15 @@ enum {
   rs_last,
 };
 
+// OSDShard perf counters
+enum {
+  l_osd_shard_first = 21000,
+  l_osd_shard_queue_depth,
+  l_osd_shard_stolen,
+  l_osd_shard_steals,
+  l_osd_shard_last,
+};
+
 class Messenger;
 class Message;
 class MonClient;
@@ -278,6 +306,9 @@ public:
   md_config_cacher_t<Option::size_t> osd_max_object_size;
   md_config_cacher_t<bool> osd_skip_data_digest;
 
+  /// write pg logs in the compact encoding; set at init, before any pg
+  bool compact_pg_log = false;
+
   void enqueue_back(OpQueueItem&& qi);
   void enqueue_front(OpQueueItem&& qi);
 
@@ -439,6 +470,8 @@ private:
   Mutex sched_scrub_lock;
   int scrubs_pending;
   int scrubs_active;
+  /// when the data deep scrubs have read so far is paid for
+  utime_t deep_scrub_budget_until;
 
 public:
   struct ScrubJob {
@@ -519,6 +552,12 @@ public:
   void dec_scrubs_pending();
   void dec_scrubs_active();
 
+  /// charge data deep scrub read, or had verified in place, to the osd
+  void charge_deep_scrub(uint64_t read_bytes, uint64_t verify_bytes);
+  /// seconds deep scrub should wait before reading more, to stay
+  /// within osd_deep_scrub_max_bytes_per_sec
+  double get_deep_scrub_delay();
+
   void reply_op_error(OpRequestRef op, int err);
   void reply_op_error(OpRequestRef op, int err, eversion_t v, version_t uv);
   void handle_misdirected_op(PG *pg, OpRequestRef op);
@@ -810,6 +849,7 @@ public:
   SharedLRU<epoch_t, const OSDMap> map_cache;
   SimpleLRU<epoch_t, bufferlist> map_bl_cache;
   SimpleLRU<epoch_t, bufferlist> map_bl_inc_cache;
+  SimpleLRU<epoch_t, bool> quiet_map_cache;
 
   /// final pg_num values for recently deleted pools
   map<int64_t,int> deleted_pool_pg_nums;
@@ -868,6 +908,13 @@ public:
     spg_t pgid,
     set<spg_t> *new_children);
 
+  /**
+   * true if nextmap, the epoch after lastmap, leaves alone everything a
+   * pg reacts to besides its own mapping and pool, which the pg checks
+   * itself (see PG::try_skip_advance_map)
+   */
+  bool is_quiet_map(OSDMapRef lastmap, OSDMapRef nextmap);
+
   void need_heartbeat_peer_update();
 
   void init();
@@ -1025,6 +1072,7 @@ enum class io_queue {
   weightedpriority,
   mclock_opclass,
   mclock_client,
+  mclock_cost,
 };
 
 
@@ -1103,6 +1151,7 @@ struct OSDShard {
   const unsigned shard_id;
   CephContext *cct;
   OSD *osd;
+  int cpu = -1;  ///< our threads are pinned here, -1 if not pinned
 
   string shard_name;
 
@@ -1146,10 +1195,42 @@ struct OSDShard {
 
   /// priority queue
   std::unique_ptr<OpQueue<OpQueueItem, uint64_t>> pqueue;
+  unsigned queue_depth = 0;  ///< items in pqueue
+
+  /// other shards' idle threads may take items from pqueue from
+  /// steal_high queued items until we are down to steal_low again
+  std::atomic<bool> stealable = { false };
+  unsigned steal_high = 0, steal_low = 0;   ///< 0 to never steal
+
+  PerfCounters *logger = nullptr;
 
   bool stop_waiting = false;
 
-  void _enqueue_front(OpQueueItem&& item, unsigned cutoff) {
+  /// a messenger thread is running one of our ops (osd_op_inline_reads)
+  bool inline_running = false;
+  /// registered on first use; thread_id is set to whichever messenger
+  /// thread runs the op each time
+  heartbeat_handle_d *inline_hb = nullptr;
+
+  /// account for items put into or taken from pqueue; true if that
+  /// made us stealable
+  bool _update_queue_depth(int delta) {
+    queue_depth += delta;
+    logger->set(l_osd_shard_queue_depth, queue_depth);
+    if (!steal_high) {
+      return false;
+    }
+    if (!stealable && queue_depth >= steal_high) {
+      stealable = true;
+      return true;
+    }
+    if (stealable && queue_depth <= steal_low) {
+      stealable = false;
+    }
+    return false;
+  }
+
+  bool _enqueue_front(OpQueueItem&& item, unsigned cutoff) {
     unsigned priority = item.get_priority();
     unsigned cost = item.get_cost();
     if (priority >= cutoff)
@@ -1160,6 +1241,7 @@ struct OSDShard {
       pqueue->enqueue_front(
 	item.get_owner(),
 	priority, cost, std::move(item));
+    return _update_queue_depth(1);
   }
 
   void _attach_pg(OSDShardPGSlot *slot, PG *pg);
@@ -1190,7 +1272,9 @@ struct OSDShard {
     CephContext *cct,
     OSD *osd,
     uint64_t max_tok_per_prio, uint64_t min_cost,
-    io_queue opqueue)
+    io_queue opqueue,
+    const ceph::mclock::OpCostModel& cost_model,
+    unsigned num_shards)
     : shard_id(id),
       cct(cct),
       osd(osd),
@@ -1214,8 +1298,16 @@ struct OSDShard {
       pqueue = std::make_unique<ceph::mClockOpClassQueue>(cct);
     } else if (opqueue == io_queue::mclock_client) {
       pqueue = std::make_unique<ceph::mClockClientQueue>(cct);
+    } else if (opqueue == io_queue::mclock_cost) {
+      pqueue = std::make_unique<ceph::mClockCostClientQueue>(
+	cct, cost_model, num_shards);
     }
+    create_logger();
   }
+  ~OSDShard();
+
+private:
+  void create_logger();
 };
 
 class OSD : public Dispatcher,
@@ -1650,7 +1742,11 @@ private:
   const io_queue op_queue;
 public:
   const unsigned int op_prio_cutoff;
+  const bool op_inline_reads;
 protected:
+  // what the data device can do; used by the mclock_cost queue
+  ceph::mclock::OpCostModel cost_model;
+  void init_cost_model();
 
   /*
    * The ordered op delivery chain is:
@@ -1696,6 +1792,11 @@ protected:
       OSDShardPGSlot *slot,
       OpQueueItem&& qi);
 
+    /// find a stealable shard other than ours; returns it locked
+    OSDShard *_steal_from(uint32_t shard_index);
+    /// let idle threads of other shards know busy became stealable
+    void _wake_thieves(OSDShard *busy);
+
     /// try to do some work
     void _process(uint32_t thread_index, heartbeat_handle_d *hb) override;
 
@@ -1753,6 +1854,8 @@ protected:
 
 
   void enqueue_op(spg_t pg, OpRequestRef& op, epoch_t epoch);
+  bool run_op_inline(spg_t pg, OpRequestRef& op, epoch_t epoch);
+  void _note_op_enqueued(spg_t pg, OpRequestRef& op, epoch_t epoch);
   void dequeue_op(
     PGRef pg, OpRequestRef op,
     ThreadPool::TPHandle &handle);
@@ -2142,7 +2245,8 @@ private:
       static io_queue index_lookup[] = { io_queue::prioritized,
 					 io_queue::weightedpriority,
 					 io_queue::mclock_opclass,
-					 io_queue::mclock_client };
+					 io_queue::mclock_client,
+					 io_queue::mclock_cost };
       srand(time(NULL));
       unsigned which = rand() % (sizeof(index_lookup) / sizeof(index_lookup[0]));
       return index_lookup[which];
@@ -2152,6 +2256,8 @@ private:
       return io_queue::mclock_opclass;
     } else if (cct->_conf->osd_op_queue == "mclock_client") {
       return io_queue::mclock_client;
+    } else if (cct->_conf->osd_op_queue == "mclock_cost") {
+      return io_queue::mclock_cost;
     } else {
       // default / catch-all is 'wpq'
       return io_queue::weightedpriority;
@@ -2219,6 +2325,12 @@ private:
   int get_num_op_shards();
   int get_num_op_threads();
 
+  // write `count` bytes in `bsize` blocks to the store, either to fresh
+  // objects or at random offsets of `onum` objects of `osize` bytes;
+  // returns the seconds taken
+  double run_osd_bench(int64_t count, int64_t bsize,
+		       int64_t osize, int64_t onum);
+
   float get_osd_recovery_sleep();
 
   void probe_smart(const string& devid, ostream& ss);
@@ -1182,6 +1182,24 @@ void OSDMap::set_epoch(epoch_t e)
     pool.second.last_change = e;
 }
 
+bool OSDMap::same_osd_states(const OSDMap& prev) const
+{
+  if (flags != prev.flags ||
+      require_osd_release != prev.require_osd_release ||
+      max_osd != prev.max_osd ||
+      blacklist != prev.blacklist) {
+    return false;
+  }
+  for (int o = 0; o < max_osd; ++o) {
+    if (exists(o) != prev.exists(o) ||
+	is_up(o) != prev.is_up(o) ||
+	(is_up(o) && get_up_from(o) != prev.get_up_from(o))) {
+      return false;
+    }
+  }
+  return true;
+}
+
 bool OSDMap::is_blacklisted(const entity_addr_t& a) const
 {
   if (blacklist.empty())
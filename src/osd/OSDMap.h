@@ -1455,6 +1455,13 @@ public:
   static void generate_test_instances(list<OSDMap*>& o);
   bool check_new_blacklist_entries() const { return new_blacklist_entries; }
 
+  /**
+   * true if every osd exists, is up and came up just as in prev, and
+   * the flags, blacklist and required release are unchanged.  pg_temp,
+   * up_thru, crush and pools may all differ.
+   */
+  bool same_osd_states(const OSDMap& prev) const;
+
   void check_health(health_check_map_t *checks) const;
 
   int parse_osd_id_list(const vector<string>& ls,
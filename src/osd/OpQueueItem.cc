@@ -21,6 +21,8 @@ void PGOpItem::run(
   PGRef& pg,
   ThreadPool::TPHandle &handle)
 {
+  // requeued after it started inline
+  op->run_inline = false;
   osd->dequeue_op(pg, op, handle);
   pg->unlock();
 }
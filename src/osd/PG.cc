@@ -325,7 +325,7 @@ PG::PG(OSDService *o, OSDMapRef curmap,
   dirty_info(false), dirty_big_info(false),
   info(p),
   info_struct_v(0),
-  pg_log(cct),
+  pg_log(cct, o->compact_pg_log),
   pgmeta_oid(p.make_pgmeta_oid()),
   missing_loc(this),
   stat_queue_item(this),
@@ -383,6 +383,17 @@ void PG::lock(bool no_lockdep) const
   dout(30) << "lock" << dendl;
 }
 
+bool PG::try_lock() const
+{
+  if (!_lock.TryLock())
+    return false;
+  assert(!dirty_info);
+  assert(!dirty_big_info);
+
+  dout(30) << "try_lock" << dendl;
+  return true;
+}
+
 std::ostream& PG::gen_prefix(std::ostream& out) const
 {
   OSDMapRef mapref = osdmap_ref;
@@ -4559,13 +4570,23 @@ int PG::build_scrub_map_chunk(
     return -EINPROGRESS;
   }
 
-  // scan objects
+  // scan objects.  a deep scrub goes back to the queue once it has
+  // read a stride's worth, even if that took several small objects.
   while (!pos.done()) {
     int r = get_pgbackend()->be_scan_list(map, pos);
-    if (r == -EINPROGRESS) {
-      return r;
+    if (r == -EINPROGRESS ||
+	(pos.deep && !pos.done() &&
+	 pos.read_bytes + pos.verify_bytes >=
+	   cct->_conf->osd_deep_scrub_stride)) {
+      osd->charge_deep_scrub(pos.read_bytes, pos.verify_bytes);
+      pos.read_bytes = pos.verify_bytes = 0;
+      return -EINPROGRESS;
     }
   }
+  if (pos.deep) {
+    osd->charge_deep_scrub(pos.read_bytes, pos.verify_bytes);
+    pos.read_bytes = pos.verify_bytes = 0;
+  }
 
   // finish
   dout(20) << __func__ << " finishing" << dendl;
@@ -4702,12 +4723,30 @@ void PG::replica_scrub(
  */
 void PG::scrub(epoch_t queued, ThreadPool::TPHandle &handle)
 {
-  if (cct->_conf->osd_scrub_sleep > 0 &&
+  // only sleep between chunks: while a chunk is being mapped, here or
+  // on a replica, client writes to it are blocked.  the deep scrub
+  // budget is charged as the chunk is read and paid back here.
+  double sleep = 0;
+  double budget = 0;
+  if (scrubber.needs_sleep &&
       (scrubber.state == PG::Scrubber::NEW_CHUNK ||
-       scrubber.state == PG::Scrubber::INACTIVE) &&
-       scrubber.needs_sleep) {
+       scrubber.state == PG::Scrubber::INACTIVE)) {
+    sleep = cct->_conf->osd_scrub_sleep;
+    if (state_test(PG_STATE_DEEP_SCRUB)) {
+      budget = osd->get_deep_scrub_delay();
+      sleep = std::max(sleep, budget);
+    }
+  }
+  if (sleep > 0) {
     ceph_assert(!scrubber.sleeping);
-    dout(20) << __func__ << " state is INACTIVE|NEW_CHUNK, sleeping" << dendl;
+    dout(20) << __func__ << " state is "
+	     << Scrubber::state_string(scrubber.state)
+	     << ", sleeping " << sleep << dendl;
+    if (budget > 0) {
+      utime_t wait;
+      wait.set_from_double(budget);
+      osd->logger->tinc(l_osd_scrub_budget_wait, wait);
+    }
 
     // Do an async sleep so we don't block the op queue
     OSDService *osds = osd;
@@ -4735,8 +4774,7 @@ void PG::scrub(epoch_t queued, ThreadPool::TPHandle &handle)
           pg->unlock();
         });
     Mutex::Locker l(osd->sleep_lock);
-    osd->sleep_timer.add_event_after(cct->_conf->osd_scrub_sleep,
-                                           scrub_requeue_callback);
+    osd->sleep_timer.add_event_after(sleep, scrub_requeue_callback);
     scrubber.sleeping = true;
     scrubber.sleep_start = ceph_clock_now();
     return;
@@ -6467,6 +6505,38 @@ void PG::handle_advance_map(
   last_require_osd_release = osdmap->require_osd_release;
 }
 
+bool PG::try_skip_advance_map(
+  OSDMapRef osdmap, OSDMapRef lastmap,
+  const vector<int>& newup, int new_up_primary,
+  const vector<int>& newacting, int new_acting_primary)
+{
+  assert(lastmap == osdmap_ref);
+  // the caller has checked that no osd went up or down and the flags
+  // are unchanged (OSDService::is_quiet_map); what is left is this
+  // pg's mapping and pool.
+  int64_t poolid = info.pgid.pool();
+  const pg_pool_t *pi = osdmap->get_pg_pool(poolid);
+  const pg_pool_t *plast = lastmap->get_pg_pool(poolid);
+  if (!pi || !plast ||
+      pi->last_change != plast->last_change ||
+      pi->get_snap_epoch() != plast->get_snap_epoch() ||
+      osdmap->get_new_removed_snaps().count(poolid) ||
+      osdmap->get_new_purged_snaps().count(poolid)) {
+    return false;
+  }
+  if (primary.osd != new_acting_primary ||
+      up_primary.osd != new_up_primary ||
+      acting != newacting ||
+      up != newup) {
+    return false;
+  }
+  dout(20) << __func__ << " " << osdmap->get_epoch() << dendl;
+  update_osdmap_ref(osdmap);
+  osd_shard->update_pg_epoch(pg_slot, osdmap->get_epoch());
+  pool.update(cct, osdmap);
+  return true;
+}
+
 void PG::handle_activate_map(RecoveryCtx *rctx)
 {
   dout(10) << "handle_activate_map " << dendl;
@@ -281,6 +281,7 @@ public:
     handle.reset_tp_timeout();
   }
   void lock(bool no_lockdep = false) const;
+  bool try_lock() const;
   void unlock() const {
     //generic_dout(0) << this << " " << info.pgid << " unlock" << dendl;
     assert(!dirty_info);
@@ -421,6 +422,11 @@ public:
     vector<int>& newup, int up_primary,
     vector<int>& newacting, int acting_primary,
     RecoveryCtx *rctx);
+  /// move to osdmap without an AdvMap if the state machine would ignore it
+  bool try_skip_advance_map(
+    OSDMapRef osdmap, OSDMapRef lastmap,
+    const vector<int>& newup, int new_up_primary,
+    const vector<int>& newacting, int new_acting_primary);
   void handle_activate_map(RecoveryCtx *rctx);
   void handle_initialize(RecoveryCtx *rctx);
   void handle_query_state(Formatter *f);
@@ -614,6 +614,7 @@ void PGLog::write_log_and_missing(
       dirty_from_dups,
       write_from_dups,
       &rebuilt_missing_with_deletes,
+      compact_entries,
       (pg_log_debug ? &log_keys_debug : nullptr));
     undirty();
   } else {
@@ -635,7 +636,7 @@ void PGLog::write_log_and_missing_wo_missing(
     t, km, log, coll, log_oid,
     divergent_priors, eversion_t::max(), eversion_t(), eversion_t(),
     true, true, require_rollback,
-    eversion_t::max(), eversion_t(), eversion_t(), nullptr);
+    eversion_t::max(), eversion_t(), eversion_t(), false, nullptr);
 }
 
 // static
@@ -661,7 +662,30 @@ void PGLog::write_log_and_missing(
     eversion_t::max(),
     eversion_t(),
     eversion_t(),
-    rebuilt_missing_with_deletes, nullptr);
+    rebuilt_missing_with_deletes, false, nullptr);
+}
+
+// static
+void PGLog::_encode_log_entries(
+  const vector<const pg_log_entry_t*>& entries,
+  map<string,bufferlist> *km,
+  bool compact_entries)
+{
+  if (!compact_entries) {
+    for (auto e : entries) {
+      bufferlist bl(sizeof(*e) * 2);
+      e->encode_with_checksum(bl);
+      (*km)[e->get_key_name()].claim(bl);
+    }
+    return;
+  }
+  // one buffer for the whole write; each key gets a slice of it
+  bufferlist bl(entries.size() * 512);
+  for (auto e : entries) {
+    unsigned off = bl.length();
+    e->encode_compact_with_checksum(bl);
+    (*km)[e->get_key_name()].substr_of(bl, off, bl.length() - off);
+  }
 }
 
 // static
@@ -680,6 +704,7 @@ void PGLog::_write_log_and_missing_wo_missing(
   eversion_t dirty_to_dups,
   eversion_t dirty_from_dups,
   eversion_t write_from_dups,
+  bool compact_entries,
   set<string> *log_keys_debug
   )
 {
@@ -700,12 +725,11 @@ void PGLog::_write_log_and_missing_wo_missing(
     clear_after(log_keys_debug, dirty_from.get_key_name());
   }
 
+  vector<const pg_log_entry_t*> dirty;
   for (list<pg_log_entry_t>::iterator p = log.log.begin();
        p != log.log.end() && p->version <= dirty_to;
        ++p) {
-    bufferlist bl(sizeof(*p) * 2);
-    p->encode_with_checksum(bl);
-    (*km)[p->get_key_name()].claim(bl);
+    dirty.push_back(&*p);
   }
 
   for (list<pg_log_entry_t>::reverse_iterator p = log.log.rbegin();
@@ -713,10 +737,9 @@ void PGLog::_write_log_and_missing_wo_missing(
 	 (p->version >= dirty_from || p->version >= writeout_from) &&
 	 p->version >= dirty_to;
        ++p) {
-    bufferlist bl(sizeof(*p) * 2);
-    p->encode_with_checksum(bl);
-    (*km)[p->get_key_name()].claim(bl);
+    dirty.push_back(&*p);
   }
+  _encode_log_entries(dirty, km, compact_entries);
 
   if (log_keys_debug) {
     for (map<string, bufferlist>::iterator i = (*km).begin();
@@ -751,7 +774,10 @@ void PGLog::_write_log_and_missing_wo_missing(
     if (entry.version > dirty_to_dups)
       break;
     bufferlist bl;
-    encode(entry, bl);
+    if (compact_entries)
+      entry.encode_compact(bl);
+    else
+      encode(entry, bl);
     (*km)[entry.get_key_name()].claim(bl);
   }
 
@@ -761,7 +787,10 @@ void PGLog::_write_log_and_missing_wo_missing(
 	 p->version >= dirty_to_dups;
        ++p) {
     bufferlist bl;
-    encode(*p, bl);
+    if (compact_entries)
+      p->encode_compact(bl);
+    else
+      encode(*p, bl);
     (*km)[p->get_key_name()].claim(bl);
   }
 
@@ -798,6 +827,7 @@ void PGLog::_write_log_and_missing(
   eversion_t dirty_from_dups,
   eversion_t write_from_dups,
   bool *rebuilt_missing_with_deletes, // in/out param
+  bool compact_entries,
   set<string> *log_keys_debug
   ) {
   set<string> to_remove;
@@ -829,12 +859,11 @@ void PGLog::_write_log_and_missing(
     clear_after(log_keys_debug, dirty_from.get_key_name());
   }
 
+  vector<const pg_log_entry_t*> dirty;
   for (list<pg_log_entry_t>::iterator p = log.log.begin();
        p != log.log.end() && p->version <= dirty_to;
        ++p) {
-    bufferlist bl(sizeof(*p) * 2);
-    p->encode_with_checksum(bl);
-    (*km)[p->get_key_name()].claim(bl);
+    dirty.push_back(&*p);
   }
 
   for (list<pg_log_entry_t>::reverse_iterator p = log.log.rbegin();
@@ -842,10 +871,9 @@ void PGLog::_write_log_and_missing(
 	 (p->version >= dirty_from || p->version >= writeout_from) &&
 	 p->version >= dirty_to;
        ++p) {
-    bufferlist bl(sizeof(*p) * 2);
-    p->encode_with_checksum(bl);
-    (*km)[p->get_key_name()].claim(bl);
+    dirty.push_back(&*p);
   }
+  _encode_log_entries(dirty, km, compact_entries);
 
   if (log_keys_debug) {
     for (map<string, bufferlist>::iterator i = (*km).begin();
@@ -880,7 +908,10 @@ void PGLog::_write_log_and_missing(
     if (entry.version > dirty_to_dups)
       break;
     bufferlist bl;
-    encode(entry, bl);
+    if (compact_entries)
+      entry.encode_compact(bl);
+    else
+      encode(entry, bl);
     (*km)[entry.get_key_name()].claim(bl);
   }
 
@@ -890,7 +921,10 @@ void PGLog::_write_log_and_missing(
 	 p->version >= dirty_to_dups;
        ++p) {
     bufferlist bl;
-    encode(*p, bl);
+    if (compact_entries)
+      p->encode_compact(bl);
+    else
+      encode(*p, bl);
     (*km)[p->get_key_name()].claim(bl);
   }
 
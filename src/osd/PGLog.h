@@ -559,6 +559,8 @@ protected:
   set<string> trimmed_dups;    ///< must clear keys in trimmed_dups
   CephContext *cct;
   bool pg_log_debug;
+  /// write entries and dups in the compact on-disk form
+  bool compact_entries;
   /// Log is clean on [dirty_to, dirty_from)
   bool touched_log;
   bool clear_divergent_priors;
@@ -644,13 +646,14 @@ protected:
 public:
 
   // cppcheck-suppress noExplicitConstructor
-  PGLog(CephContext *cct) :
+  PGLog(CephContext *cct, bool compact_entries = false) :
     dirty_from(eversion_t::max()),
     writeout_from(eversion_t::max()),
     dirty_from_dups(eversion_t::max()),
     write_from_dups(eversion_t::max()),
     cct(cct),
     pg_log_debug(!(cct && !(cct->_conf->osd_debug_pg_log_writeout))),
+    compact_entries(compact_entries),
     touched_log(false),
     clear_divergent_priors(false)
   { }
@@ -1228,6 +1231,7 @@ public:
     eversion_t dirty_to_dups,
     eversion_t dirty_from_dups,
     eversion_t write_from_dups,
+    bool compact_entries,
     set<string> *log_keys_debug
     );
 
@@ -1249,9 +1253,15 @@ public:
     eversion_t dirty_from_dups,
     eversion_t write_from_dups,
     bool *rebuilt_missing_with_deletes,
+    bool compact_entries,
     set<string> *log_keys_debug
     );
 
+  static void _encode_log_entries(
+    const vector<const pg_log_entry_t*>& entries,
+    map<string,bufferlist> *km,
+    bool compact_entries);
+
   void read_log_and_missing(
     ObjectStore *store,
     ObjectStore::CollectionHandle& ch,
@@ -1335,7 +1345,7 @@ public:
 	  missing.add(oid, item.need, item.have, item.is_delete());
 	} else if (p->key().substr(0, 4) == string("dup_")) {
 	  pg_log_dup_t dup;
-	  decode(dup, bp);
+	  dup.decode_ondisk(bp);
 	  if (!dups.empty()) {
 	    assert(dups.back().version < dup.version);
 	  }
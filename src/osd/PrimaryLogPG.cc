@@ -4065,6 +4065,9 @@ void PrimaryLogPG::log_op_stats(const OpRequest& op,
   osd->logger->inc(l_osd_op_inb, inb);
   osd->logger->tinc(l_osd_op_lat, latency);
   osd->logger->tinc(l_osd_op_process_lat, process_latency);
+  if (is_scrubbing()) {
+    osd->logger->tinc(l_osd_op_lat_scrubbing, latency);
+  }
 
   if (op.may_read() && op.may_write()) {
     osd->logger->inc(l_osd_op_rw);
@@ -4080,6 +4083,13 @@ void PrimaryLogPG::log_op_stats(const OpRequest& op,
     osd->logger->tinc(l_osd_op_r_lat, latency);
     osd->logger->hinc(l_osd_op_r_lat_outb_hist, latency.to_nsec(), outb);
     osd->logger->tinc(l_osd_op_r_process_lat, process_latency);
+    if (op.run_inline) {
+      osd->logger->tinc(l_osd_op_r_inline_lat, latency);
+      osd->logger->hinc(l_osd_op_r_inline_lat_outb_hist, latency.to_nsec(), outb);
+    } else if (osd->osd->op_inline_reads) {
+      osd->logger->tinc(l_osd_op_r_queued_lat, latency);
+      osd->logger->hinc(l_osd_op_r_queued_lat_outb_hist, latency.to_nsec(), outb);
+    }
   } else if (op.may_write() || op.may_cache()) {
     osd->logger->inc(l_osd_op_w);
     osd->logger->inc(l_osd_op_w_inb, inb);
@@ -611,25 +611,44 @@ int ReplicatedBackend::be_deep_scrub(
   if (!pos.data_done()) {
     if (pos.data_pos == 0) {
       pos.data_hash = bufferhash(-1);
+      pos.data_verify =
+	cct->_conf.get_val<bool>("osd_deep_scrub_verify_csum");
     }
 
-    bufferlist bl;
-    r = store->read(
-      ch,
-      ghobject_t(
-	poid, ghobject_t::NO_GEN, get_parent()->whoami_shard().shard),
-      pos.data_pos,
-      cct->_conf->osd_deep_scrub_stride, bl,
-      fadvise_flags);
+    ghobject_t goid(
+      poid, ghobject_t::NO_GEN, get_parent()->whoami_shard().shard);
+    if (pos.data_verify) {
+      r = store->verify_csum(
+	ch, goid, pos.data_pos, cct->_conf->osd_deep_scrub_stride,
+	fadvise_flags);
+      if (r == -EOPNOTSUPP) {
+	// the store can't vouch for it; hash it from the start instead
+	dout(20) << __func__ << "  " << poid << " can't verify in place"
+		 << dendl;
+	pos.data_verify = false;
+	pos.data_pos = 0;
+      } else if (r > 0) {
+	pos.verify_bytes += r;
+      }
+    }
+    if (!pos.data_verify) {
+      bufferlist bl;
+      r = store->read(
+	ch, goid,
+	pos.data_pos,
+	cct->_conf->osd_deep_scrub_stride, bl,
+	fadvise_flags);
+      if (r > 0) {
+	pos.data_hash << bl;
+	pos.read_bytes += r;
+      }
+    }
     if (r < 0) {
       dout(20) << __func__ << "  " << poid << " got "
 	       << r << " on read, read_error" << dendl;
       o.read_error = true;
       return 0;
     }
-    if (r > 0) {
-      pos.data_hash << bl;
-    }
     pos.data_pos += r;
     if (r == cct->_conf->osd_deep_scrub_stride) {
       dout(20) << __func__ << "  " << poid << " more data, digest so far 0x"
@@ -638,10 +657,15 @@ int ReplicatedBackend::be_deep_scrub(
     }
     // done with bytes
     pos.data_pos = -1;
-    o.digest = pos.data_hash.digest();
-    o.digest_present = true;
-    dout(20) << __func__ << "  " << poid << " done with data, digest 0x"
-	     << std::hex << o.digest << std::dec << dendl;
+    if (pos.data_verify) {
+      dout(20) << __func__ << "  " << poid << " done with data, verified"
+	       << dendl;
+    } else {
+      o.digest = pos.data_hash.digest();
+      o.digest_present = true;
+      dout(20) << __func__ << "  " << poid << " done with data, digest 0x"
+	       << std::hex << o.digest << std::dec << dendl;
+    }
   }
 
   // omap header
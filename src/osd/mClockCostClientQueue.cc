@@ -0,0 +1,166 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+
+#include <memory>
+
+#include "osd/mClockCostClientQueue.h"
+#include "common/dout.h"
+
+using namespace std::placeholders;
+
+#define dout_context cct
+#define dout_subsys ceph_subsys_osd
+#undef dout_prefix
+#define dout_prefix *_dout << "mClockCostClientQueue "
+
+
+namespace ceph {
+
+  static const ceph::mclock::CostProfile& lookup_profile(CephContext *cct) {
+    auto name = cct->_conf.get_val<std::string>("osd_mclock_cost_profile");
+    auto p = ceph::mclock::get_cost_profile(name);
+    if (!p) {
+      lderr(cct) << "unknown osd_mclock_cost_profile '" << name
+		 << "', using high_client_ops" << dendl;
+      p = ceph::mclock::get_cost_profile("high_client_ops");
+    }
+    return *p;
+  }
+
+  /*
+   * class mClockCostClientQueue
+   */
+
+  mClockCostClientQueue::mClockCostClientQueue(
+    CephContext *cct,
+    const ceph::mclock::OpCostModel& model,
+    unsigned num_shards) :
+    cct(cct),
+    model(model),
+    num_shards(std::max(num_shards, 1u)),
+    client_info_mgr(lookup_profile(cct)),
+    queue(std::bind(&mClockCostClientQueue::op_class_client_info_f, this, _1))
+  {
+    update_capacity();
+  }
+
+  void mClockCostClientQueue::update_capacity() {
+    model_version = model.get_version();
+    // each shard schedules independently, so each gets its share of
+    // the device
+    const double capacity = model.get_iops() / num_shards;
+    client_info_mgr.set_capacity(capacity);
+
+    ldout(cct, 10) << "profile " << client_info_mgr.get_profile().name
+		   << " iops " << model.get_iops()
+		   << " bandwidth " << model.get_bandwidth()
+		   << " per-shard capacity " << capacity << dendl;
+  }
+
+  void mClockCostClientQueue::remove_queued(const InnerClient& client) {
+    auto i = queued.find(client);
+    assert(i != queued.end());
+    if (--i->second == 0) {
+      queued.erase(i);
+      client_info_mgr.remove_client(client.second);
+    }
+  }
+
+  const mClockCostClientQueue::ClientInfo*
+  mClockCostClientQueue::op_class_client_info_f(
+    const mClockCostClientQueue::InnerClient& client)
+  {
+    return client_info_mgr.get_client_info(client.second);
+  }
+
+  ceph::mclock::cost_class_t
+  mClockCostClientQueue::get_cost_class(const Request& request) {
+    switch (request.get_op_type()) {
+    case Request::op_type_t::bg_recovery:
+      return cost_class_t::recovery;
+    case Request::op_type_t::bg_snaptrim:
+    case Request::op_type_t::bg_scrub:
+    case Request::op_type_t::bg_pg_delete:
+      return cost_class_t::best_effort;
+    default:
+      return cost_class_t::client;
+    }
+  }
+
+  void mClockCostClientQueue::remove_by_class(Client cl,
+					      std::list<Request> *out) {
+    queue.remove_by_filter(
+      [this, &cl, out] (Request&& r) -> bool {
+	if (cl == r.get_owner()) {
+	  remove_queued(get_inner_client(cl, r));
+	  out->push_front(std::move(r));
+	  return true;
+	} else {
+	  return false;
+	}
+      });
+  }
+
+  // Formatted output of the queue
+  void mClockCostClientQueue::dump(ceph::Formatter *f) const {
+    f->dump_string("profile", client_info_mgr.get_profile().name);
+    f->dump_float("iops", model.get_iops());
+    f->dump_float("bandwidth", model.get_bandwidth());
+    queue.dump(f);
+  }
+
+  void mClockCostClientQueue::enqueue_strict(Client cl,
+					     unsigned priority,
+					     Request&& item) {
+    InnerClient inner = get_inner_client(cl, item);
+    add_queued(inner);
+    queue.enqueue_strict(inner, priority, std::move(item));
+  }
+
+  // Enqueue op in the front of the strict queue
+  void mClockCostClientQueue::enqueue_strict_front(Client cl,
+						   unsigned priority,
+						   Request&& item) {
+    InnerClient inner = get_inner_client(cl, item);
+    add_queued(inner);
+    queue.enqueue_strict_front(inner, priority, std::move(item));
+  }
+
+  // Enqueue op in the back of the regular queue
+  void mClockCostClientQueue::enqueue(Client cl,
+				      unsigned priority,
+				      unsigned cost,
+				      Request&& item) {
+    maybe_update_capacity();
+    InnerClient inner = get_inner_client(cl, item);
+    add_queued(inner);
+    queue.enqueue_cost(inner, model.cost(cost), std::move(item));
+  }
+
+  // Enqueue the op in the front of the regular queue
+  void mClockCostClientQueue::enqueue_front(Client cl,
+					    unsigned priority,
+					    unsigned cost,
+					    Request&& item) {
+    InnerClient inner = get_inner_client(cl, item);
+    add_queued(inner);
+    queue.enqueue_front(inner, priority, cost, std::move(item));
+  }
+
+  // Return an op to be dispatched
+  Request mClockCostClientQueue::dequeue() {
+    Request ret = queue.dequeue();
+    remove_queued(get_inner_client(ret.get_owner(), ret));
+    return ret;
+  }
+} // namespace ceph
@@ -0,0 +1,137 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+
+#pragma once
+
+#include <ostream>
+
+#include "common/config.h"
+#include "common/ceph_context.h"
+#include "common/mClockCostQueue.h"
+#include "osd/OpQueueItem.h"
+#include "osd/mClockCostModel.h"
+
+
+namespace ceph {
+
+  using Request = OpQueueItem;
+  using Client = uint64_t;
+
+  // Adapter for osd_op_queue = mclock_cost.  Like mClockClientQueue
+  // every (client, class) pair is its own mClock client, but the
+  // reservation, weight and limit come from osd_mclock_cost_profile,
+  // scaled to this shard's share of the device capacity and split
+  // across the active clients of each class, and each op is charged
+  // what the OpCostModel says its bytes cost.
+  class mClockCostClientQueue : public OpQueue<Request, Client> {
+
+    using cost_class_t = ceph::mclock::cost_class_t;
+
+    using InnerClient = std::pair<uint64_t,cost_class_t>;
+
+    using queue_t = mClockCostQueue<Request, InnerClient>;
+
+    using ClientInfo = queue_t::ClientInfo;
+
+    CephContext *cct;
+    const ceph::mclock::OpCostModel& model;
+    const unsigned num_shards;
+
+    // model version the client infos were computed for
+    uint64_t model_version = 0;
+    ceph::mclock::CostClientInfoMgr client_info_mgr;
+
+    // items queued per client; a client is active while it has any
+    std::map<InnerClient,unsigned> queued;
+
+    queue_t queue;
+
+    void update_capacity();
+
+    void maybe_update_capacity() {
+      if (model.get_version() != model_version) {
+	update_capacity();
+      }
+    }
+
+    void add_queued(const InnerClient& client) {
+      if (queued[client]++ == 0) {
+	client_info_mgr.add_client(client.second);
+      }
+    }
+
+    void remove_queued(const InnerClient& client);
+
+  public:
+
+    mClockCostClientQueue(CephContext *cct,
+			  const ceph::mclock::OpCostModel& model,
+			  unsigned num_shards);
+
+    const ClientInfo* op_class_client_info_f(const InnerClient& client);
+
+    inline unsigned length() const override final {
+      return queue.length();
+    }
+
+    // Ops of this priority should be deleted immediately
+    void remove_by_class(Client cl,
+			 std::list<Request> *out) override final;
+
+    void enqueue_strict(Client cl,
+			unsigned priority,
+			Request&& item) override final;
+
+    // Enqueue op in the front of the strict queue
+    void enqueue_strict_front(Client cl,
+			      unsigned priority,
+			      Request&& item) override final;
+
+    // Enqueue op in the back of the regular queue
+    void enqueue(Client cl,
+		 unsigned priority,
+		 unsigned cost,
+		 Request&& item) override final;
+
+    // Enqueue the op in the front of the regular queue
+    void enqueue_front(Client cl,
+		       unsigned priority,
+		       unsigned cost,
+		       Request&& item) override final;
+
+    // Return an op to be dispatch
+    Request dequeue() override final;
+
+    // Returns if the queue is empty
+    inline bool empty() const override final {
+      return queue.empty();
+    }
+
+    // Formatted output of the queue
+    void dump(ceph::Formatter *f) const override final;
+
+    // clients of class c that have ops queued
+    unsigned get_active_clients(cost_class_t c) const {
+      return client_info_mgr.get_active(c);
+    }
+
+    static cost_class_t get_cost_class(const Request& request);
+
+  protected:
+
+    InnerClient get_inner_client(const Client& cl, const Request& request) {
+      return InnerClient(cl, get_cost_class(request));
+    }
+  }; // class mClockCostClientQueue
+
+} // namespace ceph
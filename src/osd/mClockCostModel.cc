@@ -0,0 +1,77 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+
+#include <algorithm>
+
+#include "osd/mClockCostModel.h"
+
+
+namespace ceph {
+
+  namespace mclock {
+
+    std::ostream& operator<<(std::ostream& out, cost_class_t c) {
+      switch (c) {
+      case cost_class_t::client:
+	return out << "client";
+      case cost_class_t::recovery:
+	return out << "recovery";
+      case cost_class_t::best_effort:
+	return out << "best_effort";
+      }
+      return out << "???";
+    }
+
+    //                reservation, weight, limit
+    static const CostProfile cost_profiles[] = {
+      { "high_client_ops",
+	{ 0.6, 2.0, 0.0 },
+	{ 0.2, 1.0, 0.0 },
+	{ 0.0, 1.0, 0.3 } },
+      { "balanced",
+	{ 0.4, 1.0, 0.0 },
+	{ 0.4, 1.0, 0.0 },
+	{ 0.0, 1.0, 0.5 } },
+      { "high_recovery_ops",
+	{ 0.3, 1.0, 0.0 },
+	{ 0.6, 2.0, 0.0 },
+	{ 0.0, 1.0, 0.0 } },
+    };
+
+    const CostProfile* get_cost_profile(const std::string& name) {
+      for (auto& p : cost_profiles) {
+	if (name == p.name) {
+	  return &p;
+	}
+      }
+      return nullptr;
+    }
+
+    void CostClientInfoMgr::set_capacity(double _capacity) {
+      capacity = _capacity;
+      for (unsigned c = 0; c < num_classes; ++c) {
+	update((cost_class_t)c);
+      }
+    }
+
+    void CostClientInfoMgr::update(cost_class_t c) {
+      const CostShare& share = profile.get(c);
+      const double n = std::max(active[(unsigned)c], 1u);
+      mClockCostInfo& i = info[(unsigned)c];
+      i.reservation = share.reservation * capacity / n;
+      i.weight = share.weight / n;
+      i.limit = share.limit * capacity / n;
+    }
+
+  } // namespace mclock
+} // namespace ceph
@@ -0,0 +1,172 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include "common/mClockCostQueue.h"
+
+
+namespace ceph {
+  namespace mclock {
+
+    // the scheduling classes of the mclock_cost op queue
+    enum class cost_class_t {
+      client,	   // client ops, replica ops and peering events
+      recovery,	   // recovery and backfill
+      best_effort  // scrub, snap trimming and pg deletion
+    };
+
+    std::ostream& operator<<(std::ostream& out, cost_class_t c);
+
+    // reservation and limit are fractions of the capacity of an op
+    // shard (0 for none); weight is relative to the other classes
+    struct CostShare {
+      double reservation;
+      double weight;
+      double limit;
+    };
+
+    struct CostProfile {
+      const char *name;
+      CostShare client;
+      CostShare recovery;
+      CostShare best_effort;
+
+      const CostShare& get(cost_class_t c) const {
+	switch (c) {
+	case cost_class_t::client:
+	  return client;
+	case cost_class_t::recovery:
+	  return recovery;
+	default:
+	  return best_effort;
+	}
+      }
+    };
+
+    // the profile named by osd_mclock_cost_profile, or nullptr
+    const CostProfile* get_cost_profile(const std::string& name);
+
+    /*
+     * What the data device of an OSD can do, and what an op costs on
+     * it.  The unit of cost is one small random I/O: an op moving
+     * `bytes` costs one seek plus its transfer time expressed in seeks,
+     *
+     *   1 + bytes * iops / bandwidth
+     *
+     * so a 4 MiB write is about 7 units on a 200 IOPS, 150 MB/s disk
+     * but over 200 on a 100k IOPS, 2 GB/s flash device.  Capacity is
+     * set once the device has been measured (or configured) and may be
+     * read concurrently by every op shard.
+     */
+    class OpCostModel {
+      std::atomic<double> iops;
+      std::atomic<double> bandwidth;
+      std::atomic<uint64_t> version;
+
+    public:
+
+      OpCostModel() : iops(0.0), bandwidth(0.0), version(0) {}
+
+      void set_capacity(double _iops, double _bandwidth) {
+	iops = _iops;
+	bandwidth = _bandwidth;
+	++version;
+      }
+
+      // random small-block ops/sec
+      double get_iops() const {
+	return iops;
+      }
+
+      // sequential bytes/sec
+      double get_bandwidth() const {
+	return bandwidth;
+      }
+
+      // bumped by every set_capacity()
+      uint64_t get_version() const {
+	return version;
+      }
+
+      bool is_set() const {
+	return version > 0;
+      }
+
+      double cost(uint64_t bytes) const {
+	double bw = bandwidth;
+	if (bw <= 0.0) {
+	  return 1.0;
+	}
+	return 1.0 + bytes * double(iops) / bw;
+      }
+    };
+
+    /*
+     * Turns a profile and a capacity into the mClock settings of each
+     * client.  A class's reservation, weight and limit are split evenly
+     * across the clients of that class that have work queued, so the
+     * profile says what all clients together are guaranteed however
+     * many of them there are.
+     */
+    class CostClientInfoMgr {
+      static constexpr unsigned num_classes = 3;
+
+      const CostProfile& profile;
+      double capacity = 0.0;
+      unsigned active[num_classes] = {};
+      mClockCostInfo info[num_classes] = {
+	{ 0.0, 1.0, 0.0 }, { 0.0, 1.0, 0.0 }, { 0.0, 1.0, 0.0 }
+      };
+
+      void update(cost_class_t c);
+
+    public:
+
+      explicit CostClientInfoMgr(const CostProfile& _profile) :
+	profile(_profile)
+      {}
+
+      const CostProfile& get_profile() const {
+	return profile;
+      }
+
+      // cost units/sec available to the scheduler
+      void set_capacity(double _capacity);
+
+      // a client of class c went from idle to having work queued
+      void add_client(cost_class_t c) {
+	++active[(unsigned)c];
+	update(c);
+      }
+
+      void remove_client(cost_class_t c) {
+	--active[(unsigned)c];
+	update(c);
+      }
+
+      const mClockCostInfo* get_client_info(cost_class_t c) const {
+	return &info[(unsigned)c];
+      }
+
+      unsigned get_active(cost_class_t c) const {
+	return active[(unsigned)c];
+      }
+    };
+
+  } // namespace mclock
+} // namespace ceph
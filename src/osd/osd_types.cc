@@ -3864,12 +3864,177 @@ void pg_log_entry_t::encode_with_checksum(bufferlist& bl) const
   encode(crc, bl);
 }
 
+// The compact on-disk log encoding.  Each entry (and dup) has an omap
+// key of its own and is trimmed by key, so nothing can be shared with
+// its neighbours; instead an entry is stored relative to itself.
+// Integers are varints, signed ones zigzagged, and the other versions
+// and reqids in an entry are deltas against its own.
+namespace {
+
+const __u8 PG_LOG_COMPACT_V = 1;
+
+const __u8 PG_LOG_COMPACT_PRIOR_ZERO = 1;   ///< prior (or reverting_to) is 0'0
+const __u8 PG_LOG_COMPACT_REVERT_ZERO = 2;  ///< LOST_REVERT's prior_version is 0'0
+
+inline uint64_t zigzag(int64_t v)
+{
+  return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+inline int64_t unzigzag(uint64_t v)
+{
+  return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+void compact_encode_string(const string& s,
+			   bufferlist::contiguous_appender& p)
+{
+  denc_varint(s.size(), p);
+  p.append(s.data(), s.size());
+}
+
+void compact_decode_string(string& s, bufferptr::const_iterator& p)
+{
+  uint64_t len;
+  denc_varint(len, p);
+  s.assign(p.get_pos_add(len), len);
+}
+
+void compact_encode_version(const eversion_t& base, const eversion_t& v,
+			    bufferlist::contiguous_appender& p)
+{
+  denc_varint(zigzag((int64_t)base.epoch - (int64_t)v.epoch), p);
+  denc_varint(zigzag((int64_t)(base.version - v.version)), p);
+}
+
+void compact_decode_version(const eversion_t& base, eversion_t& v,
+			    bufferptr::const_iterator& p)
+{
+  uint64_t epoch, version;
+  denc_varint(epoch, p);
+  denc_varint(version, p);
+  v.epoch = base.epoch - unzigzag(epoch);
+  v.version = base.version - (version_t)unzigzag(version);
+}
+
+// with a base, a name equal to it is written as type 0
+void compact_encode_reqid(const osd_reqid_t& r, const entity_name_t *base,
+			  bufferlist::contiguous_appender& p)
+{
+  if (!base) {
+    denc_varint((uint64_t)r.name.type(), p);
+    denc_varint(zigzag(r.name.num()), p);
+  } else if (r.name == *base) {
+    denc_varint((uint64_t)0, p);
+  } else {
+    denc_varint((uint64_t)r.name.type() + 1, p);
+    denc_varint(zigzag(r.name.num()), p);
+  }
+  denc_varint(r.tid, p);
+  denc_varint(zigzag(r.inc), p);
+}
+
+void compact_decode_reqid(osd_reqid_t& r, const entity_name_t *base,
+			  bufferptr::const_iterator& p)
+{
+  uint64_t type, num, inc;
+  denc_varint(type, p);
+  if (base && type == 0) {
+    r.name = *base;
+  } else {
+    denc_varint(num, p);
+    r.name = entity_name_t(base ? type - 1 : type, unzigzag(num));
+  }
+  denc_varint(r.tid, p);
+  denc_varint(inc, p);
+  r.inc = unzigzag(inc);
+}
+
+} // anonymous namespace
+
+void pg_log_entry_t::encode_compact_with_checksum(bufferlist& bl) const
+{
+  using ceph::encode;
+  assert(!soid.is_max());
+  bufferlist mbl;
+  encode(mod_desc, mbl);
+  // no varint is longer than 10 bytes
+  size_t len = 256 + soid.oid.name.size() + soid.get_key().size() +
+    soid.nspace.size() + snaps.length() + mbl.length() +
+    extra_reqids.size() * 64;
+
+  // a legacy entry is never empty, so its length is never 0
+  encode((__u32)0, bl);
+  unsigned off = bl.length();
+  {
+    auto p = bl.get_contiguous_appender(len, true);
+    const eversion_t& prior = op == LOST_REVERT ? reverting_to : prior_version;
+    __u8 flags = 0;
+    if (prior == eversion_t())
+      flags |= PG_LOG_COMPACT_PRIOR_ZERO;
+    if (op == LOST_REVERT && prior_version == eversion_t())
+      flags |= PG_LOG_COMPACT_REVERT_ZERO;
+
+    denc(PG_LOG_COMPACT_V, p);
+    denc_varint(zigzag(op), p);
+    denc(flags, p);
+    compact_encode_string(soid.oid.name, p);
+    compact_encode_string(soid.get_key(), p);
+    compact_encode_string(soid.nspace, p);
+    // NOSNAP and SNAPDIR wrap around to 0 and 1
+    denc_varint(soid.snap.val + 2, p);
+    __u32 hash = soid.get_hash();
+    denc(hash, p);
+    denc_varint(zigzag(soid.pool), p);
+    denc_varint(version.epoch, p);
+    denc_varint(version.version, p);
+    if (!(flags & PG_LOG_COMPACT_PRIOR_ZERO))
+      compact_encode_version(version, prior, p);
+    if (op == LOST_REVERT && !(flags & PG_LOG_COMPACT_REVERT_ZERO))
+      compact_encode_version(version, prior_version, p);
+    compact_encode_reqid(reqid, nullptr, p);
+    denc_varint((uint64_t)mtime.sec(), p);
+    denc_varint((uint64_t)mtime.nsec(), p);
+    denc_varint(snaps.length(), p);
+    p.append(snaps);
+    denc_varint(zigzag((int64_t)(version.version - user_version)), p);
+    denc_varint(mbl.length(), p);
+    p.append(mbl);
+    denc_varint(extra_reqids.size(), p);
+    for (auto& i : extra_reqids) {
+      compact_encode_reqid(i.first, &reqid.name, p);
+      denc_varint(zigzag((int64_t)(version.version - i.second)), p);
+    }
+    if (op == ERROR)
+      denc_varint(zigzag(return_code), p);
+  }
+  bufferlist ebl;
+  ebl.substr_of(bl, off, bl.length() - off);
+  __u32 crc = ebl.crc32c(0);
+  encode(crc, bl);
+}
+
 void pg_log_entry_t::decode_with_checksum(bufferlist::const_iterator& p)
 {
   using ceph::decode;
   bufferlist bl;
   decode(bl, p);
   __u32 crc;
+  if (bl.length() == 0) {
+    // compact: the entry runs up to the crc at the end of the value
+    unsigned len = p.get_remaining();
+    if (len <= sizeof(crc))
+      throw buffer::malformed_input("short compact pg_log_entry_t");
+    bufferptr tmp;
+    p.copy_shallow(len - sizeof(crc), tmp);
+    decode(crc, p);
+    bl.push_back(tmp);
+    if (crc != bl.crc32c(0))
+      throw buffer::malformed_input("bad checksum on pg_log_entry_t");
+    auto q = std::cbegin(tmp);
+    decode_compact(q);
+    return;
+  }
   decode(crc, p);
   if (crc != bl.crc32c(0))
     throw buffer::malformed_input("bad checksum on pg_log_entry_t");
@@ -3877,6 +4042,82 @@ void pg_log_entry_t::decode_with_checksum(bufferlist::const_iterator& p)
   this->decode(q);
 }
 
+void pg_log_entry_t::decode_compact(bufferptr::const_iterator& p)
+{
+  using ceph::decode;
+  __u8 struct_v;
+  denc(struct_v, p);
+  if (struct_v > PG_LOG_COMPACT_V)
+    throw buffer::malformed_input("unknown compact pg_log_entry_t version");
+
+  uint64_t u;
+  __u8 flags;
+  denc_varint(u, p);
+  op = unzigzag(u);
+  denc(flags, p);
+  string name, key, nspace;
+  compact_decode_string(name, p);
+  compact_decode_string(key, p);
+  compact_decode_string(nspace, p);
+  uint64_t snap;
+  denc_varint(snap, p);
+  __u32 hash;
+  denc(hash, p);
+  denc_varint(u, p);
+  soid = hobject_t(object_t(name), key, snapid_t(snap - 2), hash,
+		   unzigzag(u), nspace);
+  invalid_hash = false;
+  invalid_pool = false;
+
+  denc_varint(version.epoch, p);
+  denc_varint(version.version, p);
+  eversion_t prior;
+  if (!(flags & PG_LOG_COMPACT_PRIOR_ZERO))
+    compact_decode_version(version, prior, p);
+  if (op == LOST_REVERT) {
+    reverting_to = prior;
+    prior_version = eversion_t();
+    if (!(flags & PG_LOG_COMPACT_REVERT_ZERO))
+      compact_decode_version(version, prior_version, p);
+  } else {
+    prior_version = prior;
+  }
+  compact_decode_reqid(reqid, nullptr, p);
+  uint64_t sec, nsec;
+  denc_varint(sec, p);
+  denc_varint(nsec, p);
+  mtime = utime_t(sec, nsec);
+
+  denc_varint(u, p);
+  snaps.clear();
+  snaps.append(p.get_pos_add(u), u);
+  snaps.reassign_to_mempool(mempool::mempool_osd_pglog);
+  denc_varint(u, p);
+  user_version = version.version - (version_t)unzigzag(u);
+
+  denc_varint(u, p);
+  bufferlist mbl;
+  mbl.append(p.get_pos_add(u), u);
+  auto q = mbl.cbegin();
+  decode(mod_desc, q);
+
+  denc_varint(u, p);
+  extra_reqids.clear();
+  extra_reqids.reserve(u);
+  while (u--) {
+    osd_reqid_t r;
+    uint64_t uv;
+    compact_decode_reqid(r, &reqid.name, p);
+    denc_varint(uv, p);
+    extra_reqids.emplace_back(r, version.version - (version_t)unzigzag(uv));
+  }
+  return_code = 0;
+  if (op == ERROR) {
+    denc_varint(u, p);
+    return_code = unzigzag(u);
+  }
+}
+
 void pg_log_entry_t::encode(bufferlist &bl) const
 {
   ENCODE_START(11, 4, bl);
@@ -4073,6 +4314,46 @@ void pg_log_dup_t::decode(bufferlist::const_iterator &bl)
   DECODE_FINISH(bl);
 }
 
+void pg_log_dup_t::encode_compact(bufferlist &bl) const
+{
+  // a legacy dup starts with its struct_v, which is never 0
+  auto p = bl.get_contiguous_appender(64, true);
+  __u8 marker = 0;
+  denc(marker, p);
+  denc(PG_LOG_COMPACT_V, p);
+  denc_varint(version.epoch, p);
+  denc_varint(version.version, p);
+  compact_encode_reqid(reqid, nullptr, p);
+  denc_varint(zigzag((int64_t)(version.version - user_version)), p);
+  denc_varint(zigzag(return_code), p);
+}
+
+void pg_log_dup_t::decode_ondisk(bufferlist::const_iterator &bl)
+{
+  if (bl.end() || *bl != 0) {
+    decode(bl);
+    return;
+  }
+  bufferptr tmp;
+  auto t = bl;
+  t.copy_shallow(bl.get_remaining(), tmp);
+  auto p = std::cbegin(tmp);
+  __u8 marker, struct_v;
+  denc(marker, p);
+  denc(struct_v, p);
+  if (struct_v > PG_LOG_COMPACT_V)
+    throw buffer::malformed_input("unknown compact pg_log_dup_t version");
+  uint64_t u;
+  denc_varint(version.epoch, p);
+  denc_varint(version.version, p);
+  compact_decode_reqid(reqid, nullptr, p);
+  denc_varint(u, p);
+  user_version = version.version - (version_t)unzigzag(u);
+  denc_varint(u, p);
+  return_code = unzigzag(u);
+  bl.advance((ssize_t)p.get_offset());
+}
+
 void pg_log_dup_t::dump(Formatter *f) const
 {
   f->dump_stream("reqid") << reqid;
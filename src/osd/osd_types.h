@@ -64,6 +64,7 @@
 #define CEPH_OSD_FEATURE_INCOMPAT_MISSING CompatSet::Feature(14, "explicit missing set")
 #define CEPH_OSD_FEATURE_INCOMPAT_FASTINFO CompatSet::Feature(15, "fastinfo pg attr")
 #define CEPH_OSD_FEATURE_INCOMPAT_RECOVERY_DELETES CompatSet::Feature(16, "deletes in missing set")
+#define CEPH_OSD_FEATURE_INCOMPAT_COMPACT_PGLOG CompatSet::Feature(17, "compact pg log entries")
 
 
 /// min recovery priority for MBackfillReserve
@@ -3432,6 +3433,13 @@ struct pg_log_entry_t {
 
   string get_key_name() const;
   void encode_with_checksum(bufferlist& bl) const;
+  /**
+   * compact on-disk form (CEPH_OSD_FEATURE_INCOMPAT_COMPACT_PGLOG):
+   * varints, with versions and extra_reqids stored relative to the
+   * entry's own version and reqid.  It must be the last thing in the
+   * omap value.  decode_with_checksum() reads either form.
+   */
+  void encode_compact_with_checksum(bufferlist& bl) const;
   void decode_with_checksum(bufferlist::const_iterator& p);
 
   void encode(bufferlist &bl) const;
@@ -3439,6 +3447,8 @@ struct pg_log_entry_t {
   void dump(Formatter *f) const;
   static void generate_test_instances(list<pg_log_entry_t*>& o);
 
+private:
+  void decode_compact(bufferptr::const_iterator& p);
 };
 WRITE_CLASS_ENCODER(pg_log_entry_t)
 
@@ -3466,6 +3476,9 @@ struct pg_log_dup_t {
   string get_key_name() const;
   void encode(bufferlist &bl) const;
   void decode(bufferlist::const_iterator &bl);
+  /// compact on-disk form; decode_ondisk() reads either form
+  void encode_compact(bufferlist &bl) const;
+  void decode_ondisk(bufferlist::const_iterator &bl);
   void dump(Formatter *f) const;
   static void generate_test_instances(list<pg_log_dup_t*>& o);
 
@@ -4995,6 +5008,9 @@ struct ScrubMapBuilder {
   bufferhash data_hash, omap_hash;  ///< accumulatinng hash value
   uint64_t omap_keys = 0;
   uint64_t omap_bytes = 0;
+  bool data_verify = false;     ///< store checks this object's data in place
+  uint64_t read_bytes = 0;      ///< data read, not yet charged to the osd
+  uint64_t verify_bytes = 0;    ///< data verified, not yet charged
 
   bool empty() {
     return ls.empty();
@@ -5013,6 +5029,7 @@ struct ScrubMapBuilder {
   void next_object() {
     ++pos;
     data_pos = 0;
+    data_verify = false;
     omap_pos.clear();
     omap_keys = 0;
     omap_bytes = 0;
@@ -1138,6 +1138,41 @@ TEST(BufferListIterator, iterator_crc32c) {
   ASSERT_EQ(0u, it.get_remaining());
 }
 
+TEST(BufferListIterator, iterator_crc32c_cached) {
+  bufferptr a(buffer::create_page_aligned(4096));
+  bufferptr b(buffer::create_page_aligned(4096));
+  memset(a.c_str(), 'a', a.length());
+  memset(b.c_str(), 'b', b.length());
+  bufferlist bl;
+  bl.push_back(a);
+  bl.push_back(b);
+  uint32_t whole = bl.crc32c(0);
+
+  buffer::track_cached_crc(true);
+  int base_cached = buffer::get_cached_crc();
+  int base_adjusted = buffer::get_cached_crc_adjusted();
+
+  // whole ptrs come from the cache, with a matching or another seed
+  bufferlist::iterator it = bl.begin();
+  ASSERT_EQ(whole, it.crc32c(8192, 0));
+  ASSERT_EQ(2, buffer::get_cached_crc() - base_cached);
+  bufferlist bb;
+  bb.append(b.c_str(), b.length());
+  it = bl.begin();
+  it.advance(4096);
+  ASSERT_EQ(bb.crc32c(-1), it.crc32c(4096, -1));
+  ASSERT_EQ(1, buffer::get_cached_crc_adjusted() - base_adjusted);
+
+  // a part of a ptr is computed
+  bufferlist part;
+  part.append(a.c_str(), 100);
+  it = bl.begin();
+  ASSERT_EQ(part.crc32c(0), it.crc32c(100, 0));
+  ASSERT_EQ(2, buffer::get_cached_crc() - base_cached);
+  ASSERT_EQ(1, buffer::get_cached_crc_adjusted() - base_adjusted);
+  buffer::track_cached_crc(false);
+}
+
 TEST(BufferListIterator, seek) {
   bufferlist bl;
   bl.append("ABC", 3);
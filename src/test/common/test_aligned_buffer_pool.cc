@@ -0,0 +1,111 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <thread>
+
+#include "gtest/gtest.h"
+
+#include "common/AlignedBufferPool.h"
+#include "common/ceph_context.h"
+#include "global/global_context.h"
+#include "include/page.h"
+
+class AlignedBufferPoolTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    g_ceph_context->_conf.set_val("aligned_buffer_pool_max_bytes", "8M");
+    g_ceph_context->_conf.set_val("aligned_buffer_pool_max_buffer_size", "1M");
+  }
+  void TearDown() override {
+    g_ceph_context->_conf.rm_val("aligned_buffer_pool_max_bytes");
+    g_ceph_context->_conf.rm_val("aligned_buffer_pool_max_buffer_size");
+  }
+};
+
+TEST_F(AlignedBufferPoolTest, exact_length_and_aligned)
+{
+  AlignedBufferPool pool(g_ceph_context);
+  for (unsigned len : {1u, 4095u, 4096u, 12345u, 65536u}) {
+    bufferptr p = pool.create(len);
+    ASSERT_EQ(len, p.length());
+    ASSERT_TRUE(p.is_page_aligned());
+    ASSERT_EQ(0u, p.unused_tail_length());
+  }
+}
+
+TEST_F(AlignedBufferPoolTest, recycle)
+{
+  AlignedBufferPool pool(g_ceph_context);
+  const char *first;
+  {
+    bufferptr p = pool.create(65536);
+    first = p.c_str();
+    ASSERT_EQ(0u, pool.get_idle_bytes());
+  }
+  ASSERT_EQ(65536u, pool.get_idle_bytes());
+
+  // a different length must not be served from the idle 64K buffer
+  bufferptr q = pool.create(8192);
+  ASSERT_EQ(65536u, pool.get_idle_bytes());
+
+  bufferlist bl;
+  bl.append(pool.create(65536));
+  ASSERT_EQ(first, bl.c_str());
+  ASSERT_EQ(0u, pool.get_idle_bytes());
+
+  // the buffer survives the pool and is simply freed when released
+  bufferlist keep;
+  {
+    AlignedBufferPool other(g_ceph_context);
+    keep.append(other.create(4096));
+  }
+  keep.clear();
+}
+
+TEST_F(AlignedBufferPoolTest, limits)
+{
+  AlignedBufferPool pool(g_ceph_context);
+  {
+    // too large to be recycled
+    bufferptr p = pool.create(2 << 20);
+    ASSERT_TRUE(p.is_page_aligned());
+  }
+  ASSERT_EQ(0u, pool.get_idle_bytes());
+
+  {
+    // no more than aligned_buffer_pool_max_bytes is kept idle
+    std::vector<bufferptr> v;
+    for (unsigned i = 0; i < 16; ++i) {
+      v.push_back(pool.create(1 << 20));
+    }
+  }
+  ASSERT_EQ(8u << 20, pool.get_idle_bytes());
+}
+
+TEST_F(AlignedBufferPoolTest, freed_on_another_thread)
+{
+  AlignedBufferPool pool(g_ceph_context);
+  for (unsigned len : {4096u, 65536u, 1u << 20}) {
+    bufferlist bl;
+    bl.append(pool.create(len));
+    const char *first = bl.c_str();
+    // released by a different thread, as the messenger does with reads
+    std::thread([&bl] { bl.clear(); }).join();
+    ASSERT_EQ(len, pool.get_idle_bytes());
+
+    bufferptr p = pool.create(len);
+    ASSERT_EQ(first, p.c_str());
+    ASSERT_EQ(0u, pool.get_idle_bytes());
+  }
+}
+
+TEST_F(AlignedBufferPoolTest, disabled)
+{
+  g_ceph_context->_conf.set_val("aligned_buffer_pool_max_bytes", "0");
+  AlignedBufferPool pool(g_ceph_context);
+  {
+    bufferptr p = pool.create(4096);
+    ASSERT_TRUE(p.is_page_aligned());
+  }
+  ASSERT_EQ(0u, pool.get_idle_bytes());
+}
@@ -44,6 +44,29 @@ TEST(Crc32c, Big) {
   free(a);
 }
 
+TEST(Crc32c, Multi) {
+  unsigned len = 4096 * 9;
+  unsigned char *a = (unsigned char *)malloc(len);
+  for (unsigned i = 0; i < len; ++i)
+    a[i] = (i * 7) & 0xff;
+  // odd lengths, odd offsets and partial groups of buffers
+  for (unsigned l : {0u, 1u, 7u, 8u, 15u, 1000u, 4096u}) {
+    for (unsigned n = 1; n <= 9; ++n) {
+      const unsigned char *data[9];
+      uint32_t crcs[9];
+      for (unsigned i = 0; i < n; ++i) {
+	data[i] = a + i * 4096 + i;
+	crcs[i] = i * 1234;
+      }
+      ceph_crc32c_multi(n, crcs, data, l);
+      for (unsigned i = 0; i < n; ++i) {
+	ASSERT_EQ(ceph_crc32c(i * 1234, data[i], l), crcs[i]);
+      }
+    }
+  }
+  free(a);
+}
+
 TEST(Crc32c, Performance) {
   int len = 1000 * 1024 * 1024;
   char *a = (char *)malloc(len);
@@ -0,0 +1,101 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+
+#include "common/HostMemoryArbiter.h"
+#include "common/ceph_context.h"
+#include "global/global_context.h"
+#include "include/stringify.h"
+
+typedef HostMemoryArbiter::member_t member_t;
+
+static uint64_t total_granted(const std::vector<member_t>& members)
+{
+  uint64_t t = 0;
+  for (auto& m : members) {
+    t += m.granted;
+  }
+  return t;
+}
+
+TEST(HostMemoryArbiter, idle_host_splits_by_target)
+{
+  std::vector<member_t> members(3);
+  members[0].target = 4 << 20;
+  members[1].target = 4 << 20;
+  members[2].target = 8 << 20;
+  HostMemoryArbiter::compute_grants(0, .5, &members);
+  ASSERT_EQ(4u << 20, members[0].granted);
+  ASSERT_EQ(4u << 20, members[1].granted);
+  ASSERT_EQ(8u << 20, members[2].granted);
+}
+
+TEST(HostMemoryArbiter, demand_moves_budget)
+{
+  const uint64_t host = 12 << 20;
+  std::vector<member_t> members(3);
+  for (auto& m : members) {
+    m.target = 4 << 20;
+    m.min = 1 << 20;
+  }
+  members[0].demand = 1000;
+  for (unsigned i = 0; i < 30; ++i) {
+    HostMemoryArbiter::compute_grants(host, .5, &members);
+  }
+  // the busy member gets its floor plus the whole pool, the others their
+  // floor; together they converge to the host target
+  ASSERT_NEAR(8 << 20, members[0].granted, 64);
+  ASSERT_NEAR(2 << 20, members[1].granted, 64);
+  ASSERT_NEAR(2 << 20, members[2].granted, 64);
+  ASSERT_NEAR(host, total_granted(members), 64);
+
+  // min beats the floor
+  members[1].min = 3 << 20;
+  for (unsigned i = 0; i < 30; ++i) {
+    HostMemoryArbiter::compute_grants(host, .5, &members);
+  }
+  ASSERT_NEAR(3 << 20, members[1].granted, 64);
+  ASSERT_NEAR(host, total_granted(members), 64);
+}
+
+TEST(HostMemoryArbiter, shared_segment)
+{
+  g_ceph_context->_conf.set_val("osd_memory_host_target", "12M");
+  std::string path = "/tmp/test_host_memory_arbiter." + stringify(getpid());
+  {
+    HostMemoryArbiter a(g_ceph_context, path, "osd.0");
+    HostMemoryArbiter b(g_ceph_context, path, "osd.1");
+    ASSERT_EQ(0, a.open());
+    ASSERT_EQ(0, b.open());
+
+    // alone in the segment, a gets the whole host
+    ASSERT_EQ(12u << 20, a.update(4 << 20, 1 << 20, 0));
+    uint64_t ga = 0, gb = 0;
+    for (unsigned i = 0; i < 30; ++i) {
+      ga = a.update(4 << 20, 1 << 20, 100);
+      gb = b.update(4 << 20, 1 << 20, 0);
+    }
+    ASSERT_GT(ga, gb);
+    ASSERT_NEAR(12 << 20, ga + gb, 64);
+    ASSERT_EQ(gb, b.get_granted());
+
+    // b leaving hands its budget back
+    b.close();
+    for (unsigned i = 0; i < 30; ++i) {
+      ga = a.update(4 << 20, 1 << 20, 100);
+    }
+    ASSERT_NEAR(12 << 20, ga, 64);
+  }
+  ::unlink(path.c_str());
+  g_ceph_context->_conf.rm_val("osd_memory_host_target");
+}
+
+TEST(HostMemoryArbiter, not_open)
+{
+  HostMemoryArbiter a(g_ceph_context, "/nonexistent/dir/segment", "osd.0");
+  ASSERT_GT(0, a.open());
+  ASSERT_EQ(4u << 20, a.update(4 << 20, 1 << 20, 0));
+}
@@ -0,0 +1,272 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <list>
+#include <map>
+#include "gtest/gtest.h"
+#include "common/mClockCostQueue.h"
+
+
+struct Request {
+  int client;
+  int value;
+  Request() :
+    client(-1), value(0)
+  {}
+  Request(int client, int value) :
+    client(client), value(value)
+  {}
+};
+
+using Queue = ceph::mClockCostQueue<Request,int>;
+using Info = Queue::ClientInfo;
+
+// a queue driven by a fake clock, with per-client infos the test can
+// set up front
+struct TestQueue {
+  double now = 0.0;
+  std::map<int,Info> infos;
+  Queue q;
+
+  TestQueue() :
+    q([this](const int& c) -> const Info* {
+	auto i = infos.find(c);
+	if (i == infos.end()) {
+	  i = infos.emplace(c, Info(0.0, 1.0, 0.0)).first;
+	}
+	return &i->second;
+      },
+      [this]() { return now; })
+  {}
+};
+
+
+TEST(mClockCostQueue, Sizes)
+{
+  TestQueue t;
+  Queue& q = t.q;
+
+  ASSERT_TRUE(q.empty());
+  ASSERT_EQ(0u, q.length());
+
+  q.enqueue_strict(1, 1, Request(1, 1));
+  q.enqueue_strict(2, 2, Request(2, 2));
+  q.enqueue(2, 1, 0, Request(2, 3));
+  q.enqueue(1, 2, 100, Request(1, 4));
+  q.enqueue_front(1, 2, 0, Request(1, 5));
+
+  ASSERT_FALSE(q.empty());
+  ASSERT_EQ(5u, q.length());
+
+  for (int i = 0; i < 5; ++i) {
+    (void) q.dequeue();
+  }
+
+  ASSERT_TRUE(q.empty());
+  ASSERT_EQ(0u, q.length());
+}
+
+
+TEST(mClockCostQueue, StrictThenFrontThenTagged)
+{
+  TestQueue t;
+  Queue& q = t.q;
+
+  q.enqueue(1, 0, 1, Request(1, 1));
+  q.enqueue_front(1, 0, 1, Request(1, 2));
+  q.enqueue_strict(2, 1, Request(2, 3));
+  q.enqueue_strict(2, 5, Request(2, 4));
+
+  ASSERT_EQ(4, q.dequeue().value);
+  ASSERT_EQ(3, q.dequeue().value);
+  ASSERT_EQ(2, q.dequeue().value);
+  ASSERT_EQ(1, q.dequeue().value);
+  ASSERT_TRUE(q.empty());
+}
+
+
+// with equal weights, clients get equal cost, not equal request counts
+TEST(mClockCostQueue, ProportionalToCost)
+{
+  TestQueue t;
+  Queue& q = t.q;
+
+  for (int i = 0; i < 1000; ++i) {
+    q.enqueue(1, 0, 10, Request(1, i));
+    q.enqueue(2, 0, 1, Request(2, i));
+  }
+
+  std::map<int,unsigned> served;
+  for (int i = 0; i < 550; ++i) {
+    ++served[q.dequeue().client];
+  }
+  ASSERT_NEAR(50u, served[1], 2u);
+  ASSERT_NEAR(500u, served[2], 20u);
+}
+
+
+TEST(mClockCostQueue, Weights)
+{
+  TestQueue t;
+  Queue& q = t.q;
+  t.infos.emplace(1, Info(0.0, 3.0, 0.0));
+  t.infos.emplace(2, Info(0.0, 1.0, 0.0));
+
+  for (int i = 0; i < 1000; ++i) {
+    q.enqueue(1, 0, 1, Request(1, i));
+    q.enqueue(2, 0, 1, Request(2, i));
+  }
+
+  std::map<int,unsigned> served;
+  for (int i = 0; i < 400; ++i) {
+    ++served[q.dequeue().client];
+  }
+  ASSERT_NEAR(300u, served[1], 2u);
+  ASSERT_NEAR(100u, served[2], 2u);
+}
+
+
+// a small weight is topped up to the reservation as the clock advances
+TEST(mClockCostQueue, Reservation)
+{
+  TestQueue t;
+  Queue& q = t.q;
+  t.infos.emplace(1, Info(20.0, 1.0, 0.0));
+  t.infos.emplace(2, Info(0.0, 100.0, 0.0));
+
+  for (int i = 0; i < 2000; ++i) {
+    q.enqueue(1, 0, 1, Request(1, i));
+    q.enqueue(2, 0, 1, Request(2, i));
+  }
+
+  // serve 100 units/sec for 10 seconds
+  std::map<int,unsigned> served;
+  for (int i = 0; i < 1000; ++i) {
+    t.now += 0.01;
+    ++served[q.dequeue().client];
+  }
+  // 200 from the reservation plus a 1/101 share of the rest
+  ASSERT_GE(served[1], 200u);
+  ASSERT_LE(served[1], 215u);
+}
+
+
+TEST(mClockCostQueue, Limit)
+{
+  TestQueue t;
+  Queue& q = t.q;
+  t.infos.emplace(1, Info(0.0, 100.0, 5.0));
+  t.infos.emplace(2, Info(0.0, 1.0, 0.0));
+
+  for (int i = 0; i < 2000; ++i) {
+    q.enqueue(1, 0, 1, Request(1, i));
+    q.enqueue(2, 0, 1, Request(2, i));
+  }
+
+  std::map<int,unsigned> served;
+  for (int i = 0; i < 1000; ++i) {
+    t.now += 0.01;
+    ++served[q.dequeue().client];
+  }
+  ASSERT_LE(served[1], 52u);
+  ASSERT_GE(served[1], 48u);
+}
+
+
+// when every client is over its limit the queue still hands out work
+TEST(mClockCostQueue, LimitBreak)
+{
+  TestQueue t;
+  Queue& q = t.q;
+  t.infos.emplace(1, Info(0.0, 1.0, 1.0));
+
+  for (int i = 0; i < 10; ++i) {
+    q.enqueue(1, 0, 1, Request(1, i));
+  }
+  for (int i = 0; i < 10; ++i) {
+    ASSERT_EQ(i, q.dequeue().value);
+  }
+  ASSERT_TRUE(q.empty());
+}
+
+
+// a client that was idle starts at the current virtual time rather
+// than with all the share it didn't use
+TEST(mClockCostQueue, NoCreditForIdle)
+{
+  TestQueue t;
+  Queue& q = t.q;
+
+  for (int i = 0; i < 1000; ++i) {
+    q.enqueue(1, 0, 1, Request(1, i));
+  }
+  for (int i = 0; i < 500; ++i) {
+    ASSERT_EQ(1, q.dequeue().client);
+  }
+  for (int i = 0; i < 500; ++i) {
+    q.enqueue(2, 0, 1, Request(2, i));
+  }
+
+  std::map<int,unsigned> served;
+  for (int i = 0; i < 100; ++i) {
+    ++served[q.dequeue().client];
+  }
+  ASSERT_NEAR(50u, served[1], 1u);
+  ASSERT_NEAR(50u, served[2], 1u);
+}
+
+
+TEST(mClockCostQueue, RemoveByClass)
+{
+  TestQueue t;
+  Queue& q = t.q;
+
+  q.enqueue(1, 0, 1, Request(1, 1));
+  q.enqueue(2, 0, 1, Request(2, 2));
+  q.enqueue(1, 0, 1, Request(1, 3));
+  q.enqueue_front(1, 0, 1, Request(1, 4));
+  q.enqueue_strict(1, 3, Request(1, 5));
+  q.enqueue_strict(2, 3, Request(2, 6));
+
+  std::list<Request> removed;
+  q.remove_by_class(1, &removed);
+
+  ASSERT_EQ(4u, removed.size());
+  ASSERT_EQ(5, removed.front().value);
+  ASSERT_EQ(3, removed.back().value);
+  ASSERT_EQ(2u, q.length());
+
+  ASSERT_EQ(6, q.dequeue().value);
+  ASSERT_EQ(2, q.dequeue().value);
+  ASSERT_TRUE(q.empty());
+}
+
+
+TEST(mClockCostQueue, RemoveByFilter)
+{
+  TestQueue t;
+  Queue& q = t.q;
+
+  for (int i = 0; i < 10; ++i) {
+    q.enqueue(i % 2, 0, 1, Request(i % 2, i));
+  }
+
+  q.remove_by_filter([](Request&& r) { return r.value % 3 == 0; });
+  ASSERT_EQ(6u, q.length());
+
+  unsigned n = 0;
+  while (!q.empty()) {
+    ASSERT_NE(0, q.dequeue().value % 3);
+    ++n;
+  }
+  ASSERT_EQ(6u, n);
+}
@@ -0,0 +1,70 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "common/MPSCQueue.h"
+
+TEST(MPSCQueue, fifo)
+{
+  MPSCQueue<int> q;
+  ASSERT_TRUE(q.empty());
+  ASSERT_TRUE(q.push(1));
+  ASSERT_FALSE(q.push(2));
+  ASSERT_FALSE(q.push(3));
+  ASSERT_FALSE(q.empty());
+
+  std::vector<int> got;
+  ASSERT_EQ(3u, q.consume([&got](int&& i) { got.push_back(i); }));
+  ASSERT_EQ((std::vector<int>{1, 2, 3}), got);
+  ASSERT_TRUE(q.empty());
+  ASSERT_EQ(0u, q.consume([](int&&) { FAIL(); }));
+  ASSERT_TRUE(q.push(4));
+}
+
+TEST(MPSCQueue, move_only)
+{
+  MPSCQueue<std::unique_ptr<int>> q;
+  q.push(new int(7));
+  q.push(std::make_unique<int>(8));
+  int sum = 0;
+  q.consume([&sum](std::unique_ptr<int>&& p) { sum += *p; });
+  ASSERT_EQ(15, sum);
+  // whatever is left is freed with the queue
+  q.push(new int(9));
+}
+
+TEST(MPSCQueue, producers)
+{
+  const unsigned producers = 8, per_producer = 100000;
+  MPSCQueue<std::pair<unsigned, unsigned>> q;
+  std::vector<std::thread> threads;
+  for (unsigned p = 0; p < producers; ++p) {
+    threads.emplace_back([&q, p]() {
+	for (unsigned i = 0; i < per_producer; ++i) {
+	  q.push(p, i);
+	}
+      });
+  }
+
+  // every item arrives once, and each producer's items in order
+  std::vector<unsigned> next(producers, 0);
+  unsigned total = 0;
+  while (total < producers * per_producer) {
+    total += q.consume([&next](std::pair<unsigned, unsigned>&& v) {
+	ASSERT_EQ(next[v.first], v.second);
+	++next[v.first];
+      });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  ASSERT_TRUE(q.empty());
+  for (auto n : next) {
+    ASSERT_EQ(per_producer, n);
+  }
+}
@@ -0,0 +1,219 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Throughput of the two ways DispatchQueue can hand messages from
+ * messenger workers to its dispatch thread:
+ *
+ *  locked: every producer takes the queue mutex to put its item into the
+ *          PrioritizedQueue and signals the dispatch thread (the old way)
+ *  inbox:  producers push onto an MPSCQueue without a lock; the consumer
+ *          moves batches into a PrioritizedQueue only it touches
+ *
+ * [producers] threads each queue [items] items under their own class, a
+ * tenth of them at strict priority.  Like the dispatch throttler, at most
+ * [in flight] items may be queued at once.  Reports enqueue and dispatch
+ * rates and the mean time an item waited.
+ */
+
+#include <stdlib.h>
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/ceph_time.h"
+#include "common/Cond.h"
+#include "common/Mutex.h"
+#include "common/MPSCQueue.h"
+#include "common/PrioritizedQueue.h"
+#include "include/msgr.h"
+
+using namespace std;
+
+struct Item {
+  uint64_t klass;
+  int priority;
+  ceph::mono_time stamp;
+};
+
+struct Result {
+  double enqueue_secs = 0;     ///< until the last producer was done
+  double total_secs = 0;       ///< until the last item was dispatched
+  double wait_secs = 0;        ///< sum over items
+};
+
+static int priority_of(unsigned i)
+{
+  return i % 10 ? CEPH_MSG_PRIO_DEFAULT : CEPH_MSG_PRIO_HIGH;
+}
+
+static void pq_enqueue(PrioritizedQueue<Item, uint64_t>& pq, Item&& item)
+{
+  if (item.priority >= CEPH_MSG_PRIO_LOW) {
+    pq.enqueue_strict(item.klass, item.priority, std::move(item));
+  } else {
+    pq.enqueue(item.klass, item.priority, 1, std::move(item));
+  }
+}
+
+static uint64_t max_in_flight;
+static std::atomic<uint64_t> in_flight;
+
+static void dispatched(const Item& item, double *wait)
+{
+  *wait += std::chrono::duration<double>(
+    ceph::mono_clock::now() - item.stamp).count();
+  --in_flight;
+}
+
+template <typename Producer, typename Consumer>
+static Result run(unsigned producers, unsigned items, Producer&& produce,
+		  Consumer&& consume)
+{
+  Result r;
+  in_flight = 0;
+  auto start = ceph::mono_clock::now();
+  std::thread consumer([&]() {
+      r.wait_secs = consume((uint64_t)producers * items);
+    });
+  std::vector<std::thread> threads;
+  for (unsigned p = 0; p < producers; ++p) {
+    threads.emplace_back([&, p]() {
+	for (unsigned i = 0; i < items; ++i) {
+	  while (in_flight >= max_in_flight) {
+	    std::this_thread::yield();
+	  }
+	  ++in_flight;
+	  produce(Item{p + 1, priority_of(i), ceph::mono_clock::now()});
+	}
+      });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  r.enqueue_secs = std::chrono::duration<double>(
+    ceph::mono_clock::now() - start).count();
+  consumer.join();
+  r.total_secs = std::chrono::duration<double>(
+    ceph::mono_clock::now() - start).count();
+  return r;
+}
+
+static Result run_locked(unsigned producers, unsigned items)
+{
+  Mutex lock("perf_dispatch_queue::lock");
+  Cond cond;
+  PrioritizedQueue<Item, uint64_t> pq(65536, 65536);
+  return run(
+    producers, items,
+    [&](Item&& item) {
+      Mutex::Locker l(lock);
+      pq_enqueue(pq, std::move(item));
+      cond.Signal();
+    },
+    [&](uint64_t total) {
+      double wait = 0;
+      lock.Lock();
+      while (total) {
+	while (!pq.empty()) {
+	  Item item = pq.dequeue();
+	  lock.Unlock();
+	  dispatched(item, &wait);
+	  --total;
+	  lock.Lock();
+	}
+	if (total) {
+	  cond.Wait(lock);
+	}
+      }
+      lock.Unlock();
+      return wait;
+    });
+}
+
+static Result run_inbox(unsigned producers, unsigned items)
+{
+  Mutex lock("perf_dispatch_queue::lock");
+  Cond cond;
+  std::atomic<bool> sleeping = { false };
+  MPSCQueue<Item> inbox;
+  PrioritizedQueue<Item, uint64_t> pq(65536, 65536);
+  return run(
+    producers, items,
+    [&](Item&& item) {
+      inbox.push(std::move(item));
+      if (sleeping) {
+	Mutex::Locker l(lock);
+	cond.Signal();
+      }
+    },
+    [&](uint64_t total) {
+      double wait = 0;
+      auto drain = [&]() {
+	inbox.consume([&](Item&& item) { pq_enqueue(pq, std::move(item)); });
+      };
+      while (total) {
+	drain();
+	while (!pq.empty()) {
+	  Item item = pq.dequeue();
+	  dispatched(item, &wait);
+	  --total;
+	  if (!inbox.empty()) {
+	    drain();
+	  }
+	}
+	if (total) {
+	  lock.Lock();
+	  sleeping = true;
+	  if (inbox.empty()) {
+	    cond.Wait(lock);
+	  }
+	  sleeping = false;
+	  lock.Unlock();
+	}
+      }
+      return wait;
+    });
+}
+
+void usage(const string &name) {
+  cerr << "Usage: " << name << " [producers] [items] [in flight]" << std::endl;
+  cerr << "       [producers]: threads queueing, like messenger workers" << std::endl;
+  cerr << "       [items]: items each producer queues" << std::endl;
+  cerr << "       [in flight]: most items queued at once (default 1000)" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 3) {
+    usage(argv[0]);
+    return 1;
+  }
+  unsigned producers = std::max(1, atoi(argv[1]));
+  unsigned items = std::max(1, atoi(argv[2]));
+  max_in_flight = argc > 3 ? std::max(1, atoi(argv[3])) : 1000;
+  uint64_t total = (uint64_t)producers * items;
+
+  cerr << " " << producers << " producers, " << items << " items each, "
+       << max_in_flight << " in flight" << std::endl;
+  for (auto mode : { "locked", "inbox" }) {
+    Result r = string(mode) == "locked" ?
+      run_locked(producers, items) : run_inbox(producers, items);
+    cerr << " " << mode << ": enqueue " << (uint64_t)(total / r.enqueue_secs)
+	 << " items/s, dispatch " << (uint64_t)(total / r.total_secs)
+	 << " items/s, mean wait " << r.wait_secs / total * 1000000
+	 << " us" << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,258 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Small message throughput of the async messenger over loopback.  Every
+ * job opens its own connection and streams pings to an in-process sink
+ * with at most [window] messages in flight; afterwards each network
+ * worker reports how many messages it sent per second and how many went
+ * out per send syscall.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string>
+#include <unistd.h>
+#include <iostream>
+#include <atomic>
+#include <map>
+
+using namespace std;
+
+#include "common/ceph_argparse.h"
+#include "common/debug.h"
+#include "common/perf_counters.h"
+#include "global/global_init.h"
+#include "msg/Messenger.h"
+#include "msg/async/Stack.h"
+#include "messages/MPing.h"
+
+class SinkDispatcher : public Dispatcher {
+ public:
+  std::atomic<uint64_t> received = { 0 };
+
+  SinkDispatcher() : Dispatcher(g_ceph_context) {}
+  bool ms_can_fast_dispatch_any() const override { return true; }
+  bool ms_can_fast_dispatch(const Message *m) const override {
+    return m->get_type() == CEPH_MSG_PING;
+  }
+  void ms_fast_dispatch(Message *m) override {
+    // acknowledge so the sender can keep its window full
+    m->get_connection()->send_message(new MPing());
+    m->put();
+    ++received;
+  }
+  void ms_handle_fast_connect(Connection *con) override {}
+  void ms_handle_fast_accept(Connection *con) override {}
+  bool ms_dispatch(Message *m) override { m->put(); return true; }
+  bool ms_handle_reset(Connection *con) override { return true; }
+  void ms_handle_remote_reset(Connection *con) override {}
+  bool ms_handle_refused(Connection *con) override { return false; }
+  bool ms_verify_authorizer(Connection *con, int peer_type, int protocol,
+			    bufferlist& authorizer, bufferlist& authorizer_reply,
+			    bool& isvalid, CryptoKey& session_key,
+			    std::unique_ptr<AuthAuthorizerChallenge> *challenge) override {
+    isvalid = true;
+    return true;
+  }
+};
+
+class SenderDispatcher : public Dispatcher {
+ public:
+  Mutex lock;
+  Cond cond;
+  uint64_t acked = 0;
+
+  SenderDispatcher()
+    : Dispatcher(g_ceph_context), lock("SenderDispatcher::lock") {}
+  bool ms_can_fast_dispatch_any() const override { return true; }
+  bool ms_can_fast_dispatch(const Message *m) const override {
+    return m->get_type() == CEPH_MSG_PING;
+  }
+  void ms_fast_dispatch(Message *m) override {
+    m->put();
+    Mutex::Locker l(lock);
+    ++acked;
+    cond.Signal();
+  }
+  void ms_handle_fast_connect(Connection *con) override {}
+  void ms_handle_fast_accept(Connection *con) override {}
+  bool ms_dispatch(Message *m) override { m->put(); return true; }
+  bool ms_handle_reset(Connection *con) override { return true; }
+  void ms_handle_remote_reset(Connection *con) override {}
+  bool ms_handle_refused(Connection *con) override { return false; }
+  bool ms_verify_authorizer(Connection *con, int peer_type, int protocol,
+			    bufferlist& authorizer, bufferlist& authorizer_reply,
+			    bool& isvalid, CryptoKey& session_key,
+			    std::unique_ptr<AuthAuthorizerChallenge> *challenge) override {
+    isvalid = true;
+    return true;
+  }
+};
+
+class SenderThread : public Thread {
+  ConnectionRef conn;
+  SenderDispatcher *dispatcher;
+  uint64_t msgs, window;
+
+ public:
+  uint64_t sent = 0;
+
+  SenderThread(ConnectionRef c, SenderDispatcher *d, uint64_t n, uint64_t w)
+    : conn(c), dispatcher(d), msgs(n), window(w) {}
+  void *entry() override {
+    Mutex::Locker l(dispatcher->lock);
+    while (sent < msgs) {
+      while (sent - dispatcher->acked >= window) {
+	dispatcher->cond.Wait(dispatcher->lock);
+      }
+      ++sent;
+      dispatcher->lock.Unlock();
+      conn->send_message(new MPing());
+      dispatcher->lock.Lock();
+    }
+    while (dispatcher->acked < msgs) {
+      dispatcher->cond.Wait(dispatcher->lock);
+    }
+    return 0;
+  }
+};
+
+struct worker_stats_t {
+  uint64_t messages = 0;
+  uint64_t batched = 0;     ///< messages sent through batches
+  uint64_t syscalls = 0;
+};
+
+static map<string, worker_stats_t> get_worker_stats()
+{
+  map<string, worker_stats_t> r;
+  g_ceph_context->get_perfcounters_collection()->with_counters(
+    [&r](const PerfCountersCollection::CounterMap& counters) {
+      for (auto& p : counters) {
+	auto& pc = p.second.perf_counters;
+	if (pc->get_name().find("AsyncMessenger::Worker") != 0) {
+	  continue;
+	}
+	auto& s = r[pc->get_name()];
+	s.messages = pc->get(l_msgr_send_messages);
+	if (p.first == pc->get_name() + ".msgr_send_messages_per_syscall") {
+	  auto a = p.second.data->read_avg();
+	  s.batched = a.first;
+	  s.syscalls = a.second;
+	}
+      }
+    });
+  return r;
+}
+
+void usage(const string &name) {
+  cerr << "Usage: " << name << " [numjobs] [messages per job] [window]" << std::endl;
+  cerr << "       [numjobs]: connections, each driven by its own thread" << std::endl;
+  cerr << "       [messages per job]: pings each job sends" << std::endl;
+  cerr << "       [window]: max unacknowledged pings per job" << std::endl;
+  cerr << " e.g. --ms_async_send_flush_window_us 20 to hold small batches" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  auto cct = global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT,
+			 CODE_ENVIRONMENT_UTILITY,
+			 CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+  common_init_finish(g_ceph_context);
+  g_ceph_context->_conf.apply_changes(nullptr);
+
+  if (args.size() < 3) {
+    usage(argv[0]);
+    return 1;
+  }
+  int jobs = atoi(args[0]);
+  uint64_t msgs = atoll(args[1]);
+  uint64_t window = std::max(1, atoi(args[2]));
+
+  cerr << " jobs " << jobs << ", " << msgs << " messages each, window "
+       << window << ", batch "
+       << g_conf().get_val<uint64_t>("ms_async_send_batch_bytes")
+       << " bytes, flush window "
+       << g_conf().get_val<uint64_t>("ms_async_send_flush_window_us")
+       << "us" << std::endl;
+
+  SinkDispatcher sink;
+  Messenger *server = Messenger::create(g_ceph_context, "async+posix",
+					entity_name_t::OSD(0), "server", 0, 0);
+  server->set_default_policy(Messenger::Policy::stateless_server(0));
+  entity_addr_t bind_addr;
+  bind_addr.parse("127.0.0.1");
+  server->bind(bind_addr);
+  server->add_dispatcher_head(&sink);
+  server->start();
+
+  vector<Messenger*> clients;
+  vector<SenderDispatcher*> dispatchers;
+  vector<SenderThread*> threads;
+  for (int i = 0; i < jobs; ++i) {
+    Messenger *msgr = Messenger::create(g_ceph_context, "async+posix",
+					entity_name_t::CLIENT(i), "client",
+					getpid() + i, 0);
+    msgr->set_default_policy(Messenger::Policy::lossless_client(0));
+    auto d = new SenderDispatcher;
+    msgr->add_dispatcher_head(d);
+    msgr->start();
+    ConnectionRef conn = msgr->connect_to_osd(server->get_myaddrs());
+    clients.push_back(msgr);
+    dispatchers.push_back(d);
+    threads.push_back(new SenderThread(conn, d, msgs, window));
+  }
+
+  auto before = get_worker_stats();
+  auto start = ceph::mono_clock::now();
+  for (auto t : threads) {
+    t->create("sender");
+  }
+  for (auto t : threads) {
+    t->join();
+  }
+  double secs = std::chrono::duration<double>(
+    ceph::mono_clock::now() - start).count();
+  auto after = get_worker_stats();
+
+  cerr << " " << sink.received << " messages in " << secs << "s, "
+       << (uint64_t)(sink.received / secs) << " msgs/s" << std::endl;
+  for (auto& p : after) {
+    auto& b = before[p.first];
+    uint64_t sent = p.second.messages - b.messages;
+    uint64_t batched = p.second.batched - b.batched;
+    uint64_t syscalls = p.second.syscalls - b.syscalls;
+    cerr << " " << p.first << ": " << (uint64_t)(sent / secs) << " msgs/s, "
+	 << (syscalls ? (double)batched / syscalls : 0.0)
+	 << " msgs/syscall" << std::endl;
+  }
+
+  for (auto t : threads) {
+    delete t;
+  }
+  for (auto m : clients) {
+    m->shutdown();
+    m->wait();
+    delete m;
+  }
+  for (auto d : dispatchers) {
+    delete d;
+  }
+  server->shutdown();
+  server->wait();
+  delete server;
+  return 0;
+}
@@ -428,6 +428,42 @@ TEST_P(MessengerTest, TimeoutTest) {
   g_ceph_context->_conf.set_val("ms_tcp_read_timeout", "900");
 }
 
+TEST_P(MessengerTest, SendFlushWindowTest) {
+  // a lone message held back for more company has to go out once the
+  // window is over, with nothing else queued behind it
+  g_ceph_context->_conf.set_val("ms_async_send_flush_window_us", "100000");
+  FakeDispatcher cli_dispatcher(false), srv_dispatcher(true);
+  entity_addr_t bind_addr;
+  bind_addr.parse("127.0.0.1");
+  server_msgr->bind(bind_addr);
+  server_msgr->add_dispatcher_head(&srv_dispatcher);
+  server_msgr->start();
+
+  client_msgr->add_dispatcher_head(&cli_dispatcher);
+  client_msgr->start();
+
+  ConnectionRef conn = client_msgr->connect_to(server_msgr->get_mytype(),
+					       server_msgr->get_myaddrs());
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_EQ(conn->send_message(new MPing()), 0);
+    Mutex::Locker l(cli_dispatcher.lock);
+    utime_t until = ceph_clock_now();
+    until += 10;
+    while (!cli_dispatcher.got_new && ceph_clock_now() < until)
+      cli_dispatcher.cond.WaitInterval(cli_dispatcher.lock, utime_t(1, 0));
+    ASSERT_TRUE(cli_dispatcher.got_new);
+    cli_dispatcher.got_new = false;
+  }
+  ASSERT_EQ(3U, static_cast<Session*>(conn->get_priv().get())->get_count());
+
+  server_msgr->shutdown();
+  server_msgr->wait();
+
+  client_msgr->shutdown();
+  client_msgr->wait();
+  g_ceph_context->_conf.set_val("ms_async_send_flush_window_us", "0");
+}
+
 TEST_P(MessengerTest, StatefulTest) {
   Message *m;
   FakeDispatcher cli_dispatcher(false), srv_dispatcher(true);
@@ -40,6 +40,8 @@ public:
   }
   void doOverwriteTest(uint64_t capacity, uint64_t prefill,
     uint64_t overwrite);
+  void doAgedFragmentationTest(uint64_t capacity, uint64_t fill,
+    uint64_t churn);
 };
 
 const uint64_t _1m = 1024 * 1024;
@@ -329,10 +331,123 @@ TEST_P(AllocTest, test_alloc_bench_10_300)
   doOverwriteTest(capacity, prefill, overwrite);
 }
 
+/*
+ * Age the allocator the way a long running OSD does: fill it with small
+ * extents, then keep freeing random pieces and reallocating until the free
+ * space is shredded.  Then measure how fast, and how contiguously, both
+ * small writes and large blobs can still be placed.
+ */
+void AllocTest::doAgedFragmentationTest(uint64_t capacity, uint64_t fill,
+  uint64_t churn)
+{
+  uint64_t alloc_unit = 4096;
+  PExtentVector tmp;
+  AllocTracker at(capacity, alloc_unit);
+
+  init_alloc(capacity, alloc_unit);
+  alloc->init_add_free(0, capacity);
+
+  gen_type rng(time(NULL));
+  boost::uniform_int<> u1(0, 4); // 4K-64K
+
+  auto alloc_and_track = [&](uint64_t want) {
+    tmp.clear();
+    auto r = alloc->allocate(want, alloc_unit, 0, 0, &tmp);
+    if (r != (int64_t)want) {
+      if (r > 0) {
+	alloc->release(tmp);
+      }
+      return false;
+    }
+    for (auto a : tmp) {
+      bool full = !at.push(a.offset, a.length);
+      EXPECT_EQ(full, false);
+    }
+    return true;
+  };
+
+  for (uint64_t i = 0; i < fill; ) {
+    uint64_t want = alloc_unit << u1(rng);
+    if (!alloc_and_track(want)) {
+      break;
+    }
+    i += want;
+  }
+
+  utime_t start = ceph_clock_now();
+  for (uint64_t i = 0; i < churn; ) {
+    uint64_t want = alloc_unit << u1(rng);
+    uint64_t released = 0;
+    do {
+      uint64_t o = 0;
+      uint32_t l = 0;
+      if (!at.pop_random(rng, &o, &l, want - released)) {
+	break;
+      }
+      interval_set<uint64_t> release_set;
+      release_set.insert(o, l);
+      alloc->release(release_set);
+      released += l;
+    } while (released < want);
+    if (!alloc_and_track(want)) {
+      std::cout << "Can't allocate more space, stopping." << std::endl;
+      break;
+    }
+    i += want;
+  }
+  std::cout << "Aged in " << ceph_clock_now() - start << std::endl;
+  std::cout << "Avail " << alloc->get_free() / _1m << " MB"
+	    << " fragmentation " << alloc->get_fragmentation(alloc_unit)
+	    << " score " << alloc->get_fragmentation_score() << std::endl;
+
+  const unsigned rounds = 1024;
+  for (uint64_t want : {alloc_unit, uint64_t(64 * 1024), _1m, 4 * _1m}) {
+    uint64_t extents = 0;
+    unsigned done = 0;
+    PExtentVector all;
+    start = ceph_clock_now();
+    for (; done < rounds; ++done) {
+      tmp.clear();
+      auto r = alloc->allocate(want, alloc_unit, 0, 0, &tmp);
+      if (r != (int64_t)want) {
+	if (r > 0) {
+	  alloc->release(tmp);
+	}
+	break;
+      }
+      extents += tmp.size();
+      all.insert(all.end(), tmp.begin(), tmp.end());
+    }
+    auto elapsed = ceph_clock_now() - start;
+    std::cout << "aged alloc " << want / 1024 << "K x " << done
+	      << " in " << elapsed
+	      << ", " << (done ? double(extents) / done : 0.0)
+	      << " extents per allocation" << std::endl;
+    alloc->release(all);
+  }
+  dump_mempools();
+}
+
+TEST_P(AllocTest, test_alloc_bench_aged_80)
+{
+  uint64_t capacity = uint64_t(1024) * 1024 * 1024 * 1024;
+  auto fill = capacity / 10 * 8;
+  auto churn = capacity;
+  doAgedFragmentationTest(capacity, fill, churn);
+}
+
+TEST_P(AllocTest, test_alloc_bench_aged_95)
+{
+  uint64_t capacity = uint64_t(1024) * 1024 * 1024 * 1024;
+  auto fill = capacity / 100 * 95;
+  auto churn = capacity;
+  doAgedFragmentationTest(capacity, fill, churn);
+}
+
 INSTANTIATE_TEST_CASE_P(
   Allocator,
   AllocTest,
-  ::testing::Values("stupid", "bitmap"));
+  ::testing::Values("stupid", "bitmap", "avl"));
 
 #else
 
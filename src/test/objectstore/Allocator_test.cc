@@ -316,10 +316,61 @@ TEST_P(AllocTest, test_alloc_bug_24598)
   EXPECT_EQ(tmp.size(), 1);
 }
 
+TEST_P(AllocTest, test_alloc_fragmentation_score)
+{
+  uint64_t capacity = 4 * 1024 * 1024;
+  uint64_t alloc_unit = 4096;
+  PExtentVector allocated, tmp;
+
+  init_alloc(capacity, alloc_unit);
+  alloc->init_add_free(0, capacity);
+
+  uint64_t free = 0;
+  alloc->foreach([&](uint64_t offset, uint64_t length) {
+      free += length;
+    });
+  EXPECT_EQ(capacity, free);
+  EXPECT_EQ(0.0, alloc->get_fragmentation_score());
+
+  for (size_t i = 0; i < capacity / alloc_unit; ++i) {
+    tmp.clear();
+    EXPECT_EQ((int64_t)alloc_unit,
+	      alloc->allocate(alloc_unit, alloc_unit, 0, 0, &tmp));
+    allocated.insert(allocated.end(), tmp.begin(), tmp.end());
+  }
+  EXPECT_EQ(0.0, alloc->get_fragmentation_score());
+
+  // every other unit free: as bad as it gets at this alloc unit
+  for (size_t i = 0; i < allocated.size(); i += 2) {
+    interval_set<uint64_t> release_set;
+    release_set.insert(allocated[i].offset, allocated[i].length);
+    alloc->release(release_set);
+  }
+  size_t extents = 0;
+  alloc->foreach([&](uint64_t offset, uint64_t length) {
+      EXPECT_EQ(alloc_unit, length);
+      ++extents;
+    });
+  EXPECT_EQ(allocated.size() / 2, extents);
+  double shredded = alloc->get_fragmentation_score();
+  EXPECT_GT(shredded, 0.5);
+  EXPECT_LE(shredded, 1.0);
+
+  // coalescing the first half must improve the score
+  for (size_t i = 1; i < allocated.size() / 2; i += 2) {
+    interval_set<uint64_t> release_set;
+    release_set.insert(allocated[i].offset, allocated[i].length);
+    alloc->release(release_set);
+  }
+  double better = alloc->get_fragmentation_score();
+  EXPECT_LT(better, shredded);
+  EXPECT_GT(better, 0.0);
+}
+
 INSTANTIATE_TEST_CASE_P(
   Allocator,
   AllocTest,
-  ::testing::Values("stupid", "bitmap"));
+  ::testing::Values("stupid", "bitmap", "avl"));
 
 #else
 
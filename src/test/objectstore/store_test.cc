@@ -28,6 +28,9 @@
 #include "os/filestore/FileStore.h"
 #if defined(WITH_BLUESTORE)
 #include "os/bluestore/BlueStore.h"
+#if defined(HAVE_LIBAIO)
+#include "os/bluestore/ioring.h"
+#endif
 #endif
 #include "include/Context.h"
 #include "common/ceph_argparse.h"
@@ -508,6 +511,42 @@ TEST_P(StoreTest, FiemapHoles) {
   }
 }
 
+TEST_P(StoreTest, VerifyCsumTest) {
+  coll_t cid;
+  int r = 0;
+  ghobject_t oid(hobject_t(sobject_t("verify_csum_object", CEPH_NOSNAP)));
+  auto ch = store->create_new_collection(cid);
+  bufferlist bl;
+  for (unsigned i = 0; i < 300000 / 10; ++i) {
+    bl.append("0123456789");
+  }
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    t.write(cid, oid, 0, bl.length(), bl);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  r = store->verify_csum(ch, oid, 0, bl.length());
+  if (string(GetParam()) != "bluestore") {
+    ASSERT_EQ(-EOPNOTSUPP, r);
+  } else {
+    ASSERT_EQ((int)bl.length(), r);
+    ASSERT_EQ(1000, store->verify_csum(ch, oid, 4097, 1000));
+    ASSERT_EQ(100000, store->verify_csum(ch, oid, 200000, 200000));
+    ASSERT_EQ(0, store->verify_csum(ch, oid, 400000, 100));
+    ghobject_t missing(hobject_t(sobject_t("missing_object", CEPH_NOSNAP)));
+    ASSERT_EQ(-ENOENT, store->verify_csum(ch, missing, 0, 100));
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, oid);
+    t.remove_collection(cid);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
 TEST_P(StoreTest, SimpleMetaColTest) {
   coll_t cid;
   int r = 0;
@@ -5808,6 +5847,31 @@ TEST_P(StoreTestSpecificAUSize, Many4KWritesTest) {
   doMany4KWritesTest(store, 1, 1000, max_object, 4*1024, 0);
 }
 
+TEST_P(StoreTestSpecificAUSize, Many4KWritesIoRingTest) {
+  if (string(GetParam()) != "bluestore")
+    return;
+  // same workload as Many4KWritesTest, but with the io_uring backend so
+  // that the two can be compared.  KernelDevice falls back to libaio on
+  // its own if io_uring is not available; make sure it only does so then.
+  SetVal(g_conf(), "bdev_ioring", "true");
+  StartDeferred(0x10000);
+
+  map<string,string> pm;
+  store->collect_metadata(&pm);
+#if defined(HAVE_LIBAIO)
+  if (ioring_queue_t::supported()) {
+    ASSERT_EQ("io_uring", pm["bluestore_bdev_io_queue"]);
+  } else
+#endif
+  {
+    cout << "io_uring is not available, running on "
+	 << pm["bluestore_bdev_io_queue"] << std::endl;
+  }
+
+  const unsigned max_object = 4*1024*1024;
+  doMany4KWritesTest(store, 1, 1000, max_object, 4*1024, 0);
+}
+
 TEST_P(StoreTestSpecificAUSize, Many4KWritesNoCSumTest) {
   if (string(GetParam()) != "bluestore")
     return;
@@ -6832,6 +6896,381 @@ TEST_P(StoreTestSpecificAUSize, fsckOnUnalignedDevice2) {
   store->mount();
 }
 
+TEST_P(StoreTest, BluestoreAllocSnapshotTest) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  SetVal(g_conf(), "bluestore_fsck_on_mount", "false");
+  SetVal(g_conf(), "bluestore_fsck_on_umount", "false");
+  SetVal(g_conf(), "bluestore_alloc_snapshot", "true");
+  g_ceph_context->_conf.apply_changes(nullptr);
+
+  coll_t cid;
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+  }
+  // leave some holes behind so there is more than one free extent
+  bufferlist bl;
+  bl.append(std::string(0x30000, 'a'));
+  for (unsigned i = 0; i < 16; ++i) {
+    ObjectStore::Transaction t;
+    ghobject_t hoid(hobject_t(sobject_t("Object " + stringify(i),
+					CEPH_NOSNAP)));
+    t.write(cid, hoid, 0, bl.length(), bl);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+  }
+  for (unsigned i = 0; i < 16; i += 2) {
+    ObjectStore::Transaction t;
+    ghobject_t hoid(hobject_t(sobject_t("Object " + stringify(i),
+					CEPH_NOSNAP)));
+    t.remove(cid, hoid);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+  }
+  struct store_statfs_t before, after;
+  ASSERT_EQ(store->statfs(&before), 0);
+
+  // clean umount writes the snapshot, mount picks it up
+  ch.reset();
+  ASSERT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->mount(), 0);
+  ASSERT_EQ(store->statfs(&after), 0);
+  ASSERT_EQ(before.available, after.available);
+  ASSERT_EQ(before.allocated, after.allocated);
+
+  // allocations made from the loaded state must not collide with live data
+  ch = store->open_collection(cid);
+  for (unsigned i = 0; i < 16; i += 2) {
+    ObjectStore::Transaction t;
+    ghobject_t hoid(hobject_t(sobject_t("Object " + stringify(i),
+					CEPH_NOSNAP)));
+    t.write(cid, hoid, 0, bl.length(), bl);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+  }
+  ASSERT_EQ(store->statfs(&before), 0);
+  ch.reset();
+  ASSERT_EQ(store->umount(), 0);
+  // fsck consumes the snapshot, so the next mount goes to the freelist
+  ASSERT_EQ(store->fsck(false), 0);
+  ASSERT_EQ(store->mount(), 0);
+  ASSERT_EQ(store->statfs(&after), 0);
+  ASSERT_EQ(before.available, after.available);
+
+  ch = store->open_collection(cid);
+  for (unsigned i = 0; i < 16; ++i) {
+    ghobject_t hoid(hobject_t(sobject_t("Object " + stringify(i),
+					CEPH_NOSNAP)));
+    bufferlist in;
+    ASSERT_EQ(store->read(ch, hoid, 0, bl.length(), in), (int)bl.length());
+    ASSERT_TRUE(bl_eq(bl, in));
+  }
+  {
+    ObjectStore::Transaction t;
+    for (unsigned i = 0; i < 16; ++i) {
+      t.remove(cid, ghobject_t(hobject_t(sobject_t("Object " + stringify(i),
+						   CEPH_NOSNAP))));
+    }
+    t.remove_collection(cid);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+  }
+  SetVal(g_conf(), "bluestore_alloc_snapshot", "false");
+  g_ceph_context->_conf.apply_changes(nullptr);
+}
+
+TEST_P(StoreTest, BluestoreLazyExtentMapTest) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  auto ch = store->create_new_collection(cid);
+  bufferlist bl;
+  bl.append(std::string(0x4000, 'a'));
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    t.write(cid, hoid, 0, bl.length(), bl);
+    t.write(cid, hoid, 0x10000, bl.length(), bl);
+    bufferlist attr;
+    attr.append("value");
+    t.setattr(cid, hoid, "attr", attr);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+  }
+  // drop the cached onode
+  ch.reset();
+  ASSERT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->mount(), 0);
+  ch = store->open_collection(cid);
+
+  const PerfCounters* logger = store->get_perf_counters();
+  uint64_t deferred = logger->get(l_bluestore_extent_map_inline_deferred);
+  uint64_t faults = logger->get(l_bluestore_extent_map_inline_faults);
+  uint64_t decoded = logger->get(l_bluestore_extent_map_decode_extents);
+
+  // attrs alone leave the extent map encoded, even across an attr update
+  {
+    bufferptr bp;
+    ASSERT_EQ(store->getattr(ch, hoid, "attr", bp), 0);
+    ObjectStore::Transaction t;
+    bufferlist attr;
+    attr.append("other");
+    t.setattr(cid, hoid, "attr2", attr);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+  }
+  ASSERT_EQ(logger->get(l_bluestore_extent_map_inline_deferred),
+	    deferred + 1);
+  ASSERT_EQ(logger->get(l_bluestore_extent_map_inline_faults), faults);
+  ASSERT_EQ(logger->get(l_bluestore_extent_map_decode_extents), decoded);
+
+  // the first read decodes it, later ones reuse the decoded map
+  for (unsigned i = 0; i < 2; ++i) {
+    bufferlist in;
+    ASSERT_EQ(store->read(ch, hoid, 0x10000, bl.length(), in),
+	      (int)bl.length());
+    ASSERT_TRUE(bl_eq(bl, in));
+  }
+  ASSERT_EQ(logger->get(l_bluestore_extent_map_inline_faults), faults + 1);
+  ASSERT_EQ(logger->get(l_bluestore_extent_map_decode_extents), decoded + 2);
+
+  // the map written back with the attr update is intact
+  ch.reset();
+  ASSERT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->fsck(false), 0);
+  ASSERT_EQ(store->mount(), 0);
+  ch = store->open_collection(cid);
+  {
+    bufferlist in;
+    ASSERT_EQ(store->read(ch, hoid, 0, bl.length(), in), (int)bl.length());
+    ASSERT_TRUE(bl_eq(bl, in));
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove_collection(cid);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+  }
+}
+
+TEST_P(StoreTest, BluestoreInlineDataTest) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  SetVal(g_conf(), "bluestore_inline_data_max_size", "4096");
+  g_ceph_context->_conf.apply_changes(nullptr);
+
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  ghobject_t hoid2(hobject_t(sobject_t("Object 2", CEPH_NOSNAP)));
+  ghobject_t hoid3(hobject_t(sobject_t("Object 3", CEPH_NOSNAP)));
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+  }
+  struct store_statfs_t before, after;
+  ASSERT_EQ(store->statfs(&before), 0);
+
+  // small writes, overwrites and zeroing stay inline: nothing is allocated
+  bufferlist expected;
+  {
+    bufferlist bl;
+    bl.append(std::string(100, 'a'));
+    ObjectStore::Transaction t;
+    t.write(cid, hoid, 0, bl.length(), bl);
+    bufferlist bl2;
+    bl2.append(std::string(10, 'b'));
+    t.write(cid, hoid, 50, bl2.length(), bl2);
+    t.write(cid, hoid, 200, bl2.length(), bl2);
+    t.zero(cid, hoid, 0, 10);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+    expected.append_zero(10);
+    expected.append(std::string(40, 'a'));
+    expected.append(std::string(10, 'b'));
+    expected.append(std::string(40, 'a'));
+    expected.append_zero(100);
+    expected.append(std::string(10, 'b'));
+  }
+  ASSERT_EQ(store->statfs(&after), 0);
+  ASSERT_EQ(before.allocated, after.allocated);
+  ASSERT_EQ(before.stored + (int64_t)expected.length(), after.stored);
+  {
+    bufferlist in;
+    ASSERT_EQ(store->read(ch, hoid, 0, 1000, in), (int)expected.length());
+    ASSERT_TRUE(bl_eq(expected, in));
+    interval_set<uint64_t> m;
+    ASSERT_EQ(store->fiemap(ch, hoid, 0, 1000, m), 0);
+    ASSERT_EQ(m.size(), 1u);
+    ASSERT_EQ(m.range_start(), 0u);
+    ASSERT_EQ(m.range_end(), expected.length());
+  }
+
+  // sparse tail past the inline data reads as zeros; truncate trims it
+  {
+    ObjectStore::Transaction t;
+    t.truncate(cid, hoid, 8192);
+    t.truncate(cid, hoid, 150);
+    t.truncate(cid, hoid, 300);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+    bufferlist e;
+    e.substr_of(expected, 0, 150);
+    e.append_zero(150);
+    expected.swap(e);
+    bufferlist in;
+    ASSERT_EQ(store->read(ch, hoid, 0, 0, in), 300);
+    ASSERT_TRUE(bl_eq(expected, in));
+  }
+
+  // clones copy the inline data
+  {
+    ObjectStore::Transaction t;
+    t.clone(cid, hoid, hoid2);
+    t.clone_range(cid, hoid, hoid3, 100, 100, 1000);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+    bufferlist in;
+    ASSERT_EQ(store->read(ch, hoid2, 0, 0, in), 300);
+    ASSERT_TRUE(bl_eq(expected, in));
+    in.clear();
+    ASSERT_EQ(store->read(ch, hoid3, 0, 0, in), 1100);
+    bufferlist e;
+    e.append_zero(1000);
+    bufferlist tail;
+    tail.substr_of(expected, 100, 100);
+    e.append(tail);
+    ASSERT_TRUE(bl_eq(e, in));
+  }
+  ASSERT_EQ(store->statfs(&after), 0);
+  ASSERT_EQ(before.allocated, after.allocated);
+
+  // inline data survives a remount
+  ch.reset();
+  ASSERT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->mount(), 0);
+  ch = store->open_collection(cid);
+  {
+    bufferlist in;
+    ASSERT_EQ(store->read(ch, hoid, 0, 0, in), 300);
+    ASSERT_TRUE(bl_eq(expected, in));
+  }
+
+  // growing past the threshold moves everything to the block device
+  {
+    bufferlist bl;
+    bl.append(std::string(8192, 'c'));
+    ObjectStore::Transaction t;
+    t.write(cid, hoid, 4096, bl.length(), bl);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+    expected.append_zero(4096 - expected.length());
+    expected.append(bl);
+    bufferlist in;
+    ASSERT_EQ(store->read(ch, hoid, 0, 0, in), (int)expected.length());
+    ASSERT_TRUE(bl_eq(expected, in));
+  }
+  ASSERT_EQ(store->statfs(&after), 0);
+  ASSERT_GT(after.allocated, before.allocated);
+
+  // once on disk, small writes do not go back inline
+  {
+    bufferlist bl;
+    bl.append(std::string(10, 'd'));
+    ObjectStore::Transaction t;
+    t.write(cid, hoid, 0, bl.length(), bl);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+    bufferlist e;
+    e.append(bl);
+    bufferlist tail;
+    tail.substr_of(expected, 10, expected.length() - 10);
+    e.append(tail);
+    expected.swap(e);
+    bufferlist in;
+    ASSERT_EQ(store->read(ch, hoid, 0, 0, in), (int)expected.length());
+    ASSERT_TRUE(bl_eq(expected, in));
+  }
+
+  ch.reset();
+  ASSERT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->fsck(false), 0);
+  ASSERT_EQ(store->mount(), 0);
+  ch = store->open_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove(cid, hoid2);
+    t.remove(cid, hoid3);
+    t.remove_collection(cid);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+  }
+  ASSERT_EQ(store->statfs(&after), 0);
+  ASSERT_EQ(before.stored, after.stored);
+  SetVal(g_conf(), "bluestore_inline_data_max_size", "0");
+  g_ceph_context->_conf.apply_changes(nullptr);
+}
+
+TEST_P(StoreTest, BluestoreVerifyCsumDeferredTest) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  SetVal(g_conf(), "bluestore_prefer_deferred_size", "65536");
+  SetVal(g_conf(), "bluestore_deferred_batch_ops", "1000");
+  g_ceph_context->_conf.apply_changes(nullptr);
+
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  auto ch = store->create_new_collection(cid);
+  {
+    bufferlist bl;
+    bl.append(std::string(0x20000, 'a'));
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    t.write(cid, hoid, 0, bl.length(), bl);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+  }
+  ASSERT_EQ(store->verify_csum(ch, hoid, 0, 0x20000), 0x20000);
+
+  // the overwrite is deferred: until it reaches the disk the blob's old
+  // checksums no longer match what is there, so verify_csum must not
+  // report it as corrupt
+  {
+    bufferlist bl;
+    bl.append(std::string(0x1000, 'b'));
+    ObjectStore::Transaction t;
+    t.write(cid, hoid, 0x1000, bl.length(), bl);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+  }
+  int r = store->verify_csum(ch, hoid, 0, 0x20000);
+  ASSERT_TRUE(r == 0x20000 || r == -EOPNOTSUPP) << r;
+  {
+    bufferlist in;
+    ASSERT_EQ(store->read(ch, hoid, 0x1000, 0x1000, in), 0x1000);
+    ASSERT_EQ(in.to_str(), std::string(0x1000, 'b'));
+  }
+
+  // once it is applied the whole object verifies in place
+  ch.reset();
+  ASSERT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->mount(), 0);
+  ch = store->open_collection(cid);
+  ASSERT_EQ(store->verify_csum(ch, hoid, 0, 0x20000), 0x20000);
+
+  SetVal(g_conf(), "bluestore_debug_inject_csum_err_probability", "1");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  ASSERT_EQ(store->verify_csum(ch, hoid, 0, 0x20000), -EIO);
+  SetVal(g_conf(), "bluestore_debug_inject_csum_err_probability", "0");
+  g_ceph_context->_conf.apply_changes(nullptr);
+
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove_collection(cid);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+  }
+  SetVal(g_conf(), "bluestore_prefer_deferred_size", "0");
+  SetVal(g_conf(), "bluestore_deferred_batch_ops", "0");
+  g_ceph_context->_conf.apply_changes(nullptr);
+}
+
 TEST_P(StoreTest, BluestoreRepairTest) {
   if (string(GetParam()) != "bluestore")
     return;
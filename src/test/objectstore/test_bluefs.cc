@@ -567,6 +567,135 @@ TEST(BlueFS, test_replay) {
   rm_temp_bdev(fn);
 }
 
+#define WAL_FSYNC_COUNT 2000
+
+std::atomic<bool> wal_writes_done = { false };
+
+void compact_fs(BlueFS &fs)
+{
+  while (!wal_writes_done) {
+    fs.compact_log();
+  }
+}
+
+void write_wal(BlueFS &fs, vector<double> *lat)
+{
+  // a failed assert returns early; compact_fs must stop all the same
+  auto done = make_scope_guard([] { wal_writes_done = true; });
+  BlueFS::FileWriter *h;
+  ASSERT_EQ(0, fs.open_for_write("db.wal", "000001.log", &h, false));
+  auto sg = make_scope_guard([&fs, h] { fs.close_writer(h); });
+  char buf[ALLOC_SIZE];
+  for (int i = 0; i < WAL_FSYNC_COUNT; ++i) {
+    memset(buf, 'a' + i % 26, sizeof(buf));
+    h->append(buf, sizeof(buf));
+    auto start = ceph::mono_clock::now();
+    ASSERT_EQ(0, fs.fsync(h));
+    lat->push_back(
+      std::chrono::duration<double, std::micro>(
+	ceph::mono_clock::now() - start).count());
+  }
+}
+
+void verify_wal(BlueFS &fs)
+{
+  uint64_t size;
+  utime_t mtime;
+  ASSERT_EQ(0, fs.stat("db.wal", "000001.log", &size, &mtime));
+  ASSERT_EQ((uint64_t)WAL_FSYNC_COUNT * ALLOC_SIZE, size);
+  BlueFS::FileReader *h;
+  ASSERT_EQ(0, fs.open_for_read("db.wal", "000001.log", &h));
+  BlueFS::FileReaderBuffer buf(4096);
+  for (int i = 0; i < WAL_FSYNC_COUNT; ++i) {
+    bufferlist bl;
+    ASSERT_EQ(ALLOC_SIZE, fs.read(h, &buf, (uint64_t)i * ALLOC_SIZE,
+				  ALLOC_SIZE, &bl, NULL));
+    ASSERT_EQ(string(ALLOC_SIZE, 'a' + i % 26), bl.to_str());
+  }
+  delete h;
+}
+
+// WAL fsync latency while other writers churn metadata and the log is
+// compacted back to back; run with and without the dedicated wal log.
+void wal_fsync_under_compaction(bool wal_log)
+{
+  uint64_t size = 1048576 * 128;
+  string fn = get_temp_bdev(size);
+  // put the options back however we leave, so a failed assert here
+  // does not change what later tests run with
+  map<string,string> saved;
+  for (auto k : { "bluefs_alloc_size", "bluefs_compact_log_sync",
+		  "bluefs_wal_log" }) {
+    g_ceph_context->_conf.get_val(k, &saved[k]);
+  }
+  auto restore = make_scope_guard([&saved, &fn] {
+    for (auto& p : saved) {
+      g_ceph_context->_conf.set_val(p.first, p.second);
+    }
+    rm_temp_bdev(fn);
+  });
+  g_ceph_context->_conf.set_val(
+    "bluefs_alloc_size",
+    "65536");
+  g_ceph_context->_conf.set_val(
+    "bluefs_compact_log_sync",
+    "false");
+  g_ceph_context->_conf.set_val(
+    "bluefs_wal_log",
+    wal_log ? "true" : "false");
+
+  BlueFS fs(g_ceph_context);
+  ASSERT_EQ(0, fs.add_block_device(BlueFS::BDEV_DB, fn, false));
+  fs.add_block_extent(BlueFS::BDEV_DB, 1048576, size - 1048576);
+  uuid_d fsid;
+  ASSERT_EQ(0, fs.mkfs(fsid));
+  ASSERT_EQ(0, fs.mount());
+  ASSERT_EQ(0, fs.mkdir("db.wal"));
+  vector<double> lat;
+  {
+    wal_writes_done = false;
+    std::vector<std::thread> write_threads;
+    uint64_t effective_size = size - (64 * 1048576); // leave room for the wal and logs
+    uint64_t per_thread_bytes = (effective_size/(NUM_WRITERS));
+    for (int i=0; i<NUM_WRITERS; i++) {
+      write_threads.push_back(std::thread(write_data, std::ref(fs), per_thread_bytes));
+    }
+    std::thread compact_thread(compact_fs, std::ref(fs));
+    std::thread wal_thread(write_wal, std::ref(fs), &lat);
+    wal_thread.join();
+    compact_thread.join();
+    join_all(write_threads);
+  }
+  ASSERT_EQ((size_t)WAL_FSYNC_COUNT, lat.size());
+  std::sort(lat.begin(), lat.end());
+  std::cout << "wal fsync with bluefs_wal_log=" << wal_log
+	    << ": p50 " << lat[lat.size() / 2] << "us"
+	    << " p99 " << lat[lat.size() * 99 / 100] << "us"
+	    << " max " << lat.back() << "us" << std::endl;
+  verify_wal(fs);
+  fs.umount();
+
+  // replay, then switch the setting around and make sure the WAL file
+  // survives moving between the two journals
+  ASSERT_EQ(0, fs.mount());
+  verify_wal(fs);
+  fs.umount();
+  g_ceph_context->_conf.set_val(
+    "bluefs_wal_log",
+    wal_log ? "false" : "true");
+  ASSERT_EQ(0, fs.mount());
+  verify_wal(fs);
+  fs.umount();
+  ASSERT_EQ(0, fs.mount());
+  verify_wal(fs);
+  fs.umount();
+}
+
+TEST(BlueFS, test_wal_fsync_under_compaction) {
+  wal_fsync_under_compaction(false);
+  wal_fsync_under_compaction(true);
+}
+
 int main(int argc, char **argv) {
   vector<const char*> args;
   argv_to_vec(argc, (const char **)argv, args);
@@ -332,6 +332,121 @@ TEST(bluestore_blob_t, csum_bench)
   }
 }
 
+TEST(bluestore_blob_t, verify_csum_batch)
+{
+  bufferlist bl;
+  for (unsigned i = 0; i < 16; ++i) {
+    bufferptr bp(4096);
+    memset(bp.c_str(), i, bp.length());
+    bl.append(bp);
+  }
+  // a copy whose buffers do not line up with the csum chunks
+  bufferlist split;
+  split.substr_of(bl, 0, 1000);
+  bufferlist rest;
+  rest.substr_of(bl, 1000, bl.length() - 1000);
+  rest.rebuild();
+  split.claim_append(rest);
+
+  for (unsigned csum_type = Checksummer::CSUM_NONE + 1;
+       csum_type < Checksummer::CSUM_MAX;
+       ++csum_type) {
+    cout << "csum_type " << Checksummer::get_csum_type_string(csum_type)
+	 << std::endl;
+    bluestore_blob_t a, b;
+    a.init_csum(csum_type, 12, bl.length());
+    a.calc_csum(0, bl);
+    b.init_csum(csum_type, 13, bl.length());
+    b.calc_csum(0, bl);
+
+    bufferlist a_tail;
+    a_tail.substr_of(bl, 0x8000, 0x8000);
+    bufferlist bad = bl;
+    bad.rebuild();
+    bad.c_str()[0x5000] ^= 1;
+    bad.c_str()[0xa000] ^= 1;
+
+    const bluestore_blob_t *blobs[] = { &a, &a, &b, &a, &b, &a };
+    const bufferlist *bls[] = { &bl, &a_tail, &split, &split, &bad, &bad };
+    const size_t offsets[] = { 0, 0x8000, 0, 0, 0, 0 };
+    Checksummer::verify_item_t items[6];
+    for (unsigned i = 0; i < 6; ++i) {
+      items[i].offset = offsets[i];
+      items[i].bl = bls[i];
+    }
+    ASSERT_EQ(2, bluestore_blob_t::verify_csum_batch(blobs, items, 6));
+    for (unsigned i = 0; i < 6; ++i) {
+      int bad_off;
+      uint64_t bad_csum;
+      blobs[i]->verify_csum(offsets[i], *bls[i], &bad_off, &bad_csum);
+      ASSERT_EQ(bad_off, items[i].bad);
+      if (bad_off >= 0) {
+	ASSERT_EQ(bad_csum, items[i].bad_csum);
+      }
+    }
+    ASSERT_EQ(0x4000, items[4].bad);
+    ASSERT_EQ(0x5000, items[5].bad);
+  }
+}
+
+TEST(bluestore_blob_t, csum_batch_bench)
+{
+  bufferlist bl;
+  bufferptr bp(10485760);
+  for (char *a = bp.c_str(); a < bp.c_str() + bp.length(); ++a)
+    *a = (unsigned long)a & 0xff;
+  bl.append(bp);
+  int count = 64;
+  for (unsigned order : {12, 16}) {
+    for (unsigned csum_type = Checksummer::CSUM_NONE + 1;
+	 csum_type < Checksummer::CSUM_MAX;
+	 ++csum_type) {
+      bluestore_blob_t b;
+      b.init_csum(csum_type, order, bl.length());
+      b.calc_csum(0, bl);
+
+      // one verify_csum() per 64K read, as _do_read used to do
+      vector<bufferlist> reads(bl.length() / 0x10000);
+      for (unsigned i = 0; i < reads.size(); ++i) {
+	reads[i].substr_of(bl, i * 0x10000, 0x10000);
+      }
+      int bad_off;
+      uint64_t bad_csum;
+      auto start = ceph::mono_clock::now();
+      for (int i = 0; i < count; ++i) {
+	for (unsigned j = 0; j < reads.size(); ++j) {
+	  ASSERT_EQ(0, b.verify_csum(j * 0x10000, reads[j], &bad_off,
+				     &bad_csum));
+	}
+      }
+      auto serial = ceph::mono_clock::now() - start;
+
+      vector<const bluestore_blob_t*> blobs(reads.size(), &b);
+      vector<Checksummer::verify_item_t> items(reads.size());
+      start = ceph::mono_clock::now();
+      for (int i = 0; i < count; ++i) {
+	for (unsigned j = 0; j < reads.size(); ++j) {
+	  items[j].offset = j * 0x10000;
+	  items[j].bl = &reads[j];
+	}
+	ASSERT_EQ(0, bluestore_blob_t::verify_csum_batch(
+		    blobs.data(), items.data(), items.size()));
+      }
+      auto batched = ceph::mono_clock::now() - start;
+
+      auto mbsec = [&](ceph::timespan dur) {
+	return (double)count * (double)bl.length() / 1000000.0 /
+	  (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+	    dur).count() * 1000000000.0;
+      };
+      cout << "csum_type " << Checksummer::get_csum_type_string(csum_type)
+	   << ", chunk 0x" << std::hex << (1u << order) << std::dec
+	   << ": per-chunk " << mbsec(serial) << " MB/sec"
+	   << ", batched " << mbsec(batched) << " MB/sec" << std::endl;
+    }
+  }
+}
+
 TEST(Blob, put_ref)
 {
   {
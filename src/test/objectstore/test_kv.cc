@@ -18,12 +18,14 @@
 #include <time.h>
 #include <sys/mount.h>
 #include "kv/KeyValueDB.h"
+#include "kv/RocksDBStore.h"
 #include "include/Context.h"
 #include "common/ceph_argparse.h"
 #include "global/global_init.h"
 #include "common/Mutex.h"
 #include "common/Cond.h"
 #include "common/errno.h"
+#include "include/scope_guard.h"
 #include "include/stringify.h"
 #include <gtest/gtest.h>
 
@@ -467,6 +469,142 @@ TEST_P(KVTest, RocksDBCFMerge) {
   fini();
 }
 
+TEST_P(KVTest, RocksDBMigrateToCF) {
+  if(string(GetParam()) != "rocksdb")
+    return;
+
+  shared_ptr<KeyValueDB::MergeOperator> p(new AppendMOP);
+  ASSERT_EQ(0, db->set_merge_operator("cf1", p));
+  ASSERT_EQ(0, db->init(g_conf()->bluestore_rocksdb_options));
+  cout << "creating a db without column families" << std::endl;
+  ASSERT_EQ(0, db->create_and_open(cout));
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    bufferlist v;
+    v.append(string("1"));
+    for (unsigned i = 0; i < 3000; ++i) {
+      t->set("cf1", stringify(i), v);
+    }
+    t->set("cf0", "key", v);
+    t->set("cf2", "key", v);
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+
+  std::vector<KeyValueDB::ColumnFamily> cfs;
+  cfs.push_back(KeyValueDB::ColumnFamily("cf1", ""));
+  cout << "moving cf1 into its own column family" << std::endl;
+  ASSERT_EQ(0, db->migrate_prefixes_to_cfs(cfs, cout));
+  // running it again finds nothing left to move
+  ASSERT_EQ(0, db->migrate_prefixes_to_cfs(cfs, cout));
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    bufferlist v;
+    v.append(string("2"));
+    t->merge("cf1", "0", v);
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  fini();
+
+  init();
+  ASSERT_EQ(0, db->set_merge_operator("cf1", p));
+  ASSERT_EQ(0, db->init(g_conf()->bluestore_rocksdb_options));
+  ASSERT_EQ(0, db->open(cout, cfs));
+  ASSERT_TRUE(db->is_column_family("cf1"));
+  {
+    bufferlist v;
+    ASSERT_EQ(0, db->get("cf1", "0", &v));
+    ASSERT_EQ(tostr(v), "12");
+    v.clear();
+    ASSERT_EQ(0, db->get("cf1", "2999", &v));
+    ASSERT_EQ(tostr(v), "1");
+    v.clear();
+    ASSERT_EQ(0, db->get("cf0", "key", &v));
+    v.clear();
+    ASSERT_EQ(0, db->get("cf2", "key", &v));
+  }
+  unsigned n = 0;
+  KeyValueDB::Iterator it = db->get_iterator("cf1");
+  for (it->seek_to_first(); it->valid(); it->next()) {
+    ++n;
+  }
+  ASSERT_EQ(n, 3000u);
+  it.reset();
+  fini();
+}
+
+TEST_P(KVTest, RocksDBTombstoneCompaction) {
+  if(string(GetParam()) != "rocksdb")
+    return;
+
+  g_ceph_context->_conf.set_val("rocksdb_tombstone_compact_deletes", "0");
+  g_ceph_context->_conf.set_val("rocksdb_tombstone_compact_skips", "1000");
+  g_ceph_context->_conf.set_val("rocksdb_tombstone_compact_interval", "0");
+  // a failed assert must not leave these set for later tests
+  auto restore = make_scope_guard([] {
+    g_ceph_context->_conf.rm_val("rocksdb_tombstone_compact_deletes");
+    g_ceph_context->_conf.rm_val("rocksdb_tombstone_compact_skips");
+    g_ceph_context->_conf.rm_val("rocksdb_tombstone_compact_interval");
+  });
+  fini();
+  init();
+  ASSERT_EQ(0, db->init(g_conf()->bluestore_rocksdb_options));
+  ASSERT_EQ(0, db->create_and_open(cout));
+
+  const unsigned num = 20000;
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    bufferlist v;
+    v.append(string(100, 'v'));
+    for (unsigned i = 0; i < num; ++i) {
+      t->set("T", stringify(1000000 + i), v);
+    }
+    t->set("U", "last", v);
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (unsigned i = 0; i < num; ++i) {
+      t->rmkey("T", stringify(1000000 + i));
+    }
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+
+  PerfCounters *logger = db->get_perf_counters();
+  auto scan = [&]() {
+    auto start = ceph::mono_clock::now();
+    uint64_t skips = logger->get(l_rocksdb_iter_tombstone_skips);
+    KeyValueDB::Iterator it = db->get_iterator("T");
+    unsigned n = 0;
+    for (it->seek_to_first(); it->valid(); it->next()) {
+      ++n;
+    }
+    EXPECT_EQ(0u, n);
+    it.reset();
+    cout << "  scan took " << (ceph::mono_clock::now() - start) << std::endl;
+    return logger->get(l_rocksdb_iter_tombstone_skips) - skips;
+  };
+
+  cout << "scanning a prefix full of tombstones" << std::endl;
+  ASSERT_GE(scan(), num);
+
+  // the scan queued a compaction of the range; once it ran nothing is
+  // left to skip
+  uint64_t skipped = 0;
+  for (unsigned i = 0; i < 100; ++i) {
+    if (logger->get(l_rocksdb_tombstone_compact) > 0 &&
+	logger->get(l_rocksdb_compact_queue_len) == 0) {
+      skipped = scan();
+      if (skipped == 0) {
+	break;
+      }
+    }
+    usleep(100000);
+  }
+  ASSERT_LT(0u, logger->get(l_rocksdb_tombstone_compact));
+  ASSERT_EQ(0u, skipped);
+  fini();
+}
+
 INSTANTIATE_TEST_CASE_P(
   KeyValueDB,
   KVTest,
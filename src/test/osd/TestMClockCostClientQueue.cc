@@ -0,0 +1,150 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+
+#include <iostream>
+
+#include "gtest/gtest.h"
+#include "global/global_init.h"
+#include "common/common_init.h"
+
+#include "osd/mClockCostClientQueue.h"
+
+
+int main(int argc, char **argv) {
+  std::vector<const char*> args(argv, argv+argc);
+  auto cct = global_init(nullptr, args, CEPH_ENTITY_TYPE_OSD,
+			 CODE_ENVIRONMENT_UTILITY,
+			 CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+
+using ceph::mclock::cost_class_t;
+
+class MClockCostClientQueueTest : public testing::Test {
+public:
+  ceph::mclock::OpCostModel model;
+  mClockCostClientQueue q;
+
+  uint64_t client1;
+  uint64_t client2;
+  uint64_t client3;
+
+  MClockCostClientQueueTest() :
+    q(g_ceph_context, model, 1),
+    client1(1001),
+    client2(9999),
+    client3(100000001)
+  {
+    model.set_capacity(1000, 100 << 20);
+  }
+
+  Request create_snaptrim(epoch_t e, uint64_t owner) {
+    return Request(OpQueueItem(unique_ptr<OpQueueItem::OpQueueable>(new PGSnapTrim(spg_t(), e)),
+			       12, 12,
+			       utime_t(), owner, e));
+  }
+
+  Request create_recovery(epoch_t e, uint64_t owner) {
+    return Request(OpQueueItem(unique_ptr<OpQueueItem::OpQueueable>(new PGRecovery(spg_t(), e, 64)),
+			       12, 12,
+			       utime_t(), owner, e));
+  }
+
+  unsigned best_effort() const {
+    return q.get_active_clients(cost_class_t::best_effort);
+  }
+  unsigned recovery() const {
+    return q.get_active_clients(cost_class_t::recovery);
+  }
+};
+
+
+TEST_F(MClockCostClientQueueTest, TestActiveClients) {
+  ASSERT_EQ(0u, best_effort());
+  ASSERT_EQ(0u, recovery());
+
+  q.enqueue(client1, 12, 0, create_snaptrim(100, client1));
+  q.enqueue(client1, 12, 0, create_snaptrim(101, client1));
+  q.enqueue(client2, 12, 0, create_snaptrim(102, client2));
+  q.enqueue(client2, 12, 0, create_recovery(103, client2));
+  ASSERT_EQ(2u, best_effort());
+  ASSERT_EQ(1u, recovery());
+
+  for (int i = 0; i < 4; ++i) {
+    (void) q.dequeue();
+  }
+  ASSERT_TRUE(q.empty());
+  ASSERT_EQ(0u, best_effort());
+  ASSERT_EQ(0u, recovery());
+}
+
+
+TEST_F(MClockCostClientQueueTest, TestRequeue) {
+  q.enqueue(client1, 12, 0, create_snaptrim(100, client1));
+  q.enqueue(client2, 12, 0, create_recovery(101, client2));
+  q.enqueue_strict(client3, 12, create_snaptrim(102, client3));
+
+  std::list<Request> reqs;
+  for (int i = 0; i < 3; ++i) {
+    reqs.push_back(q.dequeue());
+  }
+  ASSERT_EQ(0u, best_effort());
+  ASSERT_EQ(0u, recovery());
+
+  // put them back the ways the op shards do
+  for (auto& r : reqs) {
+    uint64_t owner = r.get_owner();
+    if (owner == client1) {
+      q.enqueue_front(owner, 12, 0, std::move(r));
+    } else if (owner == client2) {
+      q.enqueue_strict_front(owner, 12, std::move(r));
+    } else {
+      q.enqueue_strict(owner, 12, std::move(r));
+    }
+  }
+  reqs.clear();
+  ASSERT_EQ(2u, best_effort());
+  ASSERT_EQ(1u, recovery());
+
+  for (int i = 0; i < 3; ++i) {
+    (void) q.dequeue();
+  }
+  ASSERT_TRUE(q.empty());
+  ASSERT_EQ(0u, best_effort());
+  ASSERT_EQ(0u, recovery());
+}
+
+
+TEST_F(MClockCostClientQueueTest, TestRemoveByClass) {
+  q.enqueue(client1, 12, 0, create_snaptrim(100, client1));
+  q.enqueue_strict(client2, 12, create_snaptrim(101, client2));
+  q.enqueue(client2, 12, 0, create_snaptrim(102, client2));
+  q.enqueue(client2, 12, 0, create_recovery(103, client2));
+  q.enqueue_front(client2, 12, 0, create_recovery(104, client2));
+  q.enqueue_strict(client3, 12, create_recovery(105, client3));
+  ASSERT_EQ(2u, best_effort());
+  ASSERT_EQ(2u, recovery());
+
+  std::list<Request> filtered_out;
+  q.remove_by_class(client2, &filtered_out);
+  ASSERT_EQ(4u, filtered_out.size());
+  ASSERT_EQ(1u, best_effort());
+  ASSERT_EQ(1u, recovery());
+
+  // nothing of client2 left to remove
+  q.remove_by_class(client2, &filtered_out);
+  ASSERT_EQ(4u, filtered_out.size());
+  ASSERT_EQ(1u, best_effort());
+  ASSERT_EQ(1u, recovery());
+
+  Request r = q.dequeue();
+  ASSERT_EQ(105u, r.get_map_epoch());
+  ASSERT_EQ(0u, recovery());
+  r = q.dequeue();
+  ASSERT_EQ(100u, r.get_map_epoch());
+  ASSERT_EQ(0u, best_effort());
+  ASSERT_TRUE(q.empty());
+}
@@ -318,6 +318,43 @@ TEST_F(OSDMapTest, PGTempRespected) {
   EXPECT_EQ(new_acting_osds, acting_osds);
 }
 
+TEST_F(OSDMapTest, SameOsdStates) {
+  set_up_map();
+
+  pg_t rawpg(0, my_rep_pool);
+  pg_t pgid = osdmap.raw_pg_to_pg(rawpg);
+  vector<int> up_osds, acting_osds;
+  int up_primary, acting_primary;
+  osdmap.pg_to_up_acting_osds(pgid, &up_osds, &up_primary,
+                              &acting_osds, &acting_primary);
+
+  // pg_temp and up_thru changes leave the osds as they were
+  OSDMap prev;
+  prev.deepish_copy_from(osdmap);
+  OSDMap::Incremental quiet_inc(osdmap.get_epoch() + 1);
+  quiet_inc.new_pg_temp[pgid] = mempool::osdmap::vector<int>(
+    acting_osds.rbegin(), acting_osds.rend());
+  quiet_inc.new_up_thru[acting_osds[0]] = quiet_inc.epoch;
+  osdmap.apply_incremental(quiet_inc);
+  ASSERT_TRUE(osdmap.same_osd_states(prev));
+  ASSERT_TRUE(prev.same_osd_states(osdmap));
+
+  // an osd going down does not
+  prev.deepish_copy_from(osdmap);
+  OSDMap::Incremental down_inc(osdmap.get_epoch() + 1);
+  down_inc.new_state[0] = CEPH_OSD_UP;
+  osdmap.apply_incremental(down_inc);
+  ASSERT_FALSE(osdmap.is_up(0));
+  ASSERT_FALSE(osdmap.same_osd_states(prev));
+
+  // nor does a flag change
+  prev.deepish_copy_from(osdmap);
+  OSDMap::Incremental flags_inc(osdmap.get_epoch() + 1);
+  flags_inc.new_flags = osdmap.get_flags() | CEPH_OSDMAP_NOOUT;
+  osdmap.apply_incremental(flags_inc);
+  ASSERT_FALSE(osdmap.same_osd_states(prev));
+}
+
 TEST_F(OSDMapTest, PrimaryTempRespected) {
   set_up_map();
 
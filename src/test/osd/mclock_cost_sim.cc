@@ -0,0 +1,212 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Simulates one op shard scheduling a mix of client, recovery and
+ * background work with the mclock_cost queue, on a device that serves
+ * one op at a time and takes 1/iops + bytes/bandwidth seconds per op.
+ *
+ * Every flow is closed loop: it keeps [depth] ops queued and issues a
+ * new one as soon as one completes.  Each run is done twice: charging
+ * ops what the cost model says they cost ("cost"), and charging every
+ * op 1 ("flat"), which is how the dmclock based queues treat them.
+ * Reports each flow's throughput and latency, in simulated time.
+ */
+
+#include <stdlib.h>
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "common/mClockCostQueue.h"
+#include "osd/mClockCostModel.h"
+
+using namespace std;
+using ceph::mclock::cost_class_t;
+
+struct Flow {
+  string name;
+  uint64_t owner;
+  cost_class_t klass;
+  uint64_t bytes;
+  unsigned depth;
+
+  uint64_t done = 0;
+  vector<double> latencies;
+};
+
+struct Op {
+  unsigned flow;
+  double issued;
+};
+
+using Key = pair<uint64_t,cost_class_t>;
+using Queue = ceph::mClockCostQueue<Op,Key>;
+
+struct Config {
+  double iops = 20000;
+  double bandwidth = 500 << 20;
+  double duration = 10;
+  string profile = "high_client_ops";
+  unsigned clients = 4;
+  unsigned client_depth = 16;
+  uint64_t client_bytes = 4 << 10;
+  unsigned recovery_depth = 3;
+  uint64_t recovery_bytes = 4 << 20;
+  unsigned scrub_depth = 1;
+  uint64_t scrub_bytes = 512 << 10;
+};
+
+static void run(const Config& c, const ceph::mclock::CostProfile& profile,
+		bool flat)
+{
+  vector<Flow> flows;
+  for (unsigned i = 0; i < c.clients; ++i) {
+    flows.push_back(Flow{"client." + to_string(i), 1000 + i,
+	  cost_class_t::client, c.client_bytes, c.client_depth});
+  }
+  if (c.recovery_depth) {
+    flows.push_back(Flow{"recovery", 0, cost_class_t::recovery,
+	  c.recovery_bytes, c.recovery_depth});
+  }
+  if (c.scrub_depth) {
+    flows.push_back(Flow{"scrub", 0, cost_class_t::best_effort,
+	  c.scrub_bytes, c.scrub_depth});
+  }
+
+  ceph::mclock::OpCostModel model;
+  model.set_capacity(c.iops, c.bandwidth);
+
+  // flows never go idle, so each is an active client throughout
+  ceph::mclock::CostClientInfoMgr infos(profile);
+  infos.set_capacity(c.iops);
+  for (auto& f : flows) {
+    infos.add_client(f.klass);
+  }
+
+  double now = 0.0;
+  Queue q([&infos](const Key& k) { return infos.get_client_info(k.second); },
+	  [&now]() { return now; });
+
+  auto issue = [&](unsigned i) {
+    Flow& f = flows[i];
+    q.enqueue_cost(Key(f.owner, f.klass),
+		   flat ? 1.0 : model.cost(f.bytes),
+		   Op{i, now});
+  };
+  for (unsigned i = 0; i < flows.size(); ++i) {
+    for (unsigned j = 0; j < flows[i].depth; ++j) {
+      issue(i);
+    }
+  }
+
+  while (now < c.duration) {
+    Op op = q.dequeue();
+    Flow& f = flows[op.flow];
+    now += 1.0 / c.iops + f.bytes / c.bandwidth;
+    ++f.done;
+    f.latencies.push_back(now - op.issued);
+    issue(op.flow);
+  }
+
+  cout << (flat ? "flat" : "cost") << " costs:" << std::endl;
+  cout << "  " << left << setw(12) << "flow"
+       << right << setw(10) << "ops/s" << setw(10) << "MB/s"
+       << setw(8) << "time%"
+       << setw(12) << "mean ms" << setw(12) << "p99 ms" << std::endl;
+  for (auto& f : flows) {
+    double busy = f.done * (1.0 / c.iops + f.bytes / c.bandwidth);
+    sort(f.latencies.begin(), f.latencies.end());
+    double mean = 0;
+    for (auto l : f.latencies) {
+      mean += l;
+    }
+    mean = f.latencies.empty() ? 0 : mean / f.latencies.size();
+    double p99 = f.latencies.empty() ? 0 :
+      f.latencies[f.latencies.size() * 99 / 100];
+    cout << "  " << left << setw(12) << f.name << right << fixed
+	 << setprecision(0) << setw(10) << f.done / now
+	 << setprecision(1) << setw(10) << f.done * f.bytes / now / 1000000
+	 << setw(8) << 100 * busy / now
+	 << setprecision(2) << setw(12) << mean * 1000
+	 << setw(12) << p99 * 1000 << std::endl;
+  }
+}
+
+static void usage(const char *name)
+{
+  cerr << "usage: " << name << " [options]\n"
+       << "  --iops N             device small random IOPS (20000)\n"
+       << "  --bandwidth N        device bytes/sec (500 MiB)\n"
+       << "  --duration S         simulated seconds (10)\n"
+       << "  --profile P          high_client_ops, balanced or high_recovery_ops\n"
+       << "  --clients N          number of clients (4)\n"
+       << "  --client-depth N     ops each client keeps queued (16)\n"
+       << "  --client-bytes N     bytes per client op (4096)\n"
+       << "  --recovery-depth N   recovery ops kept queued, 0 for none (3)\n"
+       << "  --recovery-bytes N   bytes per recovery op (4 MiB)\n"
+       << "  --scrub-depth N      scrub ops kept queued, 0 for none (1)\n"
+       << "  --scrub-bytes N      bytes per scrub op (512 KiB)\n";
+}
+
+int main(int argc, char **argv)
+{
+  Config c;
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    if (i + 1 >= argc) {
+      usage(argv[0]);
+      return 1;
+    }
+    const char *val = argv[++i];
+    if (arg == "--iops") {
+      c.iops = atof(val);
+    } else if (arg == "--bandwidth") {
+      c.bandwidth = atof(val);
+    } else if (arg == "--duration") {
+      c.duration = atof(val);
+    } else if (arg == "--profile") {
+      c.profile = val;
+    } else if (arg == "--clients") {
+      c.clients = atoi(val);
+    } else if (arg == "--client-depth") {
+      c.client_depth = atoi(val);
+    } else if (arg == "--client-bytes") {
+      c.client_bytes = atoll(val);
+    } else if (arg == "--recovery-depth") {
+      c.recovery_depth = atoi(val);
+    } else if (arg == "--recovery-bytes") {
+      c.recovery_bytes = atoll(val);
+    } else if (arg == "--scrub-depth") {
+      c.scrub_depth = atoi(val);
+    } else if (arg == "--scrub-bytes") {
+      c.scrub_bytes = atoll(val);
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  auto profile = ceph::mclock::get_cost_profile(c.profile);
+  if (!profile || c.iops <= 0 || c.bandwidth <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  cout << "device " << c.iops << " IOPS, " << c.bandwidth / 1000000
+       << " MB/s; profile " << profile->name << std::endl;
+  run(c, *profile, false);
+  run(c, *profile, true);
+  return 0;
+}
@@ -0,0 +1,299 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Replays the maps an osd sees while a host reboots, and reports how
+ * many of them its pgs have to step through one at a time.
+ *
+ * The host's osds go down, the monitor publishes a run of pg_temp and
+ * up_thru epochs while the survivors peer, the osds come back and
+ * another run follows.  For every pg on the observing osd, an epoch is
+ * "delivered" if advance_pg has to hand it to the state machine and
+ * "skipped" if osd_pg_advance_skip_quiet_maps lets the pg step over it:
+ * the osds are as they were, the pool is unchanged and so is the pg's
+ * mapping.  Also times the per-epoch mapping work done serially and
+ * split across [threads], as the op shards do it.
+ */
+
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/ceph_argparse.h"
+#include "common/common_init.h"
+#include "global/global_context.h"
+#include "global/global_init.h"
+#include "osd/OSDMap.h"
+
+using namespace std;
+
+struct Config {
+  int osds = 60;
+  int down = 6;
+  unsigned pgs = 4096;
+  unsigned churn = 30;
+  unsigned threads = 8;
+};
+
+typedef std::shared_ptr<const OSDMap> MapRef;
+
+static void mark_up(OSDMap::Incremental& inc, int o)
+{
+  entity_addrvec_t addrs;
+  addrs.v.push_back(entity_addr_t());
+  addrs.v[0].nonce = o;
+  inc.new_up_client[o] = addrs;
+  inc.new_up_cluster[o] = addrs;
+  inc.new_hb_back_up[o] = addrs;
+  inc.new_hb_front_up[o] = addrs;
+}
+
+static MapRef next_map(MapRef prev, OSDMap::Incremental& inc)
+{
+  auto m = std::make_shared<OSDMap>();
+  m->deepish_copy_from(*prev);
+  inc.fsid = m->get_fsid();
+  m->apply_incremental(inc);
+  return m;
+}
+
+// a run of epochs that only move pg_temp and up_thru around
+static void churn(const Config& c, vector<MapRef>& maps, int64_t pool)
+{
+  for (unsigned i = 0; i < c.churn; ++i) {
+    MapRef prev = maps.back();
+    OSDMap::Incremental inc(prev->get_epoch() + 1);
+    for (unsigned j = 0; j < 8; ++j) {
+      pg_t pgid(rand() % c.pgs, pool);
+      vector<int> up, acting;
+      int up_primary, acting_primary;
+      prev->pg_to_up_acting_osds(pgid, &up, &up_primary,
+				 &acting, &acting_primary);
+      if (acting.size() > 1) {
+	std::swap(acting[0], acting[1]);
+	inc.new_pg_temp[pgid] = mempool::osdmap::vector<int>(
+	  acting.begin(), acting.end());
+      }
+    }
+    int o = rand() % c.osds;
+    if (prev->is_up(o)) {
+      inc.new_up_thru[o] = inc.epoch;
+    }
+    maps.push_back(next_map(prev, inc));
+  }
+}
+
+static vector<MapRef> make_maps(const Config& c, int64_t *pool)
+{
+  auto m = std::make_shared<OSDMap>();
+  uuid_d fsid;
+  m->build_simple(g_ceph_context, 0, fsid, c.osds);
+  OSDMap::Incremental inc(m->get_epoch() + 1);
+  inc.fsid = m->get_fsid();
+  for (int o = 0; o < c.osds; ++o) {
+    inc.new_state[o] = CEPH_OSD_EXISTS | CEPH_OSD_NEW;
+    inc.new_weight[o] = CEPH_OSD_IN;
+    mark_up(inc, o);
+  }
+  m->apply_incremental(inc);
+
+  OSDMap::Incremental pool_inc(m->get_epoch() + 1);
+  pool_inc.fsid = m->get_fsid();
+  pool_inc.new_pool_max = m->get_pool_max();
+  *pool = ++pool_inc.new_pool_max;
+  pg_pool_t empty;
+  pg_pool_t *p = pool_inc.get_new_pool(*pool, &empty);
+  p->size = 3;
+  p->min_size = 2;
+  p->set_pg_num(c.pgs);
+  p->set_pgp_num(c.pgs);
+  p->type = pg_pool_t::TYPE_REPLICATED;
+  p->crush_rule = 0;
+  p->set_flag(pg_pool_t::FLAG_HASHPSPOOL);
+  pool_inc.new_pool_names[*pool] = "bench";
+  m->apply_incremental(pool_inc);
+
+  vector<MapRef> maps;
+  maps.push_back(m);
+
+  // the host goes down ...
+  OSDMap::Incremental down_inc(m->get_epoch() + 1);
+  for (int o = 0; o < c.down; ++o) {
+    down_inc.new_state[o] = CEPH_OSD_UP;
+  }
+  maps.push_back(next_map(maps.back(), down_inc));
+  churn(c, maps, *pool);
+
+  // ... and comes back
+  OSDMap::Incremental up_inc(maps.back()->get_epoch() + 1);
+  for (int o = 0; o < c.down; ++o) {
+    mark_up(up_inc, o);
+  }
+  maps.push_back(next_map(maps.back(), up_inc));
+  churn(c, maps, *pool);
+  return maps;
+}
+
+struct Mapping {
+  vector<int> up, acting;
+  int up_primary, acting_primary;
+
+  void calc(const OSDMap& m, pg_t pgid) {
+    m.pg_to_up_acting_osds(pgid, &up, &up_primary, &acting, &acting_primary);
+  }
+  bool operator==(const Mapping& o) const {
+    return up == o.up && acting == o.acting &&
+      up_primary == o.up_primary && acting_primary == o.acting_primary;
+  }
+};
+
+// map every pg in [begin, end) in every epoch
+static void map_pgs(const vector<MapRef>& maps, int64_t pool,
+		    unsigned begin, unsigned end,
+		    vector<vector<Mapping>> *out)
+{
+  for (unsigned e = 0; e < maps.size(); ++e) {
+    for (unsigned ps = begin; ps < end; ++ps) {
+      (*out)[e][ps].calc(*maps[e], pg_t(ps, pool));
+    }
+  }
+}
+
+static double time_mapping(const Config& c, const vector<MapRef>& maps,
+			   int64_t pool, unsigned threads,
+			   vector<vector<Mapping>> *out)
+{
+  out->assign(maps.size(), vector<Mapping>(c.pgs));
+  auto start = chrono::steady_clock::now();
+  vector<std::thread> workers;
+  unsigned per = (c.pgs + threads - 1) / threads;
+  for (unsigned t = 0; t < threads; ++t) {
+    unsigned begin = std::min(c.pgs, t * per);
+    unsigned end = std::min(c.pgs, begin + per);
+    workers.emplace_back(map_pgs, std::cref(maps), pool, begin, end, out);
+  }
+  for (auto& w : workers) {
+    w.join();
+  }
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+  return elapsed.count() * 1000;
+}
+
+static void usage(const char *name)
+{
+  cerr << "usage: " << name << " [options]\n"
+       << "  --osds N      osds in the cluster (60)\n"
+       << "  --down N      osds on the rebooting host (6)\n"
+       << "  --pgs N       pgs in the pool (4096)\n"
+       << "  --churn N     quiet epochs after each osd change (30)\n"
+       << "  --threads N   shards the mapping is split across (8)\n";
+}
+
+int main(int argc, char **argv)
+{
+  Config c;
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+  auto cct = global_init(nullptr, args, CEPH_ENTITY_TYPE_CLIENT,
+			 CODE_ENVIRONMENT_UTILITY,
+			 CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+  common_init_finish(g_ceph_context);
+  // the map is flat, so spread replicas across osds rather than hosts
+  g_ceph_context->_conf.set_val("osd_crush_chooseleaf_type", "0");
+
+  for (unsigned i = 0; i < args.size(); ++i) {
+    string arg = args[i];
+    if (i + 1 >= args.size()) {
+      usage(argv[0]);
+      return 1;
+    }
+    int val = atoi(args[++i]);
+    if (val <= 0) {
+      usage(argv[0]);
+      return 1;
+    }
+    if (arg == "--osds") {
+      c.osds = val;
+    } else if (arg == "--down") {
+      c.down = val;
+    } else if (arg == "--pgs") {
+      c.pgs = val;
+    } else if (arg == "--churn") {
+      c.churn = val;
+    } else if (arg == "--threads") {
+      c.threads = val;
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (c.down >= c.osds) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  srand(0);
+  int64_t pool;
+  auto maps = make_maps(c, &pool);
+
+  vector<vector<Mapping>> mappings;
+  double serial_ms = time_mapping(c, maps, pool, 1, &mappings);
+  double sharded_ms = time_mapping(c, maps, pool, c.threads, &mappings);
+
+  // the observer stays up throughout, and so holds its pgs from the
+  // first map on
+  int whoami = c.osds - 1;
+  uint64_t pgs = 0, delivered = 0, skipped = 0;
+  for (unsigned ps = 0; ps < c.pgs; ++ps) {
+    const Mapping& first = mappings[0][ps];
+    if (std::find(first.acting.begin(), first.acting.end(), whoami) ==
+	first.acting.end()) {
+      continue;
+    }
+    ++pgs;
+    for (unsigned e = 1; e < maps.size(); ++e) {
+      const OSDMap& lastmap = *maps[e - 1];
+      const OSDMap& nextmap = *maps[e];
+      // the newest map is always delivered
+      if (e + 1 < maps.size() &&
+	  nextmap.same_osd_states(lastmap) &&
+	  nextmap.get_pg_pool(pool)->get_last_change() ==
+	    lastmap.get_pg_pool(pool)->get_last_change() &&
+	  mappings[e][ps] == mappings[e - 1][ps]) {
+	++skipped;
+      } else {
+	++delivered;
+      }
+    }
+  }
+
+  cout << maps.size() - 1 << " epochs, " << pgs << " pgs on osd."
+       << whoami << std::endl;
+  cout << "  " << left << setw(12) << "advance" << right
+       << setw(14) << "epochs/pg" << setw(16) << "pg epochs" << std::endl;
+  cout << "  " << left << setw(12) << "every map" << right << fixed
+       << setprecision(1) << setw(14) << (double)(delivered + skipped) / pgs
+       << setw(16) << delivered + skipped << std::endl;
+  cout << "  " << left << setw(12) << "skip quiet" << right
+       << setw(14) << (double)delivered / pgs
+       << setw(16) << delivered << std::endl;
+  cout << "mapping all pgs in every epoch: " << setprecision(3)
+       << serial_ms << " ms serial, " << sharded_ms << " ms across "
+       << c.threads << " shards" << std::endl;
+  return 0;
+}
@@ -0,0 +1,160 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Compares the legacy and compact on-disk pg log encodings.
+ *
+ * Builds a log of entries like the ones small client writes leave
+ * behind, then reports, for each encoding, the omap bytes each client
+ * op costs (its log entry, plus the dup it turns into once trimmed),
+ * and the time to decode the whole log the way peering reads it back.
+ */
+
+#include <stdlib.h>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "osd/osd_types.h"
+
+using namespace std;
+
+struct Config {
+  unsigned entries = 3000;
+  unsigned objects = 1000;
+  unsigned clients = 16;
+  unsigned rounds = 20;
+};
+
+static vector<pg_log_entry_t> make_log(const Config& c)
+{
+  vector<pg_log_entry_t> log;
+  eversion_t prior;
+  for (unsigned i = 0; i < c.entries; ++i) {
+    char name[64];
+    snprintf(name, sizeof(name), "rbd_data.10226b8b4567.%016x",
+	     (unsigned)(rand() % c.objects));
+    hobject_t oid(object_t(name), "", CEPH_NOSNAP, rand(), 2, "");
+    eversion_t v(1234, 100000 + i);
+    osd_reqid_t reqid(entity_name_t::CLIENT(4100 + rand() % c.clients),
+		      0, 1000000 + i);
+    pg_log_entry_t e(pg_log_entry_t::MODIFY, oid, v, prior, v.version,
+		     reqid, utime_t(1600000000 + i / 100, rand() % 1000000000),
+		     0);
+    e.mod_desc.append(4 << 20);
+    log.push_back(e);
+    prior = eversion_t(1234, 100000 + i - rand() % 500);
+  }
+  return log;
+}
+
+static void run(const Config& c, const vector<pg_log_entry_t>& log,
+		bool compact)
+{
+  vector<bufferlist> values, dups;
+  uint64_t bytes = 0;
+  for (auto& e : log) {
+    bufferlist bl;
+    if (compact)
+      e.encode_compact_with_checksum(bl);
+    else
+      e.encode_with_checksum(bl);
+    bytes += e.get_key_name().size() + bl.length();
+    values.push_back(bl);
+
+    pg_log_dup_t dup(e);
+    bufferlist dbl;
+    if (compact)
+      dup.encode_compact(dbl);
+    else
+      encode(dup, dbl);
+    bytes += dup.get_key_name().size() + dbl.length();
+    dups.push_back(dbl);
+  }
+
+  // take the values through a flat copy, as they come off disk
+  for (auto& v : values) {
+    bufferlist copy;
+    copy.append(v.to_str());
+    v.swap(copy);
+  }
+  auto start = chrono::steady_clock::now();
+  for (unsigned r = 0; r < c.rounds; ++r) {
+    for (auto& v : values) {
+      pg_log_entry_t e;
+      auto p = v.cbegin();
+      e.decode_with_checksum(p);
+    }
+    for (auto& v : dups) {
+      pg_log_dup_t d;
+      auto p = v.cbegin();
+      d.decode_ondisk(p);
+    }
+  }
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+  cout << "  " << left << setw(8) << (compact ? "compact" : "legacy")
+       << right << fixed << setprecision(1)
+       << setw(14) << (double)bytes / log.size()
+       << setprecision(3)
+       << setw(16) << elapsed.count() * 1000 / c.rounds
+       << std::endl;
+}
+
+static void usage(const char *name)
+{
+  cerr << "usage: " << name << " [options]\n"
+       << "  --entries N   log entries, and dups (3000)\n"
+       << "  --objects N   distinct objects written (1000)\n"
+       << "  --clients N   distinct clients writing (16)\n"
+       << "  --rounds N    times the log is decoded (20)\n";
+}
+
+int main(int argc, char **argv)
+{
+  Config c;
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    if (i + 1 >= argc) {
+      usage(argv[0]);
+      return 1;
+    }
+    int val = atoi(argv[++i]);
+    if (val <= 0) {
+      usage(argv[0]);
+      return 1;
+    }
+    if (arg == "--entries") {
+      c.entries = val;
+    } else if (arg == "--objects") {
+      c.objects = val;
+    } else if (arg == "--clients") {
+      c.clients = val;
+    } else if (arg == "--rounds") {
+      c.rounds = val;
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  srand(0);
+  auto log = make_log(c);
+  cout << c.entries << " entries and dups" << std::endl;
+  cout << "  " << left << setw(8) << "format" << right
+       << setw(14) << "bytes/op" << setw(16) << "read log ms" << std::endl;
+  run(c, log, false);
+  run(c, log, true);
+  return 0;
+}
@@ -1025,6 +1025,85 @@ TEST(pg_missing_t, split_into)
   EXPECT_TRUE(missing.is_missing(oid2));
 }
 
+TEST(pg_log_entry_t, compact_encoding)
+{
+  list<pg_log_entry_t*> entries;
+  pg_log_entry_t::generate_test_instances(entries);
+
+  hobject_t oid(object_t("rbd_data.1234.0000000000000abc"), "", CEPH_NOSNAP,
+		0x1234abcd, 3, "ns");
+  auto e = new pg_log_entry_t(
+    pg_log_entry_t::LOST_REVERT, oid, eversion_t(42, 1000),
+    eversion_t(40, 980), 1000, osd_reqid_t(entity_name_t::CLIENT(4123), 0, 77),
+    utime_t(1600000000, 123456789), 0);
+  e->reverting_to = eversion_t(30, 5);
+  e->mod_desc.append(4096);
+  e->extra_reqids.push_back(
+    make_pair(osd_reqid_t(entity_name_t::CLIENT(4123), 0, 70), 990));
+  e->extra_reqids.push_back(
+    make_pair(osd_reqid_t(entity_name_t::OSD(5), 1, 3), 991));
+  entries.push_back(e);
+  e = new pg_log_entry_t(*e);
+  e->op = pg_log_entry_t::CLONE;
+  e->soid.snap = 17;
+  vector<snapid_t> snaps = {17, 12};
+  encode(snaps, e->snaps);
+  entries.push_back(e);
+
+  for (auto i : entries) {
+    bufferlist legacy, compact;
+    i->encode_with_checksum(legacy);
+    i->encode_compact_with_checksum(compact);
+    if (i->soid != hobject_t()) {
+      EXPECT_LT(compact.length(), legacy.length() / 2);
+    }
+
+    pg_log_entry_t a, b;
+    auto p = legacy.cbegin();
+    a.decode_with_checksum(p);
+    auto q = compact.cbegin();
+    b.decode_with_checksum(q);
+    EXPECT_TRUE(q.end());
+
+    // compare through the full encoding, which covers every field
+    bufferlist abl, bbl;
+    a.encode(abl);
+    b.encode(bbl);
+    EXPECT_TRUE(abl.contents_equal(bbl)) << *i;
+
+    // a corrupt entry is caught by the checksum
+    string str = compact.to_str();
+    str[8] ^= 1;
+    bufferlist bad;
+    bad.append(str);
+    auto r = bad.cbegin();
+    EXPECT_THROW(b.decode_with_checksum(r), buffer::malformed_input);
+    delete i;
+  }
+}
+
+TEST(pg_log_dup_t, compact_encoding)
+{
+  list<pg_log_dup_t*> dups;
+  pg_log_dup_t::generate_test_instances(dups);
+  for (auto i : dups) {
+    bufferlist legacy, compact;
+    encode(*i, legacy);
+    i->encode_compact(compact);
+    EXPECT_LT(compact.length(), legacy.length());
+
+    pg_log_dup_t a, b;
+    auto p = legacy.cbegin();
+    a.decode_ondisk(p);
+    auto q = compact.cbegin();
+    b.decode_ondisk(q);
+    EXPECT_TRUE(q.end());
+    EXPECT_EQ(*i, a);
+    EXPECT_EQ(*i, b);
+    delete i;
+  }
+}
+
 TEST(pg_pool_t_test, get_pg_num_divisor) {
   pg_pool_t p;
   p.set_pg_num(16);
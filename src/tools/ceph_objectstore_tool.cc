@@ -880,6 +880,9 @@ int ObjectStoreTool::do_export(ObjectStore *fs, coll_t coll, spg_t pgid,
   if (pgid.is_no_shard()) {
     pgb.superblock.compat_features.incompat.remove(CEPH_OSD_FEATURE_INCOMPAT_SHARDS);
   }
+  // The export carries the log in the wire encoding, whatever the
+  // exporting OSD keeps on disk
+  pgb.superblock.compat_features.incompat.remove(CEPH_OSD_FEATURE_INCOMPAT_COMPACT_PGLOG);
   ret = write_section(TYPE_PG_BEGIN, pgb, file_fd);
   if (ret)
     return ret;